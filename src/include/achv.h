@@ -33,10 +33,56 @@
 extern "C" {
 #endif
 
+#include <art.h>
+#include <compression.h>
 #include <json.h>
+#include <security.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 
+#define TAR_BLOCK_SIZE 512
+
+#define TAR_STATE_HEADER  0
+#define TAR_STATE_DATA    1
+#define TAR_STATE_PADDING 2
+#define TAR_STATE_END     3
+
+/** @struct tar_stream
+ * Defines a streaming tar extractor, which writes the members
+ * of a tar archive into a directory as the bytes arrive
+ */
+struct tar_stream
+{
+   char destination[MAX_PATH];         /**< The destination directory */
+   int state;                          /**< The state of the decoder */
+   char header[TAR_BLOCK_SIZE];        /**< The header being assembled */
+   size_t header_length;               /**< The number of bytes in the header */
+   char type;                          /**< The type of the current member */
+   char name[MAX_PATH];                /**< The name of the current member */
+   char path[MAX_PATH];                /**< The path of the current member */
+   char link[MAX_PATH];                /**< The link target of the current member */
+   char* extended;                     /**< The GNU long name or PAX extended header data */
+   size_t extended_length;             /**< The length of the extended data */
+   char long_path[MAX_PATH];           /**< The path from a GNU long name or PAX header */
+   char long_link[MAX_PATH];           /**< The link target from a GNU long link or PAX header */
+   int mode;                           /**< The mode of the current member */
+   size_t remaining;                   /**< The number of bytes left of the current member */
+   size_t padding;                     /**< The number of padding bytes left of the current member */
+   FILE* file;                         /**< The file of the current member */
+   int compression;                    /**< The compression type of regular files */
+   int level;                          /**< The compression level */
+   struct compressor* compressor;      /**< The compressor of the current member */
+   int algorithm;                      /**< The hash algorithm of the checksums */
+   char prefix[MAX_PATH];              /**< The prefix of the member names in the checksums */
+   struct art* checksums;              /**< The checksums of the regular files, keyed by name */
+   struct hash* hash;                  /**< The hash of the current member */
+   unsigned long number_of_files;      /**< The number of files extracted */
+   unsigned long size;                 /**< The number of bytes extracted */
+   unsigned long biggest_file;         /**< The size of the biggest file extracted */
+};
+
+
 /**
  * Create an archive
  * @param ssl The SSL connection
@@ -58,6 +104,57 @@ pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8
 int
 pgmoneta_extract_tar_file(char* file_path, char* destination);
 
+/**
+ * Create a streaming tar extractor
+ * @param destination The destination to extract to
+ * @param stream The resulting stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_tar_stream_create(char* destination, struct tar_stream** stream);
+
+/**
+ * Compress the regular files of a streaming tar extractor while they are
+ * extracted, and record the checksums of their content. The backup_label,
+ * backup_manifest and global/pg_control files are never compressed
+ * @param stream The stream
+ * @param compression The compression type, or COMPRESSION_NONE
+ * @param level The compression level
+ * @param algorithm The hash algorithm of the checksums
+ * @param prefix The prefix of the member names in the checksums, or NULL
+ * @param checksums The checksums, or NULL
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_tar_stream_compress(struct tar_stream* stream, int compression, int level, int algorithm, char* prefix, struct art* checksums);
+
+/**
+ * Feed tar data into a streaming tar extractor. The data doesn't
+ * have to be aligned on tar block boundaries
+ * @param stream The stream
+ * @param data The data
+ * @param length The length of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_tar_stream_write(struct tar_stream* stream, void* data, size_t length);
+
+/**
+ * Finish a streaming tar extractor. The archive may end with, or without,
+ * the terminating zero blocks, but not in the middle of a member
+ * @param stream The stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_tar_stream_finish(struct tar_stream* stream);
+
+/**
+ * Destroy a streaming tar extractor
+ * @param stream The stream
+ */
+void
+pgmoneta_tar_stream_destroy(struct tar_stream* stream);
+
 /**
  * Create a tar archive of the given directory
  * @param src_path The source directory
@@ -37,8 +37,32 @@ extern "C" {
 #include <json.h>
 #include <workers.h>
 
+#include <stdbool.h>
+
 #include <openssl/ssl.h>
 
+/**
+ * The output of a streaming encryptor
+ * @param data The data
+ * @param size The size of the data
+ * @param arg The argument given to the encryptor
+ * @return 0 upon success, otherwise 1
+ */
+typedef int (*encryptor_output)(void* data, size_t size, void* arg);
+
+/** @struct encryptor
+ * Defines a streaming encryptor, which produces the same format
+ * as the file based encryption functions
+ */
+struct encryptor
+{
+   EVP_CIPHER_CTX* ctx;      /**< The cipher context */
+   unsigned char* buffer;    /**< The output buffer */
+   size_t buffer_size;       /**< The size of the output buffer */
+   encryptor_output output;  /**< The output */
+   void* arg;                /**< The argument of the output */
+};
+
 /**
  * Encrypt a string
  * @param plaintext The string
@@ -164,6 +188,43 @@ pgmoneta_encrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsign
 int
 pgmoneta_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** dec_buffer, size_t* dec_size, int mode);
 
+/**
+ * Create a streaming encryptor using the master key
+ * @param mode The encryption mode
+ * @param encrypt True to encrypt, false to decrypt
+ * @param output The output
+ * @param arg The argument of the output
+ * @param encryptor [out] The encryptor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_encryptor_create(int mode, bool encrypt, encryptor_output output, void* arg, struct encryptor** encryptor);
+
+/**
+ * Encrypt, or decrypt, data
+ * @param encryptor The encryptor
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_encryptor_write(struct encryptor* encryptor, void* data, size_t size);
+
+/**
+ * Finish a streaming encryptor
+ * @param encryptor The encryptor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_encryptor_finish(struct encryptor* encryptor);
+
+/**
+ * Destroy a streaming encryptor
+ * @param encryptor The encryptor
+ */
+void
+pgmoneta_encryptor_destroy(struct encryptor* encryptor);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,8 +29,62 @@
 #ifndef PGMONETA_COMPRESSION_H
 #define PGMONETA_COMPRESSION_H
 
+#include <pgmoneta.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 typedef int (*compression_func)(char*, char*);
 
+/**
+ * The output of a streaming compressor
+ * @param data The compressed data
+ * @param size The size of the data
+ * @param arg The argument given to the compressor
+ * @return 0 upon success, otherwise 1
+ */
+typedef int (*compressor_output)(void* data, size_t size, void* arg);
+
+/** @struct compressor
+ * Defines a streaming compressor, which writes a compressed file
+ * in the same format as the file based compression functions
+ */
+struct compressor
+{
+   int type;                  /**< The compression type */
+   char path[MAX_PATH];       /**< The path of the compressed file */
+   FILE* file;                /**< The compressed file */
+   compressor_output output;  /**< The output, instead of the file */
+   void* arg;                 /**< The argument of the output */
+   void* context;             /**< The compression library context */
+   void* buffer;              /**< The output buffer */
+   size_t buffer_size;        /**< The size of the output buffer */
+   char* block;               /**< The LZ4 input blocks */
+   int block_index;           /**< The current LZ4 input block */
+   size_t block_length;       /**< The number of bytes in the current LZ4 input block */
+   size_t size;               /**< The number of uncompressed bytes */
+};
+
+/** @struct decompressor
+ * Defines a streaming decompressor, which reads the same format
+ * as the file based compression functions
+ */
+struct decompressor
+{
+   int type;                  /**< The compression type */
+   char path[MAX_PATH];       /**< The path of the decompressed file */
+   FILE* file;                /**< The decompressed file */
+   void* context;             /**< The decompression library context */
+   void* buffer;              /**< The output buffer */
+   size_t buffer_size;        /**< The size of the output buffer */
+   char* block;               /**< The LZ4 output blocks */
+   int block_index;           /**< The current LZ4 output block */
+   char* input;               /**< The LZ4 input block being assembled, with its length first */
+   size_t input_length;       /**< The number of bytes in the LZ4 input block */
+   bool end;                  /**< Has the end of the compressed data been seen */
+};
+
 /**
  * Decompress a file using the appropriate decompression method.
  *
@@ -47,4 +101,115 @@ typedef int (*compression_func)(char*, char*);
 int
 pgmoneta_decompress(char* from, char* to);
 
+/**
+ * Is inline compression used for backups of a server. Inline compression
+ * compresses the files while they are received from the server
+ * @param server The server
+ * @return True if inline compression is used, otherwise false
+ */
+bool
+pgmoneta_compression_inline(int server);
+
+/**
+ * Get the file suffix of a compression type
+ * @param type The compression type
+ * @return The suffix, or an empty string if the type doesn't compress files
+ */
+char*
+pgmoneta_compression_suffix(int type);
+
+/**
+ * Get the compression type of a file from its suffix
+ * @param path The path of the file
+ * @return The compression type, or COMPRESSION_NONE
+ */
+int
+pgmoneta_compression_type(char* path);
+
+/**
+ * Create a streaming compressor
+ * @param path The path of the uncompressed file, the compression suffix will be added
+ * @param type The compression type
+ * @param level The compression level
+ * @param compressor [out] The compressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_compressor_create(char* path, int type, int level, struct compressor** compressor);
+
+/**
+ * Create a streaming compressor which hands the compressed data to an output
+ * function instead of writing it to a file
+ * @param type The compression type
+ * @param level The compression level
+ * @param output The output
+ * @param arg The argument of the output
+ * @param compressor [out] The compressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_compressor_create_output(int type, int level, compressor_output output, void* arg, struct compressor** compressor);
+
+/**
+ * Compress data
+ * @param compressor The compressor
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_compressor_write(struct compressor* compressor, void* data, size_t size);
+
+/**
+ * Finish a streaming compressor, and close the compressed file if any
+ * @param compressor The compressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_compressor_finish(struct compressor* compressor);
+
+/**
+ * Destroy a streaming compressor
+ * @param compressor The compressor
+ */
+void
+pgmoneta_compressor_destroy(struct compressor* compressor);
+
+/**
+ * Create a streaming decompressor
+ * @param path The path of the decompressed file
+ * @param type The compression type
+ * @param decompressor [out] The decompressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_decompressor_create(char* path, int type, struct decompressor** decompressor);
+
+/**
+ * Decompress data. The data doesn't have to be aligned on the blocks
+ * of the compression
+ * @param decompressor The decompressor
+ * @param data The compressed data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_decompressor_write(struct decompressor* decompressor, void* data, size_t size);
+
+/**
+ * Finish a streaming decompressor, and close the decompressed file. The
+ * compressed data must have ended
+ * @param decompressor The decompressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_decompressor_finish(struct decompressor* decompressor);
+
+/**
+ * Destroy a streaming decompressor
+ * @param decompressor The decompressor
+ */
+void
+pgmoneta_decompressor_destroy(struct decompressor* decompressor);
+
 #endif //PGMONETA_COMPRESSION_H
@@ -50,6 +50,15 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_MANAGEMENT             "management"
 #define CONFIGURATION_ARGUMENT_COMPRESSION            "compression"
 #define CONFIGURATION_ARGUMENT_COMPRESSION_LEVEL      "compression_level"
+#define CONFIGURATION_ARGUMENT_INLINE_COMPRESSION     "inline_compression"
+#define CONFIGURATION_ARGUMENT_PARALLEL_BACKUP        "parallel_backup"
+#define CONFIGURATION_ARGUMENT_DEDUP                  "dedup"
+#define CONFIGURATION_ARGUMENT_WAL_DICTIONARY         "wal_dictionary"
+#define CONFIGURATION_ARGUMENT_WAL_SUMMARY            "wal_summary"
+#define CONFIGURATION_ARGUMENT_WAL_COMPACTION         "wal_compaction"
+#define CONFIGURATION_ARGUMENT_WAL_INDEX              "wal_index"
+#define CONFIGURATION_ARGUMENT_CONSOLIDATE            "consolidate"
+#define CONFIGURATION_ARGUMENT_WAL_SINK_MAX_SEGMENTS  "wal_sink_max_segments"
 #define CONFIGURATION_ARGUMENT_WORKERS                "workers"
 #define CONFIGURATION_ARGUMENT_STORAGE_ENGINE         "storage_engine"
 #define CONFIGURATION_ARGUMENT_ENCRYPTION             "encryption"
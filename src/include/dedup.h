@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_DEDUP_H
+#define PGMONETA_DEDUP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <workers.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define DEDUP_CHUNK_SIZE    (1024 * 1024)
+#define DEDUP_RECIPE_SUFFIX ".recipe"
+#define DEDUP_RECIPE_MAGIC  "PGMONETA_RECIPE"
+
+/**
+ * Replace the files of a backup data directory with recipes, and move
+ * their content into the content-addressed chunk store of the server.
+ * Each chunk referenced by the backup gets a hard link in the references
+ * of the backup, so the link count of a chunk is its reference count
+ * @param server The server
+ * @param label The label of the backup
+ * @param directory The data directory
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_data(int server, char* label, char* directory, struct workers* workers);
+
+/**
+ * Deduplicate the tablespaces of a backup
+ * @param server The server
+ * @param label The label of the backup
+ * @param root The root directory of the backup
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_tablespaces(int server, char* label, char* root, struct workers* workers);
+
+/**
+ * Rebuild the files of the recipes found in a directory
+ * @param server The server
+ * @param directory The directory
+ * @param workers The optional workers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_rehydrate(int server, char* directory, struct workers* workers);
+
+/**
+ * Does a backup reference the chunk store
+ * @param server The server
+ * @param label The label of the backup
+ * @return True if it does, otherwise false
+ */
+bool
+pgmoneta_dedup_exists(int server, char* label);
+
+/**
+ * Release the chunk references of a backup, and remove the chunks
+ * that are no longer referenced by any backup
+ * @param server The server
+ * @param label The label of the backup
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_dedup_release(int server, char* label);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -45,11 +45,12 @@ extern "C" {
  * @param from The current from directory
  * @param changed The changed files
  * @param added The added files
+ * @param hard True to hard link the files instead of symlinking them
  * @param workers The optional workers
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* changed, struct art* added, struct workers* workers);
+pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* changed, struct art* added, bool hard, struct workers* workers);
 
 /**
  * Relink link two directories
@@ -38,6 +38,9 @@ extern "C" {
 
 #define MANIFEST_CHUNK_SIZE 8192
 
+// the number of entries of the old manifest kept in memory while comparing
+#define MANIFEST_PARTITION_SIZE 262144
+
 // simple manifest csv structure definition in case we want to change later
 #define MANIFEST_COLUMN_COUNT 2
 #define MANIFEST_PATH_INDEX 0
@@ -64,15 +67,19 @@ struct manifest_chunk
 /**
  * Verify checksum of the manifest and the checksum
  * @param root The root directory holding the manifest
+ * @param checksums The checksums calculated while the files were received, or NULL.
+ *                  Files without a calculated checksum are hashed from disk
  * @return 0 if verification turns out ok, 1 otherwise
  */
 int
-pgmoneta_manifest_checksum_verify(char* root);
+pgmoneta_manifest_checksum_verify(char* root, struct art* checksums);
 
 /**
- * Compare manifests
- * @param manifest1 The path to the first manifest
- * @param manifest2 The path to the second manifest
+ * Compare manifests in linear time. The old manifest is indexed and probed
+ * with the new one; manifests with more than MANIFEST_PARTITION_SIZE entries
+ * are first hash partitioned on disk so that each index stays bounded
+ * @param old_manifest The path to the old manifest
+ * @param new_manifest The path to the new manifest
  * @param deleted_files The deleted files
  * @param changed_files The changed files
  * @param added_files The added files
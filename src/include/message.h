@@ -524,6 +524,7 @@ pgmoneta_consume_data_row_messages(SSL* ssl, int socket, struct stream_buffer* b
 /**
  * Receive backup tar files from the copy stream and write to disk
  * This functionality is for server version < 15
+ * @param server The server
  * @param ssl The SSL structure
  * @param socket The socket
  * @param buffer The stream buffer
@@ -531,14 +532,18 @@ pgmoneta_consume_data_row_messages(SSL* ssl, int socket, struct stream_buffer* b
  * @param tablespaces The user level tablespaces
  * @param bucket The rate limit bucket
  * @param network_bucket The network rate limit bucket
+ * @param size [out] The size of the extracted data directory, uncompressed
+ * @param biggest_file [out] The size of the biggest extracted file in the data directory, uncompressed
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket);
+pgmoneta_receive_archive_files(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces,
+                               struct token_bucket* bucket, struct token_bucket* network_bucket, unsigned long* size, unsigned long* biggest_file);
 
 /**
  * Receive backup tar files from the copy stream and write to disk
  * This functionality is for server version >= 15
+ * @param server The server
  * @param ssl The SSL structure
  * @param socket The socket
  * @param buffer The stream buffer
@@ -546,10 +551,13 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
  * @param tablespaces The user level tablespaces
  * @param bucket The rate limit bucket
  * @param network_bucket The network rate limit bucket
+ * @param size [out] The size of the extracted data directory, uncompressed
+ * @param biggest_file [out] The size of the biggest extracted file in the data directory, uncompressed
  * @return 0 upon success, otherwise 1
  */
 int
-pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket);
+pgmoneta_receive_archive_stream(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces,
+                                struct token_bucket* bucket, struct token_bucket* network_bucket, unsigned long* size, unsigned long* biggest_file);
 
 /**
  * Receive mainfest file from the copy stream and write to disk
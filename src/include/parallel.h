@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_PARALLEL_H
+#define PGMONETA_PARALLEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <tablespace.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Should a backup be fetched in parallel
+ * @param server The server
+ * @param incremental Is the backup incremental
+ * @return True if parallel, otherwise false
+ */
+bool
+pgmoneta_parallel_backup_enabled(int server, bool incremental);
+
+/**
+ * Fetch a backup over one connection per worker. The backup is taken
+ * with pg_backup_start() / pg_backup_stop() on a coordinating connection,
+ * while the workers read the files with pg_read_binary_file(). A
+ * backup_manifest is created for the fetched files. An incremental backup
+ * only reads the blocks which the WAL summaries have since its parent
+ * @param server The server
+ * @param usr The user
+ * @param label The label of the backup
+ * @param backup_base The base directory of the backup
+ * @param tablespaces The tablespaces
+ * @param hash The hash algorithm of the manifest
+ * @param incremental The directory of the parent backup, or NULL for a full backup
+ * @param startpos [out] The start position, at least 20 bytes
+ * @param start_timeline [out] The start timeline
+ * @param endpos [out] The end position, at least 20 bytes
+ * @param end_timeline [out] The end timeline
+ * @param size [out] The size of the backup
+ * @param biggest_file [out] The size of the biggest file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_parallel_backup(int server, int usr, char* label, char* backup_base, struct tablespace* tablespaces, int hash,
+                         char* incremental, char* startpos, uint32_t* start_timeline, char* endpos, uint32_t* end_timeline,
+                         unsigned long* size, unsigned long* biggest_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -132,6 +132,7 @@ extern "C" {
 #define BULLET_POINT          "- "
 
 #define INCREMENTAL_PREFIX "INCREMENTAL."
+#define INCREMENTAL_MAGIC 0xd3ae1f0d
 
 #define likely(x)    __builtin_expect (!!(x), 1)
 #define unlikely(x)  __builtin_expect (!!(x), 0)
@@ -226,6 +227,7 @@ struct server
    atomic_ulong archiving;                  /**< Is there an active archiving */
    atomic_bool delete;                      /**< Is there an active delete */
    atomic_bool wal;                         /**< Is there an active wal */
+   atomic_bool wal_compress;                /**< Is there an active compression of the wal */
    int wal_size;                            /**< The size of the WAL files */
    size_t block_size;                       /**< The size of a block in relation files*/
    size_t segment_size;                     /**< The max size of a relation file segment*/
@@ -241,6 +243,9 @@ struct server
    uint32_t cur_timeline;                   /**< Current timeline the server is on*/
    atomic_llong last_operation_time;        /**< Last operation time of the server */
    atomic_llong last_failed_operation_time; /**< Last failed operation time of the server */
+   atomic_int backup_queue_depth;           /**< The number of received buffers waiting to be written */
+   atomic_ullong wal_shipping_lag;          /**< The number of received WAL bytes not yet in the WAL shipping directory */
+   atomic_ullong wal_ssh_lag;               /**< The number of received WAL bytes not yet in the SSH storage engine */
    char wal_shipping[MAX_PATH];             /**< The WAL shipping directory */
    char hot_standby[MAX_PATH];              /**< The hot standby directory */
    char hot_standby_overrides[MAX_PATH];    /**< The hot standby overrides directory */
@@ -319,8 +324,17 @@ struct configuration
 
    char base_dir[MAX_PATH];  /**< The base directory */
 
-   int compression_type;  /**< The compression type */
-   int compression_level; /**< The compression level */
+   int compression_type;    /**< The compression type */
+   int compression_level;   /**< The compression level */
+   bool inline_compression; /**< Compress the files while they are received */
+   bool parallel_backup;    /**< Fetch full backups over several connections */
+   bool dedup;              /**< Store full backups in the chunk store */
+   bool wal_dictionary;     /**< Compress WAL with a trained zstd dictionary */
+   bool wal_summary;        /**< Summarize the block references of the WAL */
+   bool wal_compaction;     /**< Compact the WAL older than the newest full backup */
+   bool wal_index;          /**< Index the WAL by transaction and time */
+   int consolidate;         /**< The incremental chain length which is consolidated */
+   int wal_sink_max_segments; /**< The maximum number of segments staged for a WAL sink */
 
    int create_slot;                    /**< Create a slot */
 
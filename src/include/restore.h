@@ -34,6 +34,7 @@ extern "C" {
 #endif
 
 #include <json.h>
+#include <workers.h>
 
 #include <stdlib.h>
 
@@ -80,10 +81,26 @@ pgmoneta_restore_backup(int server, char* identifier, char* position, char* dire
  * @param prior_backup_dirs The root directory of prior incremental/full backups, from newest to oldest
  * @param bck The backup to be restored
  * @param manifest The manifest of the incremental backup to be combined
+ * @param workers The optional workers, which reconstruct the incremental files
  * @return 0 on success, 1 if otherwise
  */
 int
-pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs, struct backup* bck, struct json* manifest);
+pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs, struct backup* bck, struct json* manifest, struct workers* workers);
+
+/**
+ * Restore a full backup into an existing target in delta mode. The files of the target
+ * which have the size of the backup manifest, and either its time or its checksum, are
+ * kept, the other files are restored from the backup, and the files which aren't in the
+ * backup are removed. The time is only used when it is older than the start of the backup.
+ * The last files are left for the restore of the excluded files. A target with a running
+ * postmaster is refused
+ * @param from The data directory of the backup
+ * @param to The target directory
+ * @param workers The optional workers, which compare and restore the files
+ * @return 0 on success, 2 if the target can't be restored in delta mode, 1 if otherwise
+ */
+int
+pgmoneta_restore_delta(char* from, char* to, struct workers* workers);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_RING_H
+#define PGMONETA_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+#include <memory.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define RING_SIZE 8
+
+/**
+ * The writer of a ring buffer
+ * @param data The data
+ * @param size The size of the data
+ * @param arg The argument of the writer
+ * @return 0 upon success, otherwise 1
+ */
+typedef int (*ring_writer)(void* data, size_t size, void* arg);
+
+/** @struct ring
+ * Defines a ring of stream buffers, which a dedicated thread writes
+ * while the producer fills the next one
+ */
+struct ring
+{
+   pthread_mutex_t mutex;                     /**< The mutex */
+   pthread_cond_t not_empty;                  /**< Signalled when a buffer is added */
+   pthread_cond_t not_full;                   /**< Signalled when a buffer is written */
+   struct stream_buffer* buffers[RING_SIZE];  /**< The buffers */
+   ring_writer writers[RING_SIZE];            /**< The writer of each buffer */
+   void* args[RING_SIZE];                     /**< The argument of each writer */
+   int head;                                  /**< The next buffer to write */
+   int tail;                                  /**< The next buffer to fill */
+   int count;                                 /**< The number of buffers waiting to be written */
+   bool stop;                                 /**< Should the writer thread stop */
+   bool failed;                               /**< Has a write failed */
+   atomic_int* depth;                         /**< The queue depth metric, or NULL */
+   pthread_t thread;                          /**< The writer thread */
+};
+
+/**
+ * Create a ring, and start its writer thread
+ * @param depth The queue depth metric, or NULL
+ * @param ring [out] The ring
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_ring_create(atomic_int* depth, struct ring** ring);
+
+/**
+ * Queue a copy of the data for the writer thread. Blocks while the ring is full
+ * @param ring The ring
+ * @param data The data
+ * @param size The size of the data
+ * @param writer The writer
+ * @param arg The argument of the writer
+ * @return 0 upon success, otherwise 1 if a write has failed
+ */
+int
+pgmoneta_ring_write(struct ring* ring, void* data, size_t size, ring_writer writer, void* arg);
+
+/**
+ * Queue a copy of the header followed by the data for the writer thread,
+ * without blocking. The writer gets both as one buffer
+ * @param ring The ring
+ * @param header The header, or NULL
+ * @param header_size The size of the header
+ * @param data The data
+ * @param size The size of the data
+ * @param writer The writer
+ * @param arg The argument of the writer
+ * @return 0 upon success, 1 if a write has failed, otherwise 2 if the ring is full
+ */
+int
+pgmoneta_ring_offer(struct ring* ring, void* header, size_t header_size, void* data, size_t size, ring_writer writer, void* arg);
+
+/**
+ * Wait until all queued data has been written
+ * @param ring The ring
+ * @return 0 upon success, otherwise 1 if a write has failed
+ */
+int
+pgmoneta_ring_flush(struct ring* ring);
+
+/**
+ * Stop the writer thread, and destroy the ring. Queued data is
+ * written before the thread stops
+ * @param ring The ring
+ */
+void
+pgmoneta_ring_destroy(struct ring* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -46,6 +46,16 @@ extern "C" {
 #define HASH_ALGORITHM_SHA384  4
 #define HASH_ALGORITHM_SHA512  5
 
+/** @struct hash
+ * Defines an incremental hash
+ */
+struct hash
+{
+   int algorithm;      /**< The hash algorithm */
+   EVP_MD_CTX* md_ctx; /**< The message digest context */
+   uint32_t crc;       /**< The CRC32C value */
+};
+
 /**
  * Authenticate a user
  * @param server The server
@@ -184,6 +194,42 @@ pgmoneta_create_crc32c_file(char* path, char** crc);
 int
 pgmoneta_create_file_hash(int algorithm, char* file_path, char** hash);
 
+/**
+ * Create an incremental hash
+ * @param algorithm The algorithm represented by index
+ * @param hash [out] The hash
+ * @return 0 upon success, otherwise 1.
+ */
+int
+pgmoneta_hash_create(int algorithm, struct hash** hash);
+
+/**
+ * Add data to an incremental hash
+ * @param hash The hash
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1.
+ */
+int
+pgmoneta_hash_update(struct hash* hash, void* data, size_t size);
+
+/**
+ * Finalize an incremental hash. The value has the same format as
+ * pgmoneta_create_file_hash
+ * @param hash The hash
+ * @param value [out] The hash value
+ * @return 0 upon success, otherwise 1.
+ */
+int
+pgmoneta_hash_final(struct hash* hash, char** value);
+
+/**
+ * Destroy an incremental hash
+ * @param hash The hash
+ */
+void
+pgmoneta_hash_destroy(struct hash* hash);
+
 /**
  * Close a SSL structure
  * @param ssl The SSL structure
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_URING_H
+#define PGMONETA_URING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#define URING_QUEUE_DEPTH 8
+#define URING_BLOCK_SIZE  (128 * 1024)
+
+/** @struct uring_file
+ * Defines a file which is read ahead, or written behind, through an
+ * io_uring with registered buffers. When io_uring isn't available the
+ * file falls back to plain read(2) and write(2)
+ */
+struct uring_file
+{
+   int fd;                                    /**< The file descriptor */
+   bool write;                                /**< Is the file opened for writing */
+   bool active;                               /**< Is the io_uring in use */
+   bool fixed;                                /**< Are the buffers registered */
+   bool tried;                                /**< Has the io_uring been set up */
+   bool failed;                               /**< Has an operation failed */
+#ifdef HAVE_LIBURING
+   struct io_uring ring;                      /**< The io_uring */
+#endif
+   void* buffers[URING_QUEUE_DEPTH];          /**< The buffers */
+   size_t lengths[URING_QUEUE_DEPTH];         /**< The number of bytes in each buffer */
+   off_t offsets[URING_QUEUE_DEPTH];          /**< The file offset of each buffer */
+   bool pending[URING_QUEUE_DEPTH];           /**< Is an operation in flight for each buffer */
+   ssize_t results[URING_QUEUE_DEPTH];        /**< The result of the operation of each buffer */
+   int current;                               /**< The current buffer */
+   size_t position;                           /**< The read position in the current buffer */
+   int unsubmitted;                           /**< The number of prepared, but unsubmitted, operations */
+   off_t offset;                              /**< The file offset of the next operation */
+   off_t size;                                /**< The size of the file being read */
+};
+
+/**
+ * Open a file for reading
+ * @param path The path of the file
+ * @param file [out] The file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_uring_open_read(char* path, struct uring_file** file);
+
+/**
+ * Open a file for writing. The file is created, or truncated
+ * @param path The path of the file
+ * @param permissions The permissions of a created file
+ * @param file [out] The file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_uring_open_write(char* path, int permissions, struct uring_file** file);
+
+/**
+ * Read from a file. Like fread(3) the buffer is filled completely
+ * unless the end of the file is reached
+ * @param file The file
+ * @param data The buffer
+ * @param size The size of the buffer
+ * @return The number of bytes read, or -1 upon error
+ */
+ssize_t
+pgmoneta_uring_read(struct uring_file* file, void* data, size_t size);
+
+/**
+ * Write to a file
+ * @param file The file
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_uring_write(struct uring_file* file, void* data, size_t size);
+
+/**
+ * Close a file. The writes in flight are completed first
+ * @param file The file
+ * @param sync Should the file be synced to disk
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_uring_close(struct uring_file* file, bool sync);
+
+/**
+ * Copy a file
+ * @param from The source file
+ * @param to The destination file
+ * @param permissions The permissions of the destination file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_uring_copy(char* from, char* to, int permissions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
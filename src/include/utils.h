@@ -700,7 +700,8 @@ int
 pgmoneta_delete_file(char* file, struct workers* workers);
 
 /**
- * Copy a PostgreSQL installation
+ * Copy a PostgreSQL installation, and decrypt and decompress the files
+ * on the way
  * @param from The from directory
  * @param to The to directory
  * @param base The base directory
@@ -746,6 +747,31 @@ pgmoneta_copy_directory(char* from, char* to, char** restore_last_paths, struct
 int
 pgmoneta_copy_file(char* from, char* to, struct workers* workers);
 
+/**
+ * Copy a file of a backup, and decrypt and decompress it on the way, so the
+ * stored file is read once and the plain file is written once. The suffixes
+ * of the encryption and the compression are removed from the to file
+ * @param from The from file
+ * @param to The to file
+ * @param workers The optional workers
+ * @return The result
+ */
+int
+pgmoneta_extract_file(char* from, char* to, struct workers* workers);
+
+/**
+ * Copy a range of one file into another. A reflink is tried first,
+ * then copy_file_range(2), and finally a copy through user space
+ * @param fd_from The from file descriptor
+ * @param from_offset The from offset
+ * @param fd_to The to file descriptor
+ * @param to_offset The to offset
+ * @param length The length of the range
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_copy_file_range(int fd_from, off_t from_offset, int fd_to, off_t to_offset, size_t length);
+
 /**
  * Move a file
  * @param from The from file
@@ -852,11 +878,12 @@ pgmoneta_is_symlink_valid(char* path);
  * @param from The from directory
  * @param to The to directory
  * @param start The start file
+ * @param end The last WAL segment, or NULL for all
  * @param workers The optional workers
  * @return The result
  */
 int
-pgmoneta_copy_wal_files(char* from, char* to, char* start, struct workers* workers);
+pgmoneta_copy_wal_files(char* from, char* to, char* start, char* end, struct workers* workers);
 
 /**
  * Get the number of WAL files
@@ -33,9 +33,29 @@
 extern "C" {
 #endif
 
+#include <pgmoneta.h>
+#include <ring.h>
+
 #include <ev.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <libssh/sftp.h>
+
+#define WAL_FLUSH_SIZE     (1024 * 1024) /* The number of received bytes that forces a sync */
+#define WAL_FLUSH_INTERVAL 10            /* The number of milliseconds that forces a sync */
+
+#define WAL_POOL_SIZE 4 /* The number of preallocated segments kept for each server */
+
+#define WAL_SINK_SHIPPING 0
+#define WAL_SINK_SSH      1
+
+#define WAL_SINK_OPEN    0
+#define WAL_SINK_WRITE   1
+#define WAL_SINK_CLOSE   2
+#define WAL_SINK_CATCHUP 3
 
 /** @struct timeline_history
  * Defines a timeline history
@@ -48,6 +68,60 @@ struct timeline_history
    struct timeline_history* next; /**< the next history entry */
 };
 
+/** @struct wal_compression
+ * Defines the compression and encryption of completed WAL segments,
+ * which is done by a thread in the WAL receiver
+ */
+struct wal_compression
+{
+   int server;      /**< The server index */
+   char* directory; /**< The WAL directory, with a trailing slash */
+};
+
+/** @struct wal_pool
+ * Defines the pool of preallocated segments of a WAL receiver
+ */
+struct wal_pool
+{
+   int server;      /**< The server index */
+   int segsize;     /**< The size of a segment */
+   char* directory; /**< The pool directory, with a trailing slash */
+};
+
+/** @struct wal_sink_op
+ * Defines an operation queued for a WAL sink
+ */
+struct wal_sink_op
+{
+   int type;                    /**< The type of the operation */
+   bool partial;                /**< Is the closed segment incomplete */
+   size_t lsn;                  /**< The LSN after the written data */
+   char filename[MISC_LENGTH];  /**< The name of the segment */
+};
+
+/** @struct wal_sink
+ * Defines a secondary destination of the WAL stream, which is written by its own
+ * thread from a bounded queue. A sink which falls behind skips the rest of the
+ * segment, and gets the complete segment from its staging directory instead.
+ * The staging directory keeps at most wal_sink_max_segments segments
+ */
+struct wal_sink
+{
+   int type;                    /**< The type of the sink */
+   int server;                  /**< The server index */
+   int segsize;                 /**< The size of a segment */
+   char* directory;             /**< The WAL shipping directory, with a trailing slash */
+   char* staging;               /**< The segments waiting to be delivered, with a trailing slash */
+   char filename[MISC_LENGTH];  /**< The name of the open segment */
+   FILE* file;                  /**< The open segment in the WAL shipping directory */
+   sftp_file sftp;              /**< The open segment in the SSH storage engine */
+   bool behind;                 /**< Has the sink fallen behind in the current segment */
+   atomic_size_t received;      /**< The LSN received for the sink */
+   atomic_size_t written;       /**< The LSN written by the sink */
+   atomic_ullong* lag;          /**< The lag metric of the sink */
+   struct ring* ring;           /**< The queue and the thread of the sink */
+};
+
 /**
  * Receive WAL
  * @param srv The server index
@@ -56,6 +130,26 @@ struct timeline_history
 void
 pgmoneta_wal(int srv, char** argv);
 
+/**
+ * Move a WAL segment which is no longer needed into the pool of preallocated
+ * segments of the server, so that the WAL receiver can reuse its blocks
+ * @param srv The server index
+ * @param path The path of the segment
+ * @return 0 if the segment was recycled, otherwise 1 and the segment is left in place
+ */
+int
+pgmoneta_wal_pool_recycle(int srv, char* path);
+
+/**
+ * Drop the segments staged for the WAL sinks of a server which retention
+ * no longer keeps, so their blocks can be reclaimed
+ * @param srv The server index
+ * @param oldest The oldest segment kept, or NULL to drop all staged segments
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_sink_prune(int srv, char* oldest);
+
 /**
  * Find and extract the history info from .history file of given server and timeline
  * @param srv The server index
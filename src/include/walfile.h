@@ -131,4 +131,75 @@ pgmoneta_describe_walfile(char* path, enum value_type type, char* output, bool q
                           struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids,
                           uint32_t limit);
 
+/**
+ * Describe WAL files in LSN order. The files are decoded in parallel, and
+ * records which continue from one file into the following file are decoded
+ * across the files
+ * @param paths The paths to the WAL files, or directories of WAL files
+ * @param number_of_paths The number of paths
+ * @param number_of_workers The number of workers
+ * @param type The type of output description
+ * @param output The output descriptor
+ * @param quiet Is the WAL file printed
+ * @param color Are colors used
+ * @param rms The resource managers
+ * @param start_lsn The start LSN
+ * @param end_lsn The end LSN
+ * @param xids The XIDs
+ * @param limit The limit
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_describe_walfiles(char** paths, int number_of_paths, int number_of_workers, enum value_type type, char* output,
+                           bool quiet, bool color, struct deque* rms, uint64_t start_lsn, uint64_t end_lsn,
+                           struct deque* xids, uint32_t limit);
+
+/**
+ * Is a WAL file compacted
+ * @param path The path to the plain WAL file
+ * @return True if the WAL file is compacted, otherwise false
+ */
+bool
+pgmoneta_is_compacted_walfile(char* path);
+
+/**
+ * Compact a WAL file. The full-page images are moved out of the records into
+ * a stream of their own, and the images which are only kept for consistency
+ * checking are dropped. The records keep their positions, so the WAL file
+ * is restored with the same LSNs by pgmoneta_expand_walfile
+ * @param server The server index
+ * @param from The path to the plain WAL file
+ * @param to The path to the compacted WAL file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_compact_walfile(int server, char* from, char* to);
+
+/**
+ * Expand a compacted WAL file. The dropped images are zero filled, and the
+ * records which had them are no longer marked for consistency checking
+ * @param from The path to the compacted WAL file
+ * @param to The path to the WAL file, which can be the same as from
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_expand_walfile(char* from, char* to);
+
+/**
+ * Compact the archived WAL files of a server which are older than the
+ * start of its newest full backup
+ * @param server The server index
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_compact_wal(int server);
+
+/**
+ * Expand the compacted WAL files of a directory
+ * @param directory The directory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_expand_wal(char* directory);
+
 #endif //PGMONETA_WALFILE_H
@@ -480,6 +480,18 @@ struct xl_xact_parsed_abort
 char*
 pgmoneta_wal_xact_desc(char* buf, struct decoded_xlog_record* record);
 
+/**
+ * Gets the transaction and the time of a commit or abort record, which
+ * are what a recovery target by xid or by time is compared against.
+ *
+ * @param record The decoded XLOG record of the transaction resource manager.
+ * @param xid [out] The transaction, or the prepared transaction.
+ * @param time [out] The commit or abort time.
+ * @return true if the record is a commit or abort record, otherwise false.
+ */
+bool
+pgmoneta_wal_xact_target(struct decoded_xlog_record* record, transaction_id* xid, timestamp_tz* time);
+
 /**
  * Parses a version 14 xl_xact_prepare record.
  *
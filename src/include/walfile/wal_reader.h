@@ -72,6 +72,7 @@ typedef int64_t timestamp_tz;
 #define XLR_BLOCK_ID_DATA_LONG     254
 #define XLR_BLOCK_ID_ORIGIN        253
 #define XLR_BLOCK_ID_TOPLEVEL_XID  252
+#define XLR_CHECK_CONSISTENCY      0x02    /* Redo checks the pages against the images */
 #define BKPBLOCK_FORK_MASK         0x0F
 #define BKPBLOCK_FLAG_MASK         0xF0
 #define BKPBLOCK_HAS_IMAGE         0x10    /* Block data is an XLogRecordBlockImage */
@@ -333,6 +334,107 @@ extern struct server* server_config;
 
 /* Function definitions */
 
+/**
+ * @struct wal_record_iterator
+ * @brief Iterates over the records of a mapped WAL file.
+ *
+ * The records are decoded one at a time. A record, and its data, is only valid
+ * until the next record is decoded, since the data refers to the mapping, or to
+ * a buffer which is reused for records crossing a page.
+ *
+ * Fields:
+ * - fd: The file descriptor.
+ * - data: The mapping of the WAL file.
+ * - size: The size of the WAL file.
+ * - block_size: The size of a WAL page.
+ * - magic: The magic value of the WAL file.
+ * - base: The LSN of the start of the WAL file.
+ * - timeline: The timeline of the WAL file.
+ * - page_timeline: The timeline of the last page read.
+ * - offset: The offset of the next record.
+ * - buffer: The buffer for records crossing a page.
+ * - capacity: The capacity of the buffer.
+ * - record: The current record.
+ * - started: Has the first record been read.
+ * - done: Are there no more records.
+ * - failed: Did a record fail to decode.
+ */
+struct wal_record_iterator
+{
+   int fd;                                 /**< The file descriptor. */
+   char* data;                             /**< The mapping of the WAL file. */
+   size_t size;                            /**< The size of the WAL file. */
+   uint32_t block_size;                    /**< The size of a WAL page. */
+   uint16_t magic;                         /**< The magic value of the WAL file. */
+   xlog_rec_ptr base;                      /**< The LSN of the start of the WAL file. */
+   timeline_id timeline;                   /**< The timeline of the WAL file. */
+   timeline_id page_timeline;              /**< The timeline of the last page read. */
+   size_t offset;                          /**< The offset of the next record. */
+   char* buffer;                           /**< The buffer for records crossing a page. */
+   size_t capacity;                        /**< The capacity of the buffer. */
+   struct decoded_xlog_record record;      /**< The current record. */
+   bool started;                           /**< Has the first record been read. */
+   bool done;                              /**< Are there no more records. */
+   bool failed;                            /**< Did a record fail to decode. */
+};
+
+/**
+ * Creates an iterator over the records of a WAL file.
+ *
+ * @param path The file path of the WAL file.
+ * @param server The index of the server structure, if -1, config.servers[0] will be initialized based on magic value.
+ * @param iterator The resulting iterator.
+ * @return 0 on success, otherwise 1.
+ */
+int
+pgmoneta_wal_record_iterator_create(char* path, int server, struct wal_record_iterator** iterator);
+
+/**
+ * Decodes the next record of a WAL file. Like pgmoneta_wal_parse_wal_file, a partial
+ * record is returned for the end of a record from the previous file, and for a
+ * record which continues in the next file. The records end at the first page whose
+ * header doesn't match its position, since a recycled file holds old WAL past the
+ * last write.
+ *
+ * @param iterator The iterator.
+ * @param record The record, which is valid until the next call.
+ * @return True if there is a record, otherwise false.
+ */
+bool
+pgmoneta_wal_record_iterator_next(struct wal_record_iterator* iterator, struct decoded_xlog_record** record);
+
+/**
+ * Destroys an iterator over the records of a WAL file.
+ *
+ * @param iterator The iterator.
+ */
+void
+pgmoneta_wal_record_iterator_destroy(struct wal_record_iterator* iterator);
+
+/**
+ * Copies a decoded record, including its data.
+ *
+ * @param record The decoded XLOG record.
+ * @param copy The resulting copy.
+ * @return 0 on success, otherwise 1.
+ */
+int
+pgmoneta_wal_record_copy(struct decoded_xlog_record* record, struct decoded_xlog_record** copy);
+
+/**
+ * Checks if a record passes the filters.
+ *
+ * @param record The decoded XLOG record.
+ * @param rms The resource managers, or NULL.
+ * @param start_lsn The start LSN, or 0.
+ * @param end_lsn The end LSN, or 0.
+ * @param xids The XIDs, or NULL.
+ * @return True if included, otherwise false.
+ */
+bool
+pgmoneta_wal_record_included(struct decoded_xlog_record* record, struct deque* rms, uint64_t start_lsn, uint64_t end_lsn,
+                             struct deque* xids);
+
 /**
  * Parses a WAL file and populates server information.
  *
@@ -344,6 +446,20 @@ extern struct server* server_config;
 int
 pgmoneta_wal_parse_wal_file(char* path, int server, struct walfile* wal_file);
 
+/**
+ * Parses a record which starts in one WAL file and continues in the following ones.
+ * A partial record at the end of a parsed WAL file has the LSN where it starts,
+ * or 0 when no record starts in the file.
+ *
+ * @param paths The file paths of consecutive WAL files, starting with the file of the record.
+ * @param number_of_paths The number of file paths.
+ * @param lsn The LSN of the record.
+ * @param record The resulting decoded XLOG record.
+ * @return 0 on success, otherwise 1.
+ */
+int
+pgmoneta_wal_parse_spanning_record(char** paths, int number_of_paths, xlog_rec_ptr lsn, struct decoded_xlog_record** record);
+
 /**
  * Retrieves block data from the decoded XLOG record.
  *
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGMONETA_WALSUMMARY_H
+#define PGMONETA_WALSUMMARY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgmoneta.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WAL_SUMMARY_BLOCK    'b'
+#define WAL_SUMMARY_LIMIT    'l'
+#define WAL_SUMMARY_DATABASE 'd'
+
+#define WAL_SUMMARY_SUFFIX  ".summary"
+#define WAL_SUMMARY_TIMEOUT 60 /* The number of seconds a backup waits for its WAL to be summarized */
+
+#define WAL_SUMMARY_NO_LIMIT 0xFFFFFFFF
+
+/** @struct wal_block_ref
+ * Defines a reference to a block, or a range of blocks, made by the WAL.
+ * A block entry is a modified block. A limit entry is the length a fork
+ * was truncated to, or 0 when it was created. A database entry covers
+ * every relation of a database which was created by copying a template
+ */
+struct wal_block_ref
+{
+   uint32_t spcoid;     /**< The tablespace oid */
+   uint32_t dboid;      /**< The database oid */
+   uint32_t relnumber;  /**< The relation file number, 0 for a database entry */
+   int forknum;         /**< The fork number */
+   uint32_t blkno;      /**< The block number, or the limit block */
+   char type;           /**< The type of the entry */
+};
+
+/** @struct wal_summary
+ * Defines the block references of a range of WAL, sorted
+ */
+struct wal_summary
+{
+   uint64_t start_lsn;             /**< The start of the range */
+   uint64_t end_lsn;               /**< The end of the range */
+   int number_of_refs;             /**< The number of references */
+   struct wal_block_ref* refs;     /**< The references */
+};
+
+/**
+ * Summarize the complete WAL segments of a server, which haven't been
+ * summarized yet. A summary is kept in <server>/walsummary/ under the
+ * name of its segment, and is removed together with the segment
+ * @param server The server
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_summarize_wal(int server);
+
+/**
+ * Read the summaries which cover a range of WAL on a timeline
+ * @param server The server
+ * @param timeline The timeline
+ * @param start_lsn The start of the range
+ * @param end_lsn The end of the range
+ * @param summary [out] The summary
+ * @return 0 upon success, 1 if a segment of the range hasn't been summarized
+ */
+int
+pgmoneta_wal_summary_read(int server, uint32_t timeline, uint64_t start_lsn, uint64_t end_lsn, struct wal_summary** summary);
+
+/**
+ * Get the modified blocks of a relation segment
+ * @param summary The summary
+ * @param spcoid The tablespace oid
+ * @param dboid The database oid
+ * @param relnumber The relation file number
+ * @param forknum The fork number
+ * @param start The first block of the segment
+ * @param end The block after the segment
+ * @param limit [out] The lowest limit block, or WAL_SUMMARY_NO_LIMIT
+ * @param blocks [out] The modified blocks, relative to start
+ * @param number_of_blocks [out] The number of modified blocks
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_wal_summary_blocks(struct wal_summary* summary, uint32_t spcoid, uint32_t dboid, uint32_t relnumber, int forknum,
+                            uint32_t start, uint32_t end, uint32_t* limit, uint32_t** blocks, int* number_of_blocks);
+
+/**
+ * Identify the relation segment of a path in the data directory
+ * @param path The path relative to the data directory
+ * @param spcoid [out] The tablespace oid
+ * @param dboid [out] The database oid
+ * @param relnumber [out] The relation file number
+ * @param forknum [out] The fork number
+ * @param segno [out] The segment number
+ * @return true if the path is a relation segment, otherwise false
+ */
+bool
+pgmoneta_wal_summary_relation(char* path, uint32_t* spcoid, uint32_t* dboid, uint32_t* relnumber, int* forknum, uint32_t* segno);
+
+/**
+ * Destroy a summary
+ * @param summary The summary
+ */
+void
+pgmoneta_wal_summary_destroy(struct wal_summary* summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
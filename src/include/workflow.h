@@ -48,6 +48,7 @@ extern "C" {
 #define WORKFLOW_TYPE_VERIFY                6
 #define WORKFLOW_TYPE_INCREMENTAL_BACKUP    7
 #define WORKFLOW_TYPE_RESTORE_INCREMENTAL   8
+#define WORKFLOW_TYPE_CONSOLIDATE           9
 
 #define PERMISSION_TYPE_BACKUP              0
 #define PERMISSION_TYPE_RESTORE             1
@@ -72,6 +73,7 @@ extern "C" {
 #define NODE_RECOVERY_INFO "recovery_info"
 #define NODE_SERVER_BACKUP "server_backup"
 #define NODE_SERVER_BASE   "server_base"
+#define NODE_SHA256        "sha256"
 #define NODE_TARFILE       "tarfile"
 #define NODE_BACKUPS       "backups"
 #define NODE_COMBINE_BASE  "combine_base" // the base directory that contains combine output directory
@@ -94,6 +94,14 @@ pgmoneta_create_retention(void);
 struct workflow*
 pgmoneta_create_sha256(void);
 
+/**
+ * Create a workflow which compresses, encrypts and calculates the SHA-256
+ * of the backup files in a single pass
+ * @return The workflow
+ */
+struct workflow*
+pgmoneta_create_pipeline(void);
+
 /**
  * Create a workflow for the delete backups
  * @return The workflow
@@ -135,10 +143,19 @@ pgmoneta_create_bzip2(bool compress);
 
 /**
  * Create a workflow for symlinking
+ * @param hard True to hard link the unchanged files to the newest full backup instead
+ * @return The workflow
+ */
+struct workflow*
+pgmoneta_create_link(bool hard);
+
+/**
+ * Create a workflow for the deduplication chunk store
+ * @param store True to move the backup files into the store, false to rebuild them
  * @return The workflow
  */
 struct workflow*
-pgmoneta_create_link(void);
+pgmoneta_create_dedup(bool store);
 
 /**
  * Create a workflow for recovery info
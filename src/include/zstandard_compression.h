@@ -38,6 +38,13 @@ extern "C" {
 
 #include <stdlib.h>
 
+#define WAL_DICTIONARY_SIZE      112640 /* The maximum size of a trained WAL dictionary */
+#define WAL_DICTIONARY_SEGMENTS  8      /* The number of recent segments sampled for training */
+#define WAL_DICTIONARY_PAGES     128    /* The number of pages sampled from each segment */
+#define WAL_DICTIONARY_PAGE_SIZE 8192   /* The size of a sample, one WAL page */
+#define WAL_DICTIONARY_INTERVAL  86400  /* The number of seconds between two trainings */
+#define WAL_DICTIONARY_MAX       1024   /* The maximum number of dictionaries considered for pruning */
+
 /**
  * Compress a data directory with Zstandard
  * @param directory The directory
@@ -55,11 +62,13 @@ void
 pgmoneta_zstandardc_tablespaces(char* root, struct workers* workers);
 
 /**
- * Compress a WAL directory with Zstandard
+ * Compress a WAL directory with Zstandard, using the current WAL
+ * dictionary of the server when wal_dictionary is on
+ * @param server The server
  * @param directory The directory
  */
 void
-pgmoneta_zstandardc_wal(char* directory);
+pgmoneta_zstandardc_wal(int server, char* directory);
 
 /**
  * ZSTD decompress a single file, also remove the original file
@@ -109,6 +118,31 @@ pgmoneta_zstandardc_request(SSL* ssl, int client_fd, uint8_t compression, uint8_
 int
 pgmoneta_zstandardc_file(char* from, char* to);
 
+/**
+ * Compress a WAL segment, using the current WAL dictionary of the
+ * server when wal_dictionary is on
+ * @param server The server
+ * @param from The from name
+ * @param to The to name
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_zstandardc_wal_file(int server, char* from, char* to);
+
+/**
+ * Train a new WAL dictionary for a server from pages of its most recent
+ * segments, once the current dictionary is older than WAL_DICTIONARY_INTERVAL.
+ * The dictionaries are kept in <server>/waldict/ named by their id, which
+ * every compressed frame records, so older segments stay readable. The
+ * dictionaries which no segment of the server or of its backups uses are
+ * removed. Dictionaries aren't used when the segments are copied to another
+ * host, by a remote storage engine or WAL shipping
+ * @param server The server
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgmoneta_zstandard_wal_train(int server);
+
 /**
  * ZSTD compress a string
  * @param s The original string
@@ -661,6 +661,140 @@ pgmoneta_decrypt(char* ciphertext, int ciphertext_length, char* password, char**
    return aes_decrypt(ciphertext, ciphertext_length, key, iv, plaintext, mode);
 }
 
+int
+pgmoneta_encryptor_create(int mode, bool encrypt, encryptor_output output, void* arg, struct encryptor** encryptor)
+{
+   unsigned char key[EVP_MAX_KEY_LENGTH];
+   unsigned char iv[EVP_MAX_IV_LENGTH];
+   char* master_key = NULL;
+   const EVP_CIPHER* (* cipher_fp)(void) = NULL;
+   struct encryptor* e = NULL;
+
+   *encryptor = NULL;
+
+   e = (struct encryptor*)malloc(sizeof(struct encryptor));
+   if (e == NULL)
+   {
+      goto error;
+   }
+
+   memset(e, 0, sizeof(struct encryptor));
+
+   e->output = output;
+   e->arg = arg;
+
+   cipher_fp = get_cipher(mode);
+
+   e->buffer_size = ENC_BUF_SIZE + EVP_CIPHER_block_size(cipher_fp()) - 1;
+   e->buffer = (unsigned char*)malloc(e->buffer_size);
+   if (e->buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_get_master_key(&master_key))
+   {
+      pgmoneta_log_fatal("pgmoneta_get_master_key: Invalid master key");
+      goto error;
+   }
+
+   memset(&key, 0, sizeof(key));
+   memset(&iv, 0, sizeof(iv));
+   if (derive_key_iv(master_key, key, iv, mode) != 0)
+   {
+      pgmoneta_log_fatal("derive_key_iv: Failed to derive key and iv");
+      goto error;
+   }
+
+   if (!(e->ctx = EVP_CIPHER_CTX_new()))
+   {
+      pgmoneta_log_fatal("EVP_CIPHER_CTX_new: Failed to get context");
+      goto error;
+   }
+
+   if (EVP_CipherInit_ex(e->ctx, cipher_fp(), NULL, key, iv, encrypt ? 1 : 0) == 0)
+   {
+      pgmoneta_log_error("EVP_CipherInit_ex: Failed to initialize context");
+      goto error;
+   }
+
+   free(master_key);
+
+   *encryptor = e;
+
+   return 0;
+
+error:
+
+   free(master_key);
+   pgmoneta_encryptor_destroy(e);
+
+   return 1;
+}
+
+int
+pgmoneta_encryptor_write(struct encryptor* encryptor, void* data, size_t size)
+{
+   unsigned char* d = (unsigned char*)data;
+   int inl = 0;
+   int outl = 0;
+
+   while (size > 0)
+   {
+      inl = (int)MIN(size, (size_t)ENC_BUF_SIZE);
+
+      if (EVP_CipherUpdate(encryptor->ctx, encryptor->buffer, &outl, d, inl) == 0)
+      {
+         pgmoneta_log_error("EVP_CipherUpdate: failed to process block");
+         return 1;
+      }
+
+      if (outl > 0 && encryptor->output(encryptor->buffer, (size_t)outl, encryptor->arg))
+      {
+         return 1;
+      }
+
+      d += inl;
+      size -= inl;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_encryptor_finish(struct encryptor* encryptor)
+{
+   int f_len = 0;
+
+   if (EVP_CipherFinal_ex(encryptor->ctx, encryptor->buffer, &f_len) == 0)
+   {
+      pgmoneta_log_error("EVP_CipherFinal_ex: failed to process final cipher block");
+      return 1;
+   }
+
+   if (f_len > 0 && encryptor->output(encryptor->buffer, (size_t)f_len, encryptor->arg))
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+void
+pgmoneta_encryptor_destroy(struct encryptor* encryptor)
+{
+   if (encryptor != NULL)
+   {
+      if (encryptor->ctx != NULL)
+      {
+         EVP_CIPHER_CTX_free(encryptor->ctx);
+      }
+
+      free(encryptor->buffer);
+      free(encryptor);
+   }
+}
+
 // [private]
 static int
 derive_key_iv(char* password, unsigned char* key, unsigned char* iv, int mode)
@@ -29,6 +29,8 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <achv.h>
+#include <art.h>
+#include <compression.h>
 #include <deque.h>
 #include <gzip_compression.h>
 #include <info.h>
@@ -38,6 +40,7 @@
 #include <management.h>
 #include <network.h>
 #include <restore.h>
+#include <security.h>
 #include <utils.h>
 #include <workflow.h>
 #include <zstandard_compression.h>
@@ -45,11 +48,22 @@
 #include <archive.h>
 #include <archive_entry.h>
 #include <dirent.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 static void write_tar_file(struct archive* a, char* current_real_path, char* current_save_path);
 
+static int tar_stream_header(struct tar_stream* stream);
+static int tar_stream_member_end(struct tar_stream* stream);
+static int tar_stream_path(struct tar_stream* stream, char* name, char* path, size_t size);
+static bool tar_stream_uncompressed(char* name);
+static void tar_stream_pax(struct tar_stream* stream);
+static size_t tar_number(char* field, size_t length);
+static void tar_string(char* field, size_t length, char* out, size_t size);
+
 void
 pgmoneta_archive(SSL* ssl, int client_fd, int server, uint8_t compression, uint8_t encryption, struct json* payload)
 {
@@ -332,6 +346,665 @@ error:
    return 1;
 }
 
+int
+pgmoneta_tar_stream_create(char* destination, struct tar_stream** stream)
+{
+   struct tar_stream* s = NULL;
+
+   *stream = NULL;
+
+   if (destination == NULL || strlen(destination) >= MAX_PATH)
+   {
+      goto error;
+   }
+
+   s = (struct tar_stream*)malloc(sizeof(struct tar_stream));
+
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   memset(s, 0, sizeof(struct tar_stream));
+
+   memcpy(s->destination, destination, strlen(destination));
+   if (pgmoneta_ends_with(s->destination, "/") && strlen(s->destination) > 1)
+   {
+      s->destination[strlen(s->destination) - 1] = '\0';
+   }
+
+   s->state = TAR_STATE_HEADER;
+
+   if (pgmoneta_mkdir(s->destination))
+   {
+      pgmoneta_log_error("Tar: Could not create %s", s->destination);
+      goto error;
+   }
+
+   *stream = s;
+
+   return 0;
+
+error:
+
+   free(s);
+
+   return 1;
+}
+
+int
+pgmoneta_tar_stream_compress(struct tar_stream* stream, int compression, int level, int algorithm, char* prefix, struct art* checksums)
+{
+   if (stream == NULL)
+   {
+      return 1;
+   }
+
+   stream->compression = compression;
+   stream->level = level;
+   stream->algorithm = algorithm;
+   stream->checksums = checksums;
+
+   memset(stream->prefix, 0, sizeof(stream->prefix));
+   if (prefix != NULL)
+   {
+      snprintf(stream->prefix, sizeof(stream->prefix), "%s", prefix);
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_tar_stream_write(struct tar_stream* stream, void* data, size_t length)
+{
+   char* d = (char*)data;
+   size_t n;
+
+   if (stream == NULL)
+   {
+      goto error;
+   }
+
+   while (length > 0)
+   {
+      switch (stream->state)
+      {
+         case TAR_STATE_HEADER:
+            n = MIN(length, TAR_BLOCK_SIZE - stream->header_length);
+            memcpy(stream->header + stream->header_length, d, n);
+            stream->header_length += n;
+
+            if (stream->header_length == TAR_BLOCK_SIZE)
+            {
+               stream->header_length = 0;
+               if (tar_stream_header(stream))
+               {
+                  goto error;
+               }
+            }
+            break;
+         case TAR_STATE_DATA:
+            n = MIN(length, stream->remaining);
+
+            if (stream->hash != NULL && pgmoneta_hash_update(stream->hash, d, n))
+            {
+               goto error;
+            }
+
+            if (stream->compressor != NULL)
+            {
+               if (pgmoneta_compressor_write(stream->compressor, d, n))
+               {
+                  goto error;
+               }
+            }
+            else if (stream->file != NULL)
+            {
+               if (fwrite(d, 1, n, stream->file) != n)
+               {
+                  pgmoneta_log_error("Tar: Could not write to %s (%s)", stream->path, strerror(errno));
+                  errno = 0;
+                  goto error;
+               }
+            }
+            else if (stream->extended != NULL)
+            {
+               memcpy(stream->extended + stream->extended_length, d, n);
+               stream->extended_length += n;
+            }
+
+            stream->remaining -= n;
+
+            if (stream->remaining == 0)
+            {
+               if (tar_stream_member_end(stream))
+               {
+                  goto error;
+               }
+            }
+            break;
+         case TAR_STATE_PADDING:
+            n = MIN(length, stream->padding);
+            stream->padding -= n;
+
+            if (stream->padding == 0)
+            {
+               stream->state = TAR_STATE_HEADER;
+            }
+            break;
+         default:
+            /* Anything after the end of archive marker is ignored */
+            n = length;
+            break;
+      }
+
+      d += n;
+      length -= n;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_tar_stream_finish(struct tar_stream* stream)
+{
+   if (stream == NULL)
+   {
+      goto error;
+   }
+
+   if (stream->state == TAR_STATE_DATA || stream->header_length > 0)
+   {
+      pgmoneta_log_error("Tar: Archive for %s ended in the middle of %s", stream->destination,
+                         strlen(stream->path) > 0 ? stream->path : "a header");
+      goto error;
+   }
+
+   pgmoneta_log_debug("Tar: %s (Files: %lu, Size: %lu)", stream->destination, stream->number_of_files, stream->size);
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+pgmoneta_tar_stream_destroy(struct tar_stream* stream)
+{
+   if (stream != NULL)
+   {
+      if (stream->file != NULL)
+      {
+         fclose(stream->file);
+      }
+
+      pgmoneta_compressor_destroy(stream->compressor);
+      pgmoneta_hash_destroy(stream->hash);
+      free(stream->extended);
+      free(stream);
+   }
+}
+
+static int
+tar_stream_header(struct tar_stream* stream)
+{
+   char name[MAX_PATH];
+   char prefix[TAR_BLOCK_SIZE];
+   char n[TAR_BLOCK_SIZE];
+   unsigned long checksum = 0;
+   size_t size;
+   bool zero = true;
+
+   for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+   {
+      if (stream->header[i] != 0)
+      {
+         zero = false;
+         break;
+      }
+   }
+
+   if (zero)
+   {
+      stream->state = TAR_STATE_END;
+      return 0;
+   }
+
+   for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+   {
+      checksum += (i >= 148 && i < 156) ? ' ' : (unsigned char)stream->header[i];
+   }
+
+   if (checksum != tar_number(stream->header + 148, 8))
+   {
+      pgmoneta_log_error("Tar: Invalid header checksum in archive for %s", stream->destination);
+      goto error;
+   }
+
+   memset(name, 0, sizeof(name));
+   memset(stream->name, 0, sizeof(stream->name));
+   memset(stream->path, 0, sizeof(stream->path));
+   memset(stream->link, 0, sizeof(stream->link));
+
+   stream->type = stream->header[156];
+   stream->mode = (int)tar_number(stream->header + 100, 8);
+   size = tar_number(stream->header + 124, 12);
+
+   if (strlen(stream->long_path) > 0)
+   {
+      memcpy(name, stream->long_path, strlen(stream->long_path));
+      memset(stream->long_path, 0, sizeof(stream->long_path));
+   }
+   else
+   {
+      memset(prefix, 0, sizeof(prefix));
+      memset(n, 0, sizeof(n));
+
+      tar_string(stream->header, 100, n, sizeof(n));
+
+      if (!strncmp(stream->header + 257, "ustar", 5))
+      {
+         tar_string(stream->header + 345, 155, prefix, sizeof(prefix));
+      }
+
+      if (strlen(prefix) > 0)
+      {
+         snprintf(name, sizeof(name), "%s/%s", prefix, n);
+      }
+      else
+      {
+         snprintf(name, sizeof(name), "%s", n);
+      }
+   }
+
+   if (strlen(stream->long_link) > 0)
+   {
+      memcpy(stream->link, stream->long_link, strlen(stream->long_link));
+      memset(stream->long_link, 0, sizeof(stream->long_link));
+   }
+   else
+   {
+      tar_string(stream->header + 157, 100, stream->link, sizeof(stream->link));
+   }
+
+   stream->remaining = size;
+   stream->padding = (TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+
+   switch (stream->type)
+   {
+      case 'L':
+      case 'K':
+      case 'x':
+      case 'g':
+         if (size >= MAX_PATH * 4)
+         {
+            pgmoneta_log_error("Tar: Extended header too large (%zu) in archive for %s", size, stream->destination);
+            goto error;
+         }
+
+         stream->extended = (char*)malloc(size + 1);
+         if (stream->extended == NULL)
+         {
+            goto error;
+         }
+         memset(stream->extended, 0, size + 1);
+         stream->extended_length = 0;
+         break;
+      case '5':
+         if (tar_stream_path(stream, name, stream->path, sizeof(stream->path)))
+         {
+            goto error;
+         }
+
+         if (pgmoneta_mkdir(stream->path))
+         {
+            pgmoneta_log_error("Tar: Could not create directory %s", stream->path);
+            goto error;
+         }
+         break;
+      case '2':
+         if (tar_stream_path(stream, name, stream->path, sizeof(stream->path)))
+         {
+            goto error;
+         }
+
+         unlink(stream->path);
+         if (symlink(stream->link, stream->path))
+         {
+            pgmoneta_log_error("Tar: Could not create symbolic link %s -> %s (%s)", stream->path, stream->link, strerror(errno));
+            errno = 0;
+            goto error;
+         }
+         break;
+      case '1':
+      {
+         char target[MAX_PATH];
+
+         if (tar_stream_path(stream, name, stream->path, sizeof(stream->path)) ||
+             tar_stream_path(stream, stream->link, target, sizeof(target)))
+         {
+            goto error;
+         }
+
+         unlink(stream->path);
+         if (link(target, stream->path))
+         {
+            pgmoneta_log_error("Tar: Could not create link %s -> %s (%s)", stream->path, target, strerror(errno));
+            errno = 0;
+            goto error;
+         }
+         break;
+      }
+      case '0':
+      case '7':
+      case '\0':
+      {
+         char* parent = NULL;
+
+         if (tar_stream_path(stream, name, stream->path, sizeof(stream->path)))
+         {
+            goto error;
+         }
+
+         parent = pgmoneta_append(parent, stream->path);
+         if (strrchr(parent, '/') != NULL)
+         {
+            *strrchr(parent, '/') = '\0';
+            pgmoneta_mkdir(parent);
+         }
+         free(parent);
+
+         if (stream->checksums != NULL && pgmoneta_hash_create(stream->algorithm, &stream->hash))
+         {
+            goto error;
+         }
+
+         if (stream->compression != COMPRESSION_NONE && !tar_stream_uncompressed(stream->name))
+         {
+            if (pgmoneta_compressor_create(stream->path, stream->compression, stream->level, &stream->compressor))
+            {
+               goto error;
+            }
+
+            if (stream->mode != 0)
+            {
+               chmod(stream->compressor->path, stream->mode & (S_IRWXU | S_IRWXG | S_IRWXO));
+            }
+            break;
+         }
+
+         stream->file = fopen(stream->path, "wb");
+         if (stream->file == NULL)
+         {
+            pgmoneta_log_error("Tar: Could not create file %s (%s)", stream->path, strerror(errno));
+            errno = 0;
+            goto error;
+         }
+
+         if (stream->mode != 0)
+         {
+            fchmod(fileno(stream->file), stream->mode & (S_IRWXU | S_IRWXG | S_IRWXO));
+         }
+         break;
+      }
+      default:
+         pgmoneta_log_debug("Tar: Skipping %s of type %c", name, stream->type);
+         break;
+   }
+
+   if (stream->remaining > 0)
+   {
+      stream->state = TAR_STATE_DATA;
+      return 0;
+   }
+
+   return tar_stream_member_end(stream);
+
+error:
+
+   return 1;
+}
+
+static int
+tar_stream_member_end(struct tar_stream* stream)
+{
+   size_t size = 0;
+   char* checksum = NULL;
+   char* key = NULL;
+
+   if (stream->hash != NULL)
+   {
+      if (pgmoneta_hash_final(stream->hash, &checksum))
+      {
+         goto error;
+      }
+
+      key = pgmoneta_append(key, stream->prefix);
+      key = pgmoneta_append(key, stream->name);
+
+      if (pgmoneta_art_insert(stream->checksums, (unsigned char*)key, strlen(key) + 1, (uintptr_t)checksum, ValueString))
+      {
+         goto error;
+      }
+
+      pgmoneta_hash_destroy(stream->hash);
+      stream->hash = NULL;
+
+      free(checksum);
+      checksum = NULL;
+      free(key);
+      key = NULL;
+   }
+
+   if (stream->compressor != NULL)
+   {
+      size = stream->compressor->size;
+
+      if (pgmoneta_compressor_finish(stream->compressor))
+      {
+         goto error;
+      }
+
+      pgmoneta_compressor_destroy(stream->compressor);
+      stream->compressor = NULL;
+
+      stream->number_of_files++;
+      stream->size += size;
+      stream->biggest_file = MAX(stream->biggest_file, size);
+   }
+   else if (stream->file != NULL)
+   {
+      size = ftell(stream->file);
+
+      if (fclose(stream->file))
+      {
+         stream->file = NULL;
+         pgmoneta_log_error("Tar: Could not close %s (%s)", stream->path, strerror(errno));
+         errno = 0;
+         goto error;
+      }
+      stream->file = NULL;
+
+      stream->number_of_files++;
+      stream->size += size;
+      stream->biggest_file = MAX(stream->biggest_file, size);
+   }
+   else if (stream->extended != NULL)
+   {
+      if (stream->type == 'L')
+      {
+         tar_string(stream->extended, stream->extended_length, stream->long_path, sizeof(stream->long_path));
+      }
+      else if (stream->type == 'K')
+      {
+         tar_string(stream->extended, stream->extended_length, stream->long_link, sizeof(stream->long_link));
+      }
+      else if (stream->type == 'x')
+      {
+         tar_stream_pax(stream);
+      }
+
+      free(stream->extended);
+      stream->extended = NULL;
+      stream->extended_length = 0;
+   }
+
+   stream->state = stream->padding > 0 ? TAR_STATE_PADDING : TAR_STATE_HEADER;
+
+   return 0;
+
+error:
+
+   free(checksum);
+   free(key);
+
+   return 1;
+}
+
+static int
+tar_stream_path(struct tar_stream* stream, char* name, char* path, size_t size)
+{
+   char* n = name;
+
+   while (pgmoneta_starts_with(n, "./"))
+   {
+      n += 2;
+   }
+
+   if (n[0] == '/' || !strcmp(n, "..") || pgmoneta_starts_with(n, "../") ||
+       strstr(n, "/../") != NULL || pgmoneta_ends_with(n, "/.."))
+   {
+      pgmoneta_log_error("Tar: Refusing to extract %s outside of %s", name, stream->destination);
+      return 1;
+   }
+
+   memset(path, 0, size);
+   snprintf(path, size, "%s/%s", stream->destination, n);
+
+   if (strlen(path) > 1 && pgmoneta_ends_with(path, "/"))
+   {
+      path[strlen(path) - 1] = '\0';
+   }
+
+   if (path == stream->path)
+   {
+      snprintf(stream->name, sizeof(stream->name), "%s", path + strlen(stream->destination) + 1);
+   }
+
+   return 0;
+}
+
+static bool
+tar_stream_uncompressed(char* name)
+{
+   /* Read by the backup workflow before the compression step */
+   return !strcmp(name, "backup_label") ||
+          !strcmp(name, "backup_manifest") ||
+          !strcmp(name, "global/pg_control");
+}
+
+static void
+tar_stream_pax(struct tar_stream* stream)
+{
+   char* p = stream->extended;
+   char* end = stream->extended + stream->extended_length;
+
+   /* Records are on the form "<length> <key>=<value>\n" */
+   while (p < end)
+   {
+      char* record = p;
+      char* key = NULL;
+      char* value = NULL;
+      size_t length = 0;
+
+      while (p < end && *p >= '0' && *p <= '9')
+      {
+         length = length * 10 + (*p - '0');
+         p++;
+      }
+
+      if (length == 0 || p >= end || *p != ' ' || record + length > end)
+      {
+         return;
+      }
+
+      key = p + 1;
+      value = memchr(key, '=', record + length - key);
+
+      if (value != NULL)
+      {
+         size_t value_length = record + length - 1 - (value + 1);
+
+         if (!strncmp(key, "path=", 5))
+         {
+            memset(stream->long_path, 0, sizeof(stream->long_path));
+            memcpy(stream->long_path, value + 1, MIN(value_length, sizeof(stream->long_path) - 1));
+         }
+         else if (!strncmp(key, "linkpath=", 9))
+         {
+            memset(stream->long_link, 0, sizeof(stream->long_link));
+            memcpy(stream->long_link, value + 1, MIN(value_length, sizeof(stream->long_link) - 1));
+         }
+      }
+
+      p = record + length;
+   }
+}
+
+static size_t
+tar_number(char* field, size_t length)
+{
+   size_t result = 0;
+
+   /* Base-256 encoding, used for values that don't fit in octal */
+   if ((unsigned char)field[0] & 0x80)
+   {
+      result = (unsigned char)field[0] & 0x3F;
+      for (size_t i = 1; i < length; i++)
+      {
+         result = (result << 8) | (unsigned char)field[i];
+      }
+
+      return result;
+   }
+
+   for (size_t i = 0; i < length; i++)
+   {
+      if (field[i] == ' ' && result == 0)
+      {
+         continue;
+      }
+
+      if (field[i] < '0' || field[i] > '7')
+      {
+         break;
+      }
+
+      result = (result << 3) + (field[i] - '0');
+   }
+
+   return result;
+}
+
+static void
+tar_string(char* field, size_t length, char* out, size_t size)
+{
+   size_t l = 0;
+
+   while (l < length && field[l] != '\0')
+   {
+      l++;
+   }
+
+   memset(out, 0, size);
+   memcpy(out, field, MIN(l, size - 1));
+}
+
 int
 pgmoneta_tar_directory(char* src_path, char* dst_path, char* save_path)
 {
@@ -126,7 +126,7 @@ pgmoneta_backup(int client_fd, int server, uint8_t compression, uint8_t encrypti
    if (incremental != NULL)
    {
       backup_incremental = true;
-      if (config->servers[server].version < 17)
+      if (config->servers[server].version < 17 && !config->wal_summary)
       {
          pgmoneta_log_error("Incremental backup not supported for server %s at version %d",
                             config->servers[server].name, config->servers[server].version);
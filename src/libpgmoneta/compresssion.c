@@ -26,6 +26,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <pgmoneta.h>
 #include <bzip2_compression.h>
 #include <compression.h>
 #include <gzip_compression.h>
@@ -34,6 +35,31 @@
 #include <utils.h>
 #include <zstandard_compression.h>
 
+/* system */
+#include <bzlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <lz4.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#define ZSTD_DEFAULT_NUMBER_OF_WORKERS 4
+#define COMPRESSOR_BUFFER_SIZE 65536
+
+static int compressor_init(struct compressor* compressor, int level);
+static int compressor_emit(struct compressor* compressor, void* data, size_t size);
+static int compressor_gzip_write(struct compressor* compressor, void* data, size_t size, int flush);
+static int compressor_zstd_write(struct compressor* compressor, void* data, size_t size, ZSTD_EndDirective mode);
+static int compressor_lz4_block(struct compressor* compressor);
+static int compressor_bzip2_write(struct compressor* compressor, void* data, size_t size, int action);
+static int decompressor_init(struct decompressor* decompressor);
+static int decompressor_emit(struct decompressor* decompressor, void* data, size_t size);
+static int decompressor_gzip_write(struct decompressor* decompressor, void* data, size_t size);
+static int decompressor_zstd_write(struct decompressor* decompressor, void* data, size_t size);
+static int decompressor_lz4_block(struct decompressor* decompressor);
+static int decompressor_bzip2_write(struct decompressor* decompressor, void* data, size_t size);
+
 static int
 pgmoneta_decompression_file_callback(char* path, compression_func* decompress_cb)
 {
@@ -74,3 +100,1112 @@ pgmoneta_decompress(char* from, char* to)
 error:
    return 1;
 }
+
+bool
+pgmoneta_compression_inline(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!config->inline_compression)
+   {
+      return false;
+   }
+
+   if (config->compression_type != COMPRESSION_CLIENT_GZIP &&
+       config->compression_type != COMPRESSION_CLIENT_ZSTD &&
+       config->compression_type != COMPRESSION_CLIENT_LZ4 &&
+       config->compression_type != COMPRESSION_CLIENT_BZIP2)
+   {
+      return false;
+   }
+
+   /* The hot standby is created from the uncompressed files */
+   if (strlen(config->servers[server].hot_standby) > 0)
+   {
+      return false;
+   }
+
+   /* The chunk store deduplicates the uncompressed files */
+   if (config->dedup)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+char*
+pgmoneta_compression_suffix(int type)
+{
+   switch (type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         return ".gz";
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         return ".zstd";
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         return ".lz4";
+      case COMPRESSION_CLIENT_BZIP2:
+         return ".bz2";
+      default:
+         break;
+   }
+
+   return "";
+}
+
+int
+pgmoneta_compression_type(char* path)
+{
+   if (pgmoneta_ends_with(path, ".gz"))
+   {
+      return COMPRESSION_CLIENT_GZIP;
+   }
+   else if (pgmoneta_ends_with(path, ".zstd"))
+   {
+      return COMPRESSION_CLIENT_ZSTD;
+   }
+   else if (pgmoneta_ends_with(path, ".lz4"))
+   {
+      return COMPRESSION_CLIENT_LZ4;
+   }
+   else if (pgmoneta_ends_with(path, ".bz2"))
+   {
+      return COMPRESSION_CLIENT_BZIP2;
+   }
+
+   return COMPRESSION_NONE;
+}
+
+int
+pgmoneta_compressor_create(char* path, int type, int level, struct compressor** compressor)
+{
+   struct compressor* c = NULL;
+
+   *compressor = NULL;
+
+   c = (struct compressor*)malloc(sizeof(struct compressor));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   memset(c, 0, sizeof(struct compressor));
+
+   c->type = type;
+   snprintf(c->path, sizeof(c->path), "%s%s", path, pgmoneta_compression_suffix(type));
+
+   if (compressor_init(c, level))
+   {
+      goto error;
+   }
+
+   c->file = fopen(c->path, "wb");
+   if (c->file == NULL)
+   {
+      pgmoneta_log_error("Compressor: Could not create %s (%s)", c->path, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   *compressor = c;
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Compressor: Could not create compressor for %s", path);
+
+   pgmoneta_compressor_destroy(c);
+
+   return 1;
+}
+
+int
+pgmoneta_compressor_create_output(int type, int level, compressor_output output, void* arg, struct compressor** compressor)
+{
+   struct compressor* c = NULL;
+
+   *compressor = NULL;
+
+   c = (struct compressor*)malloc(sizeof(struct compressor));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   memset(c, 0, sizeof(struct compressor));
+
+   c->type = type;
+   c->output = output;
+   c->arg = arg;
+
+   if (compressor_init(c, level))
+   {
+      goto error;
+   }
+
+   *compressor = c;
+
+   return 0;
+
+error:
+
+   pgmoneta_compressor_destroy(c);
+
+   return 1;
+}
+
+int
+pgmoneta_compressor_write(struct compressor* compressor, void* data, size_t size)
+{
+   char* d = (char*)data;
+   size_t n;
+
+   if (compressor == NULL)
+   {
+      goto error;
+   }
+
+   compressor->size += size;
+
+   switch (compressor->type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         if (compressor_gzip_write(compressor, data, size, Z_NO_FLUSH))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         if (compressor_zstd_write(compressor, data, size, ZSTD_e_continue))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         while (size > 0)
+         {
+            n = MIN(size, BLOCK_BYTES - compressor->block_length);
+            memcpy(compressor->block + compressor->block_index * BLOCK_BYTES + compressor->block_length, d, n);
+            compressor->block_length += n;
+            d += n;
+            size -= n;
+
+            if (compressor->block_length == BLOCK_BYTES)
+            {
+               if (compressor_lz4_block(compressor))
+               {
+                  goto error;
+               }
+            }
+         }
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         if (compressor_bzip2_write(compressor, data, size, BZ_RUN))
+         {
+            goto error;
+         }
+         break;
+      default:
+         goto error;
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Compressor: Could not compress %s", compressor != NULL ? compressor->path : "");
+
+   return 1;
+}
+
+int
+pgmoneta_compressor_finish(struct compressor* compressor)
+{
+   int ret;
+
+   if (compressor == NULL)
+   {
+      goto error;
+   }
+
+   switch (compressor->type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         if (compressor_gzip_write(compressor, NULL, 0, Z_FINISH))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         if (compressor_zstd_write(compressor, NULL, 0, ZSTD_e_end))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         if (compressor->block_length > 0 && compressor_lz4_block(compressor))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         if (compressor_bzip2_write(compressor, NULL, 0, BZ_FINISH))
+         {
+            goto error;
+         }
+         break;
+      default:
+         goto error;
+   }
+
+   if (compressor->file != NULL)
+   {
+      ret = fclose(compressor->file);
+      compressor->file = NULL;
+      if (ret != 0)
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Compressor: Could not finish %s", compressor != NULL ? compressor->path : "");
+
+   return 1;
+}
+
+void
+pgmoneta_compressor_destroy(struct compressor* compressor)
+{
+   if (compressor == NULL)
+   {
+      return;
+   }
+
+   if (compressor->context != NULL)
+   {
+      switch (compressor->type)
+      {
+         case COMPRESSION_CLIENT_GZIP:
+         case COMPRESSION_SERVER_GZIP:
+            deflateEnd(compressor->context);
+            free(compressor->context);
+            break;
+         case COMPRESSION_CLIENT_ZSTD:
+         case COMPRESSION_SERVER_ZSTD:
+            ZSTD_freeCCtx(compressor->context);
+            break;
+         case COMPRESSION_CLIENT_LZ4:
+         case COMPRESSION_SERVER_LZ4:
+            LZ4_freeStream(compressor->context);
+            break;
+         case COMPRESSION_CLIENT_BZIP2:
+            BZ2_bzCompressEnd(compressor->context);
+            free(compressor->context);
+            break;
+         default:
+            break;
+      }
+   }
+
+   if (compressor->file != NULL)
+   {
+      fclose(compressor->file);
+   }
+
+   free(compressor->buffer);
+   free(compressor->block);
+   free(compressor);
+}
+
+int
+pgmoneta_decompressor_create(char* path, int type, struct decompressor** decompressor)
+{
+   struct decompressor* d = NULL;
+
+   *decompressor = NULL;
+
+   d = (struct decompressor*)malloc(sizeof(struct decompressor));
+   if (d == NULL)
+   {
+      goto error;
+   }
+
+   memset(d, 0, sizeof(struct decompressor));
+
+   d->type = type;
+   snprintf(d->path, sizeof(d->path), "%s", path);
+
+   if (decompressor_init(d))
+   {
+      goto error;
+   }
+
+   d->file = fopen(d->path, "wb");
+   if (d->file == NULL)
+   {
+      pgmoneta_log_error("Decompressor: Could not create %s (%s)", d->path, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   *decompressor = d;
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Decompressor: Could not create decompressor for %s", path);
+
+   pgmoneta_decompressor_destroy(d);
+
+   return 1;
+}
+
+int
+pgmoneta_decompressor_write(struct decompressor* decompressor, void* data, size_t size)
+{
+   char* d = (char*)data;
+   size_t n;
+   int length;
+
+   if (decompressor == NULL)
+   {
+      goto error;
+   }
+
+   switch (decompressor->type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         if (decompressor_gzip_write(decompressor, data, size))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         if (decompressor_zstd_write(decompressor, data, size))
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         // each block is the length of the compressed block, followed by the block
+         while (size > 0)
+         {
+            if (decompressor->input_length < sizeof(int))
+            {
+               n = MIN(size, sizeof(int) - decompressor->input_length);
+            }
+            else
+            {
+               memcpy(&length, decompressor->input, sizeof(int));
+
+               if (length <= 0 || length > LZ4_COMPRESSBOUND(BLOCK_BYTES))
+               {
+                  goto error;
+               }
+
+               n = MIN(size, sizeof(int) + (size_t)length - decompressor->input_length);
+            }
+
+            memcpy(decompressor->input + decompressor->input_length, d, n);
+            decompressor->input_length += n;
+            d += n;
+            size -= n;
+
+            if (decompressor->input_length > sizeof(int))
+            {
+               memcpy(&length, decompressor->input, sizeof(int));
+
+               if (decompressor->input_length == sizeof(int) + (size_t)length && decompressor_lz4_block(decompressor))
+               {
+                  goto error;
+               }
+            }
+         }
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         if (decompressor_bzip2_write(decompressor, data, size))
+         {
+            goto error;
+         }
+         break;
+      default:
+         goto error;
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Decompressor: Could not decompress %s", decompressor != NULL ? decompressor->path : "");
+
+   return 1;
+}
+
+int
+pgmoneta_decompressor_finish(struct decompressor* decompressor)
+{
+   int ret;
+
+   if (decompressor == NULL)
+   {
+      goto error;
+   }
+
+   switch (decompressor->type)
+   {
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         // the stream has no end marker, so it ends on a block
+         decompressor->end = decompressor->input_length == 0;
+         break;
+      default:
+         break;
+   }
+
+   if (!decompressor->end)
+   {
+      pgmoneta_log_error("Decompressor: Truncated data for %s", decompressor->path);
+      goto error;
+   }
+
+   if (decompressor->file != NULL)
+   {
+      ret = fclose(decompressor->file);
+      decompressor->file = NULL;
+      if (ret != 0)
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   pgmoneta_log_error("Decompressor: Could not finish %s", decompressor != NULL ? decompressor->path : "");
+
+   return 1;
+}
+
+void
+pgmoneta_decompressor_destroy(struct decompressor* decompressor)
+{
+   if (decompressor == NULL)
+   {
+      return;
+   }
+
+   if (decompressor->context != NULL)
+   {
+      switch (decompressor->type)
+      {
+         case COMPRESSION_CLIENT_GZIP:
+         case COMPRESSION_SERVER_GZIP:
+            inflateEnd(decompressor->context);
+            free(decompressor->context);
+            break;
+         case COMPRESSION_CLIENT_ZSTD:
+         case COMPRESSION_SERVER_ZSTD:
+            ZSTD_freeDCtx(decompressor->context);
+            break;
+         case COMPRESSION_CLIENT_LZ4:
+         case COMPRESSION_SERVER_LZ4:
+            free(decompressor->context);
+            break;
+         case COMPRESSION_CLIENT_BZIP2:
+            BZ2_bzDecompressEnd(decompressor->context);
+            free(decompressor->context);
+            break;
+         default:
+            break;
+      }
+   }
+
+   if (decompressor->file != NULL)
+   {
+      fclose(decompressor->file);
+   }
+
+   free(decompressor->buffer);
+   free(decompressor->block);
+   free(decompressor->input);
+   free(decompressor);
+}
+
+static int
+compressor_init(struct compressor* compressor, int level)
+{
+   int workers;
+   z_stream* zs = NULL;
+   bz_stream* bs = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   switch (compressor->type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         level = MAX(1, MIN(level, 9));
+
+         zs = (z_stream*)malloc(sizeof(z_stream));
+         if (zs == NULL)
+         {
+            goto error;
+         }
+
+         memset(zs, 0, sizeof(z_stream));
+
+         /* gzip format, readable by gzread */
+         if (deflateInit2(zs, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+         {
+            free(zs);
+            goto error;
+         }
+
+         compressor->context = zs;
+         compressor->buffer_size = COMPRESSOR_BUFFER_SIZE;
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         level = MAX(1, MIN(level, 19));
+         workers = config->workers != 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS;
+
+         compressor->context = ZSTD_createCCtx();
+         if (compressor->context == NULL)
+         {
+            goto error;
+         }
+
+         ZSTD_CCtx_setParameter(compressor->context, ZSTD_c_compressionLevel, level);
+         ZSTD_CCtx_setParameter(compressor->context, ZSTD_c_checksumFlag, 1);
+         ZSTD_CCtx_setParameter(compressor->context, ZSTD_c_nbWorkers, workers);
+
+         compressor->buffer_size = ZSTD_CStreamOutSize();
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         compressor->context = LZ4_createStream();
+         if (compressor->context == NULL)
+         {
+            goto error;
+         }
+
+         compressor->block = (char*)malloc(2 * BLOCK_BYTES);
+         if (compressor->block == NULL)
+         {
+            goto error;
+         }
+
+         compressor->buffer_size = LZ4_COMPRESSBOUND(BLOCK_BYTES);
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         level = MAX(1, MIN(level, 9));
+
+         bs = (bz_stream*)malloc(sizeof(bz_stream));
+         if (bs == NULL)
+         {
+            goto error;
+         }
+
+         memset(bs, 0, sizeof(bz_stream));
+
+         if (BZ2_bzCompressInit(bs, level, 0, 0) != BZ_OK)
+         {
+            free(bs);
+            goto error;
+         }
+
+         compressor->context = bs;
+         compressor->buffer_size = COMPRESSOR_BUFFER_SIZE;
+         break;
+      default:
+         pgmoneta_log_error("Compressor: Unsupported compression type %d", compressor->type);
+         goto error;
+   }
+
+   compressor->buffer = malloc(compressor->buffer_size);
+   if (compressor->buffer == NULL)
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+compressor_emit(struct compressor* compressor, void* data, size_t size)
+{
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (compressor->output != NULL)
+   {
+      return compressor->output(data, size, compressor->arg);
+   }
+
+   if (fwrite(data, sizeof(char), size, compressor->file) != size)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+compressor_gzip_write(struct compressor* compressor, void* data, size_t size, int flush)
+{
+   z_stream* zs = (z_stream*)compressor->context;
+   char* d = (char*)data;
+   size_t n;
+   int ret;
+
+   if (size == 0 && flush == Z_NO_FLUSH)
+   {
+      return 0;
+   }
+
+   do
+   {
+      n = MIN(size, (size_t)UINT_MAX);
+
+      zs->next_in = (Bytef*)d;
+      zs->avail_in = (uInt)n;
+
+      do
+      {
+         zs->next_out = compressor->buffer;
+         zs->avail_out = compressor->buffer_size;
+
+         ret = deflate(zs, size > n ? Z_NO_FLUSH : flush);
+         if (ret == Z_STREAM_ERROR)
+         {
+            return 1;
+         }
+
+         if (compressor_emit(compressor, compressor->buffer, compressor->buffer_size - zs->avail_out))
+         {
+            return 1;
+         }
+      }
+      while (zs->avail_out == 0);
+
+      d += n;
+      size -= n;
+   }
+   while (size > 0);
+
+   return 0;
+}
+
+static int
+compressor_zstd_write(struct compressor* compressor, void* data, size_t size, ZSTD_EndDirective mode)
+{
+   ZSTD_inBuffer input = {data, size, 0};
+   bool finished = false;
+
+   do
+   {
+      ZSTD_outBuffer output = {compressor->buffer, compressor->buffer_size, 0};
+      size_t remaining = ZSTD_compressStream2(compressor->context, &output, &input, mode);
+
+      if (ZSTD_isError(remaining))
+      {
+         pgmoneta_log_error("ZSTD: Compression error: %s", ZSTD_getErrorName(remaining));
+         return 1;
+      }
+
+      if (compressor_emit(compressor, compressor->buffer, output.pos))
+      {
+         return 1;
+      }
+
+      finished = mode == ZSTD_e_end ? (remaining == 0) : (input.pos == input.size);
+   }
+   while (!finished);
+
+   return 0;
+}
+
+static int
+compressor_lz4_block(struct compressor* compressor)
+{
+   int compression;
+
+   compression = LZ4_compress_fast_continue(compressor->context,
+                                            compressor->block + compressor->block_index * BLOCK_BYTES,
+                                            compressor->buffer, compressor->block_length,
+                                            compressor->buffer_size, 1);
+   if (compression <= 0)
+   {
+      return 1;
+   }
+
+   if (compressor_emit(compressor, &compression, sizeof(compression)) ||
+       compressor_emit(compressor, compressor->buffer, (size_t)compression))
+   {
+      return 1;
+   }
+
+   compressor->block_index = (compressor->block_index + 1) % 2;
+   compressor->block_length = 0;
+
+   return 0;
+}
+
+static int
+compressor_bzip2_write(struct compressor* compressor, void* data, size_t size, int action)
+{
+   bz_stream* bs = (bz_stream*)compressor->context;
+   char* d = (char*)data;
+   size_t n;
+   int ret;
+
+   if (size == 0 && action == BZ_RUN)
+   {
+      return 0;
+   }
+
+   do
+   {
+      n = MIN(size, (size_t)UINT_MAX);
+
+      bs->next_in = d;
+      bs->avail_in = (unsigned int)n;
+
+      for (;;)
+      {
+         bs->next_out = compressor->buffer;
+         bs->avail_out = compressor->buffer_size;
+
+         ret = BZ2_bzCompress(bs, size > n ? BZ_RUN : action);
+         if (ret != BZ_RUN_OK && ret != BZ_FINISH_OK && ret != BZ_STREAM_END)
+         {
+            return 1;
+         }
+
+         if (compressor_emit(compressor, compressor->buffer, compressor->buffer_size - bs->avail_out))
+         {
+            return 1;
+         }
+
+         if ((size > n || action == BZ_RUN) && bs->avail_in == 0)
+         {
+            break;
+         }
+
+         if (action == BZ_FINISH && size <= n && ret == BZ_STREAM_END)
+         {
+            break;
+         }
+      }
+
+      d += n;
+      size -= n;
+   }
+   while (size > 0);
+
+   return 0;
+}
+
+static int
+decompressor_init(struct decompressor* decompressor)
+{
+   z_stream* zs = NULL;
+   bz_stream* bs = NULL;
+   LZ4_streamDecode_t* ls = NULL;
+
+   switch (decompressor->type)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      case COMPRESSION_SERVER_GZIP:
+         zs = (z_stream*)malloc(sizeof(z_stream));
+         if (zs == NULL)
+         {
+            goto error;
+         }
+
+         memset(zs, 0, sizeof(z_stream));
+
+         /* gzip format, as written by gzwrite */
+         if (inflateInit2(zs, MAX_WBITS + 16) != Z_OK)
+         {
+            free(zs);
+            goto error;
+         }
+
+         decompressor->context = zs;
+         decompressor->buffer_size = COMPRESSOR_BUFFER_SIZE;
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+      case COMPRESSION_SERVER_ZSTD:
+         decompressor->context = ZSTD_createDCtx();
+         if (decompressor->context == NULL)
+         {
+            goto error;
+         }
+
+         decompressor->buffer_size = ZSTD_DStreamOutSize();
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+      case COMPRESSION_SERVER_LZ4:
+         ls = (LZ4_streamDecode_t*)malloc(sizeof(LZ4_streamDecode_t));
+         if (ls == NULL)
+         {
+            goto error;
+         }
+
+         LZ4_setStreamDecode(ls, NULL, 0);
+         decompressor->context = ls;
+
+         decompressor->block = (char*)malloc(2 * BLOCK_BYTES);
+         decompressor->input = (char*)malloc(sizeof(int) + LZ4_COMPRESSBOUND(BLOCK_BYTES));
+         if (decompressor->block == NULL || decompressor->input == NULL)
+         {
+            goto error;
+         }
+
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         bs = (bz_stream*)malloc(sizeof(bz_stream));
+         if (bs == NULL)
+         {
+            goto error;
+         }
+
+         memset(bs, 0, sizeof(bz_stream));
+
+         if (BZ2_bzDecompressInit(bs, 0, 0) != BZ_OK)
+         {
+            free(bs);
+            goto error;
+         }
+
+         decompressor->context = bs;
+         decompressor->buffer_size = COMPRESSOR_BUFFER_SIZE;
+         break;
+      default:
+         pgmoneta_log_error("Decompressor: Unsupported compression type %d", decompressor->type);
+         goto error;
+   }
+
+   // LZ4 decompresses into its blocks
+   if (decompressor->buffer_size > 0)
+   {
+      decompressor->buffer = malloc(decompressor->buffer_size);
+      if (decompressor->buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+decompressor_emit(struct decompressor* decompressor, void* data, size_t size)
+{
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (fwrite(data, sizeof(char), size, decompressor->file) != size)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+decompressor_gzip_write(struct decompressor* decompressor, void* data, size_t size)
+{
+   z_stream* zs = (z_stream*)decompressor->context;
+   char* d = (char*)data;
+   size_t n;
+   int ret;
+
+   while (size > 0)
+   {
+      n = MIN(size, (size_t)UINT_MAX);
+
+      zs->next_in = (Bytef*)d;
+      zs->avail_in = (uInt)n;
+
+      do
+      {
+         // gzread reads the members of a file one after the other
+         if (decompressor->end && zs->avail_in > 0)
+         {
+            if (inflateReset(zs) != Z_OK)
+            {
+               return 1;
+            }
+            decompressor->end = false;
+         }
+
+         zs->next_out = decompressor->buffer;
+         zs->avail_out = decompressor->buffer_size;
+
+         ret = inflate(zs, Z_NO_FLUSH);
+         if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+         {
+            return 1;
+         }
+
+         if (decompressor_emit(decompressor, decompressor->buffer, decompressor->buffer_size - zs->avail_out))
+         {
+            return 1;
+         }
+
+         if (ret == Z_STREAM_END)
+         {
+            decompressor->end = true;
+         }
+         else if (ret == Z_BUF_ERROR)
+         {
+            break;
+         }
+      }
+      while (zs->avail_in > 0 || zs->avail_out == 0);
+
+      d += n;
+      size -= n;
+   }
+
+   return 0;
+}
+
+static int
+decompressor_zstd_write(struct decompressor* decompressor, void* data, size_t size)
+{
+   ZSTD_inBuffer input = {data, size, 0};
+   size_t ret;
+   bool flushed = false;
+
+   // the output is drained until the decompressor has no more for this input
+   while (input.pos < input.size || !flushed)
+   {
+      ZSTD_outBuffer output = {decompressor->buffer, decompressor->buffer_size, 0};
+
+      ret = ZSTD_decompressStream(decompressor->context, &output, &input);
+      if (ZSTD_isError(ret))
+      {
+         pgmoneta_log_error("ZSTD: Decompression error: %s", ZSTD_getErrorName(ret));
+         return 1;
+      }
+
+      if (decompressor_emit(decompressor, decompressor->buffer, output.pos))
+      {
+         return 1;
+      }
+
+      decompressor->end = ret == 0;
+      flushed = output.pos < output.size;
+   }
+
+   return 0;
+}
+
+static int
+decompressor_lz4_block(struct decompressor* decompressor)
+{
+   int length;
+   int decompression;
+   char* block = NULL;
+
+   memcpy(&length, decompressor->input, sizeof(int));
+
+   block = decompressor->block + decompressor->block_index * BLOCK_BYTES;
+
+   decompression = LZ4_decompress_safe_continue(decompressor->context, decompressor->input + sizeof(int),
+                                                block, length, BLOCK_BYTES);
+   if (decompression <= 0)
+   {
+      return 1;
+   }
+
+   if (decompressor_emit(decompressor, block, (size_t)decompression))
+   {
+      return 1;
+   }
+
+   decompressor->block_index = (decompressor->block_index + 1) % 2;
+   decompressor->input_length = 0;
+
+   return 0;
+}
+
+static int
+decompressor_bzip2_write(struct decompressor* decompressor, void* data, size_t size)
+{
+   bz_stream* bs = (bz_stream*)decompressor->context;
+   char* d = (char*)data;
+   size_t n;
+   int ret;
+
+   while (size > 0 && !decompressor->end)
+   {
+      n = MIN(size, (size_t)UINT_MAX);
+
+      bs->next_in = d;
+      bs->avail_in = (unsigned int)n;
+
+      do
+      {
+         bs->next_out = decompressor->buffer;
+         bs->avail_out = decompressor->buffer_size;
+
+         ret = BZ2_bzDecompress(bs);
+         if (ret != BZ_OK && ret != BZ_STREAM_END)
+         {
+            return 1;
+         }
+
+         if (decompressor_emit(decompressor, decompressor->buffer, decompressor->buffer_size - bs->avail_out))
+         {
+            return 1;
+         }
+
+         decompressor->end = ret == BZ_STREAM_END;
+      }
+      while (!decompressor->end && (bs->avail_in > 0 || bs->avail_out == 0));
+
+      d += n;
+      size -= n;
+   }
+
+   return 0;
+}
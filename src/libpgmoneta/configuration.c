@@ -105,6 +105,15 @@ pgmoneta_init_configuration(void* shm)
 
    config->compression_type = COMPRESSION_CLIENT_ZSTD;
    config->compression_level = 3;
+   config->inline_compression = false;
+   config->parallel_backup = false;
+   config->dedup = false;
+   config->wal_dictionary = false;
+   config->wal_summary = false;
+   config->wal_compaction = false;
+   config->wal_index = false;
+   config->consolidate = 0;
+   config->wal_sink_max_segments = 1024;
 
    config->encryption = ENCRYPTION_NONE;
 
@@ -228,6 +237,7 @@ pgmoneta_read_configuration(void* shm, char* filename)
                   atomic_init(&srv.archiving, 0);
                   atomic_init(&srv.delete, false);
                   atomic_init(&srv.wal, false);
+                  atomic_init(&srv.wal_compress, false);
                   srv.wal_streaming = false;
                   srv.valid = false;
                   srv.cur_timeline = 1; // by default current timeline is 1
@@ -235,6 +245,9 @@ pgmoneta_read_configuration(void* shm, char* filename)
                   atomic_init(&srv.failed_operation_count, 0);
                   atomic_init(&srv.last_operation_time, 0);
                   atomic_init(&srv.last_failed_operation_time, 0);
+                  atomic_init(&srv.backup_queue_depth, 0);
+                  atomic_init(&srv.wal_shipping_lag, 0);
+                  atomic_init(&srv.wal_ssh_lag, 0);
                   memset(srv.wal_shipping, 0, MAX_PATH);
                   srv.workers = -1;
                   srv.backup_max_rate = -1;
@@ -953,6 +966,132 @@ pgmoneta_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "inline_compression"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->inline_compression))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "parallel_backup"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->parallel_backup))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "dedup"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->dedup))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_dictionary"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_dictionary))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_summary"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_summary))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_compaction"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_compaction))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_index"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_bool(value, &config->wal_index))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "consolidate"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->consolidate))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "wal_sink_max_segments"))
+               {
+                  if (!strcmp(section, "pgmoneta"))
+                  {
+                     if (as_int(value, &config->wal_sink_max_segments))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "storage_engine"))
                {
                   if (!strcmp(section, "pgmoneta"))
@@ -1572,6 +1711,13 @@ pgmoneta_validate_configuration(void* shm)
       config->workers = 0;
    }
 
+   /* The remote storage engines copy the recipes, but not the chunk store */
+   if (config->dedup && (config->storage_engine & (STORAGE_ENGINE_SSH | STORAGE_ENGINE_S3 | STORAGE_ENGINE_AZURE)))
+   {
+      pgmoneta_log_fatal("dedup can only be used with the local storage engine");
+      return 1;
+   }
+
    for (int i = 0; i < config->number_of_servers; i++)
    {
       if (!strcmp(config->servers[i].name, "pgmoneta"))
@@ -2108,6 +2254,15 @@ add_configuration_response(struct json* res)
    pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_MANAGEMENT, (uintptr_t)config->management, ValueInt64);
    pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION, (uintptr_t)config->compression_type, ValueInt32);
    pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_COMPRESSION_LEVEL, (uintptr_t)config->compression_level, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_INLINE_COMPRESSION, (uintptr_t)config->inline_compression, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_PARALLEL_BACKUP, (uintptr_t)config->parallel_backup, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_DEDUP, (uintptr_t)config->dedup, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_DICTIONARY, (uintptr_t)config->wal_dictionary, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_SUMMARY, (uintptr_t)config->wal_summary, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_COMPACTION, (uintptr_t)config->wal_compaction, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_INDEX, (uintptr_t)config->wal_index, ValueBool);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_CONSOLIDATE, (uintptr_t)config->consolidate, ValueInt64);
+   pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WAL_SINK_MAX_SEGMENTS, (uintptr_t)config->wal_sink_max_segments, ValueInt64);
    pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_WORKERS, (uintptr_t)config->workers, ValueInt64);
    pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_STORAGE_ENGINE, (uintptr_t)config->storage_engine, ValueInt32);
    pgmoneta_json_put(res, CONFIGURATION_ARGUMENT_ENCRYPTION, (uintptr_t)config->encryption, ValueInt32);
@@ -2874,6 +3029,78 @@ pgmoneta_conf_set(SSL* ssl, int client_fd, uint8_t compression, uint8_t encrypti
          }
          pgmoneta_json_put(response, key, (uintptr_t)config->compression_level, ValueInt32);
       }
+      else if (!strcmp(key, "inline_compression"))
+      {
+         if (as_bool(config_value, &config->inline_compression))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->inline_compression, ValueBool);
+      }
+      else if (!strcmp(key, "parallel_backup"))
+      {
+         if (as_bool(config_value, &config->parallel_backup))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->parallel_backup, ValueBool);
+      }
+      else if (!strcmp(key, "dedup"))
+      {
+         if (as_bool(config_value, &config->dedup))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->dedup, ValueBool);
+      }
+      else if (!strcmp(key, "wal_dictionary"))
+      {
+         if (as_bool(config_value, &config->wal_dictionary))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_dictionary, ValueBool);
+      }
+      else if (!strcmp(key, "wal_summary"))
+      {
+         if (as_bool(config_value, &config->wal_summary))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_summary, ValueBool);
+      }
+      else if (!strcmp(key, "wal_compaction"))
+      {
+         if (as_bool(config_value, &config->wal_compaction))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_compaction, ValueBool);
+      }
+      else if (!strcmp(key, "wal_index"))
+      {
+         if (as_bool(config_value, &config->wal_index))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_index, ValueBool);
+      }
+      else if (!strcmp(key, "consolidate"))
+      {
+         if (as_int(config_value, &config->consolidate))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->consolidate, ValueInt32);
+      }
+      else if (!strcmp(key, "wal_sink_max_segments"))
+      {
+         if (as_int(config_value, &config->wal_sink_max_segments))
+         {
+            unknown = true;
+         }
+         pgmoneta_json_put(response, key, (uintptr_t)config->wal_sink_max_segments, ValueInt32);
+      }
       else if (!strcmp(key, "storage_engine"))
       {
          config->storage_engine = as_storage_engine(config_value);
@@ -4254,6 +4481,15 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    config->create_slot = reload->create_slot;
    config->compression_type = reload->compression_type;
    config->compression_level = reload->compression_level;
+   config->inline_compression = reload->inline_compression;
+   config->parallel_backup = reload->parallel_backup;
+   config->dedup = reload->dedup;
+   config->wal_dictionary = reload->wal_dictionary;
+   config->wal_summary = reload->wal_summary;
+   config->wal_compaction = reload->wal_compaction;
+   config->wal_index = reload->wal_index;
+   config->consolidate = reload->consolidate;
+   config->wal_sink_max_segments = reload->wal_sink_max_segments;
    if (restart_string("workspace", config->workspace, reload->workspace))
    {
       changed = true;
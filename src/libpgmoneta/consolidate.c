@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <consolidate.h>
+#include <deque.h>
+#include <info.h>
+#include <logging.h>
+#include <restore.h>
+#include <utils.h>
+#include <workflow.h>
+
+/* system */
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int consolidate_swap(int server, struct backup* backup, char* staging, bool* swapped);
+static int consolidate_store(int server, char* label);
+
+int
+pgmoneta_consolidate(int server)
+{
+   bool active = false;
+   bool swapped = false;
+   int chain = 0;
+   int number_of_backups = 0;
+   unsigned long size = 0;
+   unsigned long biggest_file_size = 0;
+   double total_seconds;
+   struct timespec start_t;
+   struct timespec end_t;
+   char* elapsed = NULL;
+   char* server_backup = NULL;
+   char* backup_base = NULL;
+   char* backup_data = NULL;
+   char* staging = NULL;
+   char* output = NULL;
+   char* label = NULL;
+   struct backup** backups = NULL;
+   struct backup* backup = NULL;
+   struct backup* parent = NULL;
+   struct backup* p = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->consolidate <= 0)
+   {
+      return 0;
+   }
+
+   // a backup of the server would race with the consolidation for the newest backup
+   if (!atomic_compare_exchange_strong(&config->servers[server].backup, &active, true))
+   {
+      pgmoneta_log_debug("Consolidate: Active backup for server %s", config->servers[server].name);
+      return 0;
+   }
+
+   server_backup = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_backups(server_backup, &number_of_backups, &backups))
+   {
+      goto error;
+   }
+
+   if (number_of_backups == 0)
+   {
+      goto done;
+   }
+
+   backup = backups[number_of_backups - 1];
+
+   if (backup->type != TYPE_INCREMENTAL || backup->valid != VALID_TRUE)
+   {
+      goto done;
+   }
+
+   chain = 1;
+
+   if (pgmoneta_get_backup_parent(server, backup, &parent))
+   {
+      pgmoneta_log_error("Consolidate: No parent for %s/%s", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   while (parent->type != TYPE_FULL)
+   {
+      chain++;
+
+      if (pgmoneta_get_backup_parent(server, parent, &p))
+      {
+         pgmoneta_log_error("Consolidate: No parent for %s/%s", config->servers[server].name, parent->label);
+         goto error;
+      }
+
+      free(parent);
+      parent = p;
+      p = NULL;
+   }
+
+   if (chain < config->consolidate)
+   {
+      goto done;
+   }
+
+   pgmoneta_log_info("Consolidate: %s/%s (Chain: %d)", config->servers[server].name, backup->label, chain);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   backup_base = pgmoneta_get_server_backup_identifier(server, backup->label);
+   backup_data = pgmoneta_get_server_backup_identifier_data(server, backup->label);
+
+   // the staging directory is outside of the backup directory, which is only for backups
+   staging = pgmoneta_get_server(server);
+   staging = pgmoneta_append(staging, "consolidate/");
+
+   if (pgmoneta_exists(staging))
+   {
+      pgmoneta_delete_directory(staging);
+   }
+
+   if (pgmoneta_mkdir(staging))
+   {
+      pgmoneta_log_error("Consolidate: Could not create %s", staging);
+      goto error;
+   }
+
+   if (pgmoneta_restore_backup(server, backup->label, "", staging, &output, &label))
+   {
+      pgmoneta_log_error("Consolidate: Could not restore %s/%s", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   if (consolidate_swap(server, backup, staging, &swapped))
+   {
+      pgmoneta_log_error("Consolidate: Could not replace the files of %s/%s", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   size = pgmoneta_directory_size(backup_data);
+   biggest_file_size = pgmoneta_biggest_file(backup_data);
+
+   if (consolidate_store(server, backup->label))
+   {
+      pgmoneta_log_error("Consolidate: Could not store %s/%s", config->servers[server].name, backup->label);
+      goto error;
+   }
+
+   pgmoneta_update_info_unsigned_long(backup_base, INFO_TYPE, TYPE_FULL);
+   pgmoneta_update_info_string(backup_base, INFO_PARENT, "");
+   pgmoneta_update_info_unsigned_long(backup_base, INFO_COMPRESSION, config->compression_type);
+   pgmoneta_update_info_unsigned_long(backup_base, INFO_ENCRYPTION, config->encryption);
+   pgmoneta_update_info_unsigned_long(backup_base, INFO_RESTORE, size);
+   pgmoneta_update_info_unsigned_long(backup_base, INFO_BIGGEST_FILE, biggest_file_size);
+   pgmoneta_update_info_unsigned_long(backup_base, INFO_BACKUP, pgmoneta_directory_size(backup_data));
+
+   pgmoneta_delete_directory(staging);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+
+   elapsed = pgmoneta_get_timestamp_string(start_t, end_t, &total_seconds);
+
+   pgmoneta_log_info("Consolidate: %s/%s (Elapsed: %s)", config->servers[server].name, backup->label, elapsed);
+
+done:
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(parent);
+   free(elapsed);
+   free(server_backup);
+   free(backup_base);
+   free(backup_data);
+   free(staging);
+   free(output);
+   free(label);
+
+   atomic_store(&config->servers[server].backup, false);
+
+   return 0;
+
+error:
+
+   if (swapped)
+   {
+      // the files of the incremental backup are kept in the staging directory
+      pgmoneta_update_info_bool(backup_base, INFO_STATUS, false);
+      pgmoneta_log_error("Consolidate: %s/%s is no longer valid, the incremental files are in %s",
+                         config->servers[server].name, backup->label, staging);
+   }
+   else if (staging != NULL)
+   {
+      pgmoneta_delete_directory(staging);
+   }
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(parent);
+   free(p);
+   free(elapsed);
+   free(server_backup);
+   free(backup_base);
+   free(backup_data);
+   free(staging);
+   free(output);
+   free(label);
+
+   atomic_store(&config->servers[server].backup, false);
+
+   return 1;
+}
+
+static int
+consolidate_swap(int server, struct backup* backup, char* staging, bool* swapped)
+{
+   char from[MAX_PATH];
+   char to[MAX_PATH];
+   char link[MAX_PATH];
+   char* backup_base = NULL;
+   char* incremental = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *swapped = false;
+
+   backup_base = pgmoneta_get_server_backup_identifier(server, backup->label);
+
+   incremental = pgmoneta_append(incremental, staging);
+   incremental = pgmoneta_append(incremental, "incremental/");
+
+   if (pgmoneta_mkdir(incremental))
+   {
+      goto error;
+   }
+
+   // move the files of the incremental backup aside
+   memset(from, 0, sizeof(from));
+   memset(to, 0, sizeof(to));
+   snprintf(from, sizeof(from), "%sdata", backup_base);
+   snprintf(to, sizeof(to), "%sdata", incremental);
+
+   if (rename(from, to))
+   {
+      pgmoneta_log_error("Consolidate: Could not move %s to %s", from, to);
+      goto error;
+   }
+
+   *swapped = true;
+
+   for (int i = 0; i < backup->number_of_tablespaces; i++)
+   {
+      memset(from, 0, sizeof(from));
+      memset(to, 0, sizeof(to));
+      snprintf(from, sizeof(from), "%s%s", backup_base, backup->tablespaces[i]);
+      snprintf(to, sizeof(to), "%s%s", incremental, backup->tablespaces[i]);
+
+      if (pgmoneta_exists(from) && rename(from, to))
+      {
+         pgmoneta_log_error("Consolidate: Could not move %s to %s", from, to);
+         goto error;
+      }
+   }
+
+   // move the restored files into the backup
+   memset(from, 0, sizeof(from));
+   memset(to, 0, sizeof(to));
+   snprintf(from, sizeof(from), "%s%s-%s", staging, config->servers[server].name, backup->label);
+   snprintf(to, sizeof(to), "%sdata", backup_base);
+
+   if (rename(from, to))
+   {
+      pgmoneta_log_error("Consolidate: Could not move %s to %s", from, to);
+      goto error;
+   }
+
+   for (int i = 0; i < backup->number_of_tablespaces; i++)
+   {
+      memset(from, 0, sizeof(from));
+      memset(to, 0, sizeof(to));
+      memset(link, 0, sizeof(link));
+      snprintf(from, sizeof(from), "%s%s-%s-%s", staging, config->servers[server].name, backup->label, backup->tablespaces[i]);
+      snprintf(to, sizeof(to), "%s%s/", backup_base, backup->tablespaces[i]);
+      snprintf(link, sizeof(link), "%sdata/pg_tblspc/%s", backup_base, backup->tablespaces_oids[i]);
+
+      if (rename(from, to))
+      {
+         pgmoneta_log_error("Consolidate: Could not move %s to %s", from, to);
+         goto error;
+      }
+
+      // the restore links the tablespaces relative to the restore directory
+      unlink(link);
+
+      if (pgmoneta_symlink_file(link, to))
+      {
+         pgmoneta_log_error("Consolidate: Could not link %s to %s", link, to);
+         goto error;
+      }
+   }
+
+   free(backup_base);
+   free(incremental);
+
+   return 0;
+
+error:
+
+   free(backup_base);
+   free(incremental);
+
+   return 1;
+}
+
+static int
+consolidate_store(int server, char* label)
+{
+   struct workflow* workflow = NULL;
+   struct workflow* current = NULL;
+   struct deque* nodes = NULL;
+   struct backup* backup = NULL;
+
+   if (pgmoneta_deque_create(false, &nodes))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_workflow_nodes(server, label, nodes, &backup))
+   {
+      goto error;
+   }
+
+   workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_CONSOLIDATE, server, backup);
+
+   current = workflow;
+   while (current != NULL)
+   {
+      if (current->setup(server, label, nodes))
+      {
+         goto error;
+      }
+      current = current->next;
+   }
+
+   current = workflow;
+   while (current != NULL)
+   {
+      if (current->execute(server, label, nodes))
+      {
+         goto error;
+      }
+      current = current->next;
+   }
+
+   current = workflow;
+   while (current != NULL)
+   {
+      if (current->teardown(server, label, nodes))
+      {
+         goto error;
+      }
+      current = current->next;
+   }
+
+   pgmoneta_workflow_destroy(workflow);
+   pgmoneta_deque_destroy(nodes);
+   free(backup);
+
+   return 0;
+
+error:
+
+   pgmoneta_workflow_destroy(workflow);
+   pgmoneta_deque_destroy(nodes);
+   free(backup);
+
+   return 1;
+}
@@ -159,7 +159,6 @@ pgmoneta_csv_write(struct csv_writer* writer, int num_col, char** cols)
       }
    }
    fwrite(row, 1, strlen(row), writer->file);
-   fflush(writer->file);
    free(row);
    return 0;
 error:
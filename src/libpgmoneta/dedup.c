@@ -0,0 +1,1049 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <aes.h>
+#include <dedup.h>
+#include <logging.h>
+#include <security.h>
+#include <utils.h>
+#include <workers.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zstd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define DEDUP_HASH_LENGTH 64
+
+/** @struct chunk_buffer
+ * Defines the output buffer of a chunk decryption
+ */
+struct chunk_buffer
+{
+   unsigned char* data; /**< The data */
+   size_t size;         /**< The size of the data */
+   size_t capacity;     /**< The capacity of the buffer */
+};
+
+static char* get_store(int server);
+static char* get_references(int server, char* label);
+static int create_shards(char* directory);
+static bool dedup_candidate(char* name, off_t size);
+static int dedup_directory(char* directory, char* store, char* references, struct workers* workers);
+static int rehydrate_directory(char* directory, char* store, struct workers* workers);
+static void do_dedup_file(struct worker_input* wi);
+static void do_rehydrate_file(struct worker_input* wi);
+static int dedup_file(char* path, char* store, char* references);
+static int rehydrate_file(char* recipe, char* store);
+static int reference_chunk(char* store_path, char* reference_path, void* data, size_t size, bool compress, int encryption);
+static int store_chunk(char* path, void* data, size_t size, bool compress, int encryption);
+static int load_chunk(char* path, char* name, void* data, size_t* size);
+static int hash_chunk(void* data, size_t size, char** hash);
+static int file_output(void* data, size_t size, void* arg);
+static int buffer_output(void* data, size_t size, void* arg);
+
+int
+pgmoneta_dedup_data(int server, char* label, char* directory, struct workers* workers)
+{
+   char* store = NULL;
+   char* references = NULL;
+
+   store = get_store(server);
+   references = get_references(server, label);
+
+   if (create_shards(store) || create_shards(references))
+   {
+      pgmoneta_log_error("Dedup: Could not create %s", references);
+      goto error;
+   }
+
+   if (dedup_directory(directory, store, references, workers))
+   {
+      goto error;
+   }
+
+   free(store);
+   free(references);
+
+   return 0;
+
+error:
+
+   free(store);
+   free(references);
+
+   return 1;
+}
+
+int
+pgmoneta_dedup_tablespaces(int server, char* label, char* root, struct workers* workers)
+{
+   DIR* dir;
+   struct dirent* entry;
+   char path[MAX_PATH];
+
+   if (!(dir = opendir(root)))
+   {
+      return 1;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "data") == 0)
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+
+      if (pgmoneta_is_directory(path))
+      {
+         if (pgmoneta_dedup_data(server, label, path, workers))
+         {
+            closedir(dir);
+            return 1;
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+}
+
+int
+pgmoneta_dedup_rehydrate(int server, char* directory, struct workers* workers)
+{
+   char* store = NULL;
+   int ret;
+
+   store = get_store(server);
+
+   ret = rehydrate_directory(directory, store, workers);
+
+   free(store);
+
+   return ret;
+}
+
+bool
+pgmoneta_dedup_exists(int server, char* label)
+{
+   char* references = NULL;
+   bool exists;
+
+   references = get_references(server, label);
+
+   exists = pgmoneta_exists(references);
+
+   free(references);
+
+   return exists;
+}
+
+int
+pgmoneta_dedup_release(int server, char* label)
+{
+   char* store = NULL;
+   char* references = NULL;
+   char shard[MAX_PATH];
+   char reference_path[MAX_PATH];
+   char store_path[MAX_PATH];
+   unsigned long removed = 0;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   references = get_references(server, label);
+
+   if (!pgmoneta_exists(references))
+   {
+      free(references);
+      return 0;
+   }
+
+   store = get_store(server);
+
+   for (int i = 0; i < 256; i++)
+   {
+      snprintf(shard, sizeof(shard), "%s%02x", references, i);
+
+      if (!(dir = opendir(shard)))
+      {
+         continue;
+      }
+
+      while ((entry = readdir(dir)) != NULL)
+      {
+         snprintf(reference_path, sizeof(reference_path), "%s/%s", shard, entry->d_name);
+
+         if (!pgmoneta_is_file(reference_path))
+         {
+            continue;
+         }
+
+         snprintf(store_path, sizeof(store_path), "%s%02x/%s", store, i, entry->d_name);
+
+         unlink(reference_path);
+
+         /* The link in the store is the last one, so no backup uses the chunk */
+         if (!stat(store_path, &st) && st.st_nlink <= 1)
+         {
+            if (unlink(store_path))
+            {
+               pgmoneta_log_warn("Dedup: Could not remove %s (%s)", store_path, strerror(errno));
+               errno = 0;
+            }
+            else
+            {
+               removed++;
+            }
+         }
+      }
+
+      closedir(dir);
+      dir = NULL;
+   }
+
+   if (pgmoneta_delete_directory(references))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("Dedup: Released %s/%s (Removed chunks: %lu)", config->servers[server].name, label, removed);
+
+   free(store);
+   free(references);
+
+   return 0;
+
+error:
+
+   free(store);
+   free(references);
+
+   return 1;
+}
+
+static char*
+get_store(int server)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "dedup/store/");
+
+   return d;
+}
+
+static char*
+get_references(int server, char* label)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "dedup/backups/");
+   d = pgmoneta_append(d, label);
+   d = pgmoneta_append(d, "/");
+
+   return d;
+}
+
+static int
+create_shards(char* directory)
+{
+   char shard[MAX_PATH];
+
+   for (int i = 0; i < 256; i++)
+   {
+      snprintf(shard, sizeof(shard), "%s%02x", directory, i);
+
+      if (pgmoneta_mkdir(shard))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static bool
+dedup_candidate(char* name, off_t size)
+{
+   /* Files below one chunk gain nothing from the store */
+   if (size < DEDUP_CHUNK_SIZE)
+   {
+      return false;
+   }
+
+   if (pgmoneta_ends_with(name, DEDUP_RECIPE_SUFFIX) ||
+       !strcmp(name, "backup_label") ||
+       !strcmp(name, "backup_manifest") ||
+       !strcmp(name, "pg_control"))
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static int
+dedup_directory(char* directory, char* store, char* references, struct workers* workers)
+{
+   char path[MAX_PATH];
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+
+   if (!(dir = opendir(directory)))
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+      if (lstat(path, &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         if (dedup_directory(path, store, references, workers))
+         {
+            goto error;
+         }
+      }
+      else if (S_ISREG(st.st_mode) && dedup_candidate(entry->d_name, st.st_size))
+      {
+         struct worker_input* wi = NULL;
+
+         if (pgmoneta_create_worker_input(store, path, references, 0, workers, &wi))
+         {
+            goto error;
+         }
+
+         if (workers != NULL)
+         {
+            if (workers->outcome)
+            {
+               pgmoneta_workers_add(workers, do_dedup_file, wi);
+            }
+         }
+         else
+         {
+            int ret = dedup_file(wi->from, wi->directory, wi->to);
+
+            free(wi);
+
+            if (ret)
+            {
+               pgmoneta_log_error("Dedup: Could not deduplicate %s", path);
+               goto error;
+            }
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return 1;
+}
+
+static int
+rehydrate_directory(char* directory, char* store, struct workers* workers)
+{
+   char path[MAX_PATH];
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+
+   if (!(dir = opendir(directory)))
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+      if (lstat(path, &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         if (rehydrate_directory(path, store, workers))
+         {
+            goto error;
+         }
+      }
+      else if (S_ISREG(st.st_mode) && pgmoneta_ends_with(entry->d_name, DEDUP_RECIPE_SUFFIX))
+      {
+         struct worker_input* wi = NULL;
+
+         if (pgmoneta_create_worker_input(store, path, NULL, 0, workers, &wi))
+         {
+            goto error;
+         }
+
+         if (workers != NULL)
+         {
+            if (workers->outcome)
+            {
+               pgmoneta_workers_add(workers, do_rehydrate_file, wi);
+            }
+         }
+         else
+         {
+            int ret = rehydrate_file(wi->from, wi->directory);
+
+            free(wi);
+
+            if (ret)
+            {
+               pgmoneta_log_error("Dedup: Could not rebuild %s", path);
+               goto error;
+            }
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return 1;
+}
+
+static void
+do_dedup_file(struct worker_input* wi)
+{
+   if (dedup_file(wi->from, wi->directory, wi->to))
+   {
+      pgmoneta_log_error("Dedup: Could not deduplicate %s", wi->from);
+
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+
+   free(wi);
+}
+
+static void
+do_rehydrate_file(struct worker_input* wi)
+{
+   if (rehydrate_file(wi->from, wi->directory))
+   {
+      pgmoneta_log_error("Dedup: Could not rebuild %s", wi->from);
+
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+
+   free(wi);
+}
+
+static int
+dedup_file(char* path, char* store, char* references)
+{
+   char recipe_path[MAX_PATH];
+   char name[MISC_LENGTH];
+   char store_path[MAX_PATH];
+   char reference_path[MAX_PATH];
+   unsigned char* chunk = NULL;
+   char* hash = NULL;
+   size_t n;
+   bool compress;
+   int encryption;
+   FILE* in = NULL;
+   FILE* recipe = NULL;
+   struct stat st;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   compress = config->compression_type != COMPRESSION_NONE;
+   encryption = config->encryption;
+
+   snprintf(recipe_path, sizeof(recipe_path), "%s%s", path, DEDUP_RECIPE_SUFFIX);
+
+   chunk = (unsigned char*)malloc(DEDUP_CHUNK_SIZE);
+
+   if (chunk == NULL)
+   {
+      goto error;
+   }
+
+   in = fopen(path, "rb");
+
+   if (in == NULL || fstat(fileno(in), &st))
+   {
+      goto error;
+   }
+
+   recipe = fopen(recipe_path, "w");
+
+   if (recipe == NULL)
+   {
+      goto error;
+   }
+
+   fprintf(recipe, "%s %llu\n", DEDUP_RECIPE_MAGIC, (unsigned long long)st.st_size);
+
+   while ((n = fread(chunk, 1, DEDUP_CHUNK_SIZE, in)) > 0)
+   {
+      if (hash_chunk(chunk, n, &hash))
+      {
+         goto error;
+      }
+
+      snprintf(name, sizeof(name), "%s-%d%s", hash, encryption, compress ? ".zstd" : "");
+      snprintf(store_path, sizeof(store_path), "%s%.2s/%s", store, hash, name);
+      snprintf(reference_path, sizeof(reference_path), "%s%.2s/%s", references, hash, name);
+
+      if (reference_chunk(store_path, reference_path, chunk, n, compress, encryption))
+      {
+         goto error;
+      }
+
+      fprintf(recipe, "%s\n", name);
+
+      free(hash);
+      hash = NULL;
+   }
+
+   if (ferror(in))
+   {
+      goto error;
+   }
+
+   fclose(in);
+   in = NULL;
+
+   if (fclose(recipe))
+   {
+      recipe = NULL;
+      goto error;
+   }
+   recipe = NULL;
+
+   if (unlink(path))
+   {
+      goto error;
+   }
+
+   free(chunk);
+
+   return 0;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (recipe != NULL)
+   {
+      fclose(recipe);
+   }
+
+   if (pgmoneta_exists(recipe_path))
+   {
+      unlink(recipe_path);
+   }
+
+   free(hash);
+   free(chunk);
+
+   return 1;
+}
+
+static int
+rehydrate_file(char* recipe, char* store)
+{
+   char target[MAX_PATH];
+   char line[MISC_LENGTH];
+   char magic[MISC_LENGTH];
+   char store_path[MAX_PATH];
+   unsigned long long expected = 0;
+   unsigned long long total = 0;
+   unsigned char* chunk = NULL;
+   size_t size;
+   size_t length;
+   FILE* in = NULL;
+   FILE* out = NULL;
+
+   memset(target, 0, sizeof(target));
+   memcpy(target, recipe, MIN(strlen(recipe) - strlen(DEDUP_RECIPE_SUFFIX), sizeof(target) - 1));
+
+   chunk = (unsigned char*)malloc(DEDUP_CHUNK_SIZE);
+
+   if (chunk == NULL)
+   {
+      goto error;
+   }
+
+   in = fopen(recipe, "r");
+
+   if (in == NULL)
+   {
+      goto error;
+   }
+
+   if (fgets(line, sizeof(line), in) == NULL ||
+       sscanf(line, "%127s %llu", magic, &expected) != 2 ||
+       strcmp(magic, DEDUP_RECIPE_MAGIC))
+   {
+      pgmoneta_log_error("Dedup: Invalid recipe %s", recipe);
+      goto error;
+   }
+
+   out = fopen(target, "wb");
+
+   if (out == NULL)
+   {
+      goto error;
+   }
+
+   while (fgets(line, sizeof(line), in) != NULL)
+   {
+      length = strcspn(line, "\n");
+      line[length] = '\0';
+
+      if (length == 0)
+      {
+         continue;
+      }
+
+      if (length < DEDUP_HASH_LENGTH)
+      {
+         pgmoneta_log_error("Dedup: Invalid chunk %s in %s", line, recipe);
+         goto error;
+      }
+
+      snprintf(store_path, sizeof(store_path), "%s%.2s/%s", store, line, line);
+
+      if (load_chunk(store_path, line, chunk, &size))
+      {
+         goto error;
+      }
+
+      if (fwrite(chunk, 1, size, out) != size)
+      {
+         goto error;
+      }
+
+      total += size;
+   }
+
+   if (total != expected)
+   {
+      pgmoneta_log_error("Dedup: %s has %llu bytes, expected %llu", target, total, expected);
+      goto error;
+   }
+
+   fclose(in);
+   in = NULL;
+
+   if (fclose(out))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   unlink(recipe);
+
+   free(chunk);
+
+   return 0;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (out != NULL)
+   {
+      fclose(out);
+      unlink(target);
+   }
+
+   free(chunk);
+
+   return 1;
+}
+
+static int
+reference_chunk(char* store_path, char* reference_path, void* data, size_t size, bool compress, int encryption)
+{
+   for (int attempt = 0; attempt < 2; attempt++)
+   {
+      if (!pgmoneta_exists(store_path) && store_chunk(store_path, data, size, compress, encryption))
+      {
+         return 1;
+      }
+
+      if (link(store_path, reference_path) == 0 || errno == EEXIST)
+      {
+         errno = 0;
+         return 0;
+      }
+
+      /* The chunk was collected after the check, so store it again */
+      if (errno != ENOENT)
+      {
+         pgmoneta_log_error("Dedup: Could not link %s (%s)", reference_path, strerror(errno));
+         errno = 0;
+         return 1;
+      }
+
+      errno = 0;
+   }
+
+   return 1;
+}
+
+static int
+store_chunk(char* path, void* data, size_t size, bool compress, int encryption)
+{
+   char tmp[MAX_PATH];
+   void* compressed = NULL;
+   void* output = data;
+   size_t output_size = size;
+   size_t bound;
+   int level;
+   FILE* file = NULL;
+   struct encryptor* encryptor = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   snprintf(tmp, sizeof(tmp), "%s.%d.%lu.tmp", path, getpid(), (unsigned long)pthread_self());
+
+   if (compress)
+   {
+      level = config->compression_level;
+      if (level < 1)
+      {
+         level = 1;
+      }
+      else if (level > ZSTD_maxCLevel())
+      {
+         level = ZSTD_maxCLevel();
+      }
+
+      bound = ZSTD_compressBound(size);
+      compressed = malloc(bound);
+
+      if (compressed == NULL)
+      {
+         goto error;
+      }
+
+      output_size = ZSTD_compress(compressed, bound, data, size, level);
+
+      if (ZSTD_isError(output_size))
+      {
+         pgmoneta_log_error("Dedup: %s", ZSTD_getErrorName(output_size));
+         goto error;
+      }
+
+      output = compressed;
+   }
+
+   file = fopen(tmp, "wb");
+
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (encryption != ENCRYPTION_NONE)
+   {
+      if (pgmoneta_encryptor_create(encryption, true, file_output, file, &encryptor) ||
+          pgmoneta_encryptor_write(encryptor, output, output_size) ||
+          pgmoneta_encryptor_finish(encryptor))
+      {
+         goto error;
+      }
+
+      pgmoneta_encryptor_destroy(encryptor);
+      encryptor = NULL;
+   }
+   else if (fwrite(output, 1, output_size, file) != output_size)
+   {
+      goto error;
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   /* Workers storing the same chunk write the same content */
+   if (rename(tmp, path))
+   {
+      goto error;
+   }
+
+   free(compressed);
+
+   return 0;
+
+error:
+
+   pgmoneta_encryptor_destroy(encryptor);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   unlink(tmp);
+   errno = 0;
+
+   free(compressed);
+
+   return 1;
+}
+
+static int
+load_chunk(char* path, char* name, void* data, size_t* size)
+{
+   unsigned char* content = NULL;
+   size_t content_size;
+   char* hash = NULL;
+   char* separator = NULL;
+   int encryption = ENCRYPTION_NONE;
+   FILE* file = NULL;
+   struct stat st;
+   struct encryptor* encryptor = NULL;
+   struct chunk_buffer plain;
+
+   *size = 0;
+   memset(&plain, 0, sizeof(struct chunk_buffer));
+
+   separator = strchr(name, '-');
+   if (separator != NULL)
+   {
+      encryption = atoi(separator + 1);
+   }
+
+   file = fopen(path, "rb");
+
+   if (file == NULL || fstat(fileno(file), &st))
+   {
+      pgmoneta_log_error("Dedup: Missing chunk %s", path);
+      goto error;
+   }
+
+   content_size = st.st_size;
+   content = (unsigned char*)malloc(content_size + 1);
+
+   if (content == NULL || fread(content, 1, content_size, file) != content_size)
+   {
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (encryption != ENCRYPTION_NONE)
+   {
+      if (pgmoneta_encryptor_create(encryption, false, buffer_output, &plain, &encryptor) ||
+          pgmoneta_encryptor_write(encryptor, content, content_size) ||
+          pgmoneta_encryptor_finish(encryptor))
+      {
+         goto error;
+      }
+
+      pgmoneta_encryptor_destroy(encryptor);
+      encryptor = NULL;
+
+      free(content);
+      content = plain.data;
+      content_size = plain.size;
+      plain.data = NULL;
+   }
+
+   if (pgmoneta_ends_with(name, ".zstd"))
+   {
+      *size = ZSTD_decompress(data, DEDUP_CHUNK_SIZE, content, content_size);
+
+      if (ZSTD_isError(*size))
+      {
+         pgmoneta_log_error("Dedup: %s (%s)", path, ZSTD_getErrorName(*size));
+         goto error;
+      }
+   }
+   else
+   {
+      if (content_size > DEDUP_CHUNK_SIZE)
+      {
+         goto error;
+      }
+
+      memcpy(data, content, content_size);
+      *size = content_size;
+   }
+
+   if (hash_chunk(data, *size, &hash) || strncmp(hash, name, DEDUP_HASH_LENGTH))
+   {
+      pgmoneta_log_error("Dedup: Corrupted chunk %s", path);
+      goto error;
+   }
+
+   free(hash);
+   free(content);
+
+   return 0;
+
+error:
+
+   pgmoneta_encryptor_destroy(encryptor);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(plain.data);
+   free(hash);
+   free(content);
+
+   *size = 0;
+
+   return 1;
+}
+
+static int
+hash_chunk(void* data, size_t size, char** hash)
+{
+   struct hash* h = NULL;
+
+   *hash = NULL;
+
+   if (pgmoneta_hash_create(HASH_ALGORITHM_SHA256, &h) ||
+       pgmoneta_hash_update(h, data, size) ||
+       pgmoneta_hash_final(h, hash))
+   {
+      pgmoneta_hash_destroy(h);
+      return 1;
+   }
+
+   pgmoneta_hash_destroy(h);
+
+   return 0;
+}
+
+static int
+file_output(void* data, size_t size, void* arg)
+{
+   FILE* file = (FILE*)arg;
+
+   return fwrite(data, 1, size, file) != size ? 1 : 0;
+}
+
+static int
+buffer_output(void* data, size_t size, void* arg)
+{
+   struct chunk_buffer* buffer = (struct chunk_buffer*)arg;
+   unsigned char* d = NULL;
+
+   if (buffer->size + size > buffer->capacity)
+   {
+      size_t capacity = MAX(buffer->capacity * 2, buffer->size + size);
+
+      d = (unsigned char*)realloc(buffer->data, capacity);
+
+      if (d == NULL)
+      {
+         return 1;
+      }
+
+      buffer->data = d;
+      buffer->capacity = capacity;
+   }
+
+   memcpy(buffer->data + buffer->size, data, size);
+   buffer->size += size;
+
+   return 0;
+}
@@ -34,6 +34,7 @@
 #include <link.h>
 #include <logging.h>
 #include <utils.h>
+#include <wal.h>
 
 /* system */
 #include <stdatomic.h>
@@ -44,12 +45,13 @@
 /**
  * Delete wal files older than the given srv_wal file under the base directory
  * Base directory could be the wal/ or the wal_shipping directory
+ * @param srv The server index whose segment pool takes the segments, or -1
  * @param srv_wal The oldest wal segment file we would like to keep
  * @param base The base directory holding the wal segments
  * @param backup_index The index of the oldest backup
  */
 static void
-delete_wal_older_than(char* srv_wal, char* base, int backup_index);
+delete_wal_older_than(int srv, char* srv_wal, char* base, int backup_index);
 
 int
 pgmoneta_delete(int srv, char* label)
@@ -161,8 +163,14 @@ pgmoneta_delete_wal(int srv)
    if (number_of_backups == 0 || backup_index == 0)
    {
 
+      /* Staged segments would keep the deleted ones on disk */
+      if (backup_index == -1 || srv_wal != NULL)
+      {
+         pgmoneta_wal_sink_prune(srv, backup_index == -1 ? NULL : srv_wal);
+      }
+
       d = pgmoneta_get_server_wal(srv);
-      delete_wal_older_than(srv_wal, d, backup_index);
+      delete_wal_older_than(srv, srv_wal, d, backup_index);
       free(d);
       d = NULL;
 
@@ -170,7 +178,7 @@ pgmoneta_delete_wal(int srv)
       wal_shipping = pgmoneta_get_server_wal_shipping_wal(srv);
       if (wal_shipping != NULL)
       {
-         delete_wal_older_than(srv_wal, wal_shipping, backup_index);
+         delete_wal_older_than(-1, srv_wal, wal_shipping, backup_index);
       }
 
       free(wal_shipping);
@@ -212,7 +220,7 @@ error:
 }
 
 static void
-delete_wal_older_than(char* srv_wal, char* base, int backup_index)
+delete_wal_older_than(int srv, char* srv_wal, char* base, int backup_index)
 {
    int number_of_wal_files = 0;
    char** wal_files = NULL;
@@ -255,7 +263,10 @@ delete_wal_older_than(char* srv_wal, char* base, int backup_index)
          pgmoneta_log_trace("WAL: Deleting %s", wal_address);
          if (pgmoneta_exists(wal_address))
          {
-            pgmoneta_delete_file(wal_address, NULL);
+            if (srv == -1 || pgmoneta_wal_pool_recycle(srv, wal_address))
+            {
+               pgmoneta_delete_file(wal_address, NULL);
+            }
          }
          else
          {
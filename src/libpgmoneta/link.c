@@ -36,6 +36,8 @@
 
 /* system */
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -43,12 +45,13 @@
 #include <sys/stat.h>
 
 static void do_link(struct worker_input* wi);
+static void do_hard_link(struct worker_input* wi);
 static void do_relink(struct worker_input* wi);
 static void do_comparefiles(struct worker_input* wi);
 static char* trim_suffix(char* str);
 
 int
-pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* changed, struct art* added, struct workers* workers)
+pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* changed, struct art* added, bool hard, struct workers* workers)
 {
    DIR* from_dir = opendir(from);
    char* from_entry = NULL;
@@ -81,7 +84,7 @@ pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* c
       {
          if (S_ISDIR(statbuf.st_mode))
          {
-            pgmoneta_link_manifest(base_from, base_to, from_entry, changed, added, workers);
+            pgmoneta_link_manifest(base_from, base_to, from_entry, changed, added, hard, workers);
          }
          else
          {
@@ -108,9 +111,13 @@ pgmoneta_link_manifest(char* base_from, char* base_to, char* from, struct art* c
                {
                   if (workers->outcome)
                   {
-                     pgmoneta_workers_add(workers, do_link, wi);
+                     pgmoneta_workers_add(workers, hard ? do_hard_link : do_link, wi);
                   }
                }
+               else if (hard)
+               {
+                  do_hard_link(wi);
+               }
                else
                {
                   do_link(wi);
@@ -172,6 +179,31 @@ do_link(struct worker_input* wi)
    free(wi);
 }
 
+static void
+do_hard_link(struct worker_input* wi)
+{
+   char tmp[MAX_PATH];
+
+   memset(tmp, 0, sizeof(tmp));
+   snprintf(tmp, sizeof(tmp), "%s.link", wi->from);
+
+   // the symlinks of the older backup are followed to the stored file, so the
+   // file doesn't depend on the older backup. The file is kept if it can't be linked
+   if (linkat(AT_FDCWD, wi->to, AT_FDCWD, tmp, AT_SYMLINK_FOLLOW))
+   {
+      pgmoneta_log_debug("Unable to link %s to %s", wi->from, wi->to);
+      errno = 0;
+   }
+   else if (rename(tmp, wi->from))
+   {
+      pgmoneta_log_debug("Unable to replace %s", wi->from);
+      unlink(tmp);
+      errno = 0;
+   }
+
+   free(wi);
+}
+
 int
 pgmoneta_relink(char* from, char* to, struct workers* workers)
 {
@@ -33,6 +33,7 @@
 #include <logging.h>
 #include <lz4_compression.h>
 #include <management.h>
+#include <uring.h>
 #include <utils.h>
 #include <workers.h>
 
@@ -606,30 +607,30 @@ static int
 lz4_compress(char* from, char* to)
 {
    LZ4_stream_t* lz4Stream = NULL;
-   FILE* fin = NULL;
-   FILE* fout = NULL;
+   struct uring_file* fin = NULL;
+   struct uring_file* fout = NULL;
    char buffIn[2][BLOCK_BYTES];
    int buffInIndex = 0;
    char buffOut[LZ4_COMPRESSBOUND(BLOCK_BYTES)];
 
    lz4Stream = LZ4_createStream();
-   fin = fopen(from, "rb");
-
-   if (fin == NULL)
+   if (pgmoneta_uring_open_read(from, &fin))
    {
       goto error;
    }
 
-   fout = fopen(to, "wb");
-
-   if (fout == NULL)
+   if (pgmoneta_uring_open_write(to, 0666, &fout))
    {
       goto error;
    }
 
    for (;;)
    {
-      size_t read = fread(buffIn[buffInIndex], sizeof(char), BLOCK_BYTES, fin);
+      ssize_t read = pgmoneta_uring_read(fin, buffIn[buffInIndex], BLOCK_BYTES);
+      if (read < 0)
+      {
+         goto error;
+      }
       if (read == 0)
       {
          break;
@@ -641,14 +642,21 @@ lz4_compress(char* from, char* to)
          break;
       }
 
-      fwrite(&compression, sizeof(compression), 1, fout);
-      fwrite(buffOut, sizeof(char), (size_t)compression, fout);
+      pgmoneta_uring_write(fout, &compression, sizeof(compression));
+      pgmoneta_uring_write(fout, buffOut, (size_t)compression);
 
       buffInIndex = (buffInIndex + 1) % 2;
    }
 
-   fclose(fout);
-   fclose(fin);
+   pgmoneta_uring_close(fin, false);
+   fin = NULL;
+
+   if (pgmoneta_uring_close(fout, false))
+   {
+      fout = NULL;
+      goto error;
+   }
+
    LZ4_freeStream(lz4Stream);
 
    return 0;
@@ -657,12 +665,12 @@ error:
 
    if (fin != NULL)
    {
-      fclose(fin);
+      pgmoneta_uring_close(fin, false);
    }
 
    if (fout != NULL)
    {
-      fclose(fout);
+      pgmoneta_uring_close(fout, false);
    }
 
    return 1;
@@ -673,24 +681,20 @@ lz4_decompress(char* from, char* to)
 {
    LZ4_streamDecode_t lz4StreamDecodeBody;
    LZ4_streamDecode_t* lz4StreamDecode = NULL;
-   FILE* fin = NULL;
-   FILE* fout = NULL;
+   struct uring_file* fin = NULL;
+   struct uring_file* fout = NULL;
    char buffIn[2][BLOCK_BYTES];
    int buffInIndex = 0;
    char buffOut[LZ4_COMPRESSBOUND(BLOCK_BYTES)];
-   size_t read = 0;
+   ssize_t read = 0;
 
    lz4StreamDecode = &lz4StreamDecodeBody;
-   fin = fopen(from, "rb");
-
-   if (fin == NULL)
+   if (pgmoneta_uring_open_read(from, &fin))
    {
       goto error;
    }
 
-   fout = fopen(to, "wb");
-
-   if (fout == NULL)
+   if (pgmoneta_uring_open_write(to, 0666, &fout))
    {
       goto error;
    }
@@ -703,18 +707,26 @@ lz4_decompress(char* from, char* to)
 
       //If return value 1,read bytes == sizeof(int)
       //If return value 0,read bytes  < sizeof(int)
-      read = fread(&compression, 1, sizeof(compression), fin);
+      read = pgmoneta_uring_read(fin, &compression, sizeof(compression));
+      if (read < 0)
+      {
+         goto error;
+      }
       if (read == 0)
       {
          break;
       }
-      if (read < sizeof(compression))
+      if ((size_t)read < sizeof(compression))
       {
          pgmoneta_log_error("lz4_decompression from file compression bytes < sizeof(int)");
          goto error;
       }
 
-      read = fread(buffOut, sizeof(char), compression, fin);
+      read = pgmoneta_uring_read(fin, buffOut, compression);
+      if (read < 0)
+      {
+         goto error;
+      }
       if (read == 0)
       {
          break;
@@ -726,25 +738,31 @@ lz4_decompress(char* from, char* to)
          break;
       }
 
-      fwrite(buffIn[buffInIndex], sizeof(char), decompression, fout);
+      pgmoneta_uring_write(fout, buffIn[buffInIndex], decompression);
 
       buffInIndex = (buffInIndex + 1) % 2;
    }
 
-   fclose(fout);
-   fclose(fin);
+   pgmoneta_uring_close(fin, false);
+   fin = NULL;
+
+   if (pgmoneta_uring_close(fout, false))
+   {
+      fout = NULL;
+      goto error;
+   }
 
    return 0;
 
 error:
    if (fin != NULL)
    {
-      fclose(fin);
+      pgmoneta_uring_close(fin, false);
    }
 
    if (fout != NULL)
    {
-      fclose(fout);
+      pgmoneta_uring_close(fout, false);
    }
 
    return 1;
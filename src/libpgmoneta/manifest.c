@@ -29,7 +29,6 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <csv.h>
-#include <deque.h>
 #include <json.h>
 #include <logging.h>
 #include <manifest.h>
@@ -39,15 +38,25 @@
 /* system */
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
-static void
-build_deque(struct deque* deque, struct csv_reader* reader, char** f);
+static int
+count_rows(char* manifest, uint64_t* rows);
+
+static int
+partition_manifest(char* manifest, char* prefix, int partitions);
+
+static int
+join_partition(char* old_manifest, char* new_manifest, struct art* deleted, struct art* changed, struct art* added, bool* manifest_changed);
 
 static void
-build_tree(struct art* tree, struct csv_reader* reader, char** f);
+remove_partitions(char* prefix, int partitions);
+
+static uint32_t
+path_hash(char* path);
 
 int
-pgmoneta_manifest_checksum_verify(char* root)
+pgmoneta_manifest_checksum_verify(char* root, struct art* checksums)
 {
    char manifest_path[MAX_PATH];
    char* key_path[1] = {"Files"};
@@ -80,6 +89,7 @@ pgmoneta_manifest_checksum_verify(char* root)
       char* hash = NULL;
       char* algorithm = NULL;
       char* checksum = NULL;
+      char* path = NULL;
 
       memset(file_path, 0, MAX_PATH);
       if (pgmoneta_ends_with(root, "/"))
@@ -91,21 +101,30 @@ pgmoneta_manifest_checksum_verify(char* root)
          snprintf(file_path, MAX_PATH, "%s/%s", root, (char*)pgmoneta_json_get(file, "Path"));
       }
 
-      file_size = pgmoneta_get_file_size(file_path);
-      file_size_manifest = (int64_t)pgmoneta_json_get(file, "Size");
-      if (file_size != file_size_manifest)
+      algorithm = (char*)pgmoneta_json_get(file, "Checksum-Algorithm");
+      checksum = (char*)pgmoneta_json_get(file, "Checksum");
+      path = (char*)pgmoneta_json_get(file, "Path");
+
+      if (checksums != NULL && pgmoneta_art_contains_key(checksums, (unsigned char*)path, strlen(path) + 1))
       {
-         pgmoneta_log_error("File size mismatch: %s, getting %lu, should be %lu", file_size, file_size_manifest);
+         hash = pgmoneta_append(NULL, (char*)pgmoneta_art_search(checksums, (unsigned char*)path, strlen(path) + 1));
       }
-
-      algorithm = (char*)pgmoneta_json_get(file, "Checksum-Algorithm");
-      if (pgmoneta_create_file_hash(pgmoneta_get_hash_algorithm(algorithm), file_path, &hash))
+      else
       {
-         pgmoneta_log_error("Unable to generate hash for file %s with algorithm %s", file_path, algorithm);
-         goto error;
+         file_size = pgmoneta_get_file_size(file_path);
+         file_size_manifest = (int64_t)pgmoneta_json_get(file, "Size");
+         if (file_size != file_size_manifest)
+         {
+            pgmoneta_log_error("File size mismatch: %s, getting %lu, should be %lu", file_size, file_size_manifest);
+         }
+
+         if (pgmoneta_create_file_hash(pgmoneta_get_hash_algorithm(algorithm), file_path, &hash))
+         {
+            pgmoneta_log_error("Unable to generate hash for file %s with algorithm %s", file_path, algorithm);
+            goto error;
+         }
       }
 
-      checksum = (char*)pgmoneta_json_get(file, "Checksum");
       if (!pgmoneta_compare_string(hash, checksum))
       {
          pgmoneta_log_error("File checksum mismatch, path: %s. Getting %s, should be %s", file_path, hash, checksum);
@@ -127,239 +146,334 @@ error:
 int
 pgmoneta_compare_manifests(char* old_manifest, char* new_manifest, struct art** deleted_files, struct art** changed_files, struct art** added_files)
 {
-   struct csv_reader* r1 = NULL;
-   char** f1 = NULL;
-   struct csv_reader* r2 = NULL;
-   char** f2 = NULL;
+   uint64_t rows = 0;
+   int partitions = 1;
+   char old_prefix[MAX_PATH];
+   char new_prefix[MAX_PATH];
+   char old_partition[MAX_PATH];
+   char new_partition[MAX_PATH];
+   bool manifest_changed = false;
    struct art* deleted = NULL;
    struct art* changed = NULL;
    struct art* added = NULL;
-   char* checksum = NULL;
-   int cols = 0;
-   bool manifest_changed = false;
-   struct art* tree = NULL;
-   struct deque* que = NULL;
-   struct deque_iterator* iter = NULL;
 
    *deleted_files = NULL;
    *changed_files = NULL;
    *added_files = NULL;
 
-   pgmoneta_deque_create(false, &que);
+   memset(old_prefix, 0, MAX_PATH);
+   memset(new_prefix, 0, MAX_PATH);
 
    pgmoneta_art_create(&deleted);
    pgmoneta_art_create(&added);
    pgmoneta_art_create(&changed);
 
-   if (pgmoneta_csv_reader_init(old_manifest, &r1))
+   if (count_rows(old_manifest, &rows))
    {
       goto error;
    }
 
-   if (pgmoneta_csv_reader_init(new_manifest, &r2))
+   if (rows <= MANIFEST_PARTITION_SIZE)
    {
-      goto error;
+      if (join_partition(old_manifest, new_manifest, deleted, changed, added, &manifest_changed))
+      {
+         goto error;
+      }
    }
-
-   while (pgmoneta_csv_next_row(r1, &cols, &f1))
+   else
    {
-      if (cols != MANIFEST_COLUMN_COUNT)
+      // hash partition both sides so that each partition of the old manifest fits in memory
+      partitions = (int)(rows / MANIFEST_PARTITION_SIZE) + 1;
+
+      snprintf(old_prefix, MAX_PATH, "%s.%d.old", new_manifest, getpid());
+      snprintf(new_prefix, MAX_PATH, "%s.%d.new", new_manifest, getpid());
+
+      if (partition_manifest(old_manifest, old_prefix, partitions))
       {
-         pgmoneta_log_error("Incorrect number of columns in manifest file");
-         free(f1);
-         continue;
+         goto error;
       }
-      // build left chunk into a deque
-      build_deque(que, r1, f1);
-      while (pgmoneta_csv_next_row(r2, &cols, &f2))
+
+      if (partition_manifest(new_manifest, new_prefix, partitions))
       {
-         if (cols != MANIFEST_COLUMN_COUNT)
-         {
-            pgmoneta_log_error("Incorrect number of columns in manifest file");
-            free(f2);
-            continue;
-         }
-         // build every right chunk into an ART
-         pgmoneta_art_create(&tree);
-         build_tree(tree, r2, f2);
-         pgmoneta_deque_iterator_create(que, &iter);
-         while (pgmoneta_deque_iterator_next(iter))
-         {
-            checksum = (char*)pgmoneta_art_search(tree, (unsigned char*)iter->tag, strlen(iter->tag) + 1);
-            if (checksum != NULL)
-            {
-               if (!strcmp((char*)pgmoneta_value_data(iter->value), checksum))
-               {
-                  // not changed but not deleted, remove the entry
-                  pgmoneta_deque_iterator_remove(iter);
-               }
-               else
-               {
-                  // file is changed
-                  manifest_changed = true;
-                  pgmoneta_art_insert(changed, (unsigned char*)iter->tag, strlen(iter->tag) + 1, pgmoneta_value_data(iter->value), ValueString);
-                  // changed but not deleted, remove the entry
-                  pgmoneta_deque_iterator_remove(iter);
-               }
-            }
-         }
-         pgmoneta_art_destroy(tree);
-         tree = NULL;
+         goto error;
       }
-      pgmoneta_deque_iterator_destroy(iter);
-      iter = NULL;
 
-      // traverse
-      while (!pgmoneta_deque_empty(que))
+      for (int i = 0; i < partitions; i++)
       {
-         char* tag = NULL;
-         uintptr_t val = 0;
-         manifest_changed = true;
-         val = pgmoneta_deque_poll(que, &tag);
-         pgmoneta_art_insert(deleted, (unsigned char*)tag, strlen(tag) + 1, val, ValueString);
-         free(tag);
-         free((void*)val);
+         snprintf(old_partition, MAX_PATH, "%s.%d", old_prefix, i);
+         snprintf(new_partition, MAX_PATH, "%s.%d", new_prefix, i);
+
+         if (join_partition(old_partition, new_partition, deleted, changed, added, &manifest_changed))
+         {
+            goto error;
+         }
       }
-      // reset right reader for the next left chunk
-      if (pgmoneta_csv_reader_reset(r2))
+
+      remove_partitions(old_prefix, partitions);
+      remove_partitions(new_prefix, partitions);
+   }
+
+   if (manifest_changed)
+   {
+      pgmoneta_art_insert(changed, (unsigned char*)"backup_manifest", strlen("backup_manifest") + 1, (uintptr_t)"backup manifest", ValueString);
+   }
+
+   *deleted_files = deleted;
+   *changed_files = changed;
+   *added_files = added;
+
+   return 0;
+
+error:
+   if (strlen(old_prefix) > 0)
+   {
+      remove_partitions(old_prefix, partitions);
+      remove_partitions(new_prefix, partitions);
+   }
+
+   pgmoneta_art_destroy(deleted);
+   pgmoneta_art_destroy(changed);
+   pgmoneta_art_destroy(added);
+
+   return 1;
+}
+
+static int
+count_rows(char* manifest, uint64_t* rows)
+{
+   struct csv_reader* reader = NULL;
+   char** f = NULL;
+   int cols = 0;
+
+   *rows = 0;
+
+   if (pgmoneta_csv_reader_init(manifest, &reader))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_csv_next_row(reader, &cols, &f))
+   {
+      (*rows)++;
+      free(f);
+      f = NULL;
+   }
+
+   pgmoneta_csv_reader_destroy(reader);
+
+   return 0;
+
+error:
+   pgmoneta_csv_reader_destroy(reader);
+
+   return 1;
+}
+
+static int
+partition_manifest(char* manifest, char* prefix, int partitions)
+{
+   struct csv_reader* reader = NULL;
+   struct csv_writer** writers = NULL;
+   char path[MAX_PATH];
+   char** f = NULL;
+   int cols = 0;
+   int partition = 0;
+
+   writers = (struct csv_writer**)calloc(partitions, sizeof(struct csv_writer*));
+   if (writers == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < partitions; i++)
+   {
+      memset(path, 0, MAX_PATH);
+      snprintf(path, MAX_PATH, "%s.%d", prefix, i);
+
+      if (pgmoneta_csv_writer_init(path, &writers[i]))
       {
+         pgmoneta_log_error("Could not create csv writer for %s", path);
          goto error;
       }
    }
-   if (pgmoneta_csv_reader_reset(r1))
+
+   if (pgmoneta_csv_reader_init(manifest, &reader))
    {
       goto error;
    }
 
-   while (pgmoneta_csv_next_row(r2, &cols, &f2))
+   while (pgmoneta_csv_next_row(reader, &cols, &f))
    {
       if (cols != MANIFEST_COLUMN_COUNT)
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
-         free(f2);
+         free(f);
+         f = NULL;
          continue;
       }
-      build_deque(que, r2, f2);
-      while (pgmoneta_csv_next_row(r1, &cols, &f1))
-      {
-         if (cols != MANIFEST_COLUMN_COUNT)
-         {
-            pgmoneta_log_error("Incorrect number of columns in manifest file");
-            free(f1);
-            continue;
-         }
-         pgmoneta_art_create(&tree);
-         build_tree(tree, r1, f1);
-         pgmoneta_deque_iterator_create(que, &iter);
-         while (pgmoneta_deque_iterator_next(iter))
-         {
-            checksum = (char*)pgmoneta_art_search(tree, (unsigned char*)iter->tag, strlen(iter->tag) + 1);
-            if (checksum != NULL)
-            {
-               // the entry is not new, remove it
-               pgmoneta_deque_iterator_remove(iter);
-            }
-         }
-         pgmoneta_art_destroy(tree);
-         tree = NULL;
-      }
-      pgmoneta_deque_iterator_destroy(iter);
-      iter = NULL;
 
-      while (!pgmoneta_deque_empty(que))
-      {
-         char* tag = NULL;
-         uintptr_t val = 0;
-         manifest_changed = true;
-         val = pgmoneta_deque_poll(que, &tag);
-         pgmoneta_art_insert(added, (unsigned char*)tag, strlen(tag) + 1, val, ValueString);
-         free(tag);
-         free((void*)val);
-      }
-      if (pgmoneta_csv_reader_reset(r1))
+      partition = (int)(path_hash(f[MANIFEST_PATH_INDEX]) % (uint32_t)partitions);
+
+      if (pgmoneta_csv_write(writers[partition], MANIFEST_COLUMN_COUNT, f))
       {
          goto error;
       }
+
+      free(f);
+      f = NULL;
    }
 
-   if (manifest_changed)
+   pgmoneta_csv_reader_destroy(reader);
+   for (int i = 0; i < partitions; i++)
    {
-      pgmoneta_art_insert(changed, (unsigned char*)"backup_manifest", strlen("backup_manifest") + 1, (uintptr_t)"backup manifest", ValueString);
+      pgmoneta_csv_writer_destroy(writers[i]);
    }
-
-   *deleted_files = deleted;
-   *changed_files = changed;
-   *added_files = added;
-
-   pgmoneta_csv_reader_destroy(r1);
-   pgmoneta_csv_reader_destroy(r2);
-   pgmoneta_art_destroy(tree);
-   pgmoneta_deque_destroy(que);
+   free(writers);
 
    return 0;
+
 error:
-   pgmoneta_deque_iterator_destroy(iter);
-   pgmoneta_csv_reader_destroy(r1);
-   pgmoneta_csv_reader_destroy(r2);
-   pgmoneta_art_destroy(tree);
-   pgmoneta_deque_destroy(que);
+   free(f);
+   pgmoneta_csv_reader_destroy(reader);
+   if (writers != NULL)
+   {
+      for (int i = 0; i < partitions; i++)
+      {
+         pgmoneta_csv_writer_destroy(writers[i]);
+      }
+   }
+   free(writers);
+
    return 1;
 }
 
-static void
-build_deque(struct deque* deque, struct csv_reader* reader, char** f)
+static int
+join_partition(char* old_manifest, char* new_manifest, struct art* deleted, struct art* changed, struct art* added, bool* manifest_changed)
 {
-   char** entry = NULL;
+   struct csv_reader* reader = NULL;
+   struct art* index = NULL;
+   struct art_iterator* iter = NULL;
+   char** f = NULL;
    char* path = NULL;
    char* checksum = NULL;
+   char* old_checksum = NULL;
    int cols = 0;
-   if (deque == NULL)
+
+   pgmoneta_art_create(&index);
+
+   // build the index over the old side
+   if (pgmoneta_csv_reader_init(old_manifest, &reader))
    {
-      return;
+      goto error;
    }
-   path = f[MANIFEST_PATH_INDEX];
-   checksum = f[MANIFEST_CHECKSUM_INDEX];
-   pgmoneta_deque_add(deque, path, (uintptr_t)checksum, ValueString);
-   free(f);
-   while (deque->size < MANIFEST_CHUNK_SIZE && pgmoneta_csv_next_row(reader, &cols, &entry))
+
+   while (pgmoneta_csv_next_row(reader, &cols, &f))
    {
       if (cols != MANIFEST_COLUMN_COUNT)
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
-         free(entry);
+         free(f);
+         f = NULL;
          continue;
       }
-      path = entry[MANIFEST_PATH_INDEX];
-      checksum = entry[MANIFEST_CHECKSUM_INDEX];
-      pgmoneta_deque_add(deque, path, (uintptr_t)checksum, ValueString);
-      free(entry);
-      entry = NULL;
+
+      path = f[MANIFEST_PATH_INDEX];
+      pgmoneta_art_insert(index, (unsigned char*)path, strlen(path) + 1, (uintptr_t)f[MANIFEST_CHECKSUM_INDEX], ValueString);
+
+      free(f);
+      f = NULL;
    }
-}
 
-static void
-build_tree(struct art* tree, struct csv_reader* reader, char** f)
-{
-   char** entry = NULL;
-   char* path = NULL;
-   int cols = 0;
-   if (tree == NULL)
+   pgmoneta_csv_reader_destroy(reader);
+   reader = NULL;
+
+   // probe it with the new side
+   if (pgmoneta_csv_reader_init(new_manifest, &reader))
    {
-      return;
+      goto error;
    }
-   path = f[MANIFEST_PATH_INDEX];
-   pgmoneta_art_insert(tree, (unsigned char*)path, strlen(path) + 1, (uintptr_t)f[MANIFEST_CHECKSUM_INDEX], ValueString);
-   free(f);
-   while (tree->size < MANIFEST_CHUNK_SIZE && pgmoneta_csv_next_row(reader, &cols, &entry))
+
+   while (pgmoneta_csv_next_row(reader, &cols, &f))
    {
       if (cols != MANIFEST_COLUMN_COUNT)
       {
          pgmoneta_log_error("Incorrect number of columns in manifest file");
-         free(entry);
+         free(f);
+         f = NULL;
          continue;
       }
-      path = entry[MANIFEST_PATH_INDEX];
-      pgmoneta_art_insert(tree, (unsigned char*)path, strlen(path) + 1, (uintptr_t)entry[MANIFEST_CHECKSUM_INDEX], ValueString);
-      free(entry);
+
+      path = f[MANIFEST_PATH_INDEX];
+      checksum = f[MANIFEST_CHECKSUM_INDEX];
+      old_checksum = (char*)pgmoneta_art_search(index, (unsigned char*)path, strlen(path) + 1);
+
+      if (old_checksum == NULL)
+      {
+         *manifest_changed = true;
+         pgmoneta_art_insert(added, (unsigned char*)path, strlen(path) + 1, (uintptr_t)checksum, ValueString);
+      }
+      else
+      {
+         if (strcmp(old_checksum, checksum))
+         {
+            *manifest_changed = true;
+            pgmoneta_art_insert(changed, (unsigned char*)path, strlen(path) + 1, (uintptr_t)old_checksum, ValueString);
+         }
+         // whatever is left in the index afterwards has been deleted
+         pgmoneta_art_delete(index, (unsigned char*)path, strlen(path) + 1);
+      }
+
+      free(f);
+      f = NULL;
+   }
+
+   pgmoneta_csv_reader_destroy(reader);
+   reader = NULL;
+
+   pgmoneta_art_iterator_create(index, &iter);
+   while (pgmoneta_art_iterator_next(iter))
+   {
+      *manifest_changed = true;
+      pgmoneta_art_insert(deleted, iter->key, strlen((char*)iter->key) + 1, pgmoneta_value_data(iter->value), ValueString);
+   }
+   pgmoneta_art_iterator_destroy(iter);
+
+   pgmoneta_art_destroy(index);
+
+   return 0;
+
+error:
+   free(f);
+   pgmoneta_csv_reader_destroy(reader);
+   pgmoneta_art_destroy(index);
+
+   return 1;
+}
+
+static void
+remove_partitions(char* prefix, int partitions)
+{
+   char path[MAX_PATH];
+
+   for (int i = 0; i < partitions; i++)
+   {
+      memset(path, 0, MAX_PATH);
+      snprintf(path, MAX_PATH, "%s.%d", prefix, i);
+      unlink(path);
+   }
+}
+
+static uint32_t
+path_hash(char* path)
+{
+   uint32_t hash = 2166136261u;
+
+   // FNV-1a
+   for (unsigned char* p = (unsigned char*)path; *p != '\0'; p++)
+   {
+      hash ^= *p;
+      hash *= 16777619u;
    }
+
+   return hash;
 }
@@ -29,12 +29,15 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <achv.h>
+#include <art.h>
+#include <compression.h>
 #include <extension.h>
 #include <logging.h>
 #include <manifest.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
+#include <ring.h>
 #include <security.h>
 #include <utils.h>
 
@@ -61,6 +64,9 @@ static int get_number_of_columns(struct message* msg);
 static int get_column_name(struct message* msg, int index, char** name);
 
 static bool is_server_side_compression(void);
+static int create_tar_stream(int server, char* directory, struct tablespace* tablespace, struct art* checksums, struct tar_stream** stream);
+static int ring_tar_stream(void* data, size_t size, void* arg);
+static int ring_file(void* data, size_t size, void* arg);
 
 static unsigned char* decode_base64(const char* base64_data, int* decoded_len);
 static char** get_paths(const char* data, int* count);
@@ -1378,6 +1384,62 @@ is_server_side_compression(void)
    return config->compression_type == COMPRESSION_SERVER_GZIP || config->compression_type == COMPRESSION_SERVER_LZ4 || config->compression_type == COMPRESSION_SERVER_ZSTD;
 }
 
+static int
+create_tar_stream(int server, char* directory, struct tablespace* tablespace, struct art* checksums, struct tar_stream** stream)
+{
+   char prefix[MAX_PATH];
+   int hash;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (pgmoneta_tar_stream_create(directory, stream))
+   {
+      pgmoneta_log_error("Could not extract archive into %s", directory);
+      return 1;
+   }
+
+   if (checksums != NULL)
+   {
+      // the checksums are keyed by the path in the manifest
+      memset(prefix, 0, sizeof(prefix));
+      if (tablespace != NULL)
+      {
+         snprintf(prefix, sizeof(prefix), "pg_tblspc/%d/", tablespace->oid);
+      }
+
+      hash = config->servers[server].manifest;
+      if (hash == HASH_ALGORITHM_DEFAULT)
+      {
+         hash = config->manifest;
+      }
+
+      if (pgmoneta_tar_stream_compress(*stream, config->compression_type, config->compression_level, hash, prefix, checksums))
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static int
+ring_tar_stream(void* data, size_t size, void* arg)
+{
+   return pgmoneta_tar_stream_write((struct tar_stream*)arg, data, size);
+}
+
+static int
+ring_file(void* data, size_t size, void* arg)
+{
+   if (fwrite(data, size, 1, (FILE*)arg) != 1)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
 static int
 create_D_tuple(int number_of_columns, struct message* msg, struct tuple** tuple)
 {
@@ -2270,18 +2332,29 @@ error:
 }
 
 int
-pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket)
+pgmoneta_receive_archive_files(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces,
+                               struct token_bucket* bucket, struct token_bucket* network_bucket, unsigned long* size, unsigned long* biggest_file)
 {
    char directory[MAX_PATH];
    char link_path[MAX_PATH];
    char null_buffer[2 * 512]; // 2 tar block size of terminator null bytes
    FILE* file = NULL;
+   struct tar_stream* stream = NULL;
+   struct art* checksums = NULL;
    struct query_response* response = NULL;
    struct message* msg = (struct message*)malloc(sizeof (struct message));
    struct tuple* tup = NULL;
 
    memset(msg, 0, sizeof (struct message));
 
+   *size = 0;
+   *biggest_file = 0;
+
+   if (!is_server_side_compression() && pgmoneta_compression_inline(server))
+   {
+      pgmoneta_art_create(&checksums);
+   }
+
    // Receive the second result set
    if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
    {
@@ -2292,6 +2365,7 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
    {
       char file_path[MAX_PATH];
       char directory[MAX_PATH];
+      struct tablespace* tblspc = NULL;
       memset(file_path, 0, sizeof(file_path));
       memset(directory, 0, sizeof(directory));
       if (tup->data[1] == NULL)
@@ -2311,7 +2385,7 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
       else
       {
          // user level tablespace
-         struct tablespace* tblspc = tablespaces;
+         tblspc = tablespaces;
          while (tblspc != NULL)
          {
             if (pgmoneta_compare_string(tup->data[1], tblspc->path))
@@ -2333,10 +2407,17 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
          }
       }
       pgmoneta_mkdir(directory);
-      file = fopen(file_path, "wb");
-      if (file == NULL)
+      if (is_server_side_compression())
+      {
+         file = fopen(file_path, "wb");
+         if (file == NULL)
+         {
+            pgmoneta_log_error("Could not create archive tar file");
+            goto error;
+         }
+      }
+      else if (create_tar_stream(server, directory, tblspc, checksums, &stream))
       {
-         pgmoneta_log_error("Could not create archive tar file");
          goto error;
       }
       // get the copy out response
@@ -2347,8 +2428,6 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
          {
             pgmoneta_log_copyfail_message(msg);
             pgmoneta_log_error_response_message(msg);
-            fflush(file);
-            fclose(file);
             goto error;
          }
          pgmoneta_consume_copy_stream_end(buffer, msg);
@@ -2360,8 +2439,6 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
          {
             pgmoneta_log_copyfail_message(msg);
             pgmoneta_log_error_response_message(msg);
-            fflush(file);
-            fclose(file);
             goto error;
          }
 
@@ -2383,32 +2460,54 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
                }
             }
 
-            // copy data
-            if (fwrite(msg->data, msg->length, 1, file) != 1)
+            // extract data
+            if (stream != NULL)
+            {
+               if (pgmoneta_tar_stream_write(stream, msg->data, msg->length))
+               {
+                  pgmoneta_log_error("could not extract archive into %s", directory);
+                  goto error;
+               }
+            }
+            else if (fwrite(msg->data, msg->length, 1, file) != 1)
             {
                pgmoneta_log_error("could not write to file %s", file_path);
-               fflush(file);
-               fclose(file);
                goto error;
             }
          }
          pgmoneta_consume_copy_stream_end(buffer, msg);
       }
-      //append two blocks of null bytes to the end of the tar file
-      memset(null_buffer, 0, 2 * 512);
-      if (fwrite(null_buffer, 2 * 512, 1, file) != 1)
+      if (stream != NULL)
       {
-         pgmoneta_log_error("could not write to file %s", file_path);
+         if (pgmoneta_tar_stream_finish(stream))
+         {
+            goto error;
+         }
+         if (tblspc == NULL)
+         {
+            *size += stream->size;
+            *biggest_file = MAX(*biggest_file, stream->biggest_file);
+         }
+         pgmoneta_tar_stream_destroy(stream);
+         stream = NULL;
+      }
+      else
+      {
+         //append two blocks of null bytes to the end of the tar file
+         memset(null_buffer, 0, 2 * 512);
+         if (fwrite(null_buffer, 2 * 512, 1, file) != 1)
+         {
+            pgmoneta_log_error("could not write to file %s", file_path);
+            goto error;
+         }
          fflush(file);
          fclose(file);
-         goto error;
-      }
-      fflush(file);
-      fclose(file);
+         file = NULL;
 
-      // extract the file
-      pgmoneta_extract_tar_file(file_path, directory);
-      remove(file_path);
+         // extract the file
+         pgmoneta_extract_tar_file(file_path, directory);
+         remove(file_path);
+      }
       pgmoneta_free_message(msg);
 
       msg = NULL;
@@ -2454,12 +2553,13 @@ pgmoneta_receive_archive_files(SSL* ssl, int socket, struct stream_buffer* buffe
       snprintf(directory, sizeof(directory), "%s/data", basedir);
    }
 
-   if (pgmoneta_manifest_checksum_verify(directory))
+   if (pgmoneta_manifest_checksum_verify(directory, checksums))
    {
       pgmoneta_log_error("Manifest verification failed");
       goto error;
    }
 
+   pgmoneta_art_destroy(checksums);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 0;
@@ -2470,19 +2570,26 @@ error:
    {
       pgmoneta_disconnect(socket);
    }
+   if (file != NULL)
+   {
+      fflush(file);
+      fclose(file);
+   }
+   pgmoneta_tar_stream_destroy(stream);
+   pgmoneta_art_destroy(checksums);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 1;
 }
 
 int
-pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces, struct token_bucket* bucket, struct token_bucket* network_bucket)
+pgmoneta_receive_archive_stream(int server, SSL* ssl, int socket, struct stream_buffer* buffer, char* basedir, struct tablespace* tablespaces,
+                                struct token_bucket* bucket, struct token_bucket* network_bucket, unsigned long* size, unsigned long* biggest_file)
 {
    struct query_response* response = NULL;
    struct message* msg = (struct message*)malloc(sizeof (struct message));
    struct tuple* tup = NULL;
    struct tablespace* tblspc = NULL;
-   char null_buffer[2 * 512];
    char file_path[MAX_PATH];
    char directory[MAX_PATH];
    char link_path[MAX_PATH];
@@ -2493,9 +2600,14 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
    memset(link_path, 0, sizeof(link_path));
    memset(manifest_file_path, 0, sizeof(manifest_file_path));
    memset(tmp_manifest_file_path, 0, sizeof(tmp_manifest_file_path));
-   memset(null_buffer, 0, 2 * 512);
    char type;
    FILE* file = NULL;
+   struct tar_stream* stream = NULL;
+   struct art* checksums = NULL;
+   struct ring* ring = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    if (msg == NULL)
    {
@@ -2504,6 +2616,20 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
 
    memset(msg, 0, sizeof(struct message));
 
+   *size = 0;
+   *biggest_file = 0;
+
+   if (!is_server_side_compression() && pgmoneta_compression_inline(server))
+   {
+      pgmoneta_art_create(&checksums);
+   }
+
+   // the disk writes happen on a dedicated thread, so they overlap with the network reads
+   if (pgmoneta_ring_create(&config->servers[server].backup_queue_depth, &ring))
+   {
+      goto error;
+   }
+
    // Receive the second result set
    if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
    {
@@ -2537,17 +2663,28 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
          {
             case 'n':
             {
-               // append two blocks of null buffer and extract the tar file
-               if (file != NULL)
+               // finish off the previous archive
+               if (pgmoneta_ring_flush(ring))
                {
-                  if ((!is_server_side_compression()) && fwrite(null_buffer, 2 * 512, 1, file) != 1)
+                  pgmoneta_log_error("could not extract archive into %s", directory);
+                  goto error;
+               }
+               if (stream != NULL)
+               {
+                  if (pgmoneta_tar_stream_finish(stream))
                   {
-                     pgmoneta_log_error("could not write to file %s", file_path);
-                     fflush(file);
-                     fclose(file);
-                     file = NULL;
                      goto error;
                   }
+                  if (tup->data[1] == NULL)
+                  {
+                     *size += stream->size;
+                     *biggest_file = MAX(*biggest_file, stream->biggest_file);
+                  }
+                  pgmoneta_tar_stream_destroy(stream);
+                  stream = NULL;
+               }
+               else if (file != NULL)
+               {
                   fflush(file);
                   fclose(file);
                   file = NULL;
@@ -2573,6 +2710,7 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
                if (tup->data[1] == NULL)
                {
                   // main data directory
+                  tblspc = NULL;
                   if (pgmoneta_ends_with(basedir, "/"))
                   {
                      snprintf(file_path, sizeof(file_path), "%sdata/%s", basedir, "base.tar");
@@ -2609,10 +2747,17 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
                   }
                }
                pgmoneta_mkdir(directory);
-               file = fopen(file_path, "wb");
-               if (file == NULL)
+               if (is_server_side_compression())
+               {
+                  file = fopen(file_path, "wb");
+                  if (file == NULL)
+                  {
+                     pgmoneta_log_error("Could not create archive tar file");
+                     goto error;
+                  }
+               }
+               else if (create_tar_stream(server, directory, tblspc, checksums, &stream))
                {
-                  pgmoneta_log_error("Could not create archive tar file");
                   goto error;
                }
                break;
@@ -2620,16 +2765,27 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
             case 'm':
             {
                // start of manifest, finish off previous data archive receiving
-               if (file != NULL)
+               if (pgmoneta_ring_flush(ring))
+               {
+                  pgmoneta_log_error("could not extract archive into %s", directory);
+                  goto error;
+               }
+               if (stream != NULL)
                {
-                  if ((!is_server_side_compression()) && fwrite(null_buffer, 2 * 512, 1, file) != 1)
+                  if (pgmoneta_tar_stream_finish(stream))
                   {
-                     pgmoneta_log_error("could not write to file %s", file_path);
-                     fflush(file);
-                     fclose(file);
-                     file = NULL;
                      goto error;
                   }
+                  if (tup->data[1] == NULL)
+                  {
+                     *size += stream->size;
+                     *biggest_file = MAX(*biggest_file, stream->biggest_file);
+                  }
+                  pgmoneta_tar_stream_destroy(stream);
+                  stream = NULL;
+               }
+               else if (file != NULL)
+               {
                   fflush(file);
                   fclose(file);
                   file = NULL;
@@ -2672,7 +2828,15 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
                   }
                }
 
-               if (fwrite(msg->data + 1, msg->length - 1, 1, file) != 1)
+               if (stream != NULL)
+               {
+                  if (pgmoneta_ring_write(ring, msg->data + 1, msg->length - 1, &ring_tar_stream, stream))
+                  {
+                     pgmoneta_log_error("could not extract archive into %s", directory);
+                     goto error;
+                  }
+               }
+               else if (file == NULL || pgmoneta_ring_write(ring, msg->data + 1, msg->length - 1, &ring_file, file))
                {
                   pgmoneta_log_error("could not write to file %s", file_path);
                   goto error;
@@ -2695,6 +2859,14 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
       pgmoneta_consume_copy_stream_end(buffer, msg);
    }
 
+   if (pgmoneta_ring_flush(ring))
+   {
+      pgmoneta_log_error("could not write to file %s", tmp_manifest_file_path);
+      goto error;
+   }
+   pgmoneta_ring_destroy(ring);
+   ring = NULL;
+
    if (file != NULL)
    {
       if (rename(tmp_manifest_file_path, manifest_file_path) != 0)
@@ -2740,17 +2912,19 @@ pgmoneta_receive_archive_stream(SSL* ssl, int socket, struct stream_buffer* buff
    {
       snprintf(dir, sizeof(dir), "%s/data", basedir);
    }
-   if (pgmoneta_manifest_checksum_verify(dir))
+   if (pgmoneta_manifest_checksum_verify(dir, checksums))
    {
       pgmoneta_log_error("Manifest verification failed");
       goto error;
    }
 
+   pgmoneta_art_destroy(checksums);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 0;
 
 error:
+   pgmoneta_ring_destroy(ring);
    pgmoneta_close_ssl(ssl);
    if (socket != -1)
    {
@@ -2761,6 +2935,8 @@ error:
       fflush(file);
       fclose(file);
    }
+   pgmoneta_tar_stream_destroy(stream);
+   pgmoneta_art_destroy(checksums);
    pgmoneta_free_query_response(response);
    pgmoneta_free_message(msg);
    return 1;
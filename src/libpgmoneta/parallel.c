@@ -0,0 +1,1943 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <art.h>
+#include <backup.h>
+#include <info.h>
+#include <json.h>
+#include <logging.h>
+#include <memory.h>
+#include <message.h>
+#include <network.h>
+#include <parallel.h>
+#include <security.h>
+#include <tablespace.h>
+#include <utils.h>
+#include <walsummary.h>
+#include <walfile/wal_reader.h>
+#include <workers.h>
+
+/* system */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PARALLEL_CHUNK_SIZE (1024 * 1024)
+
+/** @struct parallel_file
+ * Defines a file, or directory, of the data directory
+ */
+struct parallel_file
+{
+   char* path;          /**< The path relative to the data directory */
+   bool directory;      /**< Is the path a directory */
+   unsigned long size;  /**< The size when listed */
+   char modified[32];   /**< The modification time in GMT */
+   int worker;          /**< The worker fetching the file */
+};
+
+/** @struct parallel_incremental
+ * Defines what an incremental backup needs from its parent
+ */
+struct parallel_incremental
+{
+   uint64_t start_lsn;            /**< The start position of the parent */
+   uint32_t timeline;             /**< The timeline of the parent */
+   struct wal_summary* summary;   /**< The block references since the parent */
+   struct art* files;             /**< The files of the parent */
+};
+
+/* Directories whose content isn't part of a backup, like pg_basebackup */
+static char* excluded_directories[] = {
+   "pg_wal",
+   "pg_replslot",
+   "pg_dynshmem",
+   "pg_notify",
+   "pg_serial",
+   "pg_snapshots",
+   "pg_stat_tmp",
+   "pg_subtrans",
+   NULL
+};
+
+/* Files which aren't part of a backup, like pg_basebackup */
+static char* excluded_files[] = {
+   "postmaster.pid",
+   "postmaster.opts",
+   "pg_internal.init",
+   "backup_label",
+   "backup_label.old",
+   "tablespace_map",
+   "backup_manifest",
+   "postgresql.auto.conf.tmp",
+   "current_logfiles.tmp",
+   NULL
+};
+
+static int parallel_query(SSL* ssl, int socket, char* query, struct query_response** response);
+static int parallel_timeline(SSL* ssl, int socket, uint32_t* timeline);
+static int parallel_privileged(SSL* ssl, int socket, bool* privileged);
+static int parallel_list(SSL* ssl, int socket, struct parallel_file** files, int* number_of_files);
+static bool parallel_excluded(char* path);
+static int parallel_unlogged(struct parallel_file* files, int number_of_files, struct art** unlogged);
+static bool parallel_unlogged_file(struct art* unlogged, char* path);
+static void parallel_relation_key(uint32_t spcoid, uint32_t dboid, uint32_t relnumber, char* key, size_t size);
+static int parallel_compare(const void* a, const void* b);
+static char* parallel_destination(char* backup_base, struct tablespace* tablespaces, char* path);
+static char* parallel_result_path(char* backup_base, int worker);
+static int parallel_worker(int server, int usr, int worker, int number_of_workers, struct parallel_file* files, int number_of_files,
+                           char* backup_base, struct tablespace* tablespaces, int hash, struct parallel_incremental* incremental);
+static int parallel_fetch(SSL* ssl, int socket, char* path, char* destination, int hash, struct token_bucket* bucket,
+                          struct token_bucket* network_bucket,
+                          unsigned long* size, char** checksum);
+static int parallel_fetch_incremental(int server, SSL* ssl, int socket, struct parallel_incremental* incremental, struct parallel_file* file,
+                                      char* destination, int hash, struct token_bucket* bucket,
+                                      struct token_bucket* network_bucket, bool* fetched,
+                                      unsigned long* size, char** checksum);
+static int parallel_read(SSL* ssl, int socket, char* escaped, unsigned long offset, size_t length, unsigned char* buffer,
+                         size_t* read, bool* removed);
+static void parallel_throttle(struct token_bucket* bucket, struct token_bucket* network_bucket, size_t length);
+static void parallel_escape(char* path, char* escaped, size_t size);
+static int parallel_incremental_create(int server, SSL* ssl, int socket, char* parent, char* startpos, uint32_t timeline,
+                                       struct parallel_incremental** incremental);
+static void parallel_incremental_destroy(struct parallel_incremental* incremental);
+static int parallel_manifest(char* backup_base, int number_of_workers, int hash, char* label, uint32_t timeline,
+                             char* startpos, char* endpos, unsigned long* size, unsigned long* biggest_file);
+static int manifest_entry(FILE* file, struct hash* h, int hash, bool first, char* path, char* size, char* modified, char* checksum);
+static int manifest_write(FILE* file, struct hash* hash, char* data);
+static char* hash_name(int hash);
+static int hex_value(char c);
+
+bool
+pgmoneta_parallel_backup_enabled(int server, bool incremental)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // before PostgreSQL 17 the changed blocks come from the WAL summaries
+   if (incremental)
+   {
+      return config->servers[server].version < 17 && config->wal_summary;
+   }
+
+   return config->parallel_backup && pgmoneta_get_number_of_workers(server) > 1;
+}
+
+int
+pgmoneta_parallel_backup(int server, int usr, char* label, char* backup_base, struct tablespace* tablespaces, int hash,
+                         char* incremental, char* startpos, uint32_t* start_timeline, char* endpos, uint32_t* end_timeline,
+                         unsigned long* size, unsigned long* biggest_file)
+{
+   char query[MAX_PATH];
+   char* d = NULL;
+   char* label_file = NULL;
+   int number_of_workers;
+   int number_of_files = 0;
+   unsigned long* load = NULL;
+   pid_t* pids = NULL;
+   bool started = false;
+   bool failed = false;
+   bool privileged = false;
+   SSL* ssl = NULL;
+   struct art* unlogged = NULL;
+   int socket = -1;
+   FILE* file = NULL;
+   struct parallel_file* files = NULL;
+   struct parallel_incremental* inc = NULL;
+   struct query_response* response = NULL;
+   struct tablespace* tblspc = NULL;
+   struct tuple* tup = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *start_timeline = 0;
+   *end_timeline = 0;
+   *size = 0;
+   *biggest_file = 0;
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers < 1)
+   {
+      number_of_workers = 1;
+   }
+
+   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket) != AUTH_SUCCESS)
+   {
+      pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
+      goto error;
+   }
+
+   // the files are read with pg_ls_dir() and pg_read_binary_file(), also for incremental backups with wal_summary
+   if (parallel_privileged(ssl, socket, &privileged) || !privileged)
+   {
+      pgmoneta_log_error("Parallel backup: %s must be a superuser or a member of pg_read_server_files to backup %s",
+                         config->users[usr].username, config->servers[server].name);
+      goto error;
+   }
+
+   // the tablespace directories are named after the tablespace, but the paths use the oid
+   if (parallel_query(ssl, socket, "SELECT oid, spcname FROM pg_tablespace;", &response))
+   {
+      goto error;
+   }
+
+   tup = response->tuples;
+   while (tup != NULL)
+   {
+      if (tup->data[0] != NULL && tup->data[1] != NULL)
+      {
+         tblspc = tablespaces;
+         while (tblspc != NULL)
+         {
+            if (!strcmp(tblspc->name, tup->data[1]))
+            {
+               tblspc->oid = atoi(tup->data[0]);
+            }
+            tblspc = tblspc->next;
+         }
+      }
+      tup = tup->next;
+   }
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   memset(query, 0, sizeof(query));
+   if (config->servers[server].version >= 15)
+   {
+      snprintf(query, sizeof(query), "SELECT pg_backup_start('%s', true);", label);
+   }
+   else
+   {
+      snprintf(query, sizeof(query), "SELECT pg_start_backup('%s', true, false);", label);
+   }
+
+   if (parallel_query(ssl, socket, query, &response) || response->tuples == NULL || response->tuples->data[0] == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not start the backup for %s", config->servers[server].name);
+      goto error;
+   }
+   started = true;
+
+   memset(startpos, 0, 20);
+   snprintf(startpos, 20, "%s", response->tuples->data[0]);
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   if (parallel_timeline(ssl, socket, start_timeline))
+   {
+      goto error;
+   }
+
+   if (incremental != NULL && parallel_incremental_create(server, ssl, socket, incremental, startpos, *start_timeline, &inc))
+   {
+      pgmoneta_log_error("Parallel backup: Could not prepare the incremental backup for %s", config->servers[server].name);
+      goto error;
+   }
+
+   if (parallel_list(ssl, socket, &files, &number_of_files))
+   {
+      pgmoneta_log_error("Parallel backup: Could not list the files of %s", config->servers[server].name);
+      goto error;
+   }
+
+   d = pgmoneta_append(d, backup_base);
+   d = pgmoneta_append(d, "data/pg_wal/archive_status");
+   pgmoneta_mkdir(d);
+   free(d);
+   d = NULL;
+
+   // like the replication protocol, only the init fork of an unlogged relation is copied
+   if (parallel_unlogged(files, number_of_files, &unlogged))
+   {
+      goto error;
+   }
+
+   // assign the biggest files first, each to the worker with the least data
+   qsort(files, number_of_files, sizeof(struct parallel_file), parallel_compare);
+
+   load = (unsigned long*)calloc(number_of_workers, sizeof(unsigned long));
+   if (load == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      files[i].worker = -1;
+
+      if (files[i].directory)
+      {
+         d = parallel_destination(backup_base, tablespaces, files[i].path);
+         if (d == NULL || pgmoneta_mkdir(d))
+         {
+            pgmoneta_log_error("Parallel backup: Could not create directory for %s", files[i].path);
+            goto error;
+         }
+         free(d);
+         d = NULL;
+      }
+      else if (!parallel_excluded(files[i].path) && !parallel_unlogged_file(unlogged, files[i].path))
+      {
+         int worker = 0;
+
+         for (int j = 1; j < number_of_workers; j++)
+         {
+            if (load[j] < load[worker])
+            {
+               worker = j;
+            }
+         }
+
+         files[i].worker = worker;
+         load[worker] += files[i].size + 1;
+      }
+   }
+
+   pids = (pid_t*)calloc(number_of_workers, sizeof(pid_t));
+   if (pids == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_workers; i++)
+   {
+      pids[i] = fork();
+      if (pids[i] == -1)
+      {
+         pgmoneta_log_error("Parallel backup: No fork for worker %d", i);
+         failed = true;
+         break;
+      }
+      else if (pids[i] == 0)
+      {
+         exit(parallel_worker(server, usr, i, number_of_workers, files, number_of_files, backup_base, tablespaces, hash, inc));
+      }
+   }
+
+   for (int i = 0; i < number_of_workers; i++)
+   {
+      int status = 0;
+
+      if (pids[i] > 0)
+      {
+         if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+         {
+            pgmoneta_log_error("Parallel backup: Worker %d failed", i);
+            failed = true;
+         }
+      }
+   }
+
+   memset(query, 0, sizeof(query));
+   if (config->servers[server].version >= 15)
+   {
+      snprintf(query, sizeof(query), "SELECT lsn, labelfile FROM pg_backup_stop(false);");
+   }
+   else
+   {
+      snprintf(query, sizeof(query), "SELECT lsn, labelfile FROM pg_stop_backup(false, false);");
+   }
+
+   started = false;
+   if (parallel_query(ssl, socket, query, &response) || response->tuples == NULL ||
+       response->tuples->data[0] == NULL || response->tuples->data[1] == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not stop the backup for %s", config->servers[server].name);
+      goto error;
+   }
+
+   if (failed)
+   {
+      goto error;
+   }
+
+   memset(endpos, 0, 20);
+   snprintf(endpos, 20, "%s", response->tuples->data[0]);
+   label_file = pgmoneta_append(label_file, response->tuples->data[1]);
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   if (inc != NULL)
+   {
+      char line[MISC_LENGTH];
+
+      memset(line, 0, sizeof(line));
+      snprintf(line, sizeof(line), "INCREMENTAL FROM LSN: %X/%X\nINCREMENTAL FROM TLI: %u\n",
+               (uint32_t)(inc->start_lsn >> 32), (uint32_t)inc->start_lsn, inc->timeline);
+      label_file = pgmoneta_append(label_file, line);
+   }
+
+   if (parallel_timeline(ssl, socket, end_timeline))
+   {
+      goto error;
+   }
+
+   d = pgmoneta_append(d, backup_base);
+   d = pgmoneta_append(d, "data/backup_label");
+
+   file = fopen(d, "wb");
+   if (file == NULL || fwrite(label_file, 1, strlen(label_file), file) != strlen(label_file))
+   {
+      pgmoneta_log_error("Parallel backup: Could not write %s", d);
+      goto error;
+   }
+   fclose(file);
+   file = NULL;
+   free(d);
+   d = NULL;
+
+   tblspc = tablespaces;
+   while (tblspc != NULL)
+   {
+      char link_path[MAX_PATH];
+      char directory[MAX_PATH];
+
+      memset(link_path, 0, sizeof(link_path));
+      memset(directory, 0, sizeof(directory));
+
+      snprintf(link_path, sizeof(link_path), "%sdata/pg_tblspc/%d", backup_base, tblspc->oid);
+      snprintf(directory, sizeof(directory), "%stblspc_%s/", backup_base, tblspc->name);
+
+      pgmoneta_mkdir(directory);
+      unlink(link_path);
+      pgmoneta_symlink_file(link_path, directory);
+
+      tblspc = tblspc->next;
+   }
+
+   if (parallel_manifest(backup_base, number_of_workers, hash, label_file, *end_timeline, startpos, endpos, size, biggest_file))
+   {
+      pgmoneta_log_error("Parallel backup: Could not create the manifest for %s", config->servers[server].name);
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i].path);
+   }
+   free(files);
+   free(load);
+   free(pids);
+   free(label_file);
+   pgmoneta_art_destroy(unlogged);
+   parallel_incremental_destroy(inc);
+
+   pgmoneta_close_ssl(ssl);
+   pgmoneta_disconnect(socket);
+
+   return 0;
+
+error:
+
+   if (started)
+   {
+      // abort the backup
+      pgmoneta_free_query_response(response);
+      response = NULL;
+
+      if (config->servers[server].version >= 15)
+      {
+         parallel_query(ssl, socket, "SELECT pg_backup_stop(false);", &response);
+      }
+      else
+      {
+         parallel_query(ssl, socket, "SELECT pg_stop_backup(false, false);", &response);
+      }
+   }
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   for (int i = 0; i < number_of_workers; i++)
+   {
+      char* r = parallel_result_path(backup_base, i);
+
+      if (r != NULL && pgmoneta_exists(r))
+      {
+         pgmoneta_delete_file(r, NULL);
+      }
+      free(r);
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i].path);
+   }
+   free(files);
+   free(load);
+   free(pids);
+   free(label_file);
+   free(d);
+   pgmoneta_art_destroy(unlogged);
+   parallel_incremental_destroy(inc);
+
+   pgmoneta_free_query_response(response);
+
+   if (ssl != NULL)
+   {
+      pgmoneta_close_ssl(ssl);
+   }
+   if (socket != -1)
+   {
+      pgmoneta_disconnect(socket);
+   }
+
+   return 1;
+}
+
+static int
+parallel_query(SSL* ssl, int socket, char* query, struct query_response** response)
+{
+   struct message* msg = NULL;
+
+   *response = NULL;
+
+   pgmoneta_create_query_message(query, &msg);
+
+   if (pgmoneta_query_execute(ssl, socket, msg, response) || *response == NULL)
+   {
+      pgmoneta_free_message(msg);
+      return 1;
+   }
+
+   pgmoneta_free_message(msg);
+
+   return 0;
+}
+
+static int
+parallel_timeline(SSL* ssl, int socket, uint32_t* timeline)
+{
+   struct query_response* response = NULL;
+
+   if (parallel_query(ssl, socket, "SELECT timeline_id FROM pg_control_checkpoint();", &response) ||
+       response->tuples == NULL || response->tuples->data[0] == NULL)
+   {
+      pgmoneta_free_query_response(response);
+      return 1;
+   }
+
+   *timeline = atoi(response->tuples->data[0]);
+
+   pgmoneta_free_query_response(response);
+
+   return 0;
+}
+
+static int
+parallel_privileged(SSL* ssl, int socket, bool* privileged)
+{
+   struct query_response* response = NULL;
+
+   *privileged = false;
+
+   if (parallel_query(ssl, socket,
+                      "SELECT rolsuper OR pg_has_role(current_user, 'pg_read_server_files', 'MEMBER') FROM pg_roles WHERE rolname = current_user;",
+                      &response) ||
+       response->tuples == NULL || response->tuples->data[0] == NULL)
+   {
+      pgmoneta_free_query_response(response);
+      return 1;
+   }
+
+   *privileged = !strcmp(response->tuples->data[0], "t");
+
+   pgmoneta_free_query_response(response);
+
+   return 0;
+}
+
+static int
+parallel_list(SSL* ssl, int socket, struct parallel_file** files, int* number_of_files)
+{
+   char query[MAX_PATH];
+   char excluded[MAX_PATH];
+   int count = 0;
+   int capacity = 0;
+   struct parallel_file* f = NULL;
+   struct query_response* response = NULL;
+   struct tuple* tup = NULL;
+
+   *files = NULL;
+   *number_of_files = 0;
+
+   memset(excluded, 0, sizeof(excluded));
+   for (int i = 0; excluded_directories[i] != NULL; i++)
+   {
+      size_t length = strlen(excluded);
+
+      snprintf(excluded + length, sizeof(excluded) - length, "%s'%s'", i > 0 ? ", " : "", excluded_directories[i]);
+   }
+
+   // walk the data directory on the server, following the tablespace links
+   memset(query, 0, sizeof(query));
+   snprintf(query, sizeof(query),
+            "WITH RECURSIVE f(p, d) AS ("
+            "SELECT n, (pg_stat_file(n, true)).isdir FROM pg_ls_dir('.', true, false) n "
+            "UNION ALL "
+            "SELECT f.p || '/' || c, (pg_stat_file(f.p || '/' || c, true)).isdir "
+            "FROM f, pg_ls_dir(f.p, true, false) c "
+            "WHERE f.d AND f.p NOT IN (%s) AND f.p NOT LIKE '%%pgsql_tmp%%') "
+            "SELECT p, d, (pg_stat_file(p, true)).size, "
+            "to_char((pg_stat_file(p, true)).modification AT TIME ZONE 'GMT', 'YYYY-MM-DD HH24:MI:SS') "
+            "FROM f WHERE d IS NOT NULL;",
+            excluded);
+
+   if (parallel_query(ssl, socket, query, &response))
+   {
+      goto error;
+   }
+
+   tup = response->tuples;
+   while (tup != NULL)
+   {
+      if (tup->data[0] != NULL && tup->data[1] != NULL)
+      {
+         if (count == capacity)
+         {
+            struct parallel_file* n = NULL;
+
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            n = (struct parallel_file*)realloc(f, capacity * sizeof(struct parallel_file));
+            if (n == NULL)
+            {
+               goto error;
+            }
+            f = n;
+         }
+
+         memset(&f[count], 0, sizeof(struct parallel_file));
+         f[count].path = pgmoneta_append(NULL, tup->data[0]);
+         f[count].directory = tup->data[1][0] == 't';
+         f[count].size = tup->data[2] != NULL ? strtoul(tup->data[2], NULL, 10) : 0;
+         snprintf(f[count].modified, sizeof(f[count].modified), "%s GMT", tup->data[3] != NULL ? tup->data[3] : "1970-01-01 00:00:00");
+         count++;
+      }
+      tup = tup->next;
+   }
+
+   pgmoneta_free_query_response(response);
+
+   *files = f;
+   *number_of_files = count;
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < count; i++)
+   {
+      free(f[i].path);
+   }
+   free(f);
+
+   pgmoneta_free_query_response(response);
+
+   return 1;
+}
+
+static bool
+parallel_excluded(char* path)
+{
+   char* name = NULL;
+
+   name = strrchr(path, '/');
+   name = name != NULL ? name + 1 : path;
+
+   if (!strncmp(name, "pgsql_tmp", strlen("pgsql_tmp")))
+   {
+      return true;
+   }
+
+   // the files of temporary relations, t<backend>_<relnumber>
+   if (name[0] == 't' && isdigit((unsigned char)name[1]))
+   {
+      char* p = name + 1;
+
+      while (isdigit((unsigned char)*p))
+      {
+         p++;
+      }
+
+      if (*p == '_' && isdigit((unsigned char)p[1]))
+      {
+         return true;
+      }
+   }
+
+   for (int i = 0; excluded_files[i] != NULL; i++)
+   {
+      if (!strcmp(name, excluded_files[i]))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static int
+parallel_unlogged(struct parallel_file* files, int number_of_files, struct art** unlogged)
+{
+   char key[MAX_PATH];
+   uint32_t spcoid;
+   uint32_t dboid;
+   uint32_t relnumber;
+   uint32_t segno;
+   int forknum;
+   struct art* tree = NULL;
+
+   *unlogged = NULL;
+
+   if (pgmoneta_art_create(&tree))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if (!files[i].directory &&
+          pgmoneta_wal_summary_relation(files[i].path, &spcoid, &dboid, &relnumber, &forknum, &segno) &&
+          forknum == INIT_FORKNUM)
+      {
+         parallel_relation_key(spcoid, dboid, relnumber, key, sizeof(key));
+
+         if (pgmoneta_art_insert(tree, (unsigned char*)key, strlen(key) + 1, (uintptr_t)true, ValueBool))
+         {
+            goto error;
+         }
+      }
+   }
+
+   *unlogged = tree;
+
+   return 0;
+
+error:
+
+   pgmoneta_art_destroy(tree);
+
+   return 1;
+}
+
+static bool
+parallel_unlogged_file(struct art* unlogged, char* path)
+{
+   char key[MAX_PATH];
+   uint32_t spcoid;
+   uint32_t dboid;
+   uint32_t relnumber;
+   uint32_t segno;
+   int forknum;
+
+   if (unlogged == NULL ||
+       !pgmoneta_wal_summary_relation(path, &spcoid, &dboid, &relnumber, &forknum, &segno) ||
+       forknum == INIT_FORKNUM)
+   {
+      return false;
+   }
+
+   parallel_relation_key(spcoid, dboid, relnumber, key, sizeof(key));
+
+   return pgmoneta_art_contains_key(unlogged, (unsigned char*)key, strlen(key) + 1);
+}
+
+static void
+parallel_relation_key(uint32_t spcoid, uint32_t dboid, uint32_t relnumber, char* key, size_t size)
+{
+   memset(key, 0, size);
+   snprintf(key, size, "%u/%u/%u", spcoid, dboid, relnumber);
+}
+
+static int
+parallel_compare(const void* a, const void* b)
+{
+   const struct parallel_file* fa = (const struct parallel_file*)a;
+   const struct parallel_file* fb = (const struct parallel_file*)b;
+
+   if (fa->size > fb->size)
+   {
+      return -1;
+   }
+   else if (fa->size < fb->size)
+   {
+      return 1;
+   }
+
+   return strcmp(fa->path, fb->path);
+}
+
+static char*
+parallel_destination(char* backup_base, struct tablespace* tablespaces, char* path)
+{
+   char* d = NULL;
+
+   if (!strncmp(path, "pg_tblspc/", strlen("pg_tblspc/")))
+   {
+      char* rest = NULL;
+      unsigned int oid;
+      struct tablespace* tblspc = tablespaces;
+
+      oid = (unsigned int)strtoul(path + strlen("pg_tblspc/"), &rest, 10);
+
+      while (tblspc != NULL && tblspc->oid != oid)
+      {
+         tblspc = tblspc->next;
+      }
+
+      if (tblspc == NULL)
+      {
+         pgmoneta_log_warn("Parallel backup: Unknown tablespace for %s", path);
+         return NULL;
+      }
+
+      d = pgmoneta_append(d, backup_base);
+      d = pgmoneta_append(d, "tblspc_");
+      d = pgmoneta_append(d, tblspc->name);
+      d = pgmoneta_append(d, rest);
+   }
+   else
+   {
+      d = pgmoneta_append(d, backup_base);
+      d = pgmoneta_append(d, "data/");
+      d = pgmoneta_append(d, path);
+   }
+
+   return d;
+}
+
+static char*
+parallel_result_path(char* backup_base, int worker)
+{
+   char name[MISC_LENGTH];
+   char* r = NULL;
+
+   memset(name, 0, sizeof(name));
+   snprintf(name, sizeof(name), "parallel.%d", worker);
+
+   r = pgmoneta_append(r, backup_base);
+   r = pgmoneta_append(r, name);
+
+   return r;
+}
+
+static int
+parallel_worker(int server, int usr, int worker, int number_of_workers, struct parallel_file* files, int number_of_files,
+                char* backup_base, struct tablespace* tablespaces, int hash, struct parallel_incremental* incremental)
+{
+   char* destination = NULL;
+   char* path = NULL;
+   bool fetched = false;
+   char* result_path = NULL;
+   char* checksum = NULL;
+   char* line = NULL;
+   unsigned long size;
+   int backup_max_rate;
+   int network_max_rate;
+   SSL* ssl = NULL;
+   int socket = -1;
+   FILE* result = NULL;
+   struct token_bucket* bucket = NULL;
+   struct token_bucket* network_bucket = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_memory_init();
+
+   // the workers share the rate limit
+   backup_max_rate = pgmoneta_get_backup_max_rate(server);
+   if (backup_max_rate)
+   {
+      bucket = (struct token_bucket*)malloc(sizeof(struct token_bucket));
+      if (pgmoneta_token_bucket_init(bucket, MAX(backup_max_rate / number_of_workers, 1)))
+      {
+         goto error;
+      }
+   }
+
+   network_max_rate = pgmoneta_get_network_max_rate(server);
+   if (network_max_rate)
+   {
+      network_bucket = (struct token_bucket*)malloc(sizeof(struct token_bucket));
+      if (pgmoneta_token_bucket_init(network_bucket, MAX(network_max_rate / number_of_workers, 1)))
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, false, &ssl, &socket) != AUTH_SUCCESS)
+   {
+      pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
+      goto error;
+   }
+
+   result_path = parallel_result_path(backup_base, worker);
+   result = fopen(result_path, "w");
+   if (result == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if (files[i].worker != worker)
+      {
+         continue;
+      }
+
+      destination = parallel_destination(backup_base, tablespaces, files[i].path);
+      if (destination == NULL)
+      {
+         goto error;
+      }
+
+      fetched = false;
+      path = files[i].path;
+
+      if (incremental != NULL)
+      {
+         if (parallel_fetch_incremental(server, ssl, socket, incremental, &files[i], destination, hash, bucket, network_bucket,
+                                        &fetched, &size, &checksum))
+         {
+            pgmoneta_log_error("Parallel backup: Could not fetch the changed blocks of %s", files[i].path);
+            goto error;
+         }
+
+         if (fetched)
+         {
+            char* name = strrchr(files[i].path, '/');
+
+            path = pgmoneta_append(NULL, "");
+            if (name != NULL)
+            {
+               path = pgmoneta_append(path, files[i].path);
+               path[name - files[i].path + 1] = '\0';
+               name++;
+            }
+            else
+            {
+               name = files[i].path;
+            }
+            path = pgmoneta_append(path, INCREMENTAL_PREFIX);
+            path = pgmoneta_append(path, name);
+         }
+      }
+
+      if (!fetched && parallel_fetch(ssl, socket, files[i].path, destination, hash, bucket, network_bucket, &size, &checksum))
+      {
+         pgmoneta_log_error("Parallel backup: Could not fetch %s", files[i].path);
+         goto error;
+      }
+
+      // a NULL checksum means that the file was removed during the backup
+      if (checksum != NULL)
+      {
+         line = pgmoneta_append(line, path);
+         line = pgmoneta_append(line, "\t");
+         line = pgmoneta_append_ulong(line, size);
+         line = pgmoneta_append(line, "\t");
+         line = pgmoneta_append(line, files[i].modified);
+         line = pgmoneta_append(line, "\t");
+         line = pgmoneta_append(line, checksum);
+         line = pgmoneta_append(line, "\n");
+
+         if (fputs(line, result) == EOF)
+         {
+            goto error;
+         }
+      }
+
+      if (path != files[i].path)
+      {
+         free(path);
+      }
+      path = NULL;
+
+      free(destination);
+      free(checksum);
+      free(line);
+      destination = NULL;
+      checksum = NULL;
+      line = NULL;
+   }
+
+   if (fclose(result) != 0)
+   {
+      result = NULL;
+      goto error;
+   }
+
+   pgmoneta_close_ssl(ssl);
+   pgmoneta_disconnect(socket);
+   pgmoneta_token_bucket_destroy(bucket);
+   pgmoneta_token_bucket_destroy(network_bucket);
+   pgmoneta_memory_destroy();
+   free(result_path);
+
+   return 0;
+
+error:
+
+   if (result != NULL)
+   {
+      fclose(result);
+   }
+
+   if (ssl != NULL)
+   {
+      pgmoneta_close_ssl(ssl);
+   }
+   if (socket != -1)
+   {
+      pgmoneta_disconnect(socket);
+   }
+
+   pgmoneta_token_bucket_destroy(bucket);
+   pgmoneta_token_bucket_destroy(network_bucket);
+   pgmoneta_memory_destroy();
+   if (path != NULL && incremental != NULL && fetched)
+   {
+      free(path);
+   }
+   free(destination);
+   free(checksum);
+   free(line);
+   free(result_path);
+
+   return 1;
+}
+
+static int
+parallel_fetch(SSL* ssl, int socket, char* path, char* destination, int hash, struct token_bucket* bucket,
+               struct token_bucket* network_bucket, unsigned long* size, char** checksum)
+{
+   char escaped[MAX_PATH];
+   unsigned char* buffer = NULL;
+   size_t length;
+   bool removed = false;
+   bool done = false;
+   FILE* file = NULL;
+   struct hash* h = NULL;
+
+   *size = 0;
+   *checksum = NULL;
+
+   parallel_escape(path, escaped, sizeof(escaped));
+
+   buffer = (unsigned char*)malloc(PARALLEL_CHUNK_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(destination, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not create %s", destination);
+      goto error;
+   }
+
+   if (hash != HASH_ALGORITHM_DEFAULT && pgmoneta_hash_create(hash, &h))
+   {
+      goto error;
+   }
+
+   while (!done)
+   {
+      if (parallel_read(ssl, socket, escaped, *size, PARALLEL_CHUNK_SIZE, buffer, &length, &removed))
+      {
+         goto error;
+      }
+
+      if (removed)
+      {
+         // removed during the backup, the WAL replay takes care of it
+         fclose(file);
+         file = NULL;
+         pgmoneta_delete_file(destination, NULL);
+
+         pgmoneta_hash_destroy(h);
+         free(buffer);
+
+         return 0;
+      }
+
+      parallel_throttle(bucket, network_bucket, length);
+
+      if (length > 0 && fwrite(buffer, 1, length, file) != length)
+      {
+         pgmoneta_log_error("Parallel backup: Could not write to %s", destination);
+         goto error;
+      }
+
+      if (h != NULL && length > 0 && pgmoneta_hash_update(h, buffer, length))
+      {
+         goto error;
+      }
+
+      *size += length;
+      done = length < PARALLEL_CHUNK_SIZE;
+   }
+
+   if (fclose(file) != 0)
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (h != NULL)
+   {
+      if (pgmoneta_hash_final(h, checksum))
+      {
+         goto error;
+      }
+   }
+   else
+   {
+      *checksum = pgmoneta_append(NULL, "-");
+   }
+
+   pgmoneta_hash_destroy(h);
+   free(buffer);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   pgmoneta_hash_destroy(h);
+   free(buffer);
+
+   return 1;
+}
+
+static int
+parallel_fetch_incremental(int server, SSL* ssl, int socket, struct parallel_incremental* incremental, struct parallel_file* file,
+                           char* destination, int hash, struct token_bucket* bucket,
+                           struct token_bucket* network_bucket, bool* fetched,
+                           unsigned long* size, char** checksum)
+{
+   char escaped[MAX_PATH];
+   char* d = NULL;
+   char* name = NULL;
+   uint32_t spcoid;
+   uint32_t dboid;
+   uint32_t relnumber;
+   int forknum;
+   uint32_t segno;
+   uint32_t limit;
+   uint32_t relative_limit;
+   uint32_t number_of_file_blocks;
+   uint32_t truncation;
+   uint32_t* changed = NULL;
+   int number_of_changed = 0;
+   uint32_t* blocks = NULL;
+   uint32_t number_of_blocks = 0;
+   uint32_t header[3];
+   size_t header_length;
+   size_t blcksz;
+   size_t relseg;
+   size_t length;
+   unsigned char* buffer = NULL;
+   bool removed = false;
+   FILE* f = NULL;
+   struct hash* h = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *fetched = false;
+   *size = 0;
+   *checksum = NULL;
+
+   blcksz = config->servers[server].block_size;
+   relseg = config->servers[server].relseg_size;
+
+   // only relation files which are in the parent, and a whole number of blocks
+   if (blcksz == 0 || relseg == 0 || file->size % blcksz != 0 ||
+       !pgmoneta_wal_summary_relation(file->path, &spcoid, &dboid, &relnumber, &forknum, &segno) ||
+       !pgmoneta_art_contains_key(incremental->files, (unsigned char*)file->path, strlen(file->path) + 1))
+   {
+      return 0;
+   }
+
+   // like PostgreSQL, the free space map isn't fully WAL-logged and is sent in full,
+   // and so is the init fork of an unlogged relation, whose other forks aren't copied
+   if (forknum == FSM_FORKNUM || forknum == INIT_FORKNUM)
+   {
+      return 0;
+   }
+
+   if (pgmoneta_wal_summary_blocks(incremental->summary, spcoid, dboid, relnumber, forknum,
+                                   segno * relseg, (segno + 1) * relseg, &limit, &changed, &number_of_changed))
+   {
+      goto error;
+   }
+
+   number_of_file_blocks = file->size / blcksz;
+   relative_limit = limit == WAL_SUMMARY_NO_LIMIT ? WAL_SUMMARY_NO_LIMIT :
+                    (limit > segno * relseg ? limit - segno * relseg : 0);
+
+   // the blocks beyond a truncation, or the creation, are all sent
+   blocks = (uint32_t*)malloc((number_of_changed + number_of_file_blocks + 1) * sizeof(uint32_t));
+   if (blocks == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_changed; i++)
+   {
+      if (changed[i] < relative_limit && changed[i] < number_of_file_blocks)
+      {
+         blocks[number_of_blocks++] = changed[i];
+      }
+   }
+
+   for (uint32_t b = relative_limit; b < number_of_file_blocks; b++)
+   {
+      blocks[number_of_blocks++] = b;
+   }
+
+   // like PostgreSQL, a file which has mostly changed is sent in full
+   if ((double)number_of_blocks * blcksz > 0.9 * file->size)
+   {
+      free(changed);
+      free(blocks);
+
+      return 0;
+   }
+
+   truncation = number_of_file_blocks;
+   if (relative_limit != WAL_SUMMARY_NO_LIMIT && relative_limit > truncation)
+   {
+      truncation = MIN(relative_limit, (uint32_t)relseg);
+   }
+
+   name = strrchr(destination, '/');
+   d = pgmoneta_append(d, destination);
+   d[name - destination + 1] = '\0';
+   d = pgmoneta_append(d, INCREMENTAL_PREFIX);
+   d = pgmoneta_append(d, name + 1);
+
+   buffer = (unsigned char*)malloc(MAX(PARALLEL_CHUNK_SIZE, blcksz));
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   f = fopen(d, "wb");
+   if (f == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not create %s", d);
+      goto error;
+   }
+
+   if (hash != HASH_ALGORITHM_DEFAULT && pgmoneta_hash_create(hash, &h))
+   {
+      goto error;
+   }
+
+   // magic + block num + truncation block length + relative block numbers, padded to a block
+   header[0] = INCREMENTAL_MAGIC;
+   header[1] = number_of_blocks;
+   header[2] = truncation;
+   header_length = sizeof(header) + number_of_blocks * sizeof(uint32_t);
+
+   if (fwrite(header, 1, sizeof(header), f) != sizeof(header) ||
+       (number_of_blocks > 0 && fwrite(blocks, sizeof(uint32_t), number_of_blocks, f) != number_of_blocks) ||
+       (h != NULL && pgmoneta_hash_update(h, header, sizeof(header))) ||
+       (h != NULL && number_of_blocks > 0 && pgmoneta_hash_update(h, blocks, number_of_blocks * sizeof(uint32_t))))
+   {
+      goto error;
+   }
+
+   if (number_of_blocks > 0 && header_length % blcksz != 0)
+   {
+      size_t padding = blcksz - (header_length % blcksz);
+
+      memset(buffer, 0, padding);
+      if (fwrite(buffer, 1, padding, f) != padding || (h != NULL && pgmoneta_hash_update(h, buffer, padding)))
+      {
+         goto error;
+      }
+      header_length += padding;
+   }
+
+   *size = header_length;
+
+   parallel_escape(file->path, escaped, sizeof(escaped));
+
+   // consecutive blocks are read together
+   for (uint32_t i = 0; i < number_of_blocks;)
+   {
+      uint32_t run = 1;
+      size_t wanted;
+
+      while (i + run < number_of_blocks && blocks[i + run] == blocks[i] + run &&
+             (run + 1) * blcksz <= MAX(PARALLEL_CHUNK_SIZE, blcksz))
+      {
+         run++;
+      }
+
+      wanted = run * blcksz;
+
+      if (parallel_read(ssl, socket, escaped, (unsigned long)blocks[i] * blcksz, wanted, buffer, &length, &removed))
+      {
+         goto error;
+      }
+
+      if (removed)
+      {
+         // removed during the backup, the WAL replay takes care of it
+         fclose(f);
+         f = NULL;
+         pgmoneta_delete_file(d, NULL);
+
+         pgmoneta_hash_destroy(h);
+         free(buffer);
+         free(changed);
+         free(blocks);
+         free(d);
+
+         *fetched = true;
+
+         return 0;
+      }
+
+      // truncated during the backup, the WAL replay takes care of it
+      if (length < wanted)
+      {
+         memset(buffer + length, 0, wanted - length);
+      }
+
+      parallel_throttle(bucket, network_bucket, wanted);
+
+      if (fwrite(buffer, 1, wanted, f) != wanted || (h != NULL && pgmoneta_hash_update(h, buffer, wanted)))
+      {
+         pgmoneta_log_error("Parallel backup: Could not write to %s", d);
+         goto error;
+      }
+
+      *size += wanted;
+      i += run;
+   }
+
+   if (fclose(f) != 0)
+   {
+      f = NULL;
+      goto error;
+   }
+   f = NULL;
+
+   if (h != NULL)
+   {
+      if (pgmoneta_hash_final(h, checksum))
+      {
+         goto error;
+      }
+   }
+   else
+   {
+      *checksum = pgmoneta_append(NULL, "-");
+   }
+
+   *fetched = true;
+
+   pgmoneta_hash_destroy(h);
+   free(buffer);
+   free(changed);
+   free(blocks);
+   free(d);
+
+   return 0;
+
+error:
+
+   if (f != NULL)
+   {
+      fclose(f);
+   }
+
+   pgmoneta_hash_destroy(h);
+   free(buffer);
+   free(changed);
+   free(blocks);
+   free(d);
+
+   return 1;
+}
+
+static int
+parallel_read(SSL* ssl, int socket, char* escaped, unsigned long offset, size_t length, unsigned char* buffer,
+              size_t* read, bool* removed)
+{
+   char query[MAX_PATH + 128];
+   char* data = NULL;
+   size_t n;
+   struct query_response* response = NULL;
+
+   *read = 0;
+   *removed = false;
+
+   // the prefix tells an empty chunk from a removed file
+   memset(query, 0, sizeof(query));
+   snprintf(query, sizeof(query), "SELECT 'x' || encode(pg_read_binary_file('%s', %lu, %zu, true), 'hex');",
+            escaped, offset, length);
+
+   if (parallel_query(ssl, socket, query, &response) || response->tuples == NULL)
+   {
+      goto error;
+   }
+
+   data = response->tuples->data[0];
+
+   if (data == NULL)
+   {
+      *removed = true;
+      pgmoneta_free_query_response(response);
+      return 0;
+   }
+
+   data++;
+   n = strlen(data) / 2;
+
+   if (n > length)
+   {
+      goto error;
+   }
+
+   for (size_t i = 0; i < n; i++)
+   {
+      int hi = hex_value(data[2 * i]);
+      int lo = hex_value(data[2 * i + 1]);
+
+      if (hi < 0 || lo < 0)
+      {
+         goto error;
+      }
+
+      buffer[i] = (unsigned char)((hi << 4) | lo);
+   }
+
+   pgmoneta_free_query_response(response);
+
+   *read = n;
+
+   return 0;
+
+error:
+
+   pgmoneta_free_query_response(response);
+
+   return 1;
+}
+
+static void
+parallel_throttle(struct token_bucket* bucket, struct token_bucket* network_bucket, size_t length)
+{
+   if (bucket != NULL && length > 0)
+   {
+      while (1)
+      {
+         if (!pgmoneta_token_bucket_consume(bucket, length))
+         {
+            break;
+         }
+         else
+         {
+            SLEEP(500000000L)
+         }
+      }
+   }
+
+   if (network_bucket != NULL && length > 0)
+   {
+      while (1)
+      {
+         if (!pgmoneta_token_bucket_consume(network_bucket, length))
+         {
+            break;
+         }
+         else
+         {
+            SLEEP(500000000L)
+         }
+      }
+   }
+}
+
+static void
+parallel_escape(char* path, char* escaped, size_t size)
+{
+   memset(escaped, 0, size);
+   for (size_t i = 0, j = 0; path[i] != '\0' && j < size - 2; i++)
+   {
+      if (path[i] == '\'')
+      {
+         escaped[j++] = '\'';
+      }
+      escaped[j++] = path[i];
+   }
+}
+
+static int
+parallel_incremental_create(int server, SSL* ssl, int socket, char* parent, char* startpos, uint32_t timeline,
+                            struct parallel_incremental** incremental)
+{
+   char path[MAX_PATH];
+   char* key_path[1] = {"Files"};
+   uint32_t hi;
+   uint32_t lo;
+   uint64_t end_lsn;
+   time_t start;
+   struct backup* backup = NULL;
+   struct json_reader* reader = NULL;
+   struct json* file = NULL;
+   struct query_response* response = NULL;
+   struct parallel_incremental* inc = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *incremental = NULL;
+
+   inc = (struct parallel_incremental*)calloc(1, sizeof(struct parallel_incremental));
+   if (inc == NULL)
+   {
+      goto error;
+   }
+
+   memset(path, 0, sizeof(path));
+   snprintf(path, sizeof(path), "%sbackup.info", parent);
+
+   if (pgmoneta_get_backup_file(path, &backup) || backup == NULL)
+   {
+      pgmoneta_log_error("Parallel backup: Could not read %s", path);
+      goto error;
+   }
+
+   inc->start_lsn = ((uint64_t)backup->start_lsn_hi32 << 32) | backup->start_lsn_lo32;
+   inc->timeline = backup->start_timeline;
+
+   if (inc->timeline != timeline)
+   {
+      pgmoneta_log_error("Parallel backup: The parent is on timeline %u, but the server is on %u", inc->timeline, timeline);
+      goto error;
+   }
+
+   if (sscanf(startpos, "%X/%X", &hi, &lo) != 2)
+   {
+      goto error;
+   }
+   end_lsn = ((uint64_t)hi << 32) | lo;
+
+   // complete the segment of the start position, so that it can be summarized
+   if (parallel_query(ssl, socket, "SELECT pg_switch_wal();", &response))
+   {
+      goto error;
+   }
+   pgmoneta_free_query_response(response);
+   response = NULL;
+
+   start = time(NULL);
+   while (pgmoneta_wal_summary_read(server, timeline, inc->start_lsn, end_lsn, &inc->summary))
+   {
+      if (difftime(time(NULL), start) >= WAL_SUMMARY_TIMEOUT)
+      {
+         pgmoneta_log_error("Parallel backup: The WAL of %s hasn't been summarized up to %s", config->servers[server].name, startpos);
+         goto error;
+      }
+
+      SLEEP(1000000000L)
+
+      pgmoneta_summarize_wal(server);
+   }
+
+   if (pgmoneta_art_create(&inc->files))
+   {
+      goto error;
+   }
+
+   memset(path, 0, sizeof(path));
+   snprintf(path, sizeof(path), "%sdata/backup_manifest", parent);
+
+   if (pgmoneta_json_reader_init(path, &reader) || pgmoneta_json_locate(reader, key_path, 1))
+   {
+      pgmoneta_log_error("Parallel backup: Could not read %s", path);
+      goto error;
+   }
+
+   while (pgmoneta_json_next_array_item(reader, &file))
+   {
+      char name[MAX_PATH];
+      char* p = (char*)pgmoneta_json_get(file, "Path");
+      char* base = NULL;
+
+      if (p != NULL)
+      {
+         // the files of an incremental parent are known by their plain name
+         memset(name, 0, sizeof(name));
+         base = strrchr(p, '/');
+         base = base != NULL ? base + 1 : p;
+
+         if (pgmoneta_starts_with(base, INCREMENTAL_PREFIX))
+         {
+            snprintf(name, sizeof(name), "%.*s%s", (int)(base - p), p, base + strlen(INCREMENTAL_PREFIX));
+         }
+         else
+         {
+            snprintf(name, sizeof(name), "%s", p);
+         }
+
+         if (pgmoneta_art_insert(inc->files, (unsigned char*)name, strlen(name) + 1, (uintptr_t)true, ValueBool))
+         {
+            goto error;
+         }
+      }
+
+      pgmoneta_json_destroy(file);
+      file = NULL;
+   }
+
+   pgmoneta_json_reader_close(reader);
+   free(backup);
+
+   pgmoneta_log_debug("Parallel backup: %d block references since %X/%X for %s", inc->summary->number_of_refs,
+                      (uint32_t)(inc->start_lsn >> 32), (uint32_t)inc->start_lsn, config->servers[server].name);
+
+   *incremental = inc;
+
+   return 0;
+
+error:
+
+   pgmoneta_json_destroy(file);
+   pgmoneta_json_reader_close(reader);
+   pgmoneta_free_query_response(response);
+   free(backup);
+   parallel_incremental_destroy(inc);
+
+   return 1;
+}
+
+static void
+parallel_incremental_destroy(struct parallel_incremental* incremental)
+{
+   if (incremental == NULL)
+   {
+      return;
+   }
+
+   pgmoneta_wal_summary_destroy(incremental->summary);
+   pgmoneta_art_destroy(incremental->files);
+   free(incremental);
+}
+
+static int
+parallel_manifest(char* backup_base, int number_of_workers, int hash, char* label, uint32_t timeline,
+                  char* startpos, char* endpos, unsigned long* size, unsigned long* biggest_file)
+{
+   char line[MAX_PATH + 256];
+   char label_size[MISC_LENGTH];
+   char modified[32];
+   char* d = NULL;
+   char* checksum = NULL;
+   char* manifest_checksum = NULL;
+   char* result_path = NULL;
+   time_t now;
+   struct tm tm;
+   FILE* manifest = NULL;
+   FILE* result = NULL;
+   struct hash* h = NULL;
+   struct hash* label_hash = NULL;
+
+   d = pgmoneta_append(d, backup_base);
+   d = pgmoneta_append(d, "data/backup_manifest");
+
+   manifest = fopen(d, "w");
+   if (manifest == NULL)
+   {
+      goto error;
+   }
+
+   // the manifest checksum covers everything before the checksum itself
+   if (pgmoneta_hash_create(HASH_ALGORITHM_SHA256, &h))
+   {
+      goto error;
+   }
+
+   if (manifest_write(manifest, h, "{ \"PostgreSQL-Backup-Manifest-Version\": 1,\n\"Files\": [\n"))
+   {
+      goto error;
+   }
+
+   now = time(NULL);
+   gmtime_r(&now, &tm);
+   memset(modified, 0, sizeof(modified));
+   strftime(modified, sizeof(modified), "%Y-%m-%d %H:%M:%S GMT", &tm);
+
+   if (hash != HASH_ALGORITHM_DEFAULT)
+   {
+      if (pgmoneta_hash_create(hash, &label_hash) ||
+          pgmoneta_hash_update(label_hash, label, strlen(label)) ||
+          pgmoneta_hash_final(label_hash, &checksum))
+      {
+         goto error;
+      }
+   }
+
+   memset(label_size, 0, sizeof(label_size));
+   snprintf(label_size, sizeof(label_size), "%zu", strlen(label));
+
+   *size = strlen(label);
+   *biggest_file = strlen(label);
+
+   if (manifest_entry(manifest, h, hash, true, "backup_label", label_size, modified, checksum))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_workers; i++)
+   {
+      result_path = parallel_result_path(backup_base, i);
+      result = fopen(result_path, "r");
+      if (result == NULL)
+      {
+         goto error;
+      }
+
+      memset(line, 0, sizeof(line));
+      while (fgets(line, sizeof(line), result) != NULL)
+      {
+         char* path = NULL;
+         char* s = NULL;
+         char* m = NULL;
+         char* c = NULL;
+         char* saveptr = NULL;
+         unsigned long file_size;
+
+         path = strtok_r(line, "\t\n", &saveptr);
+         s = strtok_r(NULL, "\t\n", &saveptr);
+         m = strtok_r(NULL, "\t\n", &saveptr);
+         c = strtok_r(NULL, "\t\n", &saveptr);
+
+         if (path == NULL || s == NULL || m == NULL || c == NULL)
+         {
+            goto error;
+         }
+
+         file_size = strtoul(s, NULL, 10);
+         *size += file_size;
+         *biggest_file = MAX(*biggest_file, file_size);
+
+         if (manifest_entry(manifest, h, hash, false, path, s, m, c))
+         {
+            goto error;
+         }
+
+         memset(line, 0, sizeof(line));
+      }
+
+      fclose(result);
+      result = NULL;
+
+      pgmoneta_delete_file(result_path, NULL);
+
+      free(result_path);
+      result_path = NULL;
+   }
+
+   memset(line, 0, sizeof(line));
+   snprintf(line, sizeof(line),
+            "\n],\n\"WAL-Ranges\": [\n{ \"Timeline\": %u, \"Start-LSN\": \"%s\", \"End-LSN\": \"%s\" }\n],\n",
+            timeline, startpos, endpos);
+
+   if (manifest_write(manifest, h, line))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_hash_final(h, &manifest_checksum))
+   {
+      goto error;
+   }
+
+   memset(line, 0, sizeof(line));
+   snprintf(line, sizeof(line), "\"Manifest-Checksum\": \"%s\"}\n", manifest_checksum);
+
+   if (manifest_write(manifest, NULL, line))
+   {
+      goto error;
+   }
+
+   if (fclose(manifest) != 0)
+   {
+      manifest = NULL;
+      goto error;
+   }
+
+   pgmoneta_hash_destroy(h);
+   pgmoneta_hash_destroy(label_hash);
+   free(manifest_checksum);
+   free(checksum);
+   free(d);
+
+   return 0;
+
+error:
+
+   if (manifest != NULL)
+   {
+      fclose(manifest);
+   }
+
+   if (result != NULL)
+   {
+      fclose(result);
+   }
+
+   pgmoneta_hash_destroy(h);
+   pgmoneta_hash_destroy(label_hash);
+   free(manifest_checksum);
+   free(checksum);
+   free(result_path);
+   free(d);
+
+   return 1;
+}
+
+static int
+manifest_entry(FILE* file, struct hash* h, int hash, bool first, char* path, char* size, char* modified, char* checksum)
+{
+   char* entry = NULL;
+   char* escaped = NULL;
+   int ret;
+
+   escaped = pgmoneta_escape_string(path);
+
+   entry = pgmoneta_append(entry, first ? "" : ",\n");
+   entry = pgmoneta_append(entry, "{ \"Path\": \"");
+   entry = pgmoneta_append(entry, escaped);
+   entry = pgmoneta_append(entry, "\", \"Size\": ");
+   entry = pgmoneta_append(entry, size);
+   entry = pgmoneta_append(entry, ", \"Last-Modified\": \"");
+   entry = pgmoneta_append(entry, modified);
+   entry = pgmoneta_append(entry, "\"");
+   if (hash != HASH_ALGORITHM_DEFAULT && checksum != NULL)
+   {
+      entry = pgmoneta_append(entry, ", \"Checksum-Algorithm\": \"");
+      entry = pgmoneta_append(entry, hash_name(hash));
+      entry = pgmoneta_append(entry, "\", \"Checksum\": \"");
+      entry = pgmoneta_append(entry, checksum);
+      entry = pgmoneta_append(entry, "\"");
+   }
+   entry = pgmoneta_append(entry, " }");
+
+   ret = manifest_write(file, h, entry);
+
+   free(escaped);
+   free(entry);
+
+   return ret;
+}
+
+static int
+manifest_write(FILE* file, struct hash* hash, char* data)
+{
+   size_t length = strlen(data);
+
+   if (fwrite(data, 1, length, file) != length)
+   {
+      return 1;
+   }
+
+   if (hash != NULL)
+   {
+      return pgmoneta_hash_update(hash, data, length);
+   }
+
+   return 0;
+}
+
+static char*
+hash_name(int hash)
+{
+   switch (hash)
+   {
+      case HASH_ALGORITHM_CRC32C:
+         return "CRC32C";
+      case HASH_ALGORITHM_SHA224:
+         return "SHA224";
+      case HASH_ALGORITHM_SHA256:
+         return "SHA256";
+      case HASH_ALGORITHM_SHA384:
+         return "SHA384";
+      case HASH_ALGORITHM_SHA512:
+         return "SHA512";
+      default:
+         break;
+   }
+
+   return "NONE";
+}
+
+static int
+hex_value(char c)
+{
+   if (c >= '0' && c <= '9')
+   {
+      return c - '0';
+   }
+   else if (c >= 'a' && c <= 'f')
+   {
+      return c - 'a' + 10;
+   }
+   else if (c >= 'A' && c <= 'F')
+   {
+      return c - 'A' + 10;
+   }
+
+   return -1;
+}
@@ -53,6 +53,15 @@
 #define PAGE_METRICS 2
 #define BAD_REQUEST  3
 
+/** @struct catalog
+ * Defines a snapshot of the backups of all servers, taken once per scrape
+ */
+struct catalog
+{
+   int number_of_backups[NUMBER_OF_SERVERS]; /**< The number of backups of each server */
+   struct backup** backups[NUMBER_OF_SERVERS]; /**< The backups of each server */
+};
+
 static int resolve_page(struct message* msg);
 static int unknown_page(int client_fd);
 static int home_page(int client_fd);
@@ -60,8 +69,11 @@ static int metrics_page(int client_fd);
 static int bad_request(int client_fd);
 
 static void general_information(int client_fd);
-static void backup_information(int client_fd);
-static void size_information(int client_fd);
+static void backup_information(int client_fd, struct catalog* catalog);
+static void size_information(int client_fd, struct catalog* catalog);
+
+static int catalog_load(struct catalog** catalog);
+static void catalog_destroy(struct catalog* catalog);
 
 static int send_chunk(int client_fd, char* data);
 
@@ -384,6 +396,15 @@ home_page(int client_fd)
    data = pgmoneta_append(data, "  <h2>pgmoneta_server_last_failed_operation_time</h2>\n");
    data = pgmoneta_append(data, "  The time of the latest failed client operation of a server \n");
    data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_server_backup_queue_depth</h2>\n");
+   data = pgmoneta_append(data, "  The number of received buffers waiting to be written by an active backup of a server\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_server_wal_shipping_lag</h2>\n");
+   data = pgmoneta_append(data, "  The number of received WAL bytes not yet written to the WAL shipping directory of a server\n");
+   data = pgmoneta_append(data, "  <p>\n");
+   data = pgmoneta_append(data, "  <h2>pgmoneta_server_wal_ssh_lag</h2>\n");
+   data = pgmoneta_append(data, "  The number of received WAL bytes not yet written to the SSH storage engine of a server\n");
+   data = pgmoneta_append(data, "  <p>\n");
    data = pgmoneta_append(data, "  <h2>pgmoneta_wal_shipping</h2>\n");
    data = pgmoneta_append(data, "  The disk space used for WAL shipping for a server\n");
    data = pgmoneta_append(data, "  <p>\n");
@@ -1208,6 +1229,7 @@ metrics_page(int client_fd)
    int status;
    struct message msg;
    struct prometheus_cache* cache;
+   struct catalog* catalog = NULL;
    signed char cache_is_free;
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
@@ -1265,8 +1287,18 @@ retry_cache_locking:
          data = NULL;
 
          general_information(client_fd);
-         backup_information(client_fd);
-         size_information(client_fd);
+
+         if (catalog_load(&catalog))
+         {
+            atomic_store(&cache->lock, STATE_FREE);
+            goto error;
+         }
+
+         backup_information(client_fd, catalog);
+         size_information(client_fd, catalog);
+
+         catalog_destroy(catalog);
+         catalog = NULL;
 
          /* Footer */
          data = pgmoneta_append(data, "0\r\n\r\n");
@@ -2023,6 +2055,54 @@ general_information(int client_fd)
    }
    data = pgmoneta_append(data, "\n");
 
+   data = pgmoneta_append(data, "#HELP pgmoneta_server_backup_queue_depth The number of received buffers waiting to be written by an active backup of a server\n");
+   data = pgmoneta_append(data, "#TYPE pgmoneta_server_backup_queue_depth gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      data = pgmoneta_append(data, "pgmoneta_server_backup_queue_depth{");
+
+      data = pgmoneta_append(data, "name=\"");
+      data = pgmoneta_append(data, config->servers[i].name);
+      data = pgmoneta_append(data, "\"} ");
+
+      data = pgmoneta_append_int(data, atomic_load(&config->servers[i].backup_queue_depth));
+
+      data = pgmoneta_append(data, "\n");
+   }
+   data = pgmoneta_append(data, "\n");
+
+   data = pgmoneta_append(data, "#HELP pgmoneta_server_wal_shipping_lag The number of received WAL bytes not yet written to the WAL shipping directory of a server\n");
+   data = pgmoneta_append(data, "#TYPE pgmoneta_server_wal_shipping_lag gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      data = pgmoneta_append(data, "pgmoneta_server_wal_shipping_lag{");
+
+      data = pgmoneta_append(data, "name=\"");
+      data = pgmoneta_append(data, config->servers[i].name);
+      data = pgmoneta_append(data, "\"} ");
+
+      data = pgmoneta_append_ulong(data, atomic_load(&config->servers[i].wal_shipping_lag));
+
+      data = pgmoneta_append(data, "\n");
+   }
+   data = pgmoneta_append(data, "\n");
+
+   data = pgmoneta_append(data, "#HELP pgmoneta_server_wal_ssh_lag The number of received WAL bytes not yet written to the SSH storage engine of a server\n");
+   data = pgmoneta_append(data, "#TYPE pgmoneta_server_wal_ssh_lag gauge\n");
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      data = pgmoneta_append(data, "pgmoneta_server_wal_ssh_lag{");
+
+      data = pgmoneta_append(data, "name=\"");
+      data = pgmoneta_append(data, config->servers[i].name);
+      data = pgmoneta_append(data, "\"} ");
+
+      data = pgmoneta_append_ulong(data, atomic_load(&config->servers[i].wal_ssh_lag));
+
+      data = pgmoneta_append(data, "\n");
+   }
+   data = pgmoneta_append(data, "\n");
+
    data = pgmoneta_append(data, "#HELP pgmoneta_server_last_operation_time The time of the latest client operation of a server\n");
    data = pgmoneta_append(data, "#TYPE pgmoneta_server_last_operation_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
@@ -2162,9 +2242,8 @@ general_information(int client_fd)
 }
 
 static void
-backup_information(int client_fd)
+backup_information(int client_fd, struct catalog* catalog)
 {
-   char* d;
    int number_of_backups;
    struct backup** backups;
    bool valid;
@@ -2178,12 +2257,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_oldest gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       data = pgmoneta_append(data, "pgmoneta_backup_oldest{");
 
@@ -2207,14 +2282,6 @@ backup_information(int client_fd)
       }
 
       data = pgmoneta_append(data, "\n");
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2230,12 +2297,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_newest gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       data = pgmoneta_append(data, "pgmoneta_backup_newest{");
 
@@ -2259,14 +2322,6 @@ backup_information(int client_fd)
       }
 
       data = pgmoneta_append(data, "\n");
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2274,12 +2329,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_count gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       data = pgmoneta_append(data, "pgmoneta_backup_count{");
 
@@ -2299,14 +2350,6 @@ backup_information(int client_fd)
       data = pgmoneta_append_int(data, valid_count);
 
       data = pgmoneta_append(data, "\n");
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2322,12 +2365,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2359,14 +2398,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2382,12 +2413,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_version gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2421,14 +2448,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2444,12 +2463,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_total_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2481,14 +2496,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2496,12 +2503,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_basebackup_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2533,14 +2536,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2548,12 +2543,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_manifest_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2585,14 +2576,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2600,12 +2583,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_zstd_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2637,14 +2616,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2652,12 +2623,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_gzip_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2689,14 +2656,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2704,12 +2663,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_bzip2_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2741,14 +2696,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2756,12 +2703,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_lz4_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2793,14 +2736,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2808,12 +2743,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_encryption_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2845,14 +2776,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2860,12 +2783,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_linking_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2897,14 +2816,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -2912,12 +2823,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_ssh_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -2949,14 +2856,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
 
    data = pgmoneta_append(data, "\n");
@@ -2965,12 +2864,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_s3_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3002,14 +2897,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
 
    data = pgmoneta_append(data, "\n");
@@ -3018,12 +2905,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_azure_elapsed_time gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3055,14 +2938,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
 
    data = pgmoneta_append(data, "\n");
@@ -3071,12 +2946,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_start_timeline gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3108,14 +2979,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3123,12 +2986,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_end_timeline gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3160,14 +3019,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3175,12 +3026,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_start_walpos gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3220,13 +3067,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3234,12 +3074,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_checkpoint_walpos gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3279,14 +3115,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3294,12 +3122,8 @@ backup_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_end_walpos gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3339,14 +3163,6 @@ backup_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3360,7 +3176,7 @@ backup_information(int client_fd)
 }
 
 static void
-size_information(int client_fd)
+size_information(int client_fd, struct catalog* catalog)
 {
    char* d;
    int number_of_backups;
@@ -3376,12 +3192,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_restore_newest_size gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       data = pgmoneta_append(data, "pgmoneta_restore_newest_size{");
 
@@ -3405,14 +3217,6 @@ size_information(int client_fd)
       }
 
       data = pgmoneta_append(data, "\n");
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3428,12 +3232,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_newest_size gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       data = pgmoneta_append(data, "pgmoneta_backup_newest_size{");
 
@@ -3457,14 +3257,6 @@ size_information(int client_fd)
       }
 
       data = pgmoneta_append(data, "\n");
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3480,12 +3272,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_restore_size gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3517,14 +3305,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3540,12 +3320,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_restore_size_increment gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3584,14 +3360,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3607,12 +3375,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_size gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3644,14 +3408,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3667,12 +3423,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_ratio gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3711,14 +3463,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3734,12 +3478,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_throughput gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3777,14 +3517,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3800,12 +3532,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_basebackup_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3843,14 +3571,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3866,12 +3586,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_manifest_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3909,14 +3625,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3932,12 +3640,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_zstd_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -3975,14 +3679,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -3998,12 +3694,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_gzip_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4041,14 +3733,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4064,12 +3748,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_bzip2_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4107,14 +3787,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4130,12 +3802,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_compression_lz4_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4173,14 +3841,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4196,12 +3856,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_encryption_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4239,14 +3895,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4262,12 +3910,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_linking_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4305,14 +3949,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4328,12 +3964,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_ssh_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4371,14 +4003,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4394,12 +4018,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_s3_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4437,14 +4057,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4460,12 +4072,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_remote_azure_mbs gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4503,14 +4111,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4526,12 +4126,8 @@ size_information(int client_fd)
    data = pgmoneta_append(data, "#TYPE pgmoneta_backup_retain gauge\n");
    for (int i = 0; i < config->number_of_servers; i++)
    {
-      d = pgmoneta_get_server_backup(i);
-
-      number_of_backups = 0;
-      backups = NULL;
-
-      pgmoneta_get_backups(d, &number_of_backups, &backups);
+      number_of_backups = catalog->number_of_backups[i];
+      backups = catalog->backups[i];
 
       if (number_of_backups > 0)
       {
@@ -4563,14 +4159,6 @@ size_information(int client_fd)
 
          data = pgmoneta_append(data, "\n");
       }
-
-      for (int j = 0; j < number_of_backups; j++)
-      {
-         free(backups[j]);
-      }
-      free(backups);
-
-      free(d);
    }
    data = pgmoneta_append(data, "\n");
 
@@ -4788,6 +4376,66 @@ size_information(int client_fd)
    }
 }
 
+static int
+catalog_load(struct catalog** catalog)
+{
+   char* d = NULL;
+   struct catalog* c = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *catalog = NULL;
+
+   c = (struct catalog*)calloc(1, sizeof(struct catalog));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      d = pgmoneta_get_server_backup(i);
+
+      pgmoneta_get_backups(d, &c->number_of_backups[i], &c->backups[i]);
+
+      free(d);
+      d = NULL;
+   }
+
+   *catalog = c;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+catalog_destroy(struct catalog* catalog)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (catalog == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      for (int j = 0; j < catalog->number_of_backups[i]; j++)
+      {
+         free(catalog->backups[i][j]);
+      }
+      free(catalog->backups[i]);
+   }
+
+   free(catalog);
+}
+
 static int
 send_chunk(int client_fd, char* data)
 {
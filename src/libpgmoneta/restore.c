@@ -28,6 +28,8 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <art.h>
+#include <compression.h>
 #include <deque.h>
 #include <info.h>
 #include <logging.h>
@@ -38,24 +40,28 @@
 #include <string.h>
 #include <utils.h>
 #include <value.h>
+#include <workers.h>
 #include <workflow.h>
 
 /* system */
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #define RESTORE_OK            0
 #define RESTORE_MISSING_LABEL 1
 #define RESTORE_NO_DISK_SPACE 2
-#define INCREMENTAL_MAGIC 0xd3ae1f0d
 #define INCREMENTAL_PREFIX_LENGTH (sizeof(INCREMENTAL_PREFIX) - 1)
 #define MANIFEST_FILES "Files"
 #define MAX_PATH_INCREMENTAL (MAX_PATH * 2)
+#define DELTA_TIME_MARGIN 5
 
 /**
  * An rfile stores the metadata we need to use a file on disk for reconstruction.
@@ -80,6 +86,46 @@ struct rfile
    uint32_t truncation_block_length;
 };
 
+/**
+ * A reconstruct task rebuilds one incremental file on a worker. The worker input comes first,
+ * so the task is handed to the worker as its input. The task owns its paths and the manifest
+ * entry of the reconstructed file, and the rfiles of the sources are only alive during the task.
+ * The prior backup directories are shared, and only read.
+ */
+struct reconstruct_task
+{
+   struct worker_input wi;
+   int server;
+   int algorithm;
+   size_t size;
+   char input_file_path[MAX_PATH_INCREMENTAL];
+   char output_file_path[MAX_PATH_INCREMENTAL];
+   char relative_dir[MAX_PATH];
+   char bare_file_name[MAX_PATH];
+   char manifest_path[MAX_PATH_INCREMENTAL];
+   struct deque* prior_backup_dirs;
+   struct json* file;
+};
+
+/**
+ * A delta task brings one file of the target in line with the backup on a worker. The worker
+ * input comes first, so the task is handed to the worker as its input, and the worker frees it.
+ * The from path is the stored file and the to path is its stored name inside the target, which
+ * is extracted to the plain path. The manifest fields are only set for the files of the manifest.
+ * The time of the manifest is only trusted when it is older than the start of the backup
+ */
+struct delta_task
+{
+   struct worker_input wi;
+   char path[MAX_PATH];
+   bool manifest;
+   size_t size;
+   time_t modified;
+   bool trusted;
+   int algorithm;
+   char* checksum;
+};
+
 static char* restore_last_files_names[] = {"/global/pg_control"};
 
 static void clear_manifest_incremental_entries(struct json* manifest);
@@ -97,7 +143,8 @@ static int get_file_manifest(char* path, char* manifest_path, int algorithm, str
  * (the last level of directory should not be followed by back slash)
  * @param algorithm The manifest hash algorithm used for the backup
  * @param prior_backup_dirs The root directory of prior incremental/full backups, from newest to oldest
- * @param files The file array inside manifest of the backup
+ * @param tasks The reconstruct tasks of the incremental files found
+ * @param workers The optional workers, which copy the full files
  * @return 0 on success, 1 if otherwise
  */
 static int combine_backups_recursive(uint32_t tsoid,
@@ -107,7 +154,29 @@ static int combine_backups_recursive(uint32_t tsoid,
                                      char* relative_dir,
                                      int algorithm,
                                      struct deque* prior_backup_dirs,
-                                     struct json* files);
+                                     struct deque* tasks,
+                                     struct workers* workers);
+
+/**
+ * Reconstruct the incremental files, the largest first, so the long reconstructions
+ * don't end up last on a single worker. The manifest entries of the reconstructed
+ * files are added to the manifest once all the tasks are done
+ * @param tasks The reconstruct tasks
+ * @param files The file array inside manifest of the backup
+ * @param workers The optional workers
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+combine_reconstruct(struct deque* tasks, struct json* files, struct workers* workers);
+
+static int
+reconstruct_task_execute(struct reconstruct_task* task);
+
+static void
+do_reconstruct(struct worker_input* wi);
+
+static int
+reconstruct_task_compare(const void* a, const void* b);
 
 /**
  * Reconstruct an incremental backup file from itself and its prior incremental/full backup files to a full backup file
@@ -154,9 +223,6 @@ incremental_rfile_initialize(int server, char* file_path, struct rfile** rf);
 static bool
 is_full_file(struct rfile* rf);
 
-static int
-read_block(struct rfile* rf, off_t offset, uint32_t blocksz, uint8_t* buffer);
-
 static int
 write_reconstructed_file(char* output_file_path,
                          uint32_t block_length,
@@ -170,6 +236,70 @@ write_backup_label(char* from_dir, char* to_dir);
 static uint32_t
 parse_oid(char* name);
 
+/**
+ * Can the target be restored in delta mode. The target must be a directory, and every
+ * tablespace of the backup must already be linked from the target
+ * @param from The data directory of the backup
+ * @param to The target directory
+ * @return True if the target can be restored in delta mode, otherwise false
+ */
+static bool
+delta_possible(char* from, char* to);
+
+/**
+ * Is a postmaster running in the target
+ * @param to The target directory
+ * @return True if postmaster.pid names a live process, otherwise false
+ */
+static bool
+delta_running(char* to);
+
+/**
+ * Load the files of the PostgreSQL manifest of a backup
+ * @param from The data directory of the backup
+ * @param files The resulting files, keyed by path
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+delta_manifest(char* from, struct art** files);
+
+/**
+ * Queue a delta task for each file of a backup directory, and record the plain names
+ * of the files and the directories of the backup
+ * @param from The backup directory
+ * @param to The target directory
+ * @param relative The directory relative to the data directory, ending with a slash, or empty
+ * @param files The files of the manifest
+ * @param start The start time of the backup, or 0 if unknown
+ * @param names The names of the backup
+ * @param workers The optional workers
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+delta_directory(char* from, char* to, char* relative, struct art* files, time_t start, struct art* names, struct workers* workers);
+
+/**
+ * Remove the files and the directories of the target which aren't in the backup
+ * @param to The target directory
+ * @param relative The directory relative to the data directory, ending with a slash, or empty
+ * @param names The names of the backup
+ * @return 0 on success, 1 if otherwise
+ */
+static int
+delta_remove(char* to, char* relative, struct art* names);
+
+static int
+delta_task_execute(struct delta_task* task);
+
+static void
+do_delta(struct worker_input* wi);
+
+static void
+delta_task_destroy(struct delta_task* task);
+
+static int
+delta_parse_time(char* s, time_t* t);
+
 int
 pgmoneta_get_restore_last_files_names(char*** output)
 {
@@ -560,7 +690,7 @@ error:
 }
 
 int
-pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs, struct backup* bck, struct json* manifest)
+pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_dir, struct deque* prior_backup_dirs, struct backup* bck, struct json* manifest, struct workers* workers)
 {
    uint32_t tsoid = 0;
    char relative_tablespace_path[MAX_PATH];
@@ -569,6 +699,7 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
    char otblspc_dir[MAX_PATH];
    char manifest_path[MAX_PATH];
    struct json* files = NULL;
+   struct deque* tasks = NULL;
    struct configuration* config;
 
    if (manifest == NULL || prior_backup_dirs == NULL || base == NULL || input_dir == NULL || output_dir == NULL)
@@ -597,8 +728,13 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
       goto error;
    }
 
+   if (pgmoneta_deque_create(false, &tasks))
+   {
+      goto error;
+   }
+
    // round 1 for base data directory
-   if (combine_backups_recursive(0, server, input_dir, output_dir, NULL, bck->hash_algorithm, prior_backup_dirs, files))
+   if (combine_backups_recursive(0, server, input_dir, output_dir, NULL, bck->hash_algorithm, prior_backup_dirs, tasks, workers))
    {
       goto error;
    }
@@ -631,12 +767,17 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
          pgmoneta_log_error("Combine backups: unable to create symlink %s->%s", otblspc_dir, relative_tablespace_path);
       }
 
-      if (combine_backups_recursive(tsoid, server, itblspc_dir, full_tablespace_path, NULL, bck->hash_algorithm, prior_backup_dirs, files))
+      if (combine_backups_recursive(tsoid, server, itblspc_dir, full_tablespace_path, NULL, bck->hash_algorithm, prior_backup_dirs, tasks, workers))
       {
          goto error;
       }
    }
 
+   if (combine_reconstruct(tasks, files, workers))
+   {
+      goto error;
+   }
+
    if (write_backup_label(input_dir, output_dir))
    {
       goto error;
@@ -648,8 +789,97 @@ pgmoneta_combine_backups(int server, char* base, char* input_dir, char* output_d
       goto error;
    }
 
+   pgmoneta_deque_destroy(tasks);
+
+   return 0;
+error:
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+   }
+   pgmoneta_deque_destroy(tasks);
+
+   return 1;
+}
+
+int
+pgmoneta_restore_delta(char* from, char* to, struct workers* workers)
+{
+   struct art* files = NULL;
+   struct art* names = NULL;
+   struct json* label = NULL;
+   char* modified = NULL;
+   time_t start = 0;
+
+   // the files of a running server must not be rewritten, nor the target be replaced
+   if (delta_running(to))
+   {
+      pgmoneta_log_error("Delta restore: A postmaster is running in %s", to);
+      return 1;
+   }
+
+   if (!delta_possible(from, to))
+   {
+      return 2;
+   }
+
+   if (delta_manifest(from, &files))
+   {
+      pgmoneta_log_error("Delta restore: Unable to read the manifest of %s", from);
+      goto error;
+   }
+
+   // backup_label is written when the backup starts, with the clock of the other files
+   label = (struct json*)pgmoneta_art_search(files, (unsigned char*)"backup_label", strlen("backup_label") + 1);
+   if (label != NULL)
+   {
+      modified = (char*)pgmoneta_json_get(label, "Last-Modified");
+      if (modified == NULL || delta_parse_time(modified, &start))
+      {
+         start = 0;
+      }
+   }
+
+   if (pgmoneta_art_create(&names))
+   {
+      goto error;
+   }
+
+   if (delta_directory(from, to, "", files, start, names, workers))
+   {
+      goto error;
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+   }
+
+   // the files are only removed once the tasks are done, since a task may replace a directory
+   if (delta_remove(to, "", names))
+   {
+      goto error;
+   }
+
+   pgmoneta_art_destroy(files);
+   pgmoneta_art_destroy(names);
+
    return 0;
+
 error:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+   }
+
+   pgmoneta_art_destroy(files);
+   pgmoneta_art_destroy(names);
+
    return 1;
 }
 
@@ -661,7 +891,8 @@ combine_backups_recursive(uint32_t tsoid,
                           char* relative_dir,
                           int algorithm,
                           struct deque* prior_backup_dirs,
-                          struct json* files)
+                          struct deque* tasks,
+                          struct workers* workers)
 {
    bool is_pg_tblspc = false;
    bool is_incremental_dir = false;
@@ -674,7 +905,7 @@ combine_backups_recursive(uint32_t tsoid,
    char relative_prefix[MAX_PATH];
    DIR* dir = NULL;
    struct dirent* entry;
-   struct json* file = NULL;
+   struct reconstruct_task* task = NULL;
 
    memset(ifulldir, 0, MAX_PATH);
    memset(ofulldir, 0, MAX_PATH);
@@ -770,7 +1001,7 @@ combine_backups_recursive(uint32_t tsoid,
          {
             snprintf(new_relative_dir, MAX_PATH, "%s/%s", relative_dir, entry->d_name);
          }
-         combine_backups_recursive(tsoid, server, input_dir, output_dir, new_relative_dir, algorithm, prior_backup_dirs, files);
+         combine_backups_recursive(tsoid, server, input_dir, output_dir, new_relative_dir, algorithm, prior_backup_dirs, tasks, workers);
          continue;
       }
 
@@ -799,31 +1030,38 @@ combine_backups_recursive(uint32_t tsoid,
          // finally found an incremental file
          snprintf(ofullpath, MAX_PATH_INCREMENTAL, "%s/%s", ofulldir, entry->d_name + INCREMENTAL_PREFIX_LENGTH);
          snprintf(manifest_path, MAX_PATH_INCREMENTAL, "%s%s", relative_prefix, entry->d_name + INCREMENTAL_PREFIX_LENGTH);
-         if (reconstruct_backup_file(server,
-                                     ifullpath,
-                                     ofullpath,
-                                     relative_prefix,
-                                     entry->d_name + INCREMENTAL_PREFIX_LENGTH,
-                                     prior_backup_dirs))
+
+         // the reconstruction is done once all the incremental files are known
+         task = (struct reconstruct_task*)malloc(sizeof(struct reconstruct_task));
+         if (task == NULL)
          {
-            pgmoneta_log_error("unable to reconstruct file %s", ifullpath);
             goto error;
          }
-         // Update file entry in manifest
-         if (get_file_manifest(ofullpath, manifest_path, algorithm, &file))
+         memset(task, 0, sizeof(struct reconstruct_task));
+
+         task->wi.workers = workers;
+         task->server = server;
+         task->algorithm = algorithm;
+         task->size = pgmoneta_get_file_size(ifullpath);
+         task->prior_backup_dirs = prior_backup_dirs;
+         snprintf(task->input_file_path, MAX_PATH_INCREMENTAL, "%s", ifullpath);
+         snprintf(task->output_file_path, MAX_PATH_INCREMENTAL, "%s", ofullpath);
+         snprintf(task->relative_dir, MAX_PATH, "%s", relative_prefix);
+         snprintf(task->bare_file_name, MAX_PATH, "%s", entry->d_name + INCREMENTAL_PREFIX_LENGTH);
+         snprintf(task->manifest_path, MAX_PATH_INCREMENTAL, "%s", manifest_path);
+
+         if (pgmoneta_deque_add(tasks, NULL, (uintptr_t)task, ValueMem))
          {
-            pgmoneta_log_error("Unable to get manifest for file %s", ofullpath);
-         }
-         else
-         {
-            pgmoneta_json_append(files, (uintptr_t)file, ValueJSON);
+            free(task);
+            goto error;
          }
+         task = NULL;
       }
       else
       {
          // copy the full file from input dir to output dir
          snprintf(ofullpath, MAX_PATH_INCREMENTAL, "%s/%s", ofulldir, entry->d_name);
-         pgmoneta_copy_file(ifullpath, ofullpath, NULL);
+         pgmoneta_copy_file(ifullpath, ofullpath, workers);
       }
    }
 
@@ -840,6 +1078,141 @@ error:
    return 1;
 }
 
+static int
+combine_reconstruct(struct deque* tasks, struct json* files, struct workers* workers)
+{
+   int number_of_tasks = 0;
+   int n = 0;
+   struct reconstruct_task** array = NULL;
+   struct deque_iterator* iter = NULL;
+
+   number_of_tasks = pgmoneta_deque_size(tasks);
+   if (number_of_tasks == 0)
+   {
+      goto done;
+   }
+
+   array = (struct reconstruct_task**)malloc(sizeof(struct reconstruct_task*) * number_of_tasks);
+   if (array == NULL)
+   {
+      goto error;
+   }
+
+   pgmoneta_deque_iterator_create(tasks, &iter);
+   while (pgmoneta_deque_iterator_next(iter) && n < number_of_tasks)
+   {
+      array[n++] = (struct reconstruct_task*)pgmoneta_value_data(iter->value);
+   }
+   pgmoneta_deque_iterator_destroy(iter);
+   iter = NULL;
+
+   qsort(array, n, sizeof(struct reconstruct_task*), reconstruct_task_compare);
+
+   for (int i = 0; i < n; i++)
+   {
+      if (workers != NULL)
+      {
+         if (workers->outcome)
+         {
+            pgmoneta_workers_add(workers, do_reconstruct, &array[i]->wi);
+         }
+      }
+      else if (reconstruct_task_execute(array[i]))
+      {
+         goto error;
+      }
+   }
+
+done:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+   }
+
+   // the manifest is only updated here, since the json isn't shared between threads
+   for (int i = 0; i < n; i++)
+   {
+      if (array[i]->file != NULL)
+      {
+         pgmoneta_json_append(files, (uintptr_t)array[i]->file, ValueJSON);
+         array[i]->file = NULL;
+      }
+   }
+
+   free(array);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < n; i++)
+   {
+      pgmoneta_json_destroy(array[i]->file);
+      array[i]->file = NULL;
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+   free(array);
+
+   return 1;
+}
+
+static int
+reconstruct_task_execute(struct reconstruct_task* task)
+{
+   if (reconstruct_backup_file(task->server,
+                               task->input_file_path,
+                               task->output_file_path,
+                               task->relative_dir,
+                               task->bare_file_name,
+                               task->prior_backup_dirs))
+   {
+      pgmoneta_log_error("unable to reconstruct file %s", task->input_file_path);
+      return 1;
+   }
+
+   // Update file entry in manifest
+   if (get_file_manifest(task->output_file_path, task->manifest_path, task->algorithm, &task->file))
+   {
+      pgmoneta_log_error("Unable to get manifest for file %s", task->output_file_path);
+   }
+
+   return 0;
+}
+
+static void
+do_reconstruct(struct worker_input* wi)
+{
+   struct reconstruct_task* task = (struct reconstruct_task*)wi;
+
+   if (reconstruct_task_execute(task))
+   {
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+}
+
+static int
+reconstruct_task_compare(const void* a, const void* b)
+{
+   struct reconstruct_task* ta = *(struct reconstruct_task**)a;
+   struct reconstruct_task* tb = *(struct reconstruct_task**)b;
+
+   if (ta->size == tb->size)
+   {
+      return 0;
+   }
+
+   return ta->size > tb->size ? -1 : 1;
+}
+
 static int
 reconstruct_backup_file(int server,
                         char* input_file_path,
@@ -1178,28 +1551,6 @@ is_full_file(struct rfile* rf)
    return rf->header_length == 0;
 }
 
-static int
-read_block(struct rfile* rf, off_t offset, uint32_t blocksz, uint8_t* buffer)
-{
-   int nread = 0;
-   if (fseek(rf->fp, offset, SEEK_SET))
-   {
-      pgmoneta_log_error("unable to locate file pointer to offset %llu in file %s", offset, rf->filepath);
-      goto error;
-   }
-
-   nread = fread(buffer, 1, blocksz, rf->fp);
-   if (nread != blocksz)
-   {
-      pgmoneta_log_error("unable to read block at offset %llu from file %s", offset, rf->filepath);
-      goto error;
-   }
-
-   return 0;
-error:
-   return 1;
-}
-
 static int
 write_reconstructed_file(char* output_file_path,
                          uint32_t block_length,
@@ -1207,54 +1558,56 @@ write_reconstructed_file(char* output_file_path,
                          off_t* offset_map,
                          uint32_t blocksz)
 {
-   FILE* wfp = NULL;
-   uint8_t buffer[blocksz];
+   int fd = -1;
    struct rfile* s = NULL;
+   uint32_t run = 0;
 
-   wfp = fopen(output_file_path, "wb+");
-   if (wfp == NULL)
+   fd = open(output_file_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+   if (fd < 0)
    {
       pgmoneta_log_error("reconstruct: unable to open file for reconstruction at %s", output_file_path);
       goto error;
    }
-   for (int i = 0; i < block_length; i++)
+
+   // the file gets its full length up front, so the blocks without a source
+   // are holes which read back as zeros
+   if (ftruncate(fd, (off_t)block_length * blocksz))
+   {
+      pgmoneta_log_error("reconstruct: unable to set the length of file %s", output_file_path);
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < block_length; i += run)
    {
-      memset(buffer, 0, blocksz);
       s = source_map[i];
+
+      // blocks from the same source at consecutive offsets are copied as one range
+      run = 1;
+      while (i + run < block_length && source_map[i + run] == s &&
+             (s == NULL || offset_map[i + run] == offset_map[i] + (off_t)run * blocksz))
+      {
+         run++;
+      }
+
       if (s == NULL)
       {
-         // zero fill the block since source doesn't exist
-         memset(buffer, 0, blocksz);
-         if (fwrite(buffer, 1, blocksz, wfp) != blocksz)
-         {
-            pgmoneta_log_error("reconstruct: fail to write to file %s", output_file_path);
-            goto error;
-         }
+         // the source doesn't exist, so leave a hole
+         continue;
       }
-      else
+
+      // reflink or copy_file_range when the filesystem allows it, otherwise large preads
+      if (pgmoneta_copy_file_range(fileno(s->fp), offset_map[i], fd, (off_t)i * blocksz, (size_t)run * blocksz))
       {
-         // we might be able to use copy_file_range to have faster copy,
-         // but for now let's stay in user space
-         if (read_block(s, offset_map[i], blocksz, buffer))
-         {
-            goto error;
-         }
-         if (fwrite(buffer, 1, blocksz, wfp) != blocksz)
-         {
-            pgmoneta_log_error("reconstruct: fail to write to file %s", output_file_path);
-            goto error;
-         }
+         pgmoneta_log_error("reconstruct: unable to copy %u blocks at offset %llu from file %s", run, (unsigned long long)offset_map[i], s->filepath);
+         goto error;
       }
    }
-   if (wfp != NULL)
-   {
-      fclose(wfp);
-   }
+   close(fd);
    return 0;
 error:
-   if (wfp != NULL)
+   if (fd >= 0)
    {
-      fclose(wfp);
+      close(fd);
    }
    return 1;
 }
@@ -1380,7 +1733,7 @@ get_file_manifest(char* path, char* manifest_path, int algorithm, struct json**
    struct json* f = NULL;
    size_t size = 0;
    time_t t;
-   struct tm* tinfo;
+   struct tm tinfo;
    char now[MISC_LENGTH];
    char* checksum = NULL;
 
@@ -1390,9 +1743,9 @@ get_file_manifest(char* path, char* manifest_path, int algorithm, struct json**
    size = pgmoneta_get_file_size(path);
 
    time(&t);
-   tinfo = gmtime(&t);
+   gmtime_r(&t, &tinfo);
    memset(now, 0, sizeof(now));
-   strftime(now, sizeof(now), "%Y-%m-%d %H:%M:%S GMT", tinfo);
+   strftime(now, sizeof(now), "%Y-%m-%d %H:%M:%S GMT", &tinfo);
 
    if (pgmoneta_create_file_hash(algorithm, path, &checksum))
    {
@@ -1433,4 +1786,539 @@ error:
    free(checksum);
    pgmoneta_json_destroy(f);
    return 1;
-}
\ No newline at end of file
+}
+
+static bool
+delta_possible(char* from, char* to)
+{
+   char path[MAX_PATH];
+   DIR* d = NULL;
+   struct dirent* entry;
+   struct stat st;
+   bool possible = true;
+
+   if (stat(to, &st) || !S_ISDIR(st.st_mode))
+   {
+      return false;
+   }
+
+   memset(path, 0, MAX_PATH);
+   snprintf(path, MAX_PATH, "%s/pg_tblspc", from);
+
+   d = opendir(path);
+   if (d == NULL)
+   {
+      return true;
+   }
+
+   while (possible && (entry = readdir(d)))
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      memset(path, 0, MAX_PATH);
+      snprintf(path, MAX_PATH, "%s/pg_tblspc/%s", to, entry->d_name);
+
+      if (stat(path, &st) || !S_ISDIR(st.st_mode))
+      {
+         pgmoneta_log_debug("Delta restore: Tablespace %s isn't linked from %s", entry->d_name, to);
+         possible = false;
+      }
+   }
+
+   closedir(d);
+
+   return possible;
+}
+
+static bool
+delta_running(char* to)
+{
+   char path[MAX_PATH];
+   char buffer[MISC_LENGTH];
+   FILE* file = NULL;
+   pid_t pid = 0;
+   bool running = false;
+
+   memset(path, 0, MAX_PATH);
+   snprintf(path, MAX_PATH, "%s/postmaster.pid", to);
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      errno = 0;
+      return false;
+   }
+
+   memset(buffer, 0, sizeof(buffer));
+   if (fgets(buffer, sizeof(buffer), file) != NULL)
+   {
+      pid = (pid_t)strtol(buffer, NULL, 10);
+   }
+
+   fclose(file);
+
+   // a process of another user is still alive
+   if (pid > 0 && (!kill(pid, 0) || errno == EPERM))
+   {
+      running = true;
+   }
+   errno = 0;
+
+   return running;
+}
+
+static int
+delta_manifest(char* from, struct art** files)
+{
+   char manifest_path[MAX_PATH];
+   char* key_path[1] = {MANIFEST_FILES};
+   char* path = NULL;
+   struct art* a = NULL;
+   struct json_reader* reader = NULL;
+   struct json* file = NULL;
+
+   *files = NULL;
+
+   memset(manifest_path, 0, MAX_PATH);
+   snprintf(manifest_path, MAX_PATH, "%s/backup_manifest", from);
+
+   if (pgmoneta_art_create(&a))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_reader_init(manifest_path, &reader))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_json_locate(reader, key_path, 1))
+   {
+      pgmoneta_log_error("cannot locate files array in manifest %s", manifest_path);
+      goto error;
+   }
+
+   while (pgmoneta_json_next_array_item(reader, &file))
+   {
+      path = (char*)pgmoneta_json_get(file, "Path");
+
+      // files with an encoded path are always rewritten
+      if (path != NULL)
+      {
+         if (pgmoneta_art_insert(a, (unsigned char*)path, strlen(path) + 1, (uintptr_t)file, ValueJSON))
+         {
+            goto error;
+         }
+      }
+      else
+      {
+         pgmoneta_json_destroy(file);
+      }
+
+      file = NULL;
+   }
+
+   pgmoneta_json_reader_close(reader);
+
+   *files = a;
+
+   return 0;
+
+error:
+
+   pgmoneta_json_reader_close(reader);
+   pgmoneta_json_destroy(file);
+   pgmoneta_art_destroy(a);
+
+   return 1;
+}
+
+static int
+delta_directory(char* from, char* to, char* relative, struct art* files, time_t start, struct art* names, struct workers* workers)
+{
+   DIR* d = NULL;
+   struct dirent* entry;
+   struct stat st;
+   char from_buffer[MAX_PATH];
+   char to_buffer[MAX_PATH];
+   char name[MAX_PATH];
+   char relative_buffer[MAX_PATH];
+   bool last;
+   int compression;
+   struct json* file = NULL;
+   struct delta_task* task = NULL;
+
+   if (pgmoneta_mkdir(to))
+   {
+      pgmoneta_log_error("Delta restore: Unable to create directory %s", to);
+      goto error;
+   }
+
+   d = opendir(from);
+   if (d == NULL)
+   {
+      pgmoneta_log_error("Delta restore: Unable to open directory %s", from);
+      goto error;
+   }
+
+   while ((entry = readdir(d)))
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      memset(from_buffer, 0, MAX_PATH);
+      snprintf(from_buffer, MAX_PATH, "%s/%s", from, entry->d_name);
+
+      // the tablespace links of the backup are followed into the tablespaces
+      if (stat(from_buffer, &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         memset(relative_buffer, 0, MAX_PATH);
+         snprintf(relative_buffer, MAX_PATH, "%s%s", relative, entry->d_name);
+
+         if (pgmoneta_art_insert(names, (unsigned char*)relative_buffer, strlen(relative_buffer) + 1, true, ValueBool))
+         {
+            goto error;
+         }
+
+         memset(to_buffer, 0, MAX_PATH);
+         snprintf(to_buffer, MAX_PATH, "%s/%s", to, entry->d_name);
+
+         strcat(relative_buffer, "/");
+
+         if (delta_directory(from_buffer, to_buffer, relative_buffer, files, start, names, workers))
+         {
+            goto error;
+         }
+
+         continue;
+      }
+
+      // the plain name of the file, without the suffixes of the encryption and the compression
+      memset(name, 0, MAX_PATH);
+      snprintf(name, MAX_PATH, "%s", entry->d_name);
+
+      if (pgmoneta_ends_with(name, ".aes"))
+      {
+         name[strlen(name) - strlen(".aes")] = '\0';
+      }
+
+      compression = pgmoneta_compression_type(name);
+      name[strlen(name) - strlen(pgmoneta_compression_suffix(compression))] = '\0';
+
+      memset(relative_buffer, 0, MAX_PATH);
+      snprintf(relative_buffer, MAX_PATH, "%s%s", relative, name);
+
+      if (pgmoneta_art_insert(names, (unsigned char*)relative_buffer, strlen(relative_buffer) + 1, true, ValueBool))
+      {
+         goto error;
+      }
+
+      // the last files are restored once the rest of the backup is in place
+      last = false;
+      for (size_t i = 0; i < sizeof(restore_last_files_names) / sizeof(restore_last_files_names[0]); i++)
+      {
+         if (!strcmp(relative_buffer, restore_last_files_names[i] + 1))
+         {
+            last = true;
+         }
+      }
+
+      if (last)
+      {
+         continue;
+      }
+
+      task = (struct delta_task*)malloc(sizeof(struct delta_task));
+      if (task == NULL)
+      {
+         goto error;
+      }
+
+      memset(task, 0, sizeof(struct delta_task));
+      task->wi.workers = workers;
+      snprintf(task->wi.from, MAX_PATH, "%s", from_buffer);
+      snprintf(task->wi.to, MAX_PATH, "%s/%s", to, entry->d_name);
+      snprintf(task->path, MAX_PATH, "%s/%s", to, name);
+
+      file = (struct json*)pgmoneta_art_search(files, (unsigned char*)relative_buffer, strlen(relative_buffer) + 1);
+      if (file != NULL)
+      {
+         char* algorithm = (char*)pgmoneta_json_get(file, "Checksum-Algorithm");
+         char* checksum = (char*)pgmoneta_json_get(file, "Checksum");
+         char* modified = (char*)pgmoneta_json_get(file, "Last-Modified");
+
+         task->manifest = true;
+         task->size = (size_t)pgmoneta_json_get(file, "Size");
+
+         if (modified == NULL || delta_parse_time(modified, &task->modified))
+         {
+            task->modified = 0;
+         }
+
+         // the time has a resolution of a second, so a file changed close to the start may
+         // have been changed again after it was read, without another time
+         task->trusted = task->modified != 0 && start != 0 && task->modified + DELTA_TIME_MARGIN < start;
+
+         // without a checksum a file of the right size, but another time, is always rewritten
+         if (algorithm != NULL && checksum != NULL && strcasecmp(algorithm, "NONE"))
+         {
+            task->algorithm = pgmoneta_get_hash_algorithm(algorithm);
+            task->checksum = strdup(checksum);
+         }
+      }
+
+      if (workers != NULL)
+      {
+         if (workers->outcome)
+         {
+            pgmoneta_workers_add(workers, do_delta, &task->wi);
+         }
+         else
+         {
+            delta_task_destroy(task);
+         }
+      }
+      else
+      {
+         if (delta_task_execute(task))
+         {
+            delta_task_destroy(task);
+            task = NULL;
+            goto error;
+         }
+
+         delta_task_destroy(task);
+      }
+
+      task = NULL;
+   }
+
+   closedir(d);
+
+   return 0;
+
+error:
+
+   if (d != NULL)
+   {
+      closedir(d);
+   }
+
+   return 1;
+}
+
+static int
+delta_remove(char* to, char* relative, struct art* names)
+{
+   DIR* d = NULL;
+   struct dirent* entry;
+   struct stat st;
+   char to_buffer[MAX_PATH];
+   char relative_buffer[MAX_PATH];
+
+   d = opendir(to);
+   if (d == NULL)
+   {
+      pgmoneta_log_error("Delta restore: Unable to open directory %s", to);
+      goto error;
+   }
+
+   while ((entry = readdir(d)))
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      memset(to_buffer, 0, MAX_PATH);
+      snprintf(to_buffer, MAX_PATH, "%s/%s", to, entry->d_name);
+
+      memset(relative_buffer, 0, MAX_PATH);
+      snprintf(relative_buffer, MAX_PATH, "%s%s", relative, entry->d_name);
+
+      if (lstat(to_buffer, &st))
+      {
+         continue;
+      }
+
+      if (!pgmoneta_art_contains_key(names, (unsigned char*)relative_buffer, strlen(relative_buffer) + 1))
+      {
+         pgmoneta_log_trace("Delta restore: Remove %s", to_buffer);
+
+         if (S_ISDIR(st.st_mode))
+         {
+            if (pgmoneta_delete_directory(to_buffer))
+            {
+               pgmoneta_log_error("Delta restore: Unable to remove directory %s", to_buffer);
+               goto error;
+            }
+         }
+         else if (unlink(to_buffer))
+         {
+            pgmoneta_log_error("Delta restore: Unable to remove file %s", to_buffer);
+            goto error;
+         }
+
+         continue;
+      }
+
+      // the tablespace links of the target are followed, but never removed
+      if (S_ISLNK(st.st_mode) && stat(to_buffer, &st))
+      {
+         continue;
+      }
+
+      if (S_ISDIR(st.st_mode))
+      {
+         strcat(relative_buffer, "/");
+
+         if (delta_remove(to_buffer, relative_buffer, names))
+         {
+            goto error;
+         }
+      }
+   }
+
+   closedir(d);
+
+   return 0;
+
+error:
+
+   if (d != NULL)
+   {
+      closedir(d);
+   }
+
+   return 1;
+}
+
+static int
+delta_task_execute(struct delta_task* task)
+{
+   struct stat st;
+   struct timespec times[2];
+   char* checksum = NULL;
+   bool same = false;
+
+   if (!lstat(task->path, &st))
+   {
+      if (S_ISDIR(st.st_mode))
+      {
+         if (pgmoneta_delete_directory(task->path))
+         {
+            pgmoneta_log_error("Delta restore: Unable to remove directory %s", task->path);
+            goto error;
+         }
+      }
+      else if (task->manifest && S_ISREG(st.st_mode) && (size_t)st.st_size == task->size)
+      {
+         // a file with the size and the time of the manifest wasn't touched since it was restored
+         if (task->trusted && st.st_mtime == task->modified)
+         {
+            same = true;
+         }
+         else if (task->checksum != NULL &&
+                  !pgmoneta_create_file_hash(task->algorithm, task->path, &checksum) &&
+                  !strcmp(checksum, task->checksum))
+         {
+            same = true;
+         }
+      }
+   }
+
+   if (!same)
+   {
+      pgmoneta_log_trace("Delta restore: Restore %s", task->path);
+
+      pgmoneta_extract_file(task->wi.from, task->wi.to, NULL);
+
+      if (lstat(task->path, &st) || !S_ISREG(st.st_mode) ||
+          (task->manifest && (size_t)st.st_size != task->size))
+      {
+         pgmoneta_log_error("Delta restore: Unable to restore %s", task->path);
+         goto error;
+      }
+   }
+
+   // the time of the manifest lets the next delta restore skip the file without reading it,
+   // which is only safe when the backup read the file well after its last change
+   if (task->manifest && task->trusted)
+   {
+      times[0].tv_sec = 0;
+      times[0].tv_nsec = UTIME_OMIT;
+      times[1].tv_sec = task->modified;
+      times[1].tv_nsec = 0;
+
+      if (utimensat(AT_FDCWD, task->path, times, 0))
+      {
+         pgmoneta_log_debug("Delta restore: Unable to set the time of %s", task->path);
+      }
+   }
+
+   free(checksum);
+
+   return 0;
+
+error:
+
+   free(checksum);
+
+   return 1;
+}
+
+static void
+do_delta(struct worker_input* wi)
+{
+   struct delta_task* task = (struct delta_task*)wi;
+
+   if (delta_task_execute(task))
+   {
+      if (wi->workers != NULL)
+      {
+         wi->workers->outcome = false;
+      }
+   }
+
+   delta_task_destroy(task);
+}
+
+static void
+delta_task_destroy(struct delta_task* task)
+{
+   if (task != NULL)
+   {
+      free(task->checksum);
+      free(task);
+   }
+}
+
+static int
+delta_parse_time(char* s, time_t* t)
+{
+   struct tm tm;
+   char* end = NULL;
+
+   memset(&tm, 0, sizeof(struct tm));
+
+   // the manifest times are in GMT, like 2025-01-01 12:00:00 GMT
+   end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+   if (end == NULL)
+   {
+      return 1;
+   }
+
+   *t = timegm(&tm);
+
+   return 0;
+}
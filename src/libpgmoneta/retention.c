@@ -28,6 +28,7 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <consolidate.h>
 #include <workflow.h>
 #include <logging.h>
 #include <retention.h>
@@ -50,6 +51,12 @@ pgmoneta_retention(char** argv)
    if (atomic_load(&config->active_restores) == 0 &&
        atomic_load(&config->active_archives) == 0)
    {
+      // consolidated chains can be removed by the retention right away
+      for (int i = 0; config->consolidate > 0 && i < config->number_of_servers; i++)
+      {
+         pgmoneta_consolidate(i);
+      }
+
       workflow = pgmoneta_workflow_create(WORKFLOW_TYPE_RETENTION, 0, NULL);
 
       pgmoneta_deque_create(false, &nodes);
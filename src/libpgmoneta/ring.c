@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <logging.h>
+#include <memory.h>
+#include <ring.h>
+
+/* system */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int ring_put(struct ring* ring, void* header, size_t header_size, void* data, size_t size, ring_writer writer, void* arg, bool block);
+static void* ring_do(void* arg);
+
+int
+pgmoneta_ring_create(atomic_int* depth, struct ring** ring)
+{
+   struct ring* r = NULL;
+
+   *ring = NULL;
+
+   r = (struct ring*)malloc(sizeof(struct ring));
+   if (r == NULL)
+   {
+      goto error;
+   }
+
+   memset(r, 0, sizeof(struct ring));
+
+   for (int i = 0; i < RING_SIZE; i++)
+   {
+      pgmoneta_memory_stream_buffer_init(&r->buffers[i]);
+      if (r->buffers[i] == NULL || r->buffers[i]->buffer == NULL)
+      {
+         goto error;
+      }
+   }
+
+   r->depth = depth;
+   if (r->depth != NULL)
+   {
+      atomic_store(r->depth, 0);
+   }
+
+   pthread_mutex_init(&r->mutex, NULL);
+   pthread_cond_init(&r->not_empty, NULL);
+   pthread_cond_init(&r->not_full, NULL);
+
+   if (pthread_create(&r->thread, NULL, &ring_do, r))
+   {
+      pgmoneta_log_error("Could not create the ring writer thread");
+      pthread_cond_destroy(&r->not_full);
+      pthread_cond_destroy(&r->not_empty);
+      pthread_mutex_destroy(&r->mutex);
+      goto error;
+   }
+
+   *ring = r;
+
+   return 0;
+
+error:
+
+   if (r != NULL)
+   {
+      for (int i = 0; i < RING_SIZE; i++)
+      {
+         pgmoneta_memory_stream_buffer_free(r->buffers[i]);
+      }
+      free(r);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_ring_write(struct ring* ring, void* data, size_t size, ring_writer writer, void* arg)
+{
+   return ring_put(ring, NULL, 0, data, size, writer, arg, true);
+}
+
+int
+pgmoneta_ring_offer(struct ring* ring, void* header, size_t header_size, void* data, size_t size, ring_writer writer, void* arg)
+{
+   return ring_put(ring, header, header_size, data, size, writer, arg, false);
+}
+
+int
+pgmoneta_ring_flush(struct ring* ring)
+{
+   bool failed;
+
+   pthread_mutex_lock(&ring->mutex);
+
+   while (ring->count > 0)
+   {
+      pthread_cond_wait(&ring->not_full, &ring->mutex);
+   }
+
+   failed = ring->failed;
+
+   pthread_mutex_unlock(&ring->mutex);
+
+   return failed ? 1 : 0;
+}
+
+void
+pgmoneta_ring_destroy(struct ring* ring)
+{
+   if (ring == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&ring->mutex);
+   ring->stop = true;
+   pthread_cond_signal(&ring->not_empty);
+   pthread_mutex_unlock(&ring->mutex);
+
+   pthread_join(ring->thread, NULL);
+
+   pthread_cond_destroy(&ring->not_full);
+   pthread_cond_destroy(&ring->not_empty);
+   pthread_mutex_destroy(&ring->mutex);
+
+   for (int i = 0; i < RING_SIZE; i++)
+   {
+      pgmoneta_memory_stream_buffer_free(ring->buffers[i]);
+   }
+
+   if (ring->depth != NULL)
+   {
+      atomic_store(ring->depth, 0);
+   }
+
+   free(ring);
+}
+
+static int
+ring_put(struct ring* ring, void* header, size_t header_size, void* data, size_t size, ring_writer writer, void* arg, bool block)
+{
+   struct stream_buffer* buffer = NULL;
+
+   pthread_mutex_lock(&ring->mutex);
+
+   while (block && ring->count == RING_SIZE && !ring->failed)
+   {
+      pthread_cond_wait(&ring->not_full, &ring->mutex);
+   }
+
+   if (ring->failed)
+   {
+      pthread_mutex_unlock(&ring->mutex);
+      return 1;
+   }
+
+   if (ring->count == RING_SIZE)
+   {
+      pthread_mutex_unlock(&ring->mutex);
+      return 2;
+   }
+
+   // the slot is owned by the producer until it is counted
+   buffer = ring->buffers[ring->tail];
+
+   pthread_mutex_unlock(&ring->mutex);
+
+   if ((size_t)buffer->size < header_size + size)
+   {
+      if (pgmoneta_memory_stream_buffer_enlarge(buffer, (int)(header_size + size - buffer->size)) || (size_t)buffer->size < header_size + size)
+      {
+         pgmoneta_log_error("Could not enlarge the ring buffer to %zu bytes", header_size + size);
+         return 1;
+      }
+   }
+
+   if (header_size > 0)
+   {
+      memcpy(buffer->buffer, header, header_size);
+   }
+   if (size > 0)
+   {
+      memcpy(buffer->buffer + header_size, data, size);
+   }
+   buffer->start = 0;
+   buffer->cursor = 0;
+   buffer->end = (int)(header_size + size);
+
+   pthread_mutex_lock(&ring->mutex);
+
+   ring->writers[ring->tail] = writer;
+   ring->args[ring->tail] = arg;
+   ring->tail = (ring->tail + 1) % RING_SIZE;
+   ring->count++;
+
+   if (ring->depth != NULL)
+   {
+      atomic_store(ring->depth, ring->count);
+   }
+
+   pthread_cond_signal(&ring->not_empty);
+   pthread_mutex_unlock(&ring->mutex);
+
+   return 0;
+}
+
+static void*
+ring_do(void* arg)
+{
+   struct ring* ring = (struct ring*)arg;
+   struct stream_buffer* buffer = NULL;
+   ring_writer writer = NULL;
+   void* writer_arg = NULL;
+   bool failed;
+
+   while (true)
+   {
+      pthread_mutex_lock(&ring->mutex);
+
+      while (ring->count == 0 && !ring->stop)
+      {
+         pthread_cond_wait(&ring->not_empty, &ring->mutex);
+      }
+
+      if (ring->count == 0)
+      {
+         pthread_mutex_unlock(&ring->mutex);
+         break;
+      }
+
+      buffer = ring->buffers[ring->head];
+      writer = ring->writers[ring->head];
+      writer_arg = ring->args[ring->head];
+      failed = ring->failed;
+
+      pthread_mutex_unlock(&ring->mutex);
+
+      // once a write has failed the remaining buffers are only drained
+      if (!failed && writer(buffer->buffer + buffer->start, (size_t)(buffer->end - buffer->start), writer_arg))
+      {
+         failed = true;
+      }
+
+      pthread_mutex_lock(&ring->mutex);
+
+      if (failed)
+      {
+         ring->failed = true;
+      }
+
+      ring->head = (ring->head + 1) % RING_SIZE;
+      ring->count--;
+
+      if (ring->depth != NULL)
+      {
+         atomic_store(ring->depth, ring->count);
+      }
+
+      pthread_cond_broadcast(&ring->not_full);
+      pthread_mutex_unlock(&ring->mutex);
+   }
+
+   return NULL;
+}
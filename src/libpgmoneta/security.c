@@ -3146,6 +3146,174 @@ pgmoneta_create_file_hash(int algorithm, char* file_path, char** hash)
    return stat;
 }
 
+int
+pgmoneta_hash_create(int algorithm, struct hash** hash)
+{
+   struct hash* h = NULL;
+   const EVP_MD* md = NULL;
+
+   *hash = NULL;
+
+   h = (struct hash*)malloc(sizeof(struct hash));
+   if (h == NULL)
+   {
+      goto error;
+   }
+
+   memset(h, 0, sizeof(struct hash));
+
+   h->algorithm = algorithm;
+
+   switch (algorithm)
+   {
+      case HASH_ALGORITHM_CRC32C:
+         break;
+      case HASH_ALGORITHM_SHA224:
+         md = EVP_get_digestbyname("SHA224");
+         break;
+      case HASH_ALGORITHM_DEFAULT:
+      case HASH_ALGORITHM_SHA256:
+         md = EVP_get_digestbyname("SHA256");
+         break;
+      case HASH_ALGORITHM_SHA384:
+         md = EVP_get_digestbyname("SHA384");
+         break;
+      case HASH_ALGORITHM_SHA512:
+         md = EVP_get_digestbyname("SHA512");
+         break;
+      default:
+         pgmoneta_log_error("Unrecognized hash algorithm: %d", algorithm);
+         goto error;
+   }
+
+   if (algorithm != HASH_ALGORITHM_CRC32C)
+   {
+      if (md == NULL)
+      {
+         pgmoneta_log_error("Invalid message digest: %d", algorithm);
+         goto error;
+      }
+
+      h->md_ctx = EVP_MD_CTX_new();
+      if (h->md_ctx == NULL)
+      {
+         goto error;
+      }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      if (!EVP_DigestInit_ex2(h->md_ctx, md, NULL))
+#else
+      if (!EVP_DigestInit_ex(h->md_ctx, md, NULL))
+#endif
+      {
+         pgmoneta_log_error("Message digest initialization failed");
+         goto error;
+      }
+   }
+
+   *hash = h;
+
+   return 0;
+
+error:
+
+   pgmoneta_hash_destroy(h);
+
+   return 1;
+}
+
+int
+pgmoneta_hash_update(struct hash* hash, void* data, size_t size)
+{
+   if (hash == NULL || data == NULL)
+   {
+      return 1;
+   }
+
+   if (hash->algorithm == HASH_ALGORITHM_CRC32C)
+   {
+      return pgmoneta_create_crc32c_buffer(data, size, &hash->crc);
+   }
+
+   if (!EVP_DigestUpdate(hash->md_ctx, data, size))
+   {
+      pgmoneta_log_error("Message digest update failed");
+      return 1;
+   }
+
+   return 0;
+}
+
+int
+pgmoneta_hash_final(struct hash* hash, char** value)
+{
+   unsigned char md_value[EVP_MAX_MD_SIZE];
+   unsigned int md_len;
+   char* v = NULL;
+
+   *value = NULL;
+
+   if (hash == NULL)
+   {
+      goto error;
+   }
+
+   if (hash->algorithm == HASH_ALGORITHM_CRC32C)
+   {
+      v = malloc(9);
+      if (v == NULL)
+      {
+         goto error;
+      }
+
+      memset(v, 0, 9);
+      sprintf(v, "%08x", hash->crc);
+   }
+   else
+   {
+      if (!EVP_DigestFinal_ex(hash->md_ctx, md_value, &md_len))
+      {
+         pgmoneta_log_error("Message digest finalization failed");
+         goto error;
+      }
+
+      v = malloc(md_len * 2 + 1);
+      if (v == NULL)
+      {
+         goto error;
+      }
+
+      memset(v, 0, md_len * 2 + 1);
+
+      for (size_t i = 0; i < md_len; i++)
+      {
+         sprintf(&v[i * 2], "%02x", md_value[i]);
+      }
+   }
+
+   *value = v;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+pgmoneta_hash_destroy(struct hash* hash)
+{
+   if (hash != NULL)
+   {
+      if (hash->md_ctx != NULL)
+      {
+         EVP_MD_CTX_free(hash->md_ctx);
+      }
+
+      free(hash);
+   }
+}
+
 void
 pgmoneta_close_ssl(SSL* ssl)
 {
@@ -0,0 +1,670 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <uring.h>
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static int uring_setup(struct uring_file* file);
+static int uring_flush(struct uring_file* file);
+static int plain_write(int fd, void* data, size_t size);
+
+#ifdef HAVE_LIBURING
+static void uring_prepare(struct uring_file* file, int slot);
+static int uring_wait(struct uring_file* file, int slot);
+static int uring_complete(struct uring_file* file, int slot);
+#endif
+
+int
+pgmoneta_uring_open_read(char* path, struct uring_file** file)
+{
+   struct uring_file* f = NULL;
+   struct stat st;
+
+   *file = NULL;
+
+   f = (struct uring_file*)malloc(sizeof(struct uring_file));
+
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   memset(f, 0, sizeof(struct uring_file));
+   f->fd = open(path, O_RDONLY);
+
+   if (f->fd < 0)
+   {
+      goto error;
+   }
+
+   if (fstat(f->fd, &st))
+   {
+      goto error;
+   }
+
+   f->size = st.st_size;
+
+   /* A file that fits in one buffer is cheaper to read directly */
+   if (f->size > URING_BLOCK_SIZE && !uring_setup(f))
+   {
+#ifdef HAVE_LIBURING
+      for (int i = 0; i < URING_QUEUE_DEPTH && f->offset < f->size; i++)
+      {
+         uring_prepare(f, i);
+      }
+#endif
+   }
+
+   *file = f;
+
+   return 0;
+
+error:
+
+   if (f != NULL)
+   {
+      if (f->fd >= 0)
+      {
+         close(f->fd);
+      }
+      free(f);
+   }
+
+   return 1;
+}
+
+int
+pgmoneta_uring_open_write(char* path, int permissions, struct uring_file** file)
+{
+   struct uring_file* f = NULL;
+
+   *file = NULL;
+
+   f = (struct uring_file*)malloc(sizeof(struct uring_file));
+
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   memset(f, 0, sizeof(struct uring_file));
+   f->write = true;
+   f->fd = -1;
+
+   /* The io_uring is set up when the first buffer is full */
+   f->buffers[0] = malloc(URING_BLOCK_SIZE);
+
+   if (f->buffers[0] == NULL)
+   {
+      goto error;
+   }
+
+   f->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, permissions);
+
+   if (f->fd < 0)
+   {
+      goto error;
+   }
+
+   *file = f;
+
+   return 0;
+
+error:
+
+   if (f != NULL)
+   {
+      free(f->buffers[0]);
+      free(f);
+   }
+
+   return 1;
+}
+
+ssize_t
+pgmoneta_uring_read(struct uring_file* file, void* data, size_t size)
+{
+   size_t total = 0;
+   ssize_t n;
+
+   if (file == NULL || file->write || file->failed)
+   {
+      return -1;
+   }
+
+   if (!file->active)
+   {
+      while (total < size)
+      {
+         n = read(file->fd, (char*)data + total, size - total);
+
+         if (n < 0)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+            goto error;
+         }
+         else if (n == 0)
+         {
+            break;
+         }
+
+         total += n;
+      }
+
+      return total;
+   }
+
+#ifdef HAVE_LIBURING
+   while (total < size)
+   {
+      int slot = file->current;
+      size_t length;
+
+      if (file->pending[slot] && uring_wait(file, slot))
+      {
+         goto error;
+      }
+
+      if (file->position >= file->lengths[slot])
+      {
+         break;
+      }
+
+      length = file->lengths[slot] - file->position;
+      if (length > size - total)
+      {
+         length = size - total;
+      }
+
+      memcpy((char*)data + total, (char*)file->buffers[slot] + file->position, length);
+      file->position += length;
+      total += length;
+
+      if (file->position == file->lengths[slot])
+      {
+         bool eof = file->lengths[slot] < URING_BLOCK_SIZE;
+
+         file->lengths[slot] = 0;
+         file->position = 0;
+
+         if (!eof)
+         {
+            if (file->offset < file->size)
+            {
+               uring_prepare(file, slot);
+            }
+            file->current = (slot + 1) % URING_QUEUE_DEPTH;
+         }
+      }
+   }
+#endif
+
+   return total;
+
+error:
+
+   file->failed = true;
+
+   return -1;
+}
+
+int
+pgmoneta_uring_write(struct uring_file* file, void* data, size_t size)
+{
+   if (file == NULL || !file->write || file->failed)
+   {
+      return 1;
+   }
+
+   while (size > 0)
+   {
+      int slot = file->current;
+      size_t length;
+
+#ifdef HAVE_LIBURING
+      if (file->pending[slot] && uring_wait(file, slot))
+      {
+         goto error;
+      }
+#endif
+
+      length = URING_BLOCK_SIZE - file->lengths[slot];
+      if (length > size)
+      {
+         length = size;
+      }
+
+      memcpy((char*)file->buffers[slot] + file->lengths[slot], data, length);
+      file->lengths[slot] += length;
+      data = (char*)data + length;
+      size -= length;
+
+      if (file->lengths[slot] == URING_BLOCK_SIZE && uring_flush(file))
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   file->failed = true;
+
+   return 1;
+}
+
+int
+pgmoneta_uring_close(struct uring_file* file, bool sync)
+{
+   int ret = 0;
+
+   if (file == NULL)
+   {
+      return 0;
+   }
+
+   if (file->write && !file->failed && uring_flush(file))
+   {
+      file->failed = true;
+   }
+
+#ifdef HAVE_LIBURING
+   if (file->active)
+   {
+      for (int i = 0; i < URING_QUEUE_DEPTH; i++)
+      {
+         if (file->pending[i])
+         {
+            uring_wait(file, i);
+         }
+      }
+
+      if (file->fixed)
+      {
+         io_uring_unregister_buffers(&file->ring);
+      }
+      io_uring_queue_exit(&file->ring);
+   }
+#endif
+
+   if (file->failed)
+   {
+      ret = 1;
+   }
+
+   if (file->write && sync && !file->failed && fsync(file->fd))
+   {
+      ret = 1;
+   }
+
+   if (close(file->fd) && file->write)
+   {
+      ret = 1;
+   }
+
+   for (int i = 0; i < URING_QUEUE_DEPTH; i++)
+   {
+      free(file->buffers[i]);
+   }
+   free(file);
+
+   return ret;
+}
+
+int
+pgmoneta_uring_copy(char* from, char* to, int permissions)
+{
+   struct uring_file* in = NULL;
+   struct uring_file* out = NULL;
+   void* buffer = NULL;
+   ssize_t n;
+
+   if (pgmoneta_uring_open_read(from, &in))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_uring_open_write(to, permissions, &out))
+   {
+      goto error;
+   }
+
+   buffer = malloc(URING_BLOCK_SIZE);
+
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   while ((n = pgmoneta_uring_read(in, buffer, URING_BLOCK_SIZE)) > 0)
+   {
+      if (pgmoneta_uring_write(out, buffer, n))
+      {
+         goto error;
+      }
+   }
+
+   if (n < 0)
+   {
+      goto error;
+   }
+
+   pgmoneta_uring_close(in, false);
+   in = NULL;
+
+   if (pgmoneta_uring_close(out, true))
+   {
+      out = NULL;
+      goto error;
+   }
+   out = NULL;
+
+   free(buffer);
+
+   return 0;
+
+error:
+
+   pgmoneta_uring_close(in, false);
+   pgmoneta_uring_close(out, false);
+   free(buffer);
+
+   return 1;
+}
+
+static int
+uring_setup(struct uring_file* file)
+{
+   file->tried = true;
+
+#ifdef HAVE_LIBURING
+   struct iovec iov[URING_QUEUE_DEPTH];
+
+   /* Kernels without io_uring, or where it is disabled, use read(2) and write(2) */
+   if (io_uring_queue_init(URING_QUEUE_DEPTH, &file->ring, 0) < 0)
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < URING_QUEUE_DEPTH; i++)
+   {
+      if (file->buffers[i] == NULL)
+      {
+         file->buffers[i] = malloc(URING_BLOCK_SIZE);
+
+         if (file->buffers[i] == NULL)
+         {
+            io_uring_queue_exit(&file->ring);
+            return 1;
+         }
+      }
+
+      iov[i].iov_base = file->buffers[i];
+      iov[i].iov_len = URING_BLOCK_SIZE;
+   }
+
+   /* The buffers are registered when the memlock limit allows it */
+   file->fixed = io_uring_register_buffers(&file->ring, iov, URING_QUEUE_DEPTH) == 0;
+   file->active = true;
+
+   return 0;
+#else
+   return 1;
+#endif
+}
+
+static int
+uring_flush(struct uring_file* file)
+{
+   int slot = file->current;
+
+   if (file->lengths[slot] == 0)
+   {
+      return 0;
+   }
+
+   if (!file->tried)
+   {
+      uring_setup(file);
+   }
+
+#ifdef HAVE_LIBURING
+   if (file->active)
+   {
+      uring_prepare(file, slot);
+      file->current = (slot + 1) % URING_QUEUE_DEPTH;
+
+      return 0;
+   }
+#endif
+
+   if (plain_write(file->fd, file->buffers[slot], file->lengths[slot]))
+   {
+      return 1;
+   }
+
+   file->offset += file->lengths[slot];
+   file->lengths[slot] = 0;
+
+   return 0;
+}
+
+static int
+plain_write(int fd, void* data, size_t size)
+{
+   ssize_t n;
+
+   while (size > 0)
+   {
+      n = write(fd, data, size);
+
+      if (n < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return 1;
+      }
+
+      data = (char*)data + n;
+      size -= n;
+   }
+
+   return 0;
+}
+
+#ifdef HAVE_LIBURING
+static void
+uring_prepare(struct uring_file* file, int slot)
+{
+   struct io_uring_sqe* sqe = NULL;
+   size_t length = file->write ? file->lengths[slot] : URING_BLOCK_SIZE;
+
+   sqe = io_uring_get_sqe(&file->ring);
+
+   if (file->write)
+   {
+      if (file->fixed)
+      {
+         io_uring_prep_write_fixed(sqe, file->fd, file->buffers[slot], length, file->offset, slot);
+      }
+      else
+      {
+         io_uring_prep_write(sqe, file->fd, file->buffers[slot], length, file->offset);
+      }
+   }
+   else
+   {
+      if (file->fixed)
+      {
+         io_uring_prep_read_fixed(sqe, file->fd, file->buffers[slot], length, file->offset, slot);
+      }
+      else
+      {
+         io_uring_prep_read(sqe, file->fd, file->buffers[slot], length, file->offset);
+      }
+   }
+
+   io_uring_sqe_set_data(sqe, (void*)(uintptr_t)slot);
+
+   file->offsets[slot] = file->offset;
+   file->offset += length;
+   file->pending[slot] = true;
+
+   /* Submit in batches to save on system calls */
+   if (++file->unsubmitted >= URING_QUEUE_DEPTH / 2)
+   {
+      io_uring_submit(&file->ring);
+      file->unsubmitted = 0;
+   }
+}
+
+static int
+uring_wait(struct uring_file* file, int slot)
+{
+   struct io_uring_cqe* cqe = NULL;
+   unsigned head;
+   unsigned count;
+   int ret;
+
+   while (file->pending[slot])
+   {
+      ret = io_uring_submit_and_wait(&file->ring, 1);
+      file->unsubmitted = 0;
+
+      if (ret < 0)
+      {
+         if (ret == -EINTR)
+         {
+            continue;
+         }
+         errno = -ret;
+         return 1;
+      }
+
+      count = 0;
+      io_uring_for_each_cqe(&file->ring, head, cqe)
+      {
+         int s = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+
+         file->results[s] = cqe->res;
+         file->pending[s] = false;
+
+         if (uring_complete(file, s))
+         {
+            file->failed = true;
+         }
+
+         count++;
+      }
+      io_uring_cq_advance(&file->ring, count);
+   }
+
+   return file->failed ? 1 : 0;
+}
+
+static int
+uring_complete(struct uring_file* file, int slot)
+{
+   ssize_t n;
+   size_t length;
+
+   if (file->results[slot] < 0)
+   {
+      errno = -file->results[slot];
+      return 1;
+   }
+
+   length = (size_t)file->results[slot];
+
+   if (file->write)
+   {
+      /* A short write is completed synchronously */
+      while (length < file->lengths[slot])
+      {
+         n = pwrite(file->fd, (char*)file->buffers[slot] + length, file->lengths[slot] - length, file->offsets[slot] + length);
+
+         if (n < 0)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+            return 1;
+         }
+
+         length += n;
+      }
+
+      file->lengths[slot] = 0;
+   }
+   else
+   {
+      /* A short read before the end of the file is completed synchronously */
+      while (length < URING_BLOCK_SIZE && file->offsets[slot] + (off_t)length < file->size)
+      {
+         n = pread(file->fd, (char*)file->buffers[slot] + length, URING_BLOCK_SIZE - length, file->offsets[slot] + length);
+
+         if (n < 0)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+            return 1;
+         }
+         else if (n == 0)
+         {
+            break;
+         }
+
+         length += n;
+      }
+
+      file->lengths[slot] = length;
+   }
+
+   return 0;
+}
+#endif
@@ -28,9 +28,12 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <aes.h>
+#include <compression.h>
 #include <info.h>
 #include <logging.h>
 #include <restore.h>
+#include <uring.h>
 #include <utils.h>
 #include <workers.h>
 
@@ -58,6 +61,11 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef HAVE_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
 #ifndef EVBACKEND_LINUXAIO
 #define EVBACKEND_LINUXAIO 0x00000040U
 #endif
@@ -83,9 +91,24 @@ static int copy_tablespaces_hotstandby(char* from, char* to, char* tblspc_mappin
 
 static int get_permissions(char* from, int* permissions);
 
+static int kernel_copy(int fd_from, off_t from_offset, int fd_to, off_t to_offset, size_t length);
 static void do_copy_file(struct worker_input* wi);
 static void do_delete_file(struct worker_input* wi);
 
+/** @struct extract_target
+ * Defines where the decrypted data of an extracted file goes
+ */
+struct extract_target
+{
+   FILE* file;                        /**< The plain file, when the file isn't compressed */
+   struct decompressor* decompressor; /**< The decompressor, when the file is compressed */
+};
+
+static int restore_directory(char* from, char* to, char** restore_last_files_names, struct workers* workers);
+static bool restore_last_file(char* path, char** restore_last_files_names);
+static int extract_output(void* data, size_t size, void* arg);
+static void do_extract_file(struct worker_input* wi);
+
 int32_t
 pgmoneta_get_request(struct message* msg)
 {
@@ -1879,27 +1902,12 @@ pgmoneta_copy_postgresql_restore(char* from, char* to, char* base, char* server,
                }
                else
                {
-                  pgmoneta_copy_directory(from_buffer, to_buffer, restore_last_files_names, workers);
+                  restore_directory(from_buffer, to_buffer, restore_last_files_names, workers);
                }
             }
-            else
+            else if (!restore_last_file(from_buffer, restore_last_files_names))
             {
-               bool file_is_excluded = false;
-               if (restore_last_files_names != NULL)
-               {
-                  for (int i = 0; restore_last_files_names[i] != NULL; i++)
-                  {
-                     file_is_excluded = !strcmp(from_buffer, restore_last_files_names[i]);
-                  }
-                  if (!file_is_excluded)
-                  {
-                     pgmoneta_copy_file(from_buffer, to_buffer, workers);
-                  }
-               }
-               else
-               {
-                  pgmoneta_copy_file(from_buffer, to_buffer, workers);
-               }
+               pgmoneta_extract_file(from_buffer, to_buffer, workers);
             }
          }
 
@@ -2117,7 +2125,7 @@ copy_tablespaces_restore(char* from, char* to, char* base, char* server, char* i
             pgmoneta_mkdir(to_directory);
             pgmoneta_symlink_at_file(to_oid, relative_directory);
 
-            pgmoneta_copy_directory(&path[0], to_directory, NULL, workers);
+            restore_directory(&path[0], to_directory, NULL, workers);
 
             free(to_oid);
             free(to_directory);
@@ -2352,6 +2360,90 @@ error:
    return 1;
 }
 
+static int
+restore_directory(char* from, char* to, char** restore_last_files_names, struct workers* workers)
+{
+   DIR* d = opendir(from);
+   char* from_buffer;
+   char* to_buffer;
+   struct dirent* entry;
+   struct stat statbuf;
+
+   pgmoneta_mkdir(to);
+
+   if (d)
+   {
+      while ((entry = readdir(d)))
+      {
+         if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+         {
+            continue;
+         }
+
+         from_buffer = NULL;
+         to_buffer = NULL;
+
+         from_buffer = pgmoneta_append(from_buffer, from);
+         from_buffer = pgmoneta_append(from_buffer, "/");
+         from_buffer = pgmoneta_append(from_buffer, entry->d_name);
+
+         to_buffer = pgmoneta_append(to_buffer, to);
+         to_buffer = pgmoneta_append(to_buffer, "/");
+         to_buffer = pgmoneta_append(to_buffer, entry->d_name);
+
+         if (!stat(from_buffer, &statbuf))
+         {
+            if (S_ISDIR(statbuf.st_mode))
+            {
+               restore_directory(from_buffer, to_buffer, restore_last_files_names, workers);
+            }
+            else if (!restore_last_file(from_buffer, restore_last_files_names))
+            {
+               pgmoneta_extract_file(from_buffer, to_buffer, workers);
+            }
+         }
+
+         free(from_buffer);
+         free(to_buffer);
+      }
+      closedir(d);
+   }
+   else
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static bool
+restore_last_file(char* path, char** restore_last_files_names)
+{
+   size_t length;
+
+   if (restore_last_files_names == NULL)
+   {
+      return false;
+   }
+
+   // the stored file may have the suffixes of the compression and the encryption
+   for (int i = 0; restore_last_files_names[i] != NULL; i++)
+   {
+      length = strlen(restore_last_files_names[i]);
+
+      if (!strncmp(path, restore_last_files_names[i], length) && (path[length] == '\0' || path[length] == '.'))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static int
 get_permissions(char* from, int* permissions)
 {
@@ -2396,14 +2488,174 @@ error:
    return 1;
 }
 
+int
+pgmoneta_extract_file(char* from, char* to, struct workers* workers)
+{
+   struct worker_input* fi = NULL;
+
+   if (pgmoneta_create_worker_input(NULL, from, to, 0, workers, &fi))
+   {
+      goto error;
+   }
+
+   if (workers != NULL)
+   {
+      if (workers->outcome)
+      {
+         pgmoneta_workers_add(workers, do_extract_file, fi);
+      }
+   }
+   else
+   {
+      do_extract_file(fi);
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgmoneta_copy_file_range(int fd_from, off_t from_offset, int fd_to, off_t to_offset, size_t length)
+{
+   char* buffer = NULL;
+   ssize_t nread;
+   ssize_t nwritten;
+   int ret;
+
+   ret = kernel_copy(fd_from, from_offset, fd_to, to_offset, length);
+
+   if (ret != 2)
+   {
+      return ret;
+   }
+
+   buffer = (char*)malloc(DEFAULT_BUFFER_SIZE);
+
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   while (length > 0)
+   {
+      nread = pread(fd_from, buffer, MIN(length, DEFAULT_BUFFER_SIZE), from_offset);
+
+      if (nread < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         goto error;
+      }
+      else if (nread == 0)
+      {
+         goto error;
+      }
+
+      for (ssize_t done = 0; done < nread; done += nwritten)
+      {
+         nwritten = pwrite(fd_to, buffer + done, nread - done, to_offset + done);
+
+         if (nwritten < 0)
+         {
+            if (errno == EINTR)
+            {
+               nwritten = 0;
+               continue;
+            }
+            goto error;
+         }
+      }
+
+      from_offset += nread;
+      to_offset += nread;
+      length -= nread;
+   }
+
+   free(buffer);
+
+   return 0;
+
+error:
+
+   free(buffer);
+
+   return 1;
+}
+
+static int
+kernel_copy(int fd_from, off_t from_offset, int fd_to, off_t to_offset, size_t length)
+{
+#ifdef HAVE_LINUX
+   struct file_clone_range range;
+   bool copied = false;
+   ssize_t n;
+
+   if (length == 0)
+   {
+      return 0;
+   }
+
+   /* A reflink shares the extents on XFS and btrfs, so no data is copied */
+   range.src_fd = fd_from;
+   range.src_offset = from_offset;
+   range.src_length = length;
+   range.dest_offset = to_offset;
+
+   if (ioctl(fd_to, FICLONERANGE, &range) == 0)
+   {
+      return 0;
+   }
+
+   while (length > 0)
+   {
+      n = copy_file_range(fd_from, &from_offset, fd_to, &to_offset, length, 0);
+
+      if (n < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         /* Not supported for these files, the caller copies in user space */
+         if (!copied && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL))
+         {
+            errno = 0;
+            return 2;
+         }
+
+         return 1;
+      }
+      else if (n == 0)
+      {
+         return 1;
+      }
+
+      copied = true;
+      length -= n;
+   }
+
+   errno = 0;
+
+   return 0;
+#else
+   return 2;
+#endif
+}
+
 static void
 do_copy_file(struct worker_input* fi)
 {
    int fd_from = -1;
    int fd_to = -1;
-   char buffer[8192];
-   ssize_t nread = -1;
    int permissions = -1;
+   struct stat st;
+   int ret;
 
    fd_from = open(fi->from, O_RDONLY);
 
@@ -2413,7 +2665,7 @@ do_copy_file(struct worker_input* fi)
       goto error;
    }
 
-   if (get_permissions(fi->from, &permissions))
+   if (get_permissions(fi->from, &permissions) || fstat(fd_from, &st))
    {
       pgmoneta_log_error("Unable to get file permissions: %s", fi->from);
       goto error;
@@ -2427,38 +2679,33 @@ do_copy_file(struct worker_input* fi)
       goto error;
    }
 
-   while ((nread = read(fd_from, buffer, sizeof(buffer))) > 0)
+   ret = kernel_copy(fd_from, 0, fd_to, 0, st.st_size);
+
+   if (ret == 1)
    {
-      char* out = &buffer[0];
-      ssize_t nwritten;
+      pgmoneta_log_error("Unable to copy file: %s to %s", fi->from, fi->to);
+      goto error;
+   }
+   else if (ret == 0)
+   {
+      fsync(fd_to);
+   }
 
-      do
-      {
-         nwritten = write(fd_to, out, nread);
+   close(fd_from);
+   fd_from = -1;
 
-         if (nwritten >= 0)
-         {
-            nread -= nwritten;
-            out += nwritten;
-         }
-         else if (errno != EINTR)
-         {
-            goto error;
-         }
-      }
-      while (nread > 0);
+   if (close(fd_to) < 0)
+   {
+      fd_to = -1;
+      goto error;
    }
+   fd_to = -1;
 
-   if (nread == 0)
+   /* The kernel can't copy between these files */
+   if (ret == 2 && pgmoneta_uring_copy(fi->from, fi->to, permissions))
    {
-      fsync(fd_to);
-
-      if (close(fd_to) < 0)
-      {
-         fd_to = -1;
-         goto error;
-      }
-      close(fd_from);
+      pgmoneta_log_error("Unable to copy file: %s to %s", fi->from, fi->to);
+      goto error;
    }
 
 #ifdef DEBUG
@@ -2489,6 +2736,177 @@ error:
    free(fi);
 }
 
+static int
+extract_output(void* data, size_t size, void* arg)
+{
+   struct extract_target* target = (struct extract_target*)arg;
+
+   if (target->decompressor != NULL)
+   {
+      return pgmoneta_decompressor_write(target->decompressor, data, size);
+   }
+
+   if (fwrite(data, sizeof(char), size, target->file) != size)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static void
+do_extract_file(struct worker_input* fi)
+{
+   char to[MAX_PATH];
+   bool encrypted;
+   int compression;
+   int permissions = -1;
+   size_t n;
+   char* buffer = NULL;
+   FILE* in = NULL;
+   struct encryptor* encryptor = NULL;
+   struct extract_target target;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&target, 0, sizeof(struct extract_target));
+
+   encrypted = pgmoneta_ends_with(fi->from, ".aes");
+
+   memset(to, 0, sizeof(to));
+   snprintf(to, sizeof(to), "%.*s", (int)(strlen(fi->to) - (encrypted ? strlen(".aes") : 0)), fi->to);
+
+   compression = pgmoneta_compression_type(to);
+   to[strlen(to) - strlen(pgmoneta_compression_suffix(compression))] = '\0';
+
+   // a plain file is copied as is, which the kernel may do without reading it
+   if (!encrypted && compression == COMPRESSION_NONE)
+   {
+      do_copy_file(fi);
+      return;
+   }
+
+   if (get_permissions(fi->from, &permissions))
+   {
+      pgmoneta_log_error("Unable to get file permissions: %s", fi->from);
+      goto error;
+   }
+
+   in = fopen(fi->from, "rb");
+   if (in == NULL)
+   {
+      pgmoneta_log_error("File doesn't exists: %s", fi->from);
+      goto error;
+   }
+
+   buffer = (char*)malloc(DEFAULT_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (compression != COMPRESSION_NONE)
+   {
+      if (pgmoneta_decompressor_create(to, compression, &target.decompressor))
+      {
+         goto error;
+      }
+   }
+   else
+   {
+      target.file = fopen(to, "wb");
+      if (target.file == NULL)
+      {
+         pgmoneta_log_error("Unable to create file: %s", to);
+         goto error;
+      }
+   }
+
+   if (encrypted && pgmoneta_encryptor_create(config->encryption, false, extract_output, &target, &encryptor))
+   {
+      goto error;
+   }
+
+   // the stored file is read once, and the plain file is written once
+   while ((n = fread(buffer, sizeof(char), DEFAULT_BUFFER_SIZE, in)) > 0)
+   {
+      if (encryptor != NULL ? pgmoneta_encryptor_write(encryptor, buffer, n) : extract_output(buffer, n, &target))
+      {
+         goto error;
+      }
+   }
+
+   if (ferror(in))
+   {
+      pgmoneta_log_error("Unable to read file: %s", fi->from);
+      goto error;
+   }
+
+   if (encryptor != NULL && pgmoneta_encryptor_finish(encryptor))
+   {
+      goto error;
+   }
+
+   if (target.decompressor != NULL)
+   {
+      if (pgmoneta_decompressor_finish(target.decompressor))
+      {
+         goto error;
+      }
+   }
+   else
+   {
+      int ret = fclose(target.file);
+
+      target.file = NULL;
+      if (ret != 0)
+      {
+         goto error;
+      }
+   }
+
+   if (chmod(to, permissions))
+   {
+      goto error;
+   }
+
+#ifdef DEBUG
+   pgmoneta_log_trace("FILETRACKER | Extract | %s | %s |", fi->from, to);
+#endif
+
+   fclose(in);
+   free(buffer);
+   pgmoneta_encryptor_destroy(encryptor);
+   pgmoneta_decompressor_destroy(target.decompressor);
+   free(fi);
+
+   return;
+
+error:
+
+   pgmoneta_log_error("Unable to extract file: %s to %s", fi->from, to);
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+   if (target.file != NULL)
+   {
+      fclose(target.file);
+   }
+   free(buffer);
+   pgmoneta_encryptor_destroy(encryptor);
+   pgmoneta_decompressor_destroy(target.decompressor);
+
+   if (fi->workers != NULL)
+   {
+      fi->workers->outcome = false;
+   }
+
+   free(fi);
+}
+
 int
 pgmoneta_move_file(char* from, char* to)
 {
@@ -2874,7 +3292,7 @@ error:
 }
 
 int
-pgmoneta_copy_wal_files(char* from, char* to, char* start, struct workers* workers)
+pgmoneta_copy_wal_files(char* from, char* to, char* start, char* end, struct workers* workers)
 {
    int number_of_wal_files = 0;
    char** wal_files = NULL;
@@ -2888,7 +3306,9 @@ pgmoneta_copy_wal_files(char* from, char* to, char* start, struct workers* worke
    {
       pgmoneta_basename_file(wal_files[i], &basename);
 
-      if (strcmp(wal_files[i], start) >= 0)
+      if (strcmp(wal_files[i], start) >= 0 &&
+          (end == NULL || strlen(wal_files[i]) < 24 || pgmoneta_ends_with(wal_files[i], ".history") ||
+           strncmp(wal_files[i] + 8, end + 8, 16) <= 0))
       {
          if (pgmoneta_ends_with(wal_files[i], ".partial"))
          {
@@ -28,24 +28,33 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <aes.h>
+#include <bzip2_compression.h>
+#include <compression.h>
+#include <gzip_compression.h>
 #include <logging.h>
+#include <lz4_compression.h>
 #include <management.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
 #include <prometheus.h>
+#include <ring.h>
 #include <security.h>
 #include <server.h>
 #include <wal.h>
 #include <workflow.h>
 #include <utils.h>
 #include <storage.h>
+#include <zstandard_compression.h>
 
 /* system */
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <ev.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -58,7 +67,7 @@
 
 static char* wal_file_name(uint32_t timeline, size_t segno, int segsize);
 static int wal_fetch_history(char* basedir, int timeline, SSL* ssl, int socket);
-static FILE* wal_open(char* root, char* filename, int segsize);
+static FILE* wal_open(char* root, char* filename, int segsize, char* pool);
 static int wal_close(char* root, char* filename, bool partial, FILE* file);
 static int wal_prepare(FILE* file, int segsize);
 static int wal_send_status_report(SSL* ssl, int socket, int64_t received, int64_t flushed, int64_t applied);
@@ -68,6 +77,28 @@ static int wal_find_streaming_start(char* basedir, int segsize, uint32_t* timeli
 static int wal_read_replication_slot(SSL* ssl, int socket, char* slot, char* name, int segsize, uint32_t* high32, uint32_t* low32, uint32_t* timeline);
 static int wal_shipping_setup(int srv, char** wal_shipping);
 static void update_wal_lsn(int srv, size_t xlogptr);
+static int wal_flush(FILE* file);
+static bool wal_data_pending(SSL* ssl, int socket, struct stream_buffer* buffer, struct message* msg);
+static void wal_sync_directory(char* root);
+static char* wal_pool_directory(int srv);
+static int wal_pool_take(char* pool, char* path, int segsize);
+static void wal_pool_refill(struct ring* ring, struct wal_pool* pool);
+static int wal_pool_fill(void* data, size_t size, void* arg);
+static int wal_sink_start(int srv, int type, char* directory, int segsize, struct wal_sink** sink);
+static void wal_sink_open(struct wal_sink* sink, char* filename);
+static void wal_sink_write(struct wal_sink* sink, void* data, size_t size, size_t lsn);
+static void wal_sink_close(struct wal_sink* sink, char* root, char* filename, bool partial);
+static void wal_sink_stop(struct wal_sink* sink);
+static int wal_sink_offer(struct wal_sink* sink, int type, char* filename, bool partial, size_t lsn, void* data, size_t size);
+static int wal_sink_do(void* data, size_t size, void* arg);
+static void wal_sink_abandon(struct wal_sink* sink);
+static void wal_sink_catch_up(struct wal_sink* sink);
+static int wal_sink_deliver(struct wal_sink* sink, char* path, char* filename);
+static void wal_sink_lag(struct wal_sink* sink);
+static void wal_sink_limit(struct wal_sink* sink);
+static int wal_sink_trim(char* staging, char* oldest, int keep);
+static void wal_compress(struct ring* ring, struct wal_compression* compression, char* filename);
+static int wal_compress_segment(void* data, size_t size, void* arg);
 
 void
 pgmoneta_wal(int srv, char** argv)
@@ -80,6 +111,7 @@ pgmoneta_wal(int srv, char** argv)
    uint32_t low32 = 0;
    char* d = NULL;
    char* wal_shipping = NULL;
+   char* pool_directory = NULL;
    uint32_t timeline = 0;
    uint32_t cur_timeline = 0;
    int hdrlen = 1 + 8 + 8 + 8;
@@ -90,6 +122,10 @@ pgmoneta_wal(int srv, char** argv)
    char cmd[MISC_LENGTH];
    size_t xlogpos_size = 0;
    size_t xlogptr = 0;
+   size_t flushptr = 0;
+   size_t unflushed = 0;
+   struct timespec last_flush;
+   struct timespec now;
    size_t segno;
    size_t xlogoff;
    size_t curr_xlogoff = 0;
@@ -99,8 +135,8 @@ pgmoneta_wal(int srv, char** argv)
    signed char type;
    int ret;
    FILE* wal_file = NULL;
-   FILE* wal_shipping_file = NULL;
-   sftp_file sftp_wal_file = NULL;
+   struct wal_sink* shipping_sink = NULL;
+   struct wal_sink* ssh_sink = NULL;
    struct message* identify_system_msg = NULL;
    struct query_response* identify_system_response = NULL;
    struct query_response* end_of_timeline_response = NULL;
@@ -111,6 +147,9 @@ pgmoneta_wal(int srv, char** argv)
    struct workflow* head = NULL;
    struct workflow* current = NULL;
    struct deque* nodes = NULL;
+   struct ring* ring = NULL;
+   struct wal_compression compression;
+   struct wal_pool pool;
 
    config = (struct configuration*) shmem;
 
@@ -160,6 +199,28 @@ pgmoneta_wal(int srv, char** argv)
    d = pgmoneta_get_server_wal(srv);
    pgmoneta_mkdir(d);
 
+   pool_directory = wal_pool_directory(srv);
+   pgmoneta_mkdir(pool_directory);
+
+   memset(&compression, 0, sizeof(struct wal_compression));
+   compression.server = srv;
+   compression.directory = d;
+
+   memset(&pool, 0, sizeof(struct wal_pool));
+   pool.server = srv;
+   pool.segsize = segsize;
+   pool.directory = pool_directory;
+
+   // completed segments are compressed and encrypted, and the segment pool is refilled,
+   // by a thread while WAL is received
+   if (pgmoneta_ring_create(NULL, &ring))
+   {
+      pgmoneta_log_warn("Unable to start the WAL thread for %s", config->servers[srv].name);
+      ring = NULL;
+   }
+
+   wal_pool_refill(ring, &pool);
+
    pgmoneta_deque_create(false, &nodes);
 
    if (config->storage_engine & STORAGE_ENGINE_SSH)
@@ -194,6 +255,23 @@ pgmoneta_wal(int srv, char** argv)
       pgmoneta_log_warn("Unable to create WAL shipping directory");
    }
 
+   // the WAL shipping directory and the SSH storage engine are written by their own threads
+   if (wal_shipping != NULL)
+   {
+      if (wal_sink_start(srv, WAL_SINK_SHIPPING, wal_shipping, segsize, &shipping_sink))
+      {
+         goto error;
+      }
+   }
+
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   {
+      if (wal_sink_start(srv, WAL_SINK_SSH, NULL, segsize, &ssh_sink))
+      {
+         goto error;
+      }
+   }
+
    auth = pgmoneta_server_authenticate(srv, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket);
 
    if (auth != AUTH_SUCCESS)
@@ -264,6 +342,8 @@ pgmoneta_wal(int srv, char** argv)
    pgmoneta_free_query_response(identify_system_response);
    identify_system_response = NULL;
 
+   clock_gettime(CLOCK_MONOTONIC_RAW, &last_flush);
+
    while (config->running)
    {
       if (wal_fetch_history(d, timeline, ssl, socket))
@@ -366,41 +446,23 @@ pgmoneta_wal(int srv, char** argv)
                         segno = xlogptr / segsize;
                         curr_xlogoff = 0;
                         filename = wal_file_name(timeline, segno, segsize);
-                        if ((wal_file = wal_open(d, filename, segsize)) == NULL)
+                        if ((wal_file = wal_open(d, filename, segsize, pool_directory)) == NULL)
                         {
                            pgmoneta_log_error("Could not create or open WAL segment file at %s", d);
                            goto error;
                         }
+                        wal_pool_refill(ring, &pool);
                         memset(config->servers[srv].current_wal_filename, 0, MISC_LENGTH);
                         snprintf(config->servers[srv].current_wal_filename, MISC_LENGTH, "%s.partial", filename);
-                        if ((wal_shipping_file = wal_open(wal_shipping, filename, segsize)) == NULL)
-                        {
-                           if (wal_shipping != NULL)
-                           {
-                              pgmoneta_log_warn("Could not create or open WAL segment file at %s", wal_shipping);
-                           }
-                        }
-                        if (config->storage_engine & STORAGE_ENGINE_SSH)
-                        {
-                           if (pgmoneta_sftp_wal_open(srv, filename, segsize, &sftp_wal_file) == 1)
-                           {
-                              pgmoneta_log_error("Could not create or open WAL segment file on remote ssh storage engine");
-                              goto error;
-                           }
-                        }
+                        wal_sink_open(shipping_sink, filename);
+                        wal_sink_open(ssh_sink, filename);
 
                         if (bytes_left > 0)
                         {
                            curr_xlogoff += bytes_left;
                            fwrite(remain_buffer, 1, bytes_left, wal_file);
-                           if (sftp_wal_file != NULL)
-                           {
-                              sftp_write(sftp_wal_file, remain_buffer, bytes_left);
-                           }
-                           if (wal_shipping_file != NULL)
-                           {
-                              fwrite(remain_buffer, 1, bytes_left, wal_shipping_file);
-                           }
+                           wal_sink_write(shipping_sink, remain_buffer, bytes_left, segno * segsize + curr_xlogoff);
+                           wal_sink_write(ssh_sink, remain_buffer, bytes_left, segno * segsize + curr_xlogoff);
                            bytes_left = 0;
                         }
                      }
@@ -430,15 +492,8 @@ pgmoneta_wal(int srv, char** argv)
                         pgmoneta_log_error("Could not write %d bytes to WAL file %s", bytes_to_write, filename);
                         goto error;
                      }
-                     if (sftp_wal_file != NULL)
-                     {
-                        sftp_write(sftp_wal_file, msg->data + hdrlen + bytes_written, bytes_to_write);
-                     }
-
-                     if (wal_shipping_file != NULL)
-                     {
-                        fwrite(msg->data + hdrlen + bytes_written, 1, bytes_to_write, wal_shipping_file);
-                     }
+                     wal_sink_write(shipping_sink, msg->data + hdrlen + bytes_written, bytes_to_write, segno * segsize + curr_xlogoff + bytes_to_write);
+                     wal_sink_write(ssh_sink, msg->data + hdrlen + bytes_written, bytes_to_write, segno * segsize + curr_xlogoff + bytes_to_write);
 
                      bytes_written += bytes_to_write;
                      bytes_left -= bytes_to_write;
@@ -450,19 +505,15 @@ pgmoneta_wal(int srv, char** argv)
                      {
                         // the end of WAL segment
                         fflush(wal_file);
-                        wal_close(d, filename, false, wal_file);
-                        if (sftp_wal_file != NULL)
-                        {
-                           pgmoneta_sftp_wal_close(srv, filename, false, &sftp_wal_file);
-                           sftp_wal_file = NULL;
-                        }
-
+                        ret = wal_close(d, filename, false, wal_file);
                         wal_file = NULL;
-                        if (wal_shipping_file != NULL)
+
+                        wal_sink_close(shipping_sink, d, filename, false);
+                        wal_sink_close(ssh_sink, d, filename, false);
+
+                        if (!ret)
                         {
-                           fflush(wal_shipping_file);
-                           wal_close(wal_shipping, filename, false, wal_shipping_file);
-                           wal_shipping_file = NULL;
+                           wal_compress(ring, &compression, filename);
                         }
                         free(filename);
                         filename = NULL;
@@ -491,14 +542,58 @@ pgmoneta_wal(int srv, char** argv)
                   }
                   // update LSN after a message data is written to the segment
                   update_wal_lsn(srv, xlogptr);
+                  unflushed += msg->length - hdrlen;
+
+                  if (wal_file == NULL)
+                  {
+                     // the segment was synced when it was closed
+                     flushptr = xlogptr;
+                     unflushed = 0;
+                     clock_gettime(CLOCK_MONOTONIC_RAW, &last_flush);
+
+                     wal_send_status_report(ssl, socket, xlogptr, flushptr, 0);
+                  }
+                  else
+                  {
+                     clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+                     // group commit: sync once the stream is drained, or the batch is large or old enough
+                     if (unflushed >= WAL_FLUSH_SIZE ||
+                         pgmoneta_compute_duration(last_flush, now) * 1000 >= WAL_FLUSH_INTERVAL ||
+                         !wal_data_pending(ssl, socket, buffer, msg))
+                     {
+                        if (wal_flush(wal_file))
+                        {
+                           pgmoneta_log_error("Could not flush WAL file %s", filename);
+                           goto error;
+                        }
 
-                  wal_send_status_report(ssl, socket, xlogptr, xlogptr, 0);
+                        flushptr = xlogptr;
+                        unflushed = 0;
+                        last_flush = now;
+
+                        wal_send_status_report(ssl, socket, xlogptr, flushptr, 0);
+                     }
+                  }
                   break;
                }
                case 'k':
                {
-                  // keep alive request
-                  wal_send_status_report(ssl, socket, xlogptr, xlogptr, 0);
+                  // keep alive request, only report what is on disk
+                  if (wal_file != NULL && unflushed > 0)
+                  {
+                     if (wal_flush(wal_file))
+                     {
+                        pgmoneta_log_error("Could not flush WAL file %s", filename);
+                        goto error;
+                     }
+
+                     flushptr = xlogptr;
+                     unflushed = 0;
+                     clock_gettime(CLOCK_MONOTONIC_RAW, &last_flush);
+                  }
+
+                  wal_send_status_report(ssl, socket, xlogptr, flushptr, 0);
                   break;
                }
                default:
@@ -514,14 +609,15 @@ pgmoneta_wal(int srv, char** argv)
             if (wal_file != NULL)
             {
                // Next file would be at a new timeline, so we treat the current wal file completed
-               wal_close(d, filename, false, wal_file);
+               ret = wal_close(d, filename, false, wal_file);
                wal_file = NULL;
-               wal_close(wal_shipping, filename, false, wal_shipping_file);
-               wal_shipping_file = NULL;
-               if (sftp_wal_file != NULL)
+
+               wal_sink_close(shipping_sink, d, filename, false);
+               wal_sink_close(ssh_sink, d, filename, false);
+
+               if (!ret)
                {
-                  pgmoneta_sftp_wal_close(srv, filename, false, &sftp_wal_file);
-                  sftp_wal_file = NULL;
+                  wal_compress(ring, &compression, filename);
                }
             }
             pgmoneta_consume_copy_stream_end(buffer, msg);
@@ -570,15 +666,22 @@ pgmoneta_wal(int srv, char** argv)
    if (wal_file != NULL)
    {
       bool partial = (wal_xlog_offset(xlogptr, segsize) != 0);
-      wal_close(d, filename, partial, wal_file);
-      wal_close(wal_shipping, filename, partial, wal_shipping_file);
-      if (sftp_wal_file != NULL)
+      ret = wal_close(d, filename, partial, wal_file);
+      wal_file = NULL;
+
+      wal_sink_close(shipping_sink, d, filename, partial);
+      wal_sink_close(ssh_sink, d, filename, partial);
+
+      if (!ret && !partial)
       {
-         pgmoneta_sftp_wal_close(srv, filename, partial, &sftp_wal_file);
-         sftp_wal_file = NULL;
+         wal_compress(ring, &compression, filename);
       }
    }
 
+   wal_sink_stop(shipping_sink);
+   wal_sink_stop(ssh_sink);
+   pgmoneta_ring_destroy(ring);
+
    current = head;
    while (current != NULL)
    {
@@ -606,6 +709,7 @@ pgmoneta_wal(int srv, char** argv)
    free(remain_buffer);
    free(d);
    free(wal_shipping);
+   free(pool_directory);
    free(filename);
    free(xlogpos);
    exit(0);
@@ -621,12 +725,8 @@ error:
    if (wal_file != NULL)
    {
       wal_close(d, filename, true, wal_file);
-      wal_close(wal_shipping, filename, true, wal_shipping_file);
-   }
-   if (sftp_wal_file != NULL)
-   {
-      pgmoneta_sftp_wal_close(srv, filename, true, &sftp_wal_file);
-      sftp_wal_file = NULL;
+      wal_sink_close(shipping_sink, d, filename, true);
+      wal_sink_close(ssh_sink, d, filename, true);
    }
    pgmoneta_free_message(identify_system_msg);
    pgmoneta_free_message(start_replication_msg);
@@ -639,6 +739,10 @@ error:
    pgmoneta_free_query_response(end_of_timeline_response);
    pgmoneta_memory_stream_buffer_free(buffer);
 
+   wal_sink_stop(shipping_sink);
+   wal_sink_stop(ssh_sink);
+   pgmoneta_ring_destroy(ring);
+
    current = head;
    while (current != NULL)
    {
@@ -655,6 +759,7 @@ error:
    free(remain_buffer);
    free(d);
    free(wal_shipping);
+   free(pool_directory);
    free(filename);
    free(xlogpos);
    exit(1);
@@ -902,7 +1007,7 @@ error:
 }
 
 static FILE*
-wal_open(char* root, char* filename, int segsize)
+wal_open(char* root, char* filename, int segsize, char* pool)
 {
    if (root == NULL || strlen(root) == 0 || !pgmoneta_exists(root))
    {
@@ -945,6 +1050,21 @@ wal_open(char* root, char* filename, int segsize)
       }
    }
 
+   if (pool != NULL && !wal_pool_take(pool, path, segsize))
+   {
+      file = fopen(path, "r+b");
+      if (file == NULL)
+      {
+         pgmoneta_log_error("WAL error: %s", strerror(errno));
+         errno = 0;
+         goto error;
+      }
+      pgmoneta_permission(path, 6, 0, 0);
+
+      free(path);
+      return file;
+   }
+
    file = fopen(path, "wb");
 
    if (file == NULL)
@@ -983,6 +1103,12 @@ wal_close(char* root, char* filename, bool partial, FILE* file)
    char tmp_file_path[MAX_PATH] = {0};
    char file_path[MAX_PATH] = {0};
 
+   if (wal_flush(file))
+   {
+      pgmoneta_log_error("Could not flush WAL file %s", filename);
+      goto error;
+   }
+
    if (partial)
    {
       pgmoneta_log_info("Not renaming %s.partial, this segment is incomplete", filename);
@@ -1006,6 +1132,8 @@ wal_close(char* root, char* filename, bool partial, FILE* file)
       goto error;
    }
 
+   wal_sync_directory(root);
+
    fclose(file);
 
    return 0;
@@ -1190,3 +1318,850 @@ wal_shipping_setup(int srv, char** wal_shipping)
    *wal_shipping = NULL;
    return 0;
 }
+
+static int
+wal_flush(FILE* file)
+{
+   if (fflush(file))
+   {
+      return 1;
+   }
+
+#ifdef HAVE_LINUX
+   if (fdatasync(fileno(file)))
+#else
+   if (fsync(fileno(file)))
+#endif
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static bool
+wal_data_pending(SSL* ssl, int socket, struct stream_buffer* buffer, struct message* msg)
+{
+   struct pollfd pfd;
+
+   // the rest of the current message is kind, length and payload
+   if (buffer->end > buffer->cursor + 1 + 4 + (int)msg->length)
+   {
+      return true;
+   }
+
+   if (ssl != NULL && SSL_pending(ssl) > 0)
+   {
+      return true;
+   }
+
+   pfd.fd = socket;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+
+   return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+static void
+wal_sync_directory(char* root)
+{
+   int fd = -1;
+
+   fd = open(root, O_RDONLY | O_DIRECTORY);
+   if (fd == -1)
+   {
+      return;
+   }
+
+   fsync(fd);
+   close(fd);
+}
+
+static char*
+wal_pool_directory(int srv)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(srv);
+   d = pgmoneta_append(d, "walpool/");
+
+   return d;
+}
+
+static int
+wal_pool_take(char* pool, char* path, int segsize)
+{
+   char slot[MAX_PATH];
+
+   for (int i = 0; i < WAL_POOL_SIZE; i++)
+   {
+      memset(slot, 0, sizeof(slot));
+      snprintf(slot, sizeof(slot), "%s%d", pool, i);
+
+      if (!pgmoneta_exists(slot))
+      {
+         continue;
+      }
+
+      // the server may have been initialized with another segment size
+      if (pgmoneta_get_file_size(slot) != (size_t)segsize)
+      {
+         unlink(slot);
+         continue;
+      }
+
+      if (!rename(slot, path))
+      {
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+static void
+wal_pool_refill(struct ring* ring, struct wal_pool* pool)
+{
+   if (ring == NULL)
+   {
+      return;
+   }
+
+   if (pgmoneta_ring_write(ring, "", 1, &wal_pool_fill, pool))
+   {
+      pgmoneta_log_warn("Unable to refill the WAL segment pool");
+   }
+}
+
+static int
+wal_pool_fill(void* data, size_t size, void* arg)
+{
+   struct wal_pool* pool = (struct wal_pool*)arg;
+   char slot[MAX_PATH];
+   char tmp[MAX_PATH];
+   int fd = -1;
+   int ret;
+
+   for (int i = 0; i < WAL_POOL_SIZE; i++)
+   {
+      memset(slot, 0, sizeof(slot));
+      snprintf(slot, sizeof(slot), "%s%d", pool->directory, i);
+
+      if (pgmoneta_exists(slot))
+      {
+         continue;
+      }
+
+      memset(tmp, 0, sizeof(tmp));
+      snprintf(tmp, sizeof(tmp), "%s%d.tmp", pool->directory, i);
+
+      fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+      if (fd == -1)
+      {
+         pgmoneta_log_warn("Unable to create %s: %s", tmp, strerror(errno));
+         errno = 0;
+         break;
+      }
+
+      // allocate the blocks without writing them, they read back as zeros
+      ret = posix_fallocate(fd, 0, pool->segsize);
+      if (ret == 0)
+      {
+         ret = fsync(fd);
+      }
+      close(fd);
+      fd = -1;
+
+      // link() doesn't replace a segment recycled into the slot meanwhile
+      if (ret != 0 || link(tmp, slot))
+      {
+         unlink(tmp);
+         if (ret != 0)
+         {
+            pgmoneta_log_warn("Unable to preallocate %s", slot);
+            break;
+         }
+         continue;
+      }
+
+      unlink(tmp);
+   }
+
+   wal_sync_directory(pool->directory);
+
+   return 0;
+}
+
+int
+pgmoneta_wal_pool_recycle(int srv, char* path)
+{
+   char* pool = NULL;
+   char slot[MAX_PATH];
+   struct stat st;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // only uncompressed and unencrypted complete segments can be reused
+   if (pgmoneta_is_compressed_archive(path) || pgmoneta_is_encrypted_archive(path) ||
+       pgmoneta_ends_with(path, ".partial") || pgmoneta_ends_with(path, ".history") ||
+       pgmoneta_get_file_size(path) != (size_t)config->servers[srv].wal_size)
+   {
+      return 1;
+   }
+
+   // a segment staged for a WAL sink shares its blocks, which must not be overwritten
+   if (stat(path, &st) || st.st_nlink > 1)
+   {
+      errno = 0;
+      return 1;
+   }
+
+   pool = wal_pool_directory(srv);
+   if (pgmoneta_mkdir(pool))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < WAL_POOL_SIZE; i++)
+   {
+      memset(slot, 0, sizeof(slot));
+      snprintf(slot, sizeof(slot), "%s%d", pool, i);
+
+      if (!link(path, slot))
+      {
+         unlink(path);
+         free(pool);
+         return 0;
+      }
+
+      if (errno != EEXIST)
+      {
+         errno = 0;
+         break;
+      }
+      errno = 0;
+   }
+
+error:
+   free(pool);
+
+   return 1;
+}
+
+static int
+wal_sink_start(int srv, int type, char* directory, int segsize, struct wal_sink** sink)
+{
+   struct wal_sink* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *sink = NULL;
+
+   s = (struct wal_sink*)calloc(1, sizeof(struct wal_sink));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   s->type = type;
+   s->server = srv;
+   s->segsize = segsize;
+   s->directory = directory;
+   s->lag = type == WAL_SINK_SHIPPING ? &config->servers[srv].wal_shipping_lag : &config->servers[srv].wal_ssh_lag;
+   atomic_init(&s->received, 0);
+   atomic_init(&s->written, 0);
+
+   s->staging = pgmoneta_get_server(srv);
+   s->staging = pgmoneta_append(s->staging, "walsink/");
+   s->staging = pgmoneta_append(s->staging, type == WAL_SINK_SHIPPING ? "shipping/" : "ssh/");
+
+   if (pgmoneta_mkdir(s->staging))
+   {
+      pgmoneta_log_error("Unable to create %s", s->staging);
+      goto error;
+   }
+
+   if (pgmoneta_ring_create(NULL, &s->ring))
+   {
+      pgmoneta_log_error("Unable to start the WAL sink thread for %s", config->servers[srv].name);
+      goto error;
+   }
+
+   // deliver the segments left behind by the previous run
+   wal_sink_offer(s, WAL_SINK_CATCHUP, "", false, 0, NULL, 0);
+
+   *sink = s;
+
+   return 0;
+
+error:
+   if (s != NULL)
+   {
+      free(s->staging);
+      free(s);
+   }
+
+   return 1;
+}
+
+static void
+wal_sink_open(struct wal_sink* sink, char* filename)
+{
+   if (sink == NULL)
+   {
+      return;
+   }
+
+   sink->behind = false;
+
+   wal_sink_offer(sink, WAL_SINK_CATCHUP, "", false, 0, NULL, 0);
+
+   if (wal_sink_offer(sink, WAL_SINK_OPEN, filename, false, 0, NULL, 0))
+   {
+      sink->behind = true;
+   }
+}
+
+static void
+wal_sink_write(struct wal_sink* sink, void* data, size_t size, size_t lsn)
+{
+   if (sink == NULL)
+   {
+      return;
+   }
+
+   atomic_store(&sink->received, lsn);
+
+   // a sink which has fallen behind gets the rest of the segment from the staging directory
+   if (!sink->behind && wal_sink_offer(sink, WAL_SINK_WRITE, "", false, lsn, data, size))
+   {
+      pgmoneta_log_debug("WAL %s sink has fallen behind", sink->type == WAL_SINK_SHIPPING ? "shipping" : "ssh");
+      sink->behind = true;
+   }
+
+   wal_sink_lag(sink);
+}
+
+static void
+wal_sink_close(struct wal_sink* sink, char* root, char* filename, bool partial)
+{
+   char from[MAX_PATH];
+   char to[MAX_PATH];
+
+   if (sink == NULL || filename == NULL)
+   {
+      return;
+   }
+
+   if (!partial)
+   {
+      // keep the segment for the sink until it is delivered, even if it is compressed meanwhile
+      memset(from, 0, sizeof(from));
+      snprintf(from, sizeof(from), "%s%s%s", root, pgmoneta_ends_with(root, "/") ? "" : "/", filename);
+      memset(to, 0, sizeof(to));
+      snprintf(to, sizeof(to), "%s%s", sink->staging, filename);
+
+      if (link(from, to) && errno != EEXIST)
+      {
+         pgmoneta_log_warn("Unable to stage %s for the WAL sink: %s", from, strerror(errno));
+      }
+      errno = 0;
+
+      wal_sink_limit(sink);
+   }
+
+   if (!sink->behind)
+   {
+      wal_sink_offer(sink, WAL_SINK_CLOSE, filename, partial, 0, NULL, 0);
+   }
+}
+
+static void
+wal_sink_stop(struct wal_sink* sink)
+{
+   if (sink == NULL)
+   {
+      return;
+   }
+
+   pgmoneta_ring_destroy(sink->ring);
+   sink->ring = NULL;
+
+   wal_sink_abandon(sink);
+
+   atomic_store(sink->lag, 0);
+
+   free(sink->staging);
+   free(sink);
+}
+
+static int
+wal_sink_offer(struct wal_sink* sink, int type, char* filename, bool partial, size_t lsn, void* data, size_t size)
+{
+   struct wal_sink_op op;
+
+   memset(&op, 0, sizeof(struct wal_sink_op));
+   op.type = type;
+   op.partial = partial;
+   op.lsn = lsn;
+   snprintf(op.filename, sizeof(op.filename), "%s", filename);
+
+   return pgmoneta_ring_offer(sink->ring, &op, sizeof(struct wal_sink_op), data, size, &wal_sink_do, sink);
+}
+
+static int
+wal_sink_do(void* data, size_t size, void* arg)
+{
+   struct wal_sink* sink = (struct wal_sink*)arg;
+   struct wal_sink_op* op = (struct wal_sink_op*)data;
+   char* payload = (char*)data + sizeof(struct wal_sink_op);
+   size_t length = size - sizeof(struct wal_sink_op);
+   char staged[MAX_PATH];
+   int ret = 0;
+
+   switch (op->type)
+   {
+      case WAL_SINK_OPEN:
+         wal_sink_abandon(sink);
+
+         if (sink->type == WAL_SINK_SHIPPING)
+         {
+            sink->file = wal_open(sink->directory, op->filename, sink->segsize, NULL);
+            ret = sink->file == NULL;
+         }
+         else
+         {
+            ret = pgmoneta_sftp_wal_open(sink->server, op->filename, sink->segsize, &sink->sftp);
+            if (ret)
+            {
+               sink->sftp = NULL;
+            }
+         }
+
+         if (ret)
+         {
+            pgmoneta_log_warn("Could not create or open WAL segment file %s for the WAL sink", op->filename);
+            break;
+         }
+
+         memset(sink->filename, 0, sizeof(sink->filename));
+         snprintf(sink->filename, sizeof(sink->filename), "%s", op->filename);
+         break;
+      case WAL_SINK_WRITE:
+         if (sink->type == WAL_SINK_SHIPPING && sink->file != NULL)
+         {
+            ret = fwrite(payload, 1, length, sink->file) != length;
+         }
+         else if (sink->type == WAL_SINK_SSH && sink->sftp != NULL)
+         {
+            ret = sftp_write(sink->sftp, payload, length) != (ssize_t)length;
+         }
+         else
+         {
+            break;
+         }
+
+         if (ret)
+         {
+            // the segment is delivered from the staging directory once it is complete
+            pgmoneta_log_warn("Could not write %zu bytes to WAL segment file %s for the WAL sink", length, sink->filename);
+            wal_sink_abandon(sink);
+            break;
+         }
+
+         atomic_store(&sink->written, op->lsn);
+         break;
+      case WAL_SINK_CLOSE:
+         if ((sink->file == NULL && sink->sftp == NULL) || strcmp(sink->filename, op->filename))
+         {
+            break;
+         }
+
+         if (sink->type == WAL_SINK_SHIPPING)
+         {
+            ret = wal_close(sink->directory, op->filename, op->partial, sink->file);
+            sink->file = NULL;
+         }
+         else
+         {
+            ret = pgmoneta_sftp_wal_close(sink->server, op->filename, op->partial, &sink->sftp);
+            sink->sftp = NULL;
+         }
+         memset(sink->filename, 0, sizeof(sink->filename));
+
+         if (!ret && !op->partial)
+         {
+            memset(staged, 0, sizeof(staged));
+            snprintf(staged, sizeof(staged), "%s%s", sink->staging, op->filename);
+            unlink(staged);
+         }
+         break;
+      case WAL_SINK_CATCHUP:
+         wal_sink_catch_up(sink);
+         break;
+      default:
+         break;
+   }
+
+   wal_sink_lag(sink);
+
+   // a failed segment stays staged, so the sink keeps going
+   return 0;
+}
+
+static void
+wal_sink_abandon(struct wal_sink* sink)
+{
+   if (sink->type == WAL_SINK_SHIPPING && sink->file != NULL)
+   {
+      wal_close(sink->directory, sink->filename, true, sink->file);
+   }
+   else if (sink->type == WAL_SINK_SSH && sink->sftp != NULL)
+   {
+      pgmoneta_sftp_wal_close(sink->server, sink->filename, true, &sink->sftp);
+   }
+
+   sink->file = NULL;
+   sink->sftp = NULL;
+   memset(sink->filename, 0, sizeof(sink->filename));
+}
+
+static void
+wal_sink_catch_up(struct wal_sink* sink)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   char path[MAX_PATH];
+   uint32_t tli = 0;
+   uint32_t log = 0;
+   uint32_t seg = 0;
+   size_t end;
+
+   if (pgmoneta_get_wal_files(sink->staging, &number_of_files, &files) || number_of_files == 0)
+   {
+      goto done;
+   }
+
+   // the catch up replaces the open segment, if any
+   wal_sink_abandon(sink);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%s", sink->staging, files[i]);
+
+      if (wal_sink_deliver(sink, path, files[i]))
+      {
+         pgmoneta_log_warn("Could not deliver %s to the WAL sink, retrying later", files[i]);
+         break;
+      }
+
+      unlink(path);
+
+      if (sscanf(files[i], "%08X%08X%08X", &tli, &log, &seg) == 3)
+      {
+         end = ((size_t)log * (0x100000000UL / sink->segsize) + seg + 1) * sink->segsize;
+         if (end > atomic_load(&sink->written))
+         {
+            atomic_store(&sink->written, end);
+         }
+      }
+   }
+
+done:
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+}
+
+static int
+wal_sink_deliver(struct wal_sink* sink, char* path, char* filename)
+{
+   char to[MAX_PATH];
+   char tmp[MAX_PATH];
+   char buffer[DEFAULT_BUFFER_SIZE];
+   size_t n;
+   FILE* file = NULL;
+   sftp_file sftp = NULL;
+
+   if (pgmoneta_get_file_size(path) != (size_t)sink->segsize)
+   {
+      // not a complete segment, nothing to deliver
+      return 0;
+   }
+
+   if (sink->type == WAL_SINK_SHIPPING)
+   {
+      memset(tmp, 0, sizeof(tmp));
+      snprintf(tmp, sizeof(tmp), "%s%s.partial", sink->directory, filename);
+      memset(to, 0, sizeof(to));
+      snprintf(to, sizeof(to), "%s%s", sink->directory, filename);
+
+      pgmoneta_copy_file(path, tmp, NULL);
+
+      if (pgmoneta_get_file_size(tmp) != (size_t)sink->segsize || rename(tmp, to))
+      {
+         goto error;
+      }
+
+      return 0;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_sftp_wal_open(sink->server, filename, sink->segsize, &sftp))
+   {
+      sftp = NULL;
+      goto error;
+   }
+
+   while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+   {
+      if (sftp_write(sftp, buffer, n) != (ssize_t)n)
+      {
+         goto error;
+      }
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (pgmoneta_sftp_wal_close(sink->server, filename, false, &sftp))
+   {
+      return 1;
+   }
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   if (sftp != NULL)
+   {
+      pgmoneta_sftp_wal_close(sink->server, filename, true, &sftp);
+   }
+
+   return 1;
+}
+
+static void
+wal_sink_limit(struct wal_sink* sink)
+{
+   int dropped;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->wal_sink_max_segments <= 0)
+   {
+      return;
+   }
+
+   dropped = wal_sink_trim(sink->staging, NULL, config->wal_sink_max_segments);
+   if (dropped > 0)
+   {
+      pgmoneta_log_error("WAL %s sink for %s is %d segments behind, dropped the %d oldest",
+                         sink->type == WAL_SINK_SHIPPING ? "shipping" : "ssh",
+                         config->servers[sink->server].name,
+                         config->wal_sink_max_segments + dropped, dropped);
+   }
+}
+
+static int
+wal_sink_trim(char* staging, char* oldest, int keep)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   char path[MAX_PATH];
+   int dropped = 0;
+
+   if (pgmoneta_get_wal_files(staging, &number_of_files, &files))
+   {
+      goto done;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      if ((keep >= 0 && i < number_of_files - keep) ||
+          (oldest != NULL && strcmp(files[i], oldest) < 0))
+      {
+         memset(path, 0, sizeof(path));
+         snprintf(path, sizeof(path), "%s%s", staging, files[i]);
+
+         if (!unlink(path))
+         {
+            dropped++;
+         }
+         errno = 0;
+      }
+   }
+
+done:
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   return dropped;
+}
+
+int
+pgmoneta_wal_sink_prune(int srv, char* oldest)
+{
+   char* staging = NULL;
+   char* types[] = {"shipping/", "ssh/"};
+   int dropped;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < 2; i++)
+   {
+      staging = pgmoneta_get_server(srv);
+      staging = pgmoneta_append(staging, "walsink/");
+      staging = pgmoneta_append(staging, types[i]);
+
+      if (pgmoneta_exists(staging))
+      {
+         dropped = wal_sink_trim(staging, oldest, oldest == NULL ? 0 : -1);
+         if (dropped > 0)
+         {
+            pgmoneta_log_error("Retention dropped %d undelivered segments of the WAL %.*s sink for %s",
+                               dropped, (int)strlen(types[i]) - 1, types[i], config->servers[srv].name);
+         }
+      }
+
+      free(staging);
+      staging = NULL;
+   }
+
+   return 0;
+}
+
+static void
+wal_sink_lag(struct wal_sink* sink)
+{
+   size_t received = atomic_load(&sink->received);
+   size_t written = atomic_load(&sink->written);
+
+   atomic_store(sink->lag, received > written ? received - written : 0);
+}
+
+static void
+wal_compress(struct ring* ring, struct wal_compression* compression, char* filename)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (ring == NULL || filename == NULL)
+   {
+      return;
+   }
+
+   if (config->compression_type == COMPRESSION_NONE && config->encryption == ENCRYPTION_NONE)
+   {
+      return;
+   }
+
+   if (pgmoneta_ring_write(ring, filename, strlen(filename) + 1, &wal_compress_segment, compression))
+   {
+      pgmoneta_log_warn("Unable to queue %s for compression", filename);
+   }
+}
+
+static int
+wal_compress_segment(void* data, size_t size, void* arg)
+{
+   char* filename = (char*)data;
+   struct wal_compression* compression = (struct wal_compression*)arg;
+   bool active = false;
+   char from[MAX_PATH];
+   char to[MAX_PATH];
+   int ret = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // the periodic sweep compresses the segment, or else the next sweep
+   if (!atomic_compare_exchange_strong(&config->servers[compression->server].wal_compress, &active, true))
+   {
+      pgmoneta_log_debug("WAL segment %s is left for the next sweep", filename);
+      return 0;
+   }
+
+   memset(from, 0, sizeof(from));
+   snprintf(from, sizeof(from), "%s%s", compression->directory, filename);
+
+   if (!pgmoneta_exists(from))
+   {
+      goto done;
+   }
+
+   if (config->compression_type != COMPRESSION_NONE)
+   {
+      memset(to, 0, sizeof(to));
+      snprintf(to, sizeof(to), "%s%s", from, pgmoneta_compression_suffix(config->compression_type));
+
+      if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+      {
+         ret = pgmoneta_gzip_file(from, to);
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+      {
+         ret = pgmoneta_zstandardc_wal_file(compression->server, from, to);
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+      {
+         ret = pgmoneta_lz4c_file(from, to);
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+      {
+         ret = pgmoneta_bzip2_file(from, to);
+      }
+      else
+      {
+         goto done;
+      }
+
+      if (ret)
+      {
+         pgmoneta_log_error("Could not compress WAL segment %s", from);
+         goto done;
+      }
+
+      pgmoneta_permission(to, 6, 0, 0);
+      memcpy(from, to, sizeof(from));
+   }
+
+   if (config->encryption != ENCRYPTION_NONE)
+   {
+      memset(to, 0, sizeof(to));
+      snprintf(to, sizeof(to), "%s.aes", from);
+
+      if (pgmoneta_encrypt_file(from, to))
+      {
+         pgmoneta_log_error("Could not encrypt WAL segment %s", from);
+         goto done;
+      }
+
+      pgmoneta_permission(to, 6, 0, 0);
+   }
+
+done:
+   atomic_store(&config->servers[compression->server].wal_compress, false);
+
+   // a segment left behind is picked up by the periodic sweep
+   return 0;
+}
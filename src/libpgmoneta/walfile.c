@@ -29,15 +29,96 @@
 #include <aes.h>
 #include <compression.h>
 #include <deque.h>
+#include <info.h>
 #include <json.h>
 #include <logging.h>
+#include <security.h>
 #include <utils.h>
 #include <walfile.h>
 #include <walfile/wal_reader.h>
+#include <workers.h>
 
+#include <errno.h>
 #include <libgen.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WALFILE_TASKS_PER_WORKER 4
+
+#define WALFILE_COMPACT_MAGIC "PGMWALC1"
+
+/** @struct walfile_segment
+ * Defines a WAL file which is decoded by a worker
+ */
+struct walfile_segment
+{
+   struct worker_input wi;    /**< The worker input, which must be first */
+   char path[MAX_PATH];       /**< The path of the WAL file */
+   char* plain;               /**< The path of the decrypted and decompressed WAL file */
+   bool temporary;            /**< Is the plain WAL file a temporary copy */
+   uint32_t timeline;         /**< The timeline */
+   uint64_t segno;            /**< The segment number */
+   struct deque* rms;         /**< The resource managers */
+   uint64_t start_lsn;        /**< The start LSN */
+   uint64_t end_lsn;          /**< The end LSN */
+   struct deque* xids;        /**< The XIDs */
+   uint32_t limit;            /**< The limit */
+   bool decoded;              /**< Has the WAL file been decoded */
+   uint16_t magic;            /**< The magic value */
+   bool continued;            /**< Does the WAL file start with the end of a record */
+   struct deque* records;     /**< The partial records, and the records passing the filters */
+};
+
+/** @struct walfile_compact_header
+ * Defines the header of a compacted WAL file. The header is followed by the
+ * holes, the offsets of the records with dropped images, the WAL file without
+ * the holes, and the moved images
+ */
+struct walfile_compact_header
+{
+   char magic[8];                /**< The magic value */
+   uint32_t segment_size;        /**< The size of the WAL file */
+   uint32_t number_of_holes;     /**< The number of holes */
+   uint32_t number_of_records;   /**< The number of records with dropped images */
+   uint32_t reserved;            /**< Reserved */
+   uint64_t image_size;          /**< The size of the moved images */
+};
+
+/** @struct walfile_compact_hole
+ * Defines an image range taken out of a compacted WAL file. A hole never
+ * crosses a page
+ */
+struct walfile_compact_hole
+{
+   uint32_t offset;              /**< The offset in the WAL file */
+   uint32_t length;              /**< The length */
+   uint32_t moved;               /**< Is the range in the moved images, otherwise it is zero filled */
+};
+
+static void walfile_record_destroy(struct decoded_xlog_record* record);
+static int walfile_plain(char* path, char** plain, bool* temporary);
+static int walfile_collect(char** paths, int number_of_paths, uint64_t start_lsn, uint64_t end_lsn,
+                           struct walfile_segment** segments, int* number_of_segments);
+static int walfile_add(char* path, struct walfile_segment** segments, int* number_of_segments, int* capacity);
+static int walfile_compare(const void* a, const void* b);
+static bool walfile_consecutive(struct walfile_segment* segments, int number_of_segments, int index);
+static void do_decode_walfile(struct worker_input* wi);
+static int walfile_display(struct walfile_segment* segments, int number_of_segments, int index, int decoded,
+                           enum value_type type, FILE* out, bool quiet, bool color,
+                           struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids, uint32_t limit);
+static void walfile_release(struct walfile_segment* segment);
+static size_t walfile_compact_position(size_t record_start, size_t offset, uint32_t block_size);
+static int walfile_compact_add(struct walfile_compact_hole** holes, uint32_t* number_of_holes, uint32_t* capacity,
+                               size_t position, size_t length, uint32_t block_size, bool moved);
+static int walfile_compact_archive(int server, char* directory, char* wal, char* name);
+static int walfile_compress(char* path, int type);
+static int walfile_compression_type(char* name);
+static int walfile_expand_copy(char* segment, size_t size, uint32_t block_size, size_t* position,
+                               void* buffer, size_t length, bool into);
+static int walfile_expand_record(char* segment, size_t size, uint32_t block_size, uint32_t offset);
 
 int
 pgmoneta_read_walfile(int server, char* path, struct walfile** wf)
@@ -174,27 +255,7 @@ pgmoneta_destroy_walfile(struct walfile* wf)
    while (pgmoneta_deque_iterator_next(record_iterator))
    {
       struct decoded_xlog_record* record = (struct decoded_xlog_record*) record_iterator->value->data;
-      if (record->partial)
-      {
-         free(record);
-         continue;
-      }
-      if (record->main_data != NULL)
-      {
-         free(record->main_data);
-      }
-      for (int i = 0; i <= record->max_block_id; i++)
-      {
-         if (record->blocks[i].has_data)
-         {
-            free(record->blocks[i].data);
-         }
-         if (record->blocks[i].has_image)
-         {
-            free(record->blocks[i].bkp_image);
-         }
-      }
-      free(record);
+      walfile_record_destroy(record);
    }
    pgmoneta_deque_iterator_destroy(record_iterator);
    pgmoneta_deque_destroy(wf->records);
@@ -216,160 +277,1611 @@ pgmoneta_describe_walfile(char* path, enum value_type type, char* output, bool q
                           struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids,
                           uint32_t limit)
 {
-   FILE* out = NULL;
-   char* tmp_wal = NULL;
-   struct walfile* wf = NULL;
-   struct deque_iterator* record_iterator = NULL;
-   struct decoded_xlog_record* record = NULL;
-   char* decompressed_file_name = NULL;
-   char* decrypted_file_name = NULL;
-   char* wal_path = NULL;
-   bool copy = true;
-
    if (!pgmoneta_is_file(path))
    {
       pgmoneta_log_fatal("WAL file at %s does not exist", path);
-      goto error;
+      return 1;
    }
 
-   wal_path = pgmoneta_append(wal_path, path);
-
-   // Based on the file extension, if it's an encrypted file, decrypt it in /tmp
-   if (pgmoneta_is_encrypted_archive(wal_path))
-   {
-      tmp_wal = pgmoneta_format_and_append(tmp_wal, "/tmp/%s", basename(wal_path));
+   return pgmoneta_describe_walfiles(&path, 1, 1, type, output, quiet, color, rms, start_lsn, end_lsn, xids, limit);
+}
 
-      // Temporarily copying the encrypted WAL file, because the decrypt
-      // functions delete the source file
-      pgmoneta_copy_file(wal_path, tmp_wal, NULL);
-      copy = false;
+int
+pgmoneta_describe_walfiles(char** paths, int number_of_paths, int number_of_workers, enum value_type type, char* output,
+                           bool quiet, bool color, struct deque* rms, uint64_t start_lsn, uint64_t end_lsn,
+                           struct deque* xids, uint32_t limit)
+{
+   FILE* out = NULL;
+   int number_of_segments = 0;
+   int queued = 0;
+   int displayed = 0;
+   uint32_t shown = 0;
+   int batch;
+   struct walfile_segment* segments = NULL;
+   struct workers* workers = NULL;
 
-      pgmoneta_basename_file(basename(wal_path), &decrypted_file_name);
+   if (walfile_collect(paths, number_of_paths, start_lsn, end_lsn, &segments, &number_of_segments))
+   {
+      goto error;
+   }
 
-      free(wal_path);
-      wal_path = NULL;
+   if (number_of_workers > 1 && number_of_segments > 1)
+   {
+      if (pgmoneta_workers_initialize(MIN(number_of_workers, number_of_segments), &workers))
+      {
+         goto error;
+      }
+   }
 
-      wal_path = pgmoneta_format_and_append(wal_path, "/tmp/%s", decrypted_file_name);
-      free(decrypted_file_name);
+   if (output == NULL)
+   {
+      out = stdout;
+   }
+   else
+   {
+      out = fopen(output, "w");
+      color = false;
 
-      if (pgmoneta_decrypt_file(tmp_wal, wal_path))
+      if (out == NULL)
       {
-         pgmoneta_log_fatal("Failed to decrypt WAL file at %s", path);
+         pgmoneta_log_fatal("Could not create %s", output);
          goto error;
       }
    }
 
-   // Based on the file extension, if it's a compressed file, decompress it
-   // in /tmp
-   if (pgmoneta_is_compressed_archive(wal_path))
+   if (type == ValueJSON && !quiet)
    {
-      free(tmp_wal);
-      tmp_wal = NULL;
+      fprintf(out, "{ \"WAL\": [\n");
+   }
+
+   // decode a window of files in parallel, and display them in LSN order. The last
+   // file of a window is kept until the next window, since a record can continue in it
+   batch = MAX(number_of_workers, 1) * WALFILE_TASKS_PER_WORKER;
 
-      tmp_wal = pgmoneta_format_and_append(tmp_wal, "/tmp/%s", basename(wal_path));
+   while (displayed < number_of_segments && (limit == 0 || shown < limit))
+   {
+      int end = MIN(queued + batch, number_of_segments);
+      int last;
 
-      if (copy)
+      for (; queued < end; queued++)
       {
-         // Temporarily copying the compressed WAL file, because the decompress
-         // functions delete the source file
-         pgmoneta_copy_file(wal_path, tmp_wal, NULL);
+         segments[queued].wi.workers = workers;
+         segments[queued].rms = rms;
+         segments[queued].start_lsn = start_lsn;
+         segments[queued].end_lsn = end_lsn;
+         segments[queued].xids = xids;
+         segments[queued].limit = limit;
+
+         if (workers != NULL)
+         {
+            pgmoneta_workers_add(workers, do_decode_walfile, &segments[queued].wi);
+         }
+         else
+         {
+            do_decode_walfile(&segments[queued].wi);
+         }
       }
 
-      pgmoneta_basename_file(basename(wal_path), &decompressed_file_name);
+      if (workers != NULL)
+      {
+         pgmoneta_workers_wait(workers);
+      }
 
-      free(wal_path);
-      wal_path = NULL;
+      for (int i = displayed; i < queued; i++)
+      {
+         if (!segments[i].decoded)
+         {
+            pgmoneta_log_fatal("Failed to read WAL file at %s", segments[i].path);
+            goto error;
+         }
+      }
 
-      wal_path = pgmoneta_format_and_append(wal_path, "/tmp/%s", decompressed_file_name);
-      free(decompressed_file_name);
+      last = queued == number_of_segments ? number_of_segments : queued - 1;
 
-      if (pgmoneta_decompress(tmp_wal, wal_path))
+      // stop once the limit has been displayed
+      for (; displayed < last && (limit == 0 || shown < limit); displayed++)
       {
-         pgmoneta_log_fatal("Failed to decompress WAL file at %s", path);
-         goto error;
+         shown += walfile_display(segments, number_of_segments, displayed, queued, type, out, quiet, color,
+                                  rms, start_lsn, end_lsn, xids, limit);
+
+         // the previous file is only needed for a record which continues in this one
+         if (displayed > 0)
+         {
+            walfile_release(&segments[displayed - 1]);
+         }
       }
    }
 
-   if (pgmoneta_read_walfile(-1, wal_path, &wf))
+   if (type == ValueJSON && !quiet)
    {
-      pgmoneta_log_fatal("Failed to read WAL file at %s", path);
-      goto error;
+      fprintf(out, "\n]}");
    }
 
-   if (pgmoneta_deque_iterator_create(wf->records, &record_iterator))
+   if (output != NULL)
    {
-      pgmoneta_log_fatal("Failed to create deque iterator");
-      goto error;
+      fflush(out);
+      fclose(out);
    }
 
-   if (output == NULL)
+   if (workers != NULL)
    {
-      out = stdout;
+      pgmoneta_workers_destroy(workers);
    }
-   else
+
+   for (int i = 0; i < number_of_segments; i++)
    {
-      out = fopen(output, "w");
-      color = false;
+      walfile_release(&segments[i]);
+   }
+   free(segments);
+
+   return 0;
+
+error:
+
+   if (output != NULL && out != NULL)
+   {
+      fflush(out);
+      fclose(out);
+   }
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   for (int i = 0; i < number_of_segments; i++)
+   {
+      walfile_release(&segments[i]);
    }
+   free(segments);
 
-   if (type == ValueJSON)
+   return 1;
+}
+
+bool
+pgmoneta_is_compacted_walfile(char* path)
+{
+   char magic[8];
+   bool compacted = false;
+   FILE* file = NULL;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      return false;
+   }
+
+   if (fread(&magic[0], 1, sizeof(magic), file) == sizeof(magic))
+   {
+      compacted = !memcmp(&magic[0], WALFILE_COMPACT_MAGIC, sizeof(magic));
+   }
+
+   fclose(file);
+
+   return compacted;
+}
+
+int
+pgmoneta_compact_walfile(int server, char* from, char* to)
+{
+   struct wal_record_iterator* it = NULL;
+   struct decoded_xlog_record* record = NULL;
+   struct walfile_compact_header header;
+   struct walfile_compact_hole* holes = NULL;
+   uint32_t number_of_holes = 0;
+   uint32_t capacity = 0;
+   uint32_t* records = NULL;
+   uint32_t number_of_records = 0;
+   uint32_t records_capacity = 0;
+   size_t position = 0;
+   FILE* file = NULL;
+
+   memset(&header, 0, sizeof(struct walfile_compact_header));
+
+   if (pgmoneta_wal_record_iterator_create(from, server, &it))
+   {
+      goto error;
+   }
+
+   while (pgmoneta_wal_record_iterator_next(it, &record))
    {
-      if (!quiet)
+      size_t record_start;
+      bool dropped = false;
+
+      // the parts of records crossing into the neighbouring files are kept as they are
+      if (record->partial)
       {
-         fprintf(out, "{ \"WAL\": [\n");
+         continue;
       }
 
-      while (pgmoneta_deque_iterator_next(record_iterator))
+      record_start = record->lsn - it->base;
+
+      for (int i = 0; i <= record->max_block_id; i++)
       {
-         record = (struct decoded_xlog_record*) record_iterator->value->data;
-         pgmoneta_wal_record_display(record, wf->long_phd->std.xlp_magic, type, out, quiet, color,
-                                     rms, start_lsn, end_lsn, xids, limit);
+         struct decoded_bkp_block* blk = &record->blocks[i];
+         size_t start;
+
+         if (!blk->in_use || !blk->has_image || blk->bimg_len == 0)
+         {
+            continue;
+         }
+
+         // the image is in the mapping when the record is in one page,
+         // otherwise in the buffer of the record
+         if (blk->bkp_image >= it->data && blk->bkp_image < it->data + it->size)
+         {
+            start = blk->bkp_image - it->data;
+         }
+         else
+         {
+            start = walfile_compact_position(record_start, SIZE_OF_XLOG_RECORD + (blk->bkp_image - it->buffer), it->block_size);
+         }
+
+         if (walfile_compact_add(&holes, &number_of_holes, &capacity, start, blk->bimg_len, it->block_size, blk->apply_image))
+         {
+            goto error;
+         }
+
+         dropped = dropped || !blk->apply_image;
       }
 
-      if (!quiet)
+      if (dropped)
       {
-         fprintf(out, "\n]}");
+         if (number_of_records == records_capacity)
+         {
+            uint32_t* r = NULL;
+
+            records_capacity = records_capacity == 0 ? 64 : records_capacity * 2;
+            r = (uint32_t*)realloc(records, records_capacity * sizeof(uint32_t));
+            if (r == NULL)
+            {
+               goto error;
+            }
+            records = r;
+         }
+
+         records[number_of_records++] = (uint32_t)record_start;
       }
    }
-   else
+
+   if (it->failed)
+   {
+      pgmoneta_log_error("WAL compaction: Could not decode %s", from);
+      goto error;
+   }
+
+   memcpy(&header.magic[0], WALFILE_COMPACT_MAGIC, sizeof(header.magic));
+   header.segment_size = (uint32_t)it->size;
+   header.number_of_holes = number_of_holes;
+   header.number_of_records = number_of_records;
+
+   for (uint32_t i = 0; i < number_of_holes; i++)
    {
-      while (pgmoneta_deque_iterator_next(record_iterator))
+      if (holes[i].moved)
       {
-         record = (struct decoded_xlog_record*) record_iterator->value->data;
-         pgmoneta_wal_record_display(record, wf->long_phd->std.xlp_magic, type, out, quiet, color,
-                                     rms, start_lsn, end_lsn, xids, limit);
+         header.image_size += holes[i].length;
       }
    }
 
-   if (output != NULL)
+   file = fopen(to, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("WAL compaction: Could not create %s (%s)", to, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   fwrite(&header, 1, sizeof(struct walfile_compact_header), file);
+   fwrite(holes, sizeof(struct walfile_compact_hole), number_of_holes, file);
+   fwrite(records, sizeof(uint32_t), number_of_records, file);
+
+   // the WAL file without the holes, and then the moved images
+   for (uint32_t i = 0; i < number_of_holes; i++)
+   {
+      fwrite(it->data + position, 1, holes[i].offset - position, file);
+      position = holes[i].offset + holes[i].length;
+   }
+   fwrite(it->data + position, 1, it->size - position, file);
+
+   for (uint32_t i = 0; i < number_of_holes; i++)
    {
-      if (out != NULL)
+      if (holes[i].moved)
       {
-         fflush(out);
-         fclose(out);
+         fwrite(it->data + holes[i].offset, 1, holes[i].length, file);
       }
    }
 
-   free(tmp_wal);
-   free(wal_path);
-   pgmoneta_deque_iterator_destroy(record_iterator);
-   pgmoneta_destroy_walfile(wf);
+   if (ferror(file))
+   {
+      pgmoneta_log_error("WAL compaction: Could not write %s", to);
+      goto error;
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+
+   pgmoneta_wal_record_iterator_destroy(it);
+   free(holes);
+   free(records);
+
    return 0;
 
 error:
 
-   if (output != NULL)
+   if (file != NULL)
+   {
+      fclose(file);
+      unlink(to);
+   }
+
+   pgmoneta_wal_record_iterator_destroy(it);
+   free(holes);
+   free(records);
+
+   return 1;
+}
+
+int
+pgmoneta_expand_walfile(char* from, char* to)
+{
+   struct walfile_compact_header* header = NULL;
+   struct walfile_compact_hole* holes = NULL;
+   struct xlog_long_page_header_data* long_header = NULL;
+   uint32_t* records = NULL;
+   char* compacted = NULL;
+   char* segment = NULL;
+   char* skeleton = NULL;
+   char* images = NULL;
+   size_t size;
+   size_t metadata;
+   size_t position = 0;
+   size_t hole_size = 0;
+   size_t image_offset = 0;
+   FILE* file = NULL;
+
+   size = pgmoneta_get_file_size(from);
+   if (size < sizeof(struct walfile_compact_header))
+   {
+      goto error;
+   }
+
+   compacted = (char*)malloc(size);
+   if (compacted == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(from, "rb");
+   if (file == NULL || fread(compacted, 1, size, file) != size)
+   {
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   header = (struct walfile_compact_header*)compacted;
+
+   if (memcmp(&header->magic[0], WALFILE_COMPACT_MAGIC, sizeof(header->magic)))
+   {
+      pgmoneta_log_error("WAL compaction: %s isn't compacted", from);
+      goto error;
+   }
+
+   metadata = sizeof(struct walfile_compact_header) +
+              (size_t)header->number_of_holes * sizeof(struct walfile_compact_hole) +
+              (size_t)header->number_of_records * sizeof(uint32_t);
+
+   if (metadata > size)
+   {
+      goto corrupt;
+   }
+
+   holes = (struct walfile_compact_hole*)(compacted + sizeof(struct walfile_compact_header));
+   records = (uint32_t*)(holes + header->number_of_holes);
+
+   for (uint32_t i = 0; i < header->number_of_holes; i++)
    {
-      if (out != NULL)
+      if (holes[i].offset < position || (size_t)holes[i].offset + holes[i].length > header->segment_size)
       {
-         fflush(out);
-         fclose(out);
+         goto corrupt;
       }
+
+      position = holes[i].offset + holes[i].length;
+      hole_size += holes[i].length;
    }
 
-   free(tmp_wal);
-   free(wal_path);
-   pgmoneta_destroy_walfile(wf);
-   pgmoneta_deque_iterator_destroy(record_iterator);
-   return 1;
-}
\ No newline at end of file
+   if (metadata + (header->segment_size - hole_size) + header->image_size != size)
+   {
+      goto corrupt;
+   }
+
+   skeleton = compacted + metadata;
+   images = skeleton + (header->segment_size - hole_size);
+
+   segment = (char*)malloc(header->segment_size);
+   if (segment == NULL)
+   {
+      goto error;
+   }
+
+   position = 0;
+
+   for (uint32_t i = 0; i < header->number_of_holes; i++)
+   {
+      size_t length = holes[i].offset - position;
+
+      memcpy(segment + position, skeleton, length);
+      skeleton += length;
+
+      if (holes[i].moved)
+      {
+         memcpy(segment + holes[i].offset, images + image_offset, holes[i].length);
+         image_offset += holes[i].length;
+      }
+      else
+      {
+         memset(segment + holes[i].offset, 0, holes[i].length);
+      }
+
+      position = holes[i].offset + holes[i].length;
+   }
+   memcpy(segment + position, skeleton, header->segment_size - position);
+
+   long_header = (struct xlog_long_page_header_data*)segment;
+
+   if (long_header->xlp_xlog_blcksz == 0 || header->segment_size % long_header->xlp_xlog_blcksz != 0)
+   {
+      goto corrupt;
+   }
+
+   for (uint32_t i = 0; i < header->number_of_records; i++)
+   {
+      if (walfile_expand_record(segment, header->segment_size, long_header->xlp_xlog_blcksz, records[i]))
+      {
+         goto corrupt;
+      }
+   }
+
+   file = fopen(to, "wb");
+   if (file == NULL)
+   {
+      pgmoneta_log_error("WAL compaction: Could not create %s (%s)", to, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   if (fwrite(segment, 1, header->segment_size, file) != header->segment_size)
+   {
+      goto error;
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+
+   free(compacted);
+   free(segment);
+
+   return 0;
+
+corrupt:
+
+   pgmoneta_log_error("WAL compaction: %s is corrupt", from);
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(compacted);
+   free(segment);
+
+   return 1;
+}
+
+int
+pgmoneta_compact_wal(int server)
+{
+   char* directory = NULL;
+   char* wal = NULL;
+   char* backup_directory = NULL;
+   char* state = NULL;
+   char cutoff[MISC_LENGTH];
+   char last[MISC_LENGTH];
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   int compacted = 0;
+   FILE* file = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&cutoff[0], 0, sizeof(cutoff));
+   memset(&last[0], 0, sizeof(last));
+
+   directory = pgmoneta_get_server(server);
+   wal = pgmoneta_get_server_wal(server);
+   backup_directory = pgmoneta_get_server_backup(server);
+
+   if (pgmoneta_get_backups(backup_directory, &number_of_backups, &backups))
+   {
+      goto error;
+   }
+
+   // the full-page images are needed to replay the WAL from the start of the
+   // newest full backup, so only the segments before it are compacted
+   for (int i = number_of_backups - 1; i >= 0; i--)
+   {
+      if (backups[i] != NULL && backups[i]->valid == VALID_TRUE && backups[i]->type == TYPE_FULL)
+      {
+         snprintf(&cutoff[0], sizeof(cutoff), "%.24s", backups[i]->wal);
+         break;
+      }
+   }
+
+   if (strlen(&cutoff[0]) != 24)
+   {
+      goto done;
+   }
+
+   // the newest segment which has been compacted
+   state = pgmoneta_append(state, directory);
+   state = pgmoneta_append(state, "walcompaction");
+
+   if (pgmoneta_exists(state))
+   {
+      file = fopen(state, "r");
+      if (file != NULL)
+      {
+         if (fgets(&last[0], sizeof(last), file) == NULL)
+         {
+            memset(&last[0], 0, sizeof(last));
+         }
+         last[strcspn(&last[0], "\n")] = '\0';
+
+         fclose(file);
+         file = NULL;
+      }
+   }
+
+   if (pgmoneta_get_wal_files(wal, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   // the names sort by timeline first, then by position
+   for (int i = 0; i < number_of_files; i++)
+   {
+      uint32_t tli;
+      uint32_t log;
+      uint32_t seg;
+
+      if (strlen(files[i]) < 24 || sscanf(files[i], "%08X%08X%08X", &tli, &log, &seg) != 3)
+      {
+         continue;
+      }
+
+      if (strncmp(files[i], &cutoff[0], 24) >= 0)
+      {
+         break;
+      }
+
+      if (strlen(&last[0]) == 24 && strncmp(files[i], &last[0], 24) <= 0)
+      {
+         continue;
+      }
+
+      if (walfile_compact_archive(server, directory, wal, files[i]))
+      {
+         pgmoneta_log_warn("WAL compaction: Could not compact %s of %s", files[i], config->servers[server].name);
+         break;
+      }
+
+      snprintf(&last[0], sizeof(last), "%.24s", files[i]);
+      compacted++;
+   }
+
+   if (compacted > 0)
+   {
+      file = fopen(state, "w");
+      if (file == NULL)
+      {
+         goto error;
+      }
+
+      fprintf(file, "%s\n", &last[0]);
+
+      fclose(file);
+      file = NULL;
+
+      pgmoneta_log_debug("WAL compaction: %d segments of %s", compacted, config->servers[server].name);
+   }
+
+done:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(directory);
+   free(wal);
+   free(backup_directory);
+   free(state);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(directory);
+   free(wal);
+   free(backup_directory);
+   free(state);
+
+   return 1;
+}
+
+int
+pgmoneta_expand_wal(char* directory)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   char* path = NULL;
+
+   if (pgmoneta_get_wal_files(directory, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      path = pgmoneta_append(path, directory);
+      if (!pgmoneta_ends_with(path, "/"))
+      {
+         path = pgmoneta_append(path, "/");
+      }
+      path = pgmoneta_append(path, files[i]);
+
+      if (pgmoneta_is_compacted_walfile(path))
+      {
+         if (pgmoneta_expand_walfile(path, path))
+         {
+            goto error;
+         }
+      }
+
+      free(path);
+      path = NULL;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(path);
+
+   return 1;
+}
+
+static void
+walfile_record_destroy(struct decoded_xlog_record* record)
+{
+   if (record == NULL)
+   {
+      return;
+   }
+
+   if (record->partial)
+   {
+      free(record);
+      return;
+   }
+
+   if (record->main_data != NULL)
+   {
+      free(record->main_data);
+   }
+
+   for (int i = 0; i <= record->max_block_id; i++)
+   {
+      if (record->blocks[i].has_data)
+      {
+         free(record->blocks[i].data);
+      }
+      if (record->blocks[i].has_image)
+      {
+         free(record->blocks[i].bkp_image);
+      }
+   }
+
+   free(record);
+}
+
+static int
+walfile_plain(char* path, char** plain, bool* temporary)
+{
+   char tmp[MAX_PATH];
+   char* name = NULL;
+   char* wal_path = NULL;
+
+   *plain = NULL;
+   *temporary = false;
+
+   memset(&tmp[0], 0, sizeof(tmp));
+
+   name = basename(path);
+
+   // Decrypt and decompress a copy in /tmp, because those functions delete the
+   // source file. The copies are named after the process, since files are
+   // decoded in parallel, but keep the segment name first for its LSN
+   if (pgmoneta_is_encrypted_archive(name) || pgmoneta_is_compressed_archive(name))
+   {
+      wal_path = pgmoneta_format_and_append(wal_path, "/tmp/%.24s.%d", name, getpid());
+      snprintf(&tmp[0], sizeof(tmp), "%s%s", wal_path, strlen(name) > 24 ? name + 24 : "");
+
+      if (pgmoneta_copy_file(path, &tmp[0], NULL))
+      {
+         pgmoneta_log_fatal("Failed to copy WAL file at %s", path);
+         goto error;
+      }
+
+      *temporary = true;
+
+      if (pgmoneta_is_encrypted_archive(&tmp[0]))
+      {
+         char decrypted[MAX_PATH];
+
+         memset(&decrypted[0], 0, sizeof(decrypted));
+         snprintf(&decrypted[0], sizeof(decrypted), "%.*s", (int)(strlen(&tmp[0]) - strlen(".aes")), &tmp[0]);
+
+         if (pgmoneta_decrypt_file(&tmp[0], &decrypted[0]))
+         {
+            pgmoneta_log_fatal("Failed to decrypt WAL file at %s", path);
+            goto error;
+         }
+
+         memcpy(&tmp[0], &decrypted[0], sizeof(tmp));
+      }
+
+      if (pgmoneta_is_compressed_archive(&tmp[0]))
+      {
+         if (pgmoneta_decompress(&tmp[0], wal_path))
+         {
+            pgmoneta_log_fatal("Failed to decompress WAL file at %s", path);
+            goto error;
+         }
+      }
+      else if (rename(&tmp[0], wal_path))
+      {
+         goto error;
+      }
+
+      memset(&tmp[0], 0, sizeof(tmp));
+   }
+
+   // A compacted WAL file is expanded into its own copy as well
+   if (pgmoneta_is_compacted_walfile(wal_path != NULL ? wal_path : path))
+   {
+      if (wal_path == NULL)
+      {
+         wal_path = pgmoneta_format_and_append(wal_path, "/tmp/%.24s.%d", name, getpid());
+         *temporary = true;
+
+         if (pgmoneta_expand_walfile(path, wal_path))
+         {
+            pgmoneta_log_fatal("Failed to expand WAL file at %s", path);
+            goto error;
+         }
+      }
+      else if (pgmoneta_expand_walfile(wal_path, wal_path))
+      {
+         pgmoneta_log_fatal("Failed to expand WAL file at %s", path);
+         goto error;
+      }
+   }
+
+   if (wal_path == NULL)
+   {
+      wal_path = pgmoneta_append(wal_path, path);
+   }
+
+   *plain = wal_path;
+
+   return 0;
+
+error:
+
+   if (strlen(&tmp[0]) > 0)
+   {
+      unlink(&tmp[0]);
+   }
+
+   if (wal_path != NULL && *temporary)
+   {
+      unlink(wal_path);
+   }
+
+   free(wal_path);
+
+   *temporary = false;
+
+   return 1;
+}
+
+static int
+walfile_collect(char** paths, int number_of_paths, uint64_t start_lsn, uint64_t end_lsn,
+                struct walfile_segment** segments, int* number_of_segments)
+{
+   int count = 0;
+   int capacity = 0;
+   int selected = 0;
+   uint64_t segment_size = DEFAULT_WAL_SEGZ_BYTES;
+   struct walfile_segment* s = NULL;
+
+   *segments = NULL;
+   *number_of_segments = 0;
+
+   for (int i = 0; i < number_of_paths; i++)
+   {
+      if (pgmoneta_is_directory(paths[i]))
+      {
+         int number_of_files = 0;
+         char** files = NULL;
+
+         if (pgmoneta_get_wal_files(paths[i], &number_of_files, &files))
+         {
+            pgmoneta_log_fatal("Could not read the WAL files in %s", paths[i]);
+            goto error;
+         }
+
+         for (int j = 0; j < number_of_files; j++)
+         {
+            char* f = NULL;
+
+            f = pgmoneta_append(f, paths[i]);
+            if (!pgmoneta_ends_with(f, "/"))
+            {
+               f = pgmoneta_append(f, "/");
+            }
+            f = pgmoneta_append(f, files[j]);
+
+            if (walfile_add(f, &s, &count, &capacity))
+            {
+               free(f);
+               for (int k = 0; k < number_of_files; k++)
+               {
+                  free(files[k]);
+               }
+               free(files);
+               goto error;
+            }
+
+            free(f);
+         }
+
+         for (int j = 0; j < number_of_files; j++)
+         {
+            free(files[j]);
+         }
+         free(files);
+      }
+      else if (pgmoneta_is_file(paths[i]))
+      {
+         if (walfile_add(paths[i], &s, &count, &capacity))
+         {
+            goto error;
+         }
+      }
+      else
+      {
+         pgmoneta_log_fatal("WAL file at %s does not exist", paths[i]);
+         goto error;
+      }
+   }
+
+   // the segment size is in the header of an uncompressed WAL file
+   for (int i = 0; i < count; i++)
+   {
+      struct xlog_long_page_header_data long_header;
+      FILE* file = NULL;
+
+      if (pgmoneta_is_encrypted_archive(s[i].path) || pgmoneta_is_compressed_archive(s[i].path))
+      {
+         continue;
+      }
+
+      file = fopen(s[i].path, "rb");
+      if (file != NULL)
+      {
+         if (fread(&long_header, sizeof(struct xlog_long_page_header_data), 1, file) == 1 && long_header.xlp_seg_size > 0)
+         {
+            segment_size = long_header.xlp_seg_size;
+         }
+         fclose(file);
+         break;
+      }
+   }
+
+   for (int i = 0; i < count; i++)
+   {
+      uint32_t log;
+      uint32_t seg;
+      uint64_t first;
+
+      sscanf(basename(s[i].path), "%08X%08X%08X", &s[i].timeline, &log, &seg);
+      s[i].segno = (uint64_t)log * (0x100000000ULL / segment_size) + seg;
+
+      first = s[i].segno * segment_size;
+
+      if ((start_lsn > 0 && first + segment_size <= start_lsn) ||
+          (end_lsn > 0 && first > end_lsn))
+      {
+         continue;
+      }
+
+      s[selected++] = s[i];
+   }
+
+   qsort(s, selected, sizeof(struct walfile_segment), walfile_compare);
+
+   *segments = s;
+   *number_of_segments = selected;
+
+   return 0;
+
+error:
+
+   free(s);
+
+   return 1;
+}
+
+static int
+walfile_add(char* path, struct walfile_segment** segments, int* number_of_segments, int* capacity)
+{
+   uint32_t tli;
+   uint32_t log;
+   uint32_t seg;
+   struct walfile_segment* segment = NULL;
+
+   if (strlen(basename(path)) < 24 || sscanf(basename(path), "%08X%08X%08X", &tli, &log, &seg) != 3)
+   {
+      pgmoneta_log_fatal("%s is not a WAL file", path);
+      return 1;
+   }
+
+   if (*number_of_segments == *capacity)
+   {
+      struct walfile_segment* n = NULL;
+      int c = *capacity == 0 ? 64 : *capacity * 2;
+
+      n = (struct walfile_segment*)realloc(*segments, c * sizeof(struct walfile_segment));
+      if (n == NULL)
+      {
+         return 1;
+      }
+
+      *segments = n;
+      *capacity = c;
+   }
+
+   segment = &(*segments)[(*number_of_segments)++];
+   memset(segment, 0, sizeof(struct walfile_segment));
+   snprintf(segment->path, sizeof(segment->path), "%s", path);
+
+   return 0;
+}
+
+static int
+walfile_compare(const void* a, const void* b)
+{
+   const struct walfile_segment* sa = (const struct walfile_segment*)a;
+   const struct walfile_segment* sb = (const struct walfile_segment*)b;
+
+   if (sa->segno != sb->segno)
+   {
+      return sa->segno < sb->segno ? -1 : 1;
+   }
+
+   if (sa->timeline != sb->timeline)
+   {
+      return sa->timeline < sb->timeline ? -1 : 1;
+   }
+
+   return strcmp(sa->path, sb->path);
+}
+
+static bool
+walfile_consecutive(struct walfile_segment* segments, int number_of_segments, int index)
+{
+   if (index < 0 || index + 1 >= number_of_segments)
+   {
+      return false;
+   }
+
+   return segments[index + 1].segno == segments[index].segno + 1 &&
+          segments[index + 1].timeline == segments[index].timeline;
+}
+
+static void
+do_decode_walfile(struct worker_input* wi)
+{
+   struct walfile_segment* segment = (struct walfile_segment*)wi;
+   struct wal_record_iterator* iterator = NULL;
+   struct decoded_xlog_record* record = NULL;
+   struct decoded_xlog_record* copy = NULL;
+   uint32_t count = 0;
+
+   if (walfile_plain(segment->path, &segment->plain, &segment->temporary) ||
+       pgmoneta_wal_record_iterator_create(segment->plain, -1, &iterator) ||
+       pgmoneta_deque_create(false, &segment->records))
+   {
+      goto error;
+   }
+
+   segment->magic = iterator->magic;
+   segment->continued = ((struct xlog_page_header_data*)iterator->data)->xlp_rem_len > 0;
+
+   // only the records which are displayed are kept
+   while ((segment->limit == 0 || count < segment->limit) && pgmoneta_wal_record_iterator_next(iterator, &record))
+   {
+      if (!record->partial)
+      {
+         if (!pgmoneta_wal_record_included(record, segment->rms, segment->start_lsn, segment->end_lsn, segment->xids))
+         {
+            continue;
+         }
+
+         count++;
+      }
+
+      if (pgmoneta_wal_record_copy(record, &copy) ||
+          pgmoneta_deque_add(segment->records, NULL, (uintptr_t)copy, ValueRef))
+      {
+         walfile_record_destroy(copy);
+         goto error;
+      }
+      copy = NULL;
+   }
+
+   if (iterator->failed)
+   {
+      goto error;
+   }
+
+   pgmoneta_wal_record_iterator_destroy(iterator);
+
+   segment->decoded = true;
+
+   return;
+
+error:
+
+   pgmoneta_wal_record_iterator_destroy(iterator);
+
+   if (wi->workers != NULL)
+   {
+      wi->workers->outcome = false;
+   }
+}
+
+static int
+walfile_display(struct walfile_segment* segments, int number_of_segments, int index, int decoded,
+                enum value_type type, FILE* out, bool quiet, bool color,
+                struct deque* rms, uint64_t start_lsn, uint64_t end_lsn, struct deque* xids, uint32_t limit)
+{
+   struct walfile_segment* segment = &segments[index];
+   struct deque_iterator* record_iterator = NULL;
+   struct decoded_xlog_record* record = NULL;
+   bool continued;
+   bool first = true;
+   int count = 0;
+
+   // the start of a record from the previous file has been displayed with it
+   continued = walfile_consecutive(segments, number_of_segments, index - 1) && segment->continued;
+
+   if (pgmoneta_deque_iterator_create(segment->records, &record_iterator))
+   {
+      pgmoneta_log_fatal("Failed to create deque iterator");
+      return 0;
+   }
+
+   while (pgmoneta_deque_iterator_next(record_iterator))
+   {
+      record = (struct decoded_xlog_record*) record_iterator->value->data;
+
+      if (record->partial && first && continued)
+      {
+         first = false;
+         continue;
+      }
+      first = false;
+
+      // a record which continues in the following files
+      if (record->partial && !pgmoneta_deque_iterator_has_next(record_iterator) && index + 1 < decoded &&
+          walfile_consecutive(segments, number_of_segments, index))
+      {
+         char** paths = NULL;
+         int number_of_paths = 0;
+         struct decoded_xlog_record* spanning = NULL;
+
+         if (record->lsn == 0)
+         {
+            continue;
+         }
+
+         paths = (char**)malloc((decoded - index) * sizeof(char*));
+         if (paths != NULL)
+         {
+            paths[number_of_paths++] = segment->plain;
+            for (int i = index; i + 1 < decoded && walfile_consecutive(segments, number_of_segments, i); i++)
+            {
+               paths[number_of_paths++] = segments[i + 1].plain;
+            }
+
+            if (!pgmoneta_wal_parse_spanning_record(paths, number_of_paths, record->lsn, &spanning))
+            {
+               if (pgmoneta_wal_record_included(spanning, rms, start_lsn, end_lsn, xids))
+               {
+                  pgmoneta_wal_record_display(spanning, segment->magic, type, out, quiet, color,
+                                              rms, start_lsn, end_lsn, xids, limit);
+                  count++;
+               }
+               walfile_record_destroy(spanning);
+               free(paths);
+               continue;
+            }
+
+            free(paths);
+         }
+      }
+
+      pgmoneta_wal_record_display(record, segment->magic, type, out, quiet, color,
+                                  rms, start_lsn, end_lsn, xids, limit);
+
+      if (!record->partial)
+      {
+         count++;
+      }
+   }
+
+   pgmoneta_deque_iterator_destroy(record_iterator);
+
+   return count;
+}
+
+static void
+walfile_release(struct walfile_segment* segment)
+{
+   struct deque_iterator* record_iterator = NULL;
+
+   if (segment->records != NULL)
+   {
+      if (!pgmoneta_deque_iterator_create(segment->records, &record_iterator))
+      {
+         while (pgmoneta_deque_iterator_next(record_iterator))
+         {
+            walfile_record_destroy((struct decoded_xlog_record*) record_iterator->value->data);
+         }
+         pgmoneta_deque_iterator_destroy(record_iterator);
+      }
+
+      pgmoneta_deque_destroy(segment->records);
+      segment->records = NULL;
+   }
+
+   if (segment->temporary && segment->plain != NULL)
+   {
+      unlink(segment->plain);
+   }
+
+   free(segment->plain);
+   segment->plain = NULL;
+   segment->temporary = false;
+}
+
+static size_t
+walfile_compact_position(size_t record_start, size_t offset, uint32_t block_size)
+{
+   size_t position = record_start;
+
+   // the pages which the record crosses start with a short page header
+   while (true)
+   {
+      size_t room;
+
+      if (position % block_size == 0)
+      {
+         position += SIZE_OF_XLOG_SHORT_PHD;
+      }
+
+      room = block_size - position % block_size;
+
+      if (offset < room)
+      {
+         return position + offset;
+      }
+
+      offset -= room;
+      position += room;
+   }
+}
+
+static int
+walfile_compact_add(struct walfile_compact_hole** holes, uint32_t* number_of_holes, uint32_t* capacity,
+                    size_t position, size_t length, uint32_t block_size, bool moved)
+{
+   while (length > 0)
+   {
+      size_t chunk;
+
+      if (position % block_size == 0)
+      {
+         position += SIZE_OF_XLOG_SHORT_PHD;
+      }
+
+      chunk = MIN(length, block_size - position % block_size);
+
+      if (*number_of_holes == *capacity)
+      {
+         struct walfile_compact_hole* h = NULL;
+
+         *capacity = *capacity == 0 ? 256 : *capacity * 2;
+         h = (struct walfile_compact_hole*)realloc(*holes, *capacity * sizeof(struct walfile_compact_hole));
+         if (h == NULL)
+         {
+            return 1;
+         }
+         *holes = h;
+      }
+
+      (*holes)[*number_of_holes].offset = (uint32_t)position;
+      (*holes)[*number_of_holes].length = (uint32_t)chunk;
+      (*holes)[*number_of_holes].moved = moved ? 1 : 0;
+      (*number_of_holes)++;
+
+      position += chunk;
+      length -= chunk;
+   }
+
+   return 0;
+}
+
+static int
+walfile_compact_archive(int server, char* directory, char* wal, char* name)
+{
+   char from[MAX_PATH];
+   char tmp[MAX_PATH];
+   char plain[MAX_PATH];
+   char compacted[MAX_PATH];
+   char result[MAX_PATH];
+   bool encrypted = pgmoneta_is_encrypted_archive(name);
+   int type = walfile_compression_type(name);
+
+   memset(&from[0], 0, sizeof(from));
+   memset(&tmp[0], 0, sizeof(tmp));
+   memset(&plain[0], 0, sizeof(plain));
+   memset(&compacted[0], 0, sizeof(compacted));
+   memset(&result[0], 0, sizeof(result));
+
+   snprintf(&from[0], sizeof(from), "%s%s", wal, name);
+
+   // work on a copy in the server directory, so the segment is replaced in one rename
+   snprintf(&plain[0], sizeof(plain), "%s%.24s", directory, name);
+   snprintf(&tmp[0], sizeof(tmp), "%s%s", &plain[0], name + 24);
+   snprintf(&compacted[0], sizeof(compacted), "%s.compact", &plain[0]);
+
+   if (pgmoneta_copy_file(&from[0], &tmp[0], NULL))
+   {
+      goto error;
+   }
+
+   if (encrypted)
+   {
+      char decrypted[MAX_PATH];
+
+      memset(&decrypted[0], 0, sizeof(decrypted));
+      snprintf(&decrypted[0], sizeof(decrypted), "%.*s", (int)(strlen(&tmp[0]) - strlen(".aes")), &tmp[0]);
+
+      if (pgmoneta_decrypt_file(&tmp[0], &decrypted[0]))
+      {
+         goto error;
+      }
+
+      memcpy(&tmp[0], &decrypted[0], sizeof(tmp));
+   }
+
+   if (type != COMPRESSION_NONE)
+   {
+      if (pgmoneta_decompress(&tmp[0], &plain[0]))
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_is_compacted_walfile(&plain[0]))
+   {
+      unlink(&plain[0]);
+      return 0;
+   }
+
+   if (pgmoneta_compact_walfile(server, &plain[0], &compacted[0]))
+   {
+      goto error;
+   }
+
+   if (rename(&compacted[0], &plain[0]))
+   {
+      goto error;
+   }
+
+   snprintf(&result[0], sizeof(result), "%s%s", &plain[0], pgmoneta_compression_suffix(type));
+
+   if (type != COMPRESSION_NONE)
+   {
+      if (walfile_compress(&plain[0], type))
+      {
+         goto error;
+      }
+   }
+
+   if (encrypted)
+   {
+      char encrypted_path[MAX_PATH];
+
+      memset(&encrypted_path[0], 0, sizeof(encrypted_path));
+      snprintf(&encrypted_path[0], sizeof(encrypted_path), "%s.aes", &result[0]);
+
+      if (pgmoneta_encrypt_file(&result[0], &encrypted_path[0]))
+      {
+         goto error;
+      }
+
+      memcpy(&result[0], &encrypted_path[0], sizeof(result));
+   }
+
+   // keep the segment as it is when it has no images to take out
+   if (pgmoneta_get_file_size(&result[0]) >= pgmoneta_get_file_size(&from[0]))
+   {
+      unlink(&result[0]);
+      return 0;
+   }
+
+   if (rename(&result[0], &from[0]))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   unlink(&tmp[0]);
+   unlink(&plain[0]);
+   unlink(&compacted[0]);
+   if (strlen(&result[0]) > 0)
+   {
+      unlink(&result[0]);
+   }
+
+   return 1;
+}
+
+static int
+walfile_compress(char* path, int type)
+{
+   char buffer[65536];
+   size_t length;
+   struct compressor* compressor = NULL;
+   FILE* file = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (pgmoneta_compressor_create(path, type, config->compression_level, &compressor))
+   {
+      goto error;
+   }
+
+   while ((length = fread(&buffer[0], 1, sizeof(buffer), file)) > 0)
+   {
+      if (pgmoneta_compressor_write(compressor, &buffer[0], length))
+      {
+         goto error;
+      }
+   }
+
+   if (ferror(file) || pgmoneta_compressor_finish(compressor))
+   {
+      goto error;
+   }
+
+   pgmoneta_compressor_destroy(compressor);
+   fclose(file);
+   unlink(path);
+
+   return 0;
+
+error:
+
+   pgmoneta_compressor_destroy(compressor);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static int
+walfile_compression_type(char* name)
+{
+   if (strstr(name, ".zstd") != NULL)
+   {
+      return COMPRESSION_CLIENT_ZSTD;
+   }
+   else if (strstr(name, ".gz") != NULL)
+   {
+      return COMPRESSION_CLIENT_GZIP;
+   }
+   else if (strstr(name, ".lz4") != NULL)
+   {
+      return COMPRESSION_CLIENT_LZ4;
+   }
+   else if (strstr(name, ".bz2") != NULL)
+   {
+      return COMPRESSION_CLIENT_BZIP2;
+   }
+
+   return COMPRESSION_NONE;
+}
+
+static int
+walfile_expand_copy(char* segment, size_t size, uint32_t block_size, size_t* position,
+                    void* buffer, size_t length, bool into)
+{
+   char* b = (char*)buffer;
+   size_t p = *position;
+
+   while (length > 0)
+   {
+      size_t chunk;
+
+      if (p % block_size == 0)
+      {
+         p += SIZE_OF_XLOG_SHORT_PHD;
+      }
+
+      if (p >= size)
+      {
+         return 1;
+      }
+
+      chunk = MIN(length, block_size - p % block_size);
+
+      if (into)
+      {
+         memcpy(segment + p, b, chunk);
+      }
+      else
+      {
+         memcpy(b, segment + p, chunk);
+      }
+
+      b += chunk;
+      p += chunk;
+      length -= chunk;
+   }
+
+   *position = p;
+
+   return 0;
+}
+
+static int
+walfile_expand_record(char* segment, size_t size, uint32_t block_size, uint32_t offset)
+{
+   struct xlog_record header;
+   size_t position = offset;
+   size_t length;
+   char* data = NULL;
+   uint32_t crc = 0;
+
+   if (offset == 0 || walfile_expand_copy(segment, size, block_size, &position, &header, SIZE_OF_XLOG_RECORD, false))
+   {
+      goto error;
+   }
+
+   if (header.xl_tot_len < SIZE_OF_XLOG_RECORD)
+   {
+      goto error;
+   }
+
+   length = header.xl_tot_len - SIZE_OF_XLOG_RECORD;
+
+   if (length > 0)
+   {
+      data = (char*)malloc(length);
+      if (data == NULL)
+      {
+         goto error;
+      }
+
+      if (walfile_expand_copy(segment, size, block_size, &position, data, length, false))
+      {
+         goto error;
+      }
+
+      pgmoneta_create_crc32c_buffer(data, length, &crc);
+   }
+
+   // the zero filled images no longer match the pages, so redo mustn't check them
+   header.xl_info &= ~XLR_CHECK_CONSISTENCY;
+
+   pgmoneta_create_crc32c_buffer(&header, offsetof(struct xlog_record, xl_crc), &crc);
+   header.xl_crc = crc;
+
+   position = offset;
+   if (walfile_expand_copy(segment, size, block_size, &position, &header, SIZE_OF_XLOG_RECORD, true))
+   {
+      goto error;
+   }
+
+   free(data);
+
+   return 0;
+
+error:
+
+   free(data);
+
+   return 1;
+}
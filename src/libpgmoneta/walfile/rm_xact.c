@@ -477,6 +477,71 @@ pgmoneta_wal_xact_desc(char* buf, struct decoded_xlog_record* record)
    return buf;
 }
 
+bool
+pgmoneta_wal_xact_target(struct decoded_xlog_record* record, transaction_id* xid, timestamp_tz* time)
+{
+   char* rec = XLOG_REC_GET_DATA(record);
+   uint8_t info = XLOG_REC_GET_INFO(record) & XLOG_XACT_OPMASK;
+   transaction_id twophase_xid = INVALID_TRANSACTION_ID;
+
+   if (rec == NULL)
+   {
+      return false;
+   }
+
+   if (info == XLOG_XACT_COMMIT || info == XLOG_XACT_COMMIT_PREPARED)
+   {
+      struct xl_xact_commit* xlrec = (struct xl_xact_commit*) rec;
+
+      if (server_config->version >= 15)
+      {
+         struct xl_xact_parsed_commit_v15 parsed;
+
+         parse_commit_record_v15(XLOG_REC_GET_INFO(record), xlrec, &parsed);
+         twophase_xid = parsed.twophase_xid;
+      }
+      else
+      {
+         struct xl_xact_parsed_commit_v14 parsed;
+
+         parse_commit_record_v14(XLOG_REC_GET_INFO(record), xlrec, &parsed);
+         twophase_xid = parsed.twophase_xid;
+      }
+
+      *time = xlrec->xact_time;
+   }
+   else if (info == XLOG_XACT_ABORT || info == XLOG_XACT_ABORT_PREPARED)
+   {
+      struct xl_xact_abort* xlrec = (struct xl_xact_abort*) rec;
+
+      if (server_config->version >= 15)
+      {
+         struct xl_xact_parsed_abort_v15 parsed;
+
+         parse_abort_record_v15(XLOG_REC_GET_INFO(record), xlrec, &parsed);
+         twophase_xid = parsed.twophase_xid;
+      }
+      else
+      {
+         struct xl_xact_parsed_abort_v14 parsed;
+
+         parse_abort_record_v14(XLOG_REC_GET_INFO(record), xlrec, &parsed);
+         twophase_xid = parsed.twophase_xid;
+      }
+
+      *time = xlrec->xact_time;
+   }
+   else
+   {
+      return false;
+   }
+
+   // a prepared transaction is finished under the xid it was prepared with
+   *xid = TRANSACTION_ID_IS_VALID(twophase_xid) ? twophase_xid : record->header.xl_xid;
+
+   return true;
+}
+
 // v14
 
 void
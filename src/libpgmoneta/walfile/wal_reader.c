@@ -33,13 +33,22 @@
 #include <walfile/wal_reader.h>
 
 #include <assert.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 struct server* server_config;
 
-static int decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn);
+static int read_spanning(char** paths, int number_of_paths, int* index, FILE** file, size_t* offset, uint32_t block_size, size_t segment_size,
+                         void* destination, size_t length);
+static int iterator_read(struct wal_record_iterator* iterator, void* destination, size_t length, char** data);
+static bool iterator_page(struct wal_record_iterator* iterator, size_t offset);
+static int decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn,
+                              bool copy);
 static void record_json(struct decoded_xlog_record* record, uint8_t magic_value, struct value** value);
 static bool get_record_block_tag_extended(struct decoded_xlog_record* pRecord, int id, struct rel_file_locator* pLocator, enum fork_number* pNumber, block_number* pInt, buffer* pVoid);
 static char* get_record_block_ref_info(char* buf, struct decoded_xlog_record* record, bool pretty, bool detailed_format, uint32_t* fpi_len, uint8_t magic_value);
@@ -134,273 +143,687 @@ pgmoneta_wal_array_desc(char* buf, void* array, size_t elem_size, int count)
    return buf;
 }
 
-static void
-read_all_page_headers(FILE* file, struct xlog_long_page_header_data* long_header, struct walfile* wal_file)
-{
-   int page_number = 1;
-   while (true)
-   {
-      fseek(file, page_number * long_header->xlp_xlog_blcksz, SEEK_SET);
-      struct xlog_page_header_data* page_header = NULL;
-      page_header = malloc(SIZE_OF_XLOG_SHORT_PHD);
-      size_t bytes_read = fread(page_header, SIZE_OF_XLOG_SHORT_PHD, 1, file);
-      if (feof(file))
-      {
-         free(page_header);
-         goto finish;
-      }
-      if (bytes_read != 1)
-      {
-         pgmoneta_log_error("Error: Failed to read the complete data");
-         goto error;
-      }
-      pgmoneta_deque_add(wal_file->page_headers, NULL, (uintptr_t) page_header, ValueRef);
-      page_number++;
-   }
-finish:
-   return;
-error:
-   pgmoneta_log_fatal("Error: Could not read all page headers");
-   return;
-}
-
 int
-pgmoneta_wal_parse_wal_file(char* path, int server, struct walfile* wal_file)
+pgmoneta_wal_record_iterator_create(char* path, int server, struct wal_record_iterator** iterator)
 {
-#define MALLOC(pointer, size) \
-        pointer = malloc(size); \
-        if (pointer == NULL) \
-        { \
-           pgmoneta_log_fatal("Error: Could not allocate memory for %s", #pointer); \
-           goto error; \
-        }
-
-   struct xlog_record* record = NULL;
+   struct wal_record_iterator* it = NULL;
    struct xlog_long_page_header_data* long_header = NULL;
-   char* buffer = NULL;
-   struct decoded_xlog_record* decoded = NULL;
-   struct xlog_page_header_data* page_header = NULL;
    struct configuration* config = NULL;
+   struct stat st;
    timeline_id tli = 0;
-   xlog_seg_no logSegNo = 0;
-   xlog_rec_ptr base;
-   int wal_segz_bytes = DEFAULT_WAL_SEGZ_BYTES;
+   xlog_seg_no log_seg_no = 0;
+   int version;
 
    config = (struct configuration*) shmem;
 
-   FILE* file = fopen(path, "rb");
-   if (file == NULL)
+   *iterator = NULL;
+
+   it = calloc(1, sizeof(struct wal_record_iterator));
+   if (it == NULL)
    {
-      pgmoneta_log_fatal("Error: Could not open file %s", path);
       goto error;
    }
 
-   // calculate the size of the file
-   fseek(file, 0, SEEK_END);
-   wal_segz_bytes = ftell(file);
-   fseek(file, 0, SEEK_SET);
+   it->fd = open(path, O_RDONLY);
+   if (it->fd == -1)
+   {
+      pgmoneta_log_fatal("Error: Could not open file %s", path);
+      goto error;
+   }
 
-   MALLOC(long_header, SIZE_OF_XLOG_LONG_PHD);
-   size_t bytes_read = fread(long_header, SIZE_OF_XLOG_LONG_PHD, 1, file);
+   if (fstat(it->fd, &st) || (size_t)st.st_size < SIZE_OF_XLOG_LONG_PHD)
+   {
+      pgmoneta_log_fatal("Error: Could not read the header of %s", path);
+      goto error;
+   }
 
-   if (bytes_read < 0)
+   it->size = st.st_size;
+   it->data = mmap(NULL, it->size, PROT_READ, MAP_PRIVATE, it->fd, 0);
+   if (it->data == MAP_FAILED)
    {
-      pgmoneta_log_error("Error: Failed to read the complete data");
+      it->data = NULL;
+      pgmoneta_log_fatal("Error: Could not map file %s", path);
       goto error;
    }
 
-   assert(magic_value_to_postgres_version(long_header->std.xlp_magic) != -1);
+   // the records are read once, from the start to the end
+   madvise(it->data, it->size, MADV_SEQUENTIAL);
+
+   long_header = (struct xlog_long_page_header_data*)it->data;
+   it->block_size = long_header->xlp_xlog_blcksz;
+   it->magic = long_header->std.xlp_magic;
+
+   version = magic_value_to_postgres_version(it->magic);
+   if (version == -1 || it->block_size == 0 || it->size % it->block_size != 0)
+   {
+      pgmoneta_log_fatal("Error: Invalid header in %s", path);
+      goto error;
+   }
 
    if (server == -1)
    {
-      config->servers[0].version = magic_value_to_postgres_version(long_header->std.xlp_magic);
+      config->servers[0].version = version;
       server_config = &config->servers[0];
    }
    else
    {
-      assert(config->servers[server].version == magic_value_to_postgres_version(long_header->std.xlp_magic));
+      assert(config->servers[server].version == version);
       server_config = &config->servers[server];
    }
 
-   if (long_header->std.xlp_rem_len > 0)
+   if (xlog_from_file_name(basename(path), &tli, &log_seg_no, it->size))
    {
-      decoded = malloc(sizeof(struct decoded_xlog_record));
-      decoded->partial = true;
-      if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
-      {
-         goto error;
-      }
+      pgmoneta_log_fatal("Failed to extract LSN from the filename");
+      goto error;
    }
+   XLOG_SEG_NO_OFFEST_TO_REC_PTR(log_seg_no, 0, it->size, it->base);
+
+   it->timeline = tli;
+   it->page_timeline = 0;
+   it->offset = 0;
+   it->started = false;
+   it->done = false;
+   it->failed = false;
+
+   *iterator = it;
+
+   return 0;
 
-   uint32_t next_record = MAXALIGN(
-      ftell(file) +
-      ((long_header->std.xlp_rem_len / long_header->xlp_xlog_blcksz) * SIZE_OF_XLOG_SHORT_PHD) +
-      long_header->std.xlp_rem_len % long_header->xlp_xlog_blcksz
-      );
-   int page_number = 0;
-   wal_file->long_phd = long_header;
+error:
+
+   pgmoneta_wal_record_iterator_destroy(it);
 
-   read_all_page_headers(file, long_header, wal_file);
-   fseek(file, next_record, SEEK_SET);
+   return 1;
+}
 
-   if (xlog_from_file_name(basename(path), &tli, &logSegNo, wal_segz_bytes))
+bool
+pgmoneta_wal_record_iterator_next(struct wal_record_iterator* iterator, struct decoded_xlog_record** record)
+{
+   struct xlog_long_page_header_data* long_header = NULL;
+   struct decoded_xlog_record* decoded = &iterator->record;
+   struct xlog_record header;
+   char* data = NULL;
+   int ret;
+   size_t record_start;
+   size_t data_length;
+   size_t page_offset;
+
+   *record = NULL;
+
+   if (iterator->done)
    {
-      pgmoneta_log_fatal("Failed to extract LSN from the filename");
-      goto error;
+      return false;
    }
-   XLOG_SEG_NO_OFFEST_TO_REC_PTR(logSegNo, 0, wal_segz_bytes, base);
 
-   while (true)
+   memset(decoded, 0, sizeof(struct decoded_xlog_record));
+
+   if (!iterator->started)
    {
-      // Check if next record is beyond the current page
-      if (next_record >= (long_header->xlp_xlog_blcksz * (page_number + 1)))
+      long_header = (struct xlog_long_page_header_data*)iterator->data;
+
+      iterator->started = true;
+      iterator->offset = SIZE_OF_XLOG_LONG_PHD;
+
+      // a recycled file which hasn't been written
+      if (!iterator_page(iterator, 0))
+      {
+         goto end;
+      }
+
+      // the end of a record from the previous file
+      if (long_header->std.xlp_rem_len > 0)
       {
-         page_number++;
-         fseek(file, page_number * long_header->xlp_xlog_blcksz, SEEK_SET);
-         MALLOC(page_header, SIZE_OF_XLOG_SHORT_PHD);
-         size_t bytes_read = fread(page_header, SIZE_OF_XLOG_SHORT_PHD, 1, file);
-         if (feof(file))
+         ret = iterator_read(iterator, NULL, long_header->std.xlp_rem_len, NULL);
+         if (ret == 2)
          {
-            decoded = calloc(1, sizeof(struct decoded_xlog_record));
-            decoded->partial = true;
-            if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
-            {
-               goto error;
-            }
-            free(page_header);
-            goto finish;
+            goto end;
          }
-         if (bytes_read <= 0)
+         else if (ret)
          {
-            pgmoneta_log_error("Error: Failed to read the complete data");
-            goto error;
+            iterator->offset = iterator->size;
          }
-         next_record = MAXALIGN(ftell(file) + page_header->xlp_rem_len);
-         free(page_header);
-         continue;
+
+         decoded->partial = true;
+         *record = decoded;
+
+         return true;
       }
-      fseek(file, next_record, SEEK_SET);
+   }
+
+   iterator->offset = MAXALIGN(iterator->offset);
 
-      // Check if record crosses the page boundary
-      if (ftell(file) + SIZE_OF_XLOG_RECORD > long_header->xlp_xlog_blcksz * (page_number + 1))
+   if (iterator->offset < iterator->size && iterator->offset % iterator->block_size == 0)
+   {
+      if (!iterator_page(iterator, iterator->offset))
       {
-         char* temp_buffer = NULL;
-         MALLOC(temp_buffer, SIZE_OF_XLOG_RECORD)
-         uint32_t end_of_page = (page_number + 1) * long_header->xlp_xlog_blcksz;
-         size_t bytes_read = fread(temp_buffer, 1, end_of_page - ftell(file), file);
+         goto end;
+      }
+
+      iterator->offset += SIZE_OF_XLOG_SHORT_PHD;
+   }
 
-         fseek(file, SIZE_OF_XLOG_SHORT_PHD, SEEK_CUR);
-         bytes_read += fread(temp_buffer + bytes_read, 1, SIZE_OF_XLOG_RECORD - bytes_read, file);
+   // the next record starts in the next file
+   if (iterator->offset >= iterator->size)
+   {
+      iterator->done = true;
+      decoded->partial = true;
+      *record = decoded;
 
-         if (feof(file) && bytes_read != SIZE_OF_XLOG_RECORD)
-         {
-            free(temp_buffer);
-            decoded = calloc(1, sizeof(struct decoded_xlog_record));
-            decoded->partial = true;
-            if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
-            {
-               goto error;
-            }
-            goto finish;
-         }
+      return true;
+   }
+
+   record_start = iterator->offset;
+
+   ret = iterator_read(iterator, &header, SIZE_OF_XLOG_RECORD, NULL);
+   if (ret == 2)
+   {
+      goto end;
+   }
+   else if (ret)
+   {
+      goto partial;
+   }
+
+   if (header.xl_tot_len == 0)
+   {
+      iterator->done = true;
+      return false;
+   }
 
-         assert(bytes_read == SIZE_OF_XLOG_RECORD);
-         record = (struct xlog_record*) temp_buffer;
-         page_number++;
+   if (header.xl_tot_len < SIZE_OF_XLOG_RECORD)
+   {
+      pgmoneta_log_error("Error: Invalid record length %u at %X/%X", header.xl_tot_len,
+                         (uint32_t)((iterator->base + record_start) >> 32), (uint32_t)(iterator->base + record_start));
+      goto error;
+   }
+
+   data_length = header.xl_tot_len - SIZE_OF_XLOG_RECORD;
+
+   // the data is used from the mapping, unless it crosses a page
+   page_offset = iterator->offset % iterator->block_size;
+   if (data_length > iterator->capacity && (page_offset == 0 || data_length > iterator->block_size - page_offset))
+   {
+      char* buffer = realloc(iterator->buffer, data_length);
+
+      if (buffer == NULL)
+      {
+         goto error;
       }
-      else
+
+      iterator->buffer = buffer;
+      iterator->capacity = data_length;
+   }
+
+   ret = iterator_read(iterator, iterator->buffer, data_length, &data);
+   if (ret == 2)
+   {
+      goto end;
+   }
+   else if (ret)
+   {
+      goto partial;
+   }
+
+   if (decode_xlog_record(data, decoded, &header, iterator->block_size, iterator->magic, iterator->base + record_start, false))
+   {
+      goto error;
+   }
+
+   *record = decoded;
+
+   return true;
+
+partial:
+
+   // continues in the next file
+   memset(decoded, 0, sizeof(struct decoded_xlog_record));
+   iterator->done = true;
+   decoded->partial = true;
+   decoded->lsn = iterator->base + record_start;
+   *record = decoded;
+
+   return true;
+
+end:
+
+   // the rest of the file is old WAL, like at the end of a .partial file
+   memset(decoded, 0, sizeof(struct decoded_xlog_record));
+   iterator->done = true;
+
+   return false;
+
+error:
+
+   iterator->done = true;
+   iterator->failed = true;
+
+   return false;
+}
+
+void
+pgmoneta_wal_record_iterator_destroy(struct wal_record_iterator* iterator)
+{
+   if (iterator == NULL)
+   {
+      return;
+   }
+
+   if (iterator->data != NULL)
+   {
+      munmap(iterator->data, iterator->size);
+   }
+
+   if (iterator->fd != -1)
+   {
+      close(iterator->fd);
+   }
+
+   free(iterator->buffer);
+   free(iterator);
+}
+
+int
+pgmoneta_wal_record_copy(struct decoded_xlog_record* record, struct decoded_xlog_record** copy)
+{
+   struct decoded_xlog_record* c = NULL;
+
+   *copy = NULL;
+
+   c = malloc(sizeof(struct decoded_xlog_record));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   memcpy(c, record, sizeof(struct decoded_xlog_record));
+
+   if (record->partial)
+   {
+      *copy = c;
+      return 0;
+   }
+
+   c->main_data = NULL;
+   for (int i = 0; i <= c->max_block_id; i++)
+   {
+      if (c->blocks[i].in_use && c->blocks[i].has_image)
+      {
+         c->blocks[i].bkp_image = NULL;
+      }
+      if (c->blocks[i].in_use && c->blocks[i].has_data)
+      {
+         c->blocks[i].data = NULL;
+      }
+   }
+
+   if (record->main_data_len > 0)
+   {
+      c->main_data = malloc(record->main_data_len);
+      if (c->main_data == NULL)
+      {
+         goto error;
+      }
+      memcpy(c->main_data, record->main_data, record->main_data_len);
+   }
+
+   for (int i = 0; i <= c->max_block_id; i++)
+   {
+      struct decoded_bkp_block* blk = &c->blocks[i];
+
+      if (!blk->in_use)
+      {
+         continue;
+      }
+
+      if (blk->has_image)
       {
-         MALLOC(record, SIZE_OF_XLOG_RECORD)
-         size_t bytes_read = fread(record, SIZE_OF_XLOG_RECORD, 1, file);
-         if (bytes_read < 0)
+         blk->bkp_image = malloc(blk->bimg_len);
+         if (blk->bkp_image == NULL)
          {
-            pgmoneta_log_error("Error: Failed to read the complete data");
             goto error;
          }
+         memcpy(blk->bkp_image, record->blocks[i].bkp_image, blk->bimg_len);
       }
 
-      if (record->xl_tot_len == 0)
+      if (blk->has_data)
       {
-         free(record);
-         break;
+         blk->data = malloc(blk->data_len);
+         if (blk->data == NULL)
+         {
+            goto error;
+         }
+         memcpy(blk->data, record->blocks[i].data, blk->data_len);
       }
-      uint32_t data_length = record->xl_tot_len - SIZE_OF_XLOG_RECORD;
-      xlog_rec_ptr lsn = ftell(file) + base - SIZE_OF_XLOG_RECORD;
-      next_record = ftell(file) + MAXALIGN(record->xl_tot_len - SIZE_OF_XLOG_RECORD);
-      uint32_t end_of_page = (page_number + 1) * long_header->xlp_xlog_blcksz;
+   }
+
+   *copy = c;
+
+   return 0;
 
-      MALLOC(buffer, data_length)
+error:
 
-      // Read record data, possibly across page boundaries
-      if (data_length + ftell(file) >= end_of_page)
+   if (c != NULL && !record->partial)
+   {
+      free(c->main_data);
+      for (int i = 0; i <= c->max_block_id; i++)
       {
-         size_t bytes_read = 0;
-         size_t total_bytes_read = 0;
-         uint32_t remaining_data_length = data_length;
-         bytes_read = fread(buffer, 1, end_of_page - ftell(file), file);
-         total_bytes_read += bytes_read;
-         remaining_data_length -= bytes_read;
-         while (remaining_data_length != 0)
+         if (c->blocks[i].in_use)
          {
-            if (feof(file))
+            if (c->blocks[i].has_image)
             {
-               free(record);
-               decoded = calloc(1, sizeof(struct decoded_xlog_record));
-               decoded->partial = true;
-               if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
-               {
-                  goto error;
-               }
-               free(buffer);
-               goto finish;
+               free(c->blocks[i].bkp_image);
+            }
+            if (c->blocks[i].has_data)
+            {
+               free(c->blocks[i].data);
             }
-            fseek(file, SIZE_OF_XLOG_SHORT_PHD, SEEK_CUR);
-            bytes_read = fread(buffer + total_bytes_read, 1,
-                               MIN(remaining_data_length, long_header->xlp_xlog_blcksz - SIZE_OF_XLOG_SHORT_PHD), file);
-            remaining_data_length -= bytes_read;
-            total_bytes_read += bytes_read;
          }
-         assert(total_bytes_read == data_length);
       }
-      else
+   }
+   free(c);
+
+   return 1;
+}
+
+bool
+pgmoneta_wal_record_included(struct decoded_xlog_record* record, struct deque* rms, uint64_t start_lsn, uint64_t end_lsn,
+                             struct deque* xids)
+{
+   return is_included(RmgrTable[record->header.xl_rmid].name, rms,
+                      record->header.xl_prev, start_lsn,
+                      record->lsn, end_lsn,
+                      record->header.xl_xid, xids);
+}
+
+int
+pgmoneta_wal_parse_wal_file(char* path, int server, struct walfile* wal_file)
+{
+   struct wal_record_iterator* iterator = NULL;
+   struct decoded_xlog_record* record = NULL;
+   struct decoded_xlog_record* copy = NULL;
+   struct xlog_page_header_data* page_header = NULL;
+
+   if (pgmoneta_wal_record_iterator_create(path, server, &iterator))
+   {
+      goto error;
+   }
+
+   wal_file->long_phd = malloc(SIZE_OF_XLOG_LONG_PHD);
+   if (wal_file->long_phd == NULL)
+   {
+      goto error;
+   }
+   memcpy(wal_file->long_phd, iterator->data, SIZE_OF_XLOG_LONG_PHD);
+
+   for (size_t offset = iterator->block_size; offset < iterator->size; offset += iterator->block_size)
+   {
+      page_header = malloc(SIZE_OF_XLOG_SHORT_PHD);
+      if (page_header == NULL)
       {
-         size_t bytes_read = fread(buffer, 1, data_length, file);
+         goto error;
+      }
+      memcpy(page_header, iterator->data + offset, SIZE_OF_XLOG_SHORT_PHD);
 
-         if (bytes_read != data_length)
-         {
-            pgmoneta_log_error("Error: Actual bytes read do not match the expected length");
-            goto error;
-         }
+      if (pgmoneta_deque_add(wal_file->page_headers, NULL, (uintptr_t) page_header, ValueRef))
+      {
+         free(page_header);
+         goto error;
       }
+   }
 
-      decoded = calloc(1, sizeof(struct decoded_xlog_record));
+   while (pgmoneta_wal_record_iterator_next(iterator, &record))
+   {
+      if (pgmoneta_wal_record_copy(record, &copy))
+      {
+         goto error;
+      }
 
-      if (decode_xlog_record(buffer, decoded, record, long_header->xlp_xlog_blcksz, long_header->std.xlp_magic, lsn))
+      if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) copy, ValueRef))
       {
          goto error;
       }
-      else
+   }
+
+   if (iterator->failed)
+   {
+      goto error;
+   }
+
+   pgmoneta_wal_record_iterator_destroy(iterator);
+
+   return 0;
+
+error:
+   pgmoneta_log_fatal("Error: Could not parse WAL file");
+   pgmoneta_wal_record_iterator_destroy(iterator);
+   return 1;
+}
+
+static int
+iterator_read(struct wal_record_iterator* iterator, void* destination, size_t length, char** data)
+{
+   char* d = (char*)destination;
+   size_t page_offset;
+
+   page_offset = iterator->offset % iterator->block_size;
+
+   // in one page, so the mapping can be used
+   if (data != NULL && page_offset != 0 && length <= iterator->block_size - page_offset)
+   {
+      if (iterator->offset + length > iterator->size)
+      {
+         return 1;
+      }
+
+      *data = iterator->data + iterator->offset;
+      iterator->offset += length;
+
+      return 0;
+   }
+
+   if (data != NULL)
+   {
+      *data = d;
+   }
+
+   while (length > 0)
+   {
+      size_t chunk;
+
+      if (iterator->offset >= iterator->size)
+      {
+         return 1;
+      }
+
+      page_offset = iterator->offset % iterator->block_size;
+
+      if (page_offset == 0)
       {
-         if (pgmoneta_deque_add(wal_file->records, NULL, (uintptr_t) decoded, ValueRef))
+         if (!iterator_page(iterator, iterator->offset))
          {
-            goto error;
+            return 2;
          }
+
+         iterator->offset += iterator->offset == 0 ? SIZE_OF_XLOG_LONG_PHD : SIZE_OF_XLOG_SHORT_PHD;
+         continue;
+      }
+
+      chunk = MIN(length, iterator->block_size - page_offset);
+
+      if (d != NULL)
+      {
+         memcpy(d, iterator->data + iterator->offset, chunk);
+         d += chunk;
       }
-      free(buffer);
-      free(record);
+
+      iterator->offset += chunk;
+      length -= chunk;
    }
-finish:
+
+   return 0;
+}
+
+static bool
+iterator_page(struct wal_record_iterator* iterator, size_t offset)
+{
+   struct xlog_page_header_data* header = (struct xlog_page_header_data*)(iterator->data + offset);
+
+   // like the XLogReader, a page which wasn't written for this position ends the WAL
+   if (header->xlp_magic != iterator->magic ||
+       header->xlp_pageaddr != iterator->base + offset ||
+       (iterator->timeline != 0 && header->xlp_tli > iterator->timeline) ||
+       header->xlp_tli < iterator->page_timeline)
+   {
+      pgmoneta_log_debug("WAL: Unexpected page header at %X/%X (address %X/%X, timeline %u)",
+                         (uint32_t)((iterator->base + offset) >> 32), (uint32_t)(iterator->base + offset),
+                         (uint32_t)(header->xlp_pageaddr >> 32), (uint32_t)header->xlp_pageaddr, header->xlp_tli);
+      return false;
+   }
+
+   iterator->page_timeline = header->xlp_tli;
+
+   return true;
+}
+
+int
+pgmoneta_wal_parse_spanning_record(char** paths, int number_of_paths, xlog_rec_ptr lsn, struct decoded_xlog_record** record)
+{
+   struct xlog_long_page_header_data long_header;
+   struct xlog_record header;
+   struct decoded_xlog_record* decoded = NULL;
+   char* buffer = NULL;
+   FILE* file = NULL;
+   int index = 0;
+   size_t offset;
+
+   *record = NULL;
+
+   if (number_of_paths < 1)
+   {
+      goto error;
+   }
+
+   file = fopen(paths[0], "rb");
+   if (file == NULL || fread(&long_header, sizeof(struct xlog_long_page_header_data), 1, file) != 1 ||
+       long_header.xlp_xlog_blcksz == 0 || long_header.xlp_seg_size == 0)
+   {
+      goto error;
+   }
+
+   offset = lsn % long_header.xlp_seg_size;
+
+   if (read_spanning(paths, number_of_paths, &index, &file, &offset, long_header.xlp_xlog_blcksz, long_header.xlp_seg_size,
+                     &header, SIZE_OF_XLOG_RECORD))
+   {
+      goto error;
+   }
+
+   if (header.xl_tot_len <= SIZE_OF_XLOG_RECORD)
+   {
+      goto error;
+   }
+
+   buffer = malloc(header.xl_tot_len - SIZE_OF_XLOG_RECORD);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   if (read_spanning(paths, number_of_paths, &index, &file, &offset, long_header.xlp_xlog_blcksz, long_header.xlp_seg_size,
+                     buffer, header.xl_tot_len - SIZE_OF_XLOG_RECORD))
+   {
+      goto error;
+   }
+
+   decoded = calloc(1, sizeof(struct decoded_xlog_record));
+   if (decoded == NULL)
+   {
+      goto error;
+   }
+
+   if (decode_xlog_record(buffer, decoded, &header, long_header.xlp_xlog_blcksz, long_header.std.xlp_magic, lsn, true))
+   {
+      goto error;
+   }
+
    fclose(file);
+   free(buffer);
+
+   *record = decoded;
+
    return 0;
 
 error:
-   pgmoneta_log_fatal("Error: Could not parse WAL file");
-   fclose(file);
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(buffer);
+   free(decoded);
+
    return 1;
 }
 
 static int
-decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn)
+read_spanning(char** paths, int number_of_paths, int* index, FILE** file, size_t* offset, uint32_t block_size, size_t segment_size,
+              void* destination, size_t length)
+{
+   char* d = (char*)destination;
+
+   while (length > 0)
+   {
+      size_t page_offset;
+      size_t chunk;
+
+      if (*offset >= segment_size)
+      {
+         fclose(*file);
+         *file = NULL;
+
+         (*index)++;
+         if (*index >= number_of_paths)
+         {
+            return 1;
+         }
+
+         *file = fopen(paths[*index], "rb");
+         if (*file == NULL)
+         {
+            return 1;
+         }
+
+         *offset = 0;
+      }
+
+      page_offset = *offset % block_size;
+
+      // the record data continues after the page header
+      if (page_offset == 0)
+      {
+         *offset += *offset == 0 ? SIZE_OF_XLOG_LONG_PHD : SIZE_OF_XLOG_SHORT_PHD;
+         continue;
+      }
+
+      chunk = MIN(length, block_size - page_offset);
+
+      if (fseek(*file, *offset, SEEK_SET) || fread(d, 1, chunk, *file) != chunk)
+      {
+         return 1;
+      }
+
+      d += chunk;
+      *offset += chunk;
+      length -= chunk;
+   }
+
+   return 0;
+}
+
+static int
+decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlog_record* record, uint32_t block_size, uint16_t magic_value, xlog_rec_ptr lsn,
+                   bool copy)
 {
 #define COPY_HEADER_FIELD(_dst, _size)          \
         do {                                        \
@@ -610,30 +1033,52 @@ decode_xlog_record(char* buffer, struct decoded_xlog_record* decoded, struct xlo
 
       assert(blk->has_image || !blk->apply_image);
 
+      // without a copy the data points into the buffer
       if (blk->has_image)
       {
          /* no need to align image */
-         blk->bkp_image = malloc(blk->bimg_len);
-         memcpy(blk->bkp_image, ptr, blk->bimg_len);
+         if (copy)
+         {
+            blk->bkp_image = malloc(blk->bimg_len);
+            memcpy(blk->bkp_image, ptr, blk->bimg_len);
+         }
+         else
+         {
+            blk->bkp_image = ptr;
+         }
          ptr += blk->bimg_len;
       }
       if (blk->has_data)
       {
-         blk->data = malloc(blk->data_len);
-         memcpy(blk->data, ptr, blk->data_len);
+         if (copy)
+         {
+            blk->data = malloc(blk->data_len);
+            memcpy(blk->data, ptr, blk->data_len);
+         }
+         else
+         {
+            blk->data = ptr;
+         }
          ptr += blk->data_len;
       }
    }
 
    if (decoded->main_data_len > 0)
    {
-      decoded->main_data = malloc(decoded->main_data_len);
-      if (decoded->main_data == NULL)
+      if (copy)
+      {
+         decoded->main_data = malloc(decoded->main_data_len);
+         if (decoded->main_data == NULL)
+         {
+            goto
+            shortdata_err;
+         }
+         memcpy(decoded->main_data, ptr, decoded->main_data_len);
+      }
+      else
       {
-         goto
-         shortdata_err;
+         decoded->main_data = ptr;
       }
-      memcpy(decoded->main_data, ptr, decoded->main_data_len);
       ptr += decoded->main_data_len;
    }
    decoded->partial = false;
@@ -0,0 +1,723 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <aes.h>
+#include <compression.h>
+#include <info.h>
+#include <logging.h>
+#include <utils.h>
+#include <walfile.h>
+#include <walindex.h>
+#include <walfile/rm_xact.h>
+#include <walfile/wal_reader.h>
+
+/* system */
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INDEX_RM_XACT_ID 1
+
+#define INDEX_POSTGRES_EPOCH 946684800LL                   /* The seconds from 1970-01-01 to 2000-01-01 */
+#define INDEX_ZONE_MARGIN    (14LL * 3600LL * 1000000LL)   /* The widest time zone offset in microseconds */
+
+static int index_segment(int server, char* directory, char* wal, char* name, char* index);
+static int index_load(char* wal, char* name, char* plain);
+static void index_prune(char* directory, char** files, int number_of_files);
+static char* index_directory(int server);
+static size_t index_segment_size(int server);
+static int index_parse_time(char* value, int64_t* timestamp, bool* zoned);
+static bool index_other_timeline(int server, uint32_t timeline);
+static int index_find(int server, uint32_t timeline, uint64_t start, bool by_xid, transaction_id xid, int64_t time, uint64_t* found);
+
+int
+pgmoneta_wal_index(int server)
+{
+   char path[MAX_PATH];
+   char* directory = NULL;
+   char* wal = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+
+   directory = index_directory(server);
+   wal = pgmoneta_get_server_wal(server);
+
+   if (pgmoneta_mkdir(directory))
+   {
+      pgmoneta_log_error("WAL index: Could not create %s", directory);
+      goto error;
+   }
+
+   if (pgmoneta_get_wal_files(wal, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      uint32_t tli;
+      uint32_t log;
+      uint32_t seg;
+
+      if (strlen(files[i]) < 24 || sscanf(files[i], "%08X%08X%08X", &tli, &log, &seg) != 3)
+      {
+         continue;
+      }
+
+      // a segment both compressed and not is being compressed right now
+      if (i > 0 && !strncmp(files[i - 1], files[i], 24))
+      {
+         continue;
+      }
+
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%.24s%s", directory, files[i], WAL_INDEX_SUFFIX);
+
+      if (pgmoneta_exists(path))
+      {
+         continue;
+      }
+
+      if (index_segment(server, directory, wal, files[i], path))
+      {
+         pgmoneta_log_warn("WAL index: Could not index %s", files[i]);
+         goto error;
+      }
+   }
+
+   index_prune(directory, files, number_of_files);
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(directory);
+   free(wal);
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(directory);
+   free(wal);
+
+   return 1;
+}
+
+int
+pgmoneta_wal_index_target(int server, struct backup* backup, char* position, char** segment)
+{
+   char tokens[512];
+   char key[256];
+   char value[256];
+   char* ptr = NULL;
+   bool target = false;
+   uint32_t timeline;
+   uint32_t log;
+   uint32_t seg;
+   uint64_t start;
+   uint64_t last;
+   uint64_t found = 0;
+   size_t segsize;
+   char* name = NULL;
+
+   *segment = NULL;
+
+   if (position == NULL || strlen(position) == 0 || strlen(position) >= sizeof(tokens))
+   {
+      return 0;
+   }
+
+   segsize = index_segment_size(server);
+
+   if (sscanf(backup->wal, "%08X%08X%08X", &timeline, &log, &seg) != 3)
+   {
+      return 0;
+   }
+   start = (uint64_t)log * (0x100000000UL / segsize) + seg;
+
+   memset(&tokens[0], 0, sizeof(tokens));
+   memcpy(&tokens[0], position, strlen(position));
+
+   ptr = strtok(&tokens[0], ",");
+
+   // the first target decides, like in the recovery settings
+   while (ptr != NULL && !target)
+   {
+      char* equal = NULL;
+
+      memset(&key[0], 0, sizeof(key));
+      memset(&value[0], 0, sizeof(value));
+
+      equal = strchr(ptr, '=');
+
+      if (equal == NULL)
+      {
+         snprintf(&key[0], sizeof(key), "%s", ptr);
+      }
+      else
+      {
+         snprintf(&key[0], sizeof(key), "%.*s", (int)(equal - ptr), ptr);
+         snprintf(&value[0], sizeof(value), "%s", equal + 1);
+      }
+
+      target = !strcmp(&key[0], "current") || !strcmp(&key[0], "immediate") || !strcmp(&key[0], "name") ||
+               !strcmp(&key[0], "xid") || !strcmp(&key[0], "lsn") || !strcmp(&key[0], "time");
+
+      ptr = strtok(NULL, ",");
+   }
+
+   if (!target || strlen(&value[0]) == 0)
+   {
+      return 0;
+   }
+
+   // a later timeline may branch off before the target
+   if (index_other_timeline(server, timeline))
+   {
+      return 0;
+   }
+
+   if (!strcmp(&key[0], "lsn"))
+   {
+      uint32_t hi;
+      uint32_t lo;
+
+      if (sscanf(&value[0], "%X/%X", &hi, &lo) != 2)
+      {
+         return 0;
+      }
+
+      found = (((uint64_t)hi << 32) | lo) / segsize;
+   }
+   else if (!strcmp(&key[0], "xid"))
+   {
+      char* end = NULL;
+      unsigned long xid = strtoul(&value[0], &end, 10);
+
+      if (end == NULL || *end != '\0' || index_find(server, timeline, start, true, (transaction_id)xid, 0, &found))
+      {
+         return 0;
+      }
+   }
+   else if (!strcmp(&key[0], "time"))
+   {
+      int64_t time;
+      bool zoned;
+
+      if (index_parse_time(&value[0], &time, &zoned))
+      {
+         return 0;
+      }
+
+      // without a zone the target may be up to the widest offset later
+      if (!zoned)
+      {
+         time += INDEX_ZONE_MARGIN;
+      }
+
+      if (index_find(server, timeline, start, false, 0, time, &found))
+      {
+         return 0;
+      }
+   }
+   else
+   {
+      return 0;
+   }
+
+   // the backup must be consistent, and the segment after the target
+   // covers a read ahead past the target
+   last = MAX(found, (((uint64_t)backup->end_lsn_hi32 << 32) | backup->end_lsn_lo32) / segsize) + 1;
+
+   name = pgmoneta_format_and_append(name, "%08X%08X%08X", timeline,
+                                     (uint32_t)(last / (0x100000000UL / segsize)),
+                                     (uint32_t)(last % (0x100000000UL / segsize)));
+
+   *segment = name;
+
+   return 0;
+}
+
+static int
+index_segment(int server, char* directory, char* wal, char* name, char* index)
+{
+   char plain[MAX_PATH];
+   char tmp[MAX_PATH];
+   int count = 0;
+   transaction_id xid;
+   timestamp_tz time;
+   struct wal_record_iterator* it = NULL;
+   struct decoded_xlog_record* record = NULL;
+   FILE* file = NULL;
+
+   memset(plain, 0, sizeof(plain));
+   snprintf(plain, sizeof(plain), "%s%.24s.%d", directory, name, getpid());
+   memset(tmp, 0, sizeof(tmp));
+   snprintf(tmp, sizeof(tmp), "%s.tmp", index);
+
+   if (index_load(wal, name, plain))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_wal_record_iterator_create(plain, server, &it))
+   {
+      goto error;
+   }
+
+   file = fopen(tmp, "w");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   // a record crossing into the next segment isn't indexed, which only
+   // makes a restore copy more of the WAL
+   while (pgmoneta_wal_record_iterator_next(it, &record))
+   {
+      if (record->partial || record->header.xl_rmid != INDEX_RM_XACT_ID)
+      {
+         continue;
+      }
+
+      if (pgmoneta_wal_xact_target(record, &xid, &time))
+      {
+         if (fprintf(file, "%" PRIX64 " %u %" PRId64 "\n", record->lsn, xid, time) < 0)
+         {
+            goto error;
+         }
+         count++;
+      }
+   }
+
+   if (it->failed)
+   {
+      goto error;
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (rename(tmp, index))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_debug("WAL index: %.24s has %d transactions", name, count);
+
+   pgmoneta_wal_record_iterator_destroy(it);
+   unlink(plain);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   pgmoneta_wal_record_iterator_destroy(it);
+   unlink(tmp);
+   unlink(plain);
+
+   return 1;
+}
+
+static int
+index_load(char* wal, char* name, char* plain)
+{
+   char from[MAX_PATH];
+   char tmp[MAX_PATH];
+
+   memset(from, 0, sizeof(from));
+   snprintf(from, sizeof(from), "%s%s", wal, name);
+   memset(tmp, 0, sizeof(tmp));
+   snprintf(tmp, sizeof(tmp), "%s%s", plain, name + 24);
+
+   // decrypt and decompress a copy, since that removes the source file
+   if (pgmoneta_copy_file(from, tmp, NULL))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_is_encrypted_archive(tmp))
+   {
+      char decrypted[MAX_PATH];
+
+      memset(decrypted, 0, sizeof(decrypted));
+      snprintf(decrypted, sizeof(decrypted), "%.*s", (int)(strlen(tmp) - strlen(".aes")), tmp);
+
+      if (pgmoneta_decrypt_file(tmp, decrypted))
+      {
+         goto error;
+      }
+
+      memcpy(tmp, decrypted, sizeof(tmp));
+   }
+
+   if (pgmoneta_is_compressed_archive(tmp))
+   {
+      if (pgmoneta_decompress(tmp, plain))
+      {
+         goto error;
+      }
+   }
+
+   if (pgmoneta_is_compacted_walfile(plain))
+   {
+      if (pgmoneta_expand_walfile(plain, plain))
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   if (strcmp(tmp, plain))
+   {
+      unlink(tmp);
+   }
+
+   return 1;
+}
+
+static void
+index_prune(char* directory, char** files, int number_of_files)
+{
+   char path[MAX_PATH];
+   bool found;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   if (!(dir = opendir(directory)))
+   {
+      return;
+   }
+
+   // an index goes together with its segment
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!pgmoneta_ends_with(entry->d_name, WAL_INDEX_SUFFIX))
+      {
+         continue;
+      }
+
+      found = false;
+      for (int i = 0; !found && i < number_of_files; i++)
+      {
+         found = !strncmp(entry->d_name, files[i], 24);
+      }
+
+      if (!found)
+      {
+         memset(path, 0, sizeof(path));
+         snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
+         unlink(path);
+      }
+   }
+
+   closedir(dir);
+}
+
+static char*
+index_directory(int server)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "walindex/");
+
+   return d;
+}
+
+static size_t
+index_segment_size(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return config->servers[server].wal_size > 0 ? (size_t)config->servers[server].wal_size : (size_t)DEFAULT_WAL_SEGZ_BYTES;
+}
+
+static int
+index_parse_time(char* value, int64_t* timestamp, bool* zoned)
+{
+   struct tm tm;
+   int year;
+   int month;
+   int day;
+   int hour = 0;
+   int minute = 0;
+   int second = 0;
+   int consumed = 0;
+   int64_t usec = 0;
+   int64_t offset = 0;
+   time_t seconds;
+   char* p = NULL;
+
+   *timestamp = 0;
+   *zoned = false;
+
+   // YYYY-MM-DD[ HH:MM:SS[.ffffff]][Z|UTC|GMT|+HH[:MM]|-HH[:MM]]
+   if (sscanf(value, "%4d-%2d-%2d%n", &year, &month, &day, &consumed) != 3)
+   {
+      return 1;
+   }
+   p = value + consumed;
+
+   if (*p == ' ' || *p == 'T')
+   {
+      p++;
+
+      if (sscanf(p, "%2d:%2d:%2d%n", &hour, &minute, &second, &consumed) != 3)
+      {
+         return 1;
+      }
+      p += consumed;
+
+      if (*p == '.')
+      {
+         int64_t scale = 100000;
+
+         p++;
+         while (*p >= '0' && *p <= '9')
+         {
+            usec += (*p - '0') * scale;
+            scale /= 10;
+            p++;
+         }
+      }
+   }
+
+   while (*p == ' ')
+   {
+      p++;
+   }
+
+   if (*p == 'Z' || !strcasecmp(p, "UTC") || !strcasecmp(p, "GMT"))
+   {
+      *zoned = true;
+   }
+   else if (*p == '+' || *p == '-')
+   {
+      int sign = *p == '-' ? -1 : 1;
+      int zone_hour = 0;
+      int zone_minute = 0;
+
+      p++;
+
+      if (sscanf(p, "%2d%n", &zone_hour, &consumed) != 1)
+      {
+         return 1;
+      }
+      p += consumed;
+
+      if (*p == ':')
+      {
+         p++;
+      }
+
+      if (*p != '\0' && sscanf(p, "%2d", &zone_minute) != 1)
+      {
+         return 1;
+      }
+
+      offset = sign * (zone_hour * 3600 + zone_minute * 60);
+      *zoned = true;
+   }
+   else if (*p != '\0')
+   {
+      return 1;
+   }
+
+   memset(&tm, 0, sizeof(struct tm));
+   tm.tm_year = year - 1900;
+   tm.tm_mon = month - 1;
+   tm.tm_mday = day;
+   tm.tm_hour = hour;
+   tm.tm_min = minute;
+   tm.tm_sec = second;
+
+   seconds = timegm(&tm);
+   if (seconds == (time_t)-1)
+   {
+      return 1;
+   }
+
+   *timestamp = ((int64_t)seconds - offset - INDEX_POSTGRES_EPOCH) * 1000000LL + usec;
+
+   return 0;
+}
+
+static bool
+index_other_timeline(int server, uint32_t timeline)
+{
+   bool other = false;
+   char* wal = NULL;
+   uint32_t tli;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   wal = pgmoneta_get_server_wal(server);
+
+   if (!(dir = opendir(wal)))
+   {
+      free(wal);
+      return true;
+   }
+
+   while (!other && (entry = readdir(dir)) != NULL)
+   {
+      if (strlen(entry->d_name) >= 8 && sscanf(entry->d_name, "%08X", &tli) == 1 && tli > timeline)
+      {
+         other = true;
+      }
+   }
+
+   closedir(dir);
+   free(wal);
+
+   return other;
+}
+
+static int
+index_find(int server, uint32_t timeline, uint64_t start, bool by_xid, transaction_id xid, int64_t time, uint64_t* found)
+{
+   char path[MAX_PATH];
+   char line[128];
+   char* directory = NULL;
+   int number_of_files = 0;
+   char** files = NULL;
+   size_t segsize;
+   bool match = false;
+   FILE* file = NULL;
+
+   *found = 0;
+
+   segsize = index_segment_size(server);
+   directory = index_directory(server);
+
+   if (pgmoneta_get_wal_files(directory, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   // the names sort by position on the timeline, so the first match is the
+   // first commit or abort which recovery can stop at
+   for (int i = 0; !match && i < number_of_files; i++)
+   {
+      uint32_t tli;
+      uint32_t log;
+      uint32_t seg;
+      uint64_t segno;
+
+      if (!pgmoneta_ends_with(files[i], WAL_INDEX_SUFFIX) ||
+          sscanf(files[i], "%08X%08X%08X", &tli, &log, &seg) != 3 || tli != timeline)
+      {
+         continue;
+      }
+
+      segno = (uint64_t)log * (0x100000000UL / segsize) + seg;
+      if (segno < start)
+      {
+         continue;
+      }
+
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%s", directory, files[i]);
+
+      file = fopen(path, "r");
+      if (file == NULL)
+      {
+         continue;
+      }
+
+      while (!match && fgets(line, sizeof(line), file) != NULL)
+      {
+         uint64_t lsn;
+         transaction_id x;
+         int64_t t;
+
+         if (sscanf(line, "%" SCNx64 " %u %" SCNd64, &lsn, &x, &t) != 3)
+         {
+            continue;
+         }
+
+         match = by_xid ? x == xid : t > time;
+         if (match)
+         {
+            *found = lsn / segsize;
+         }
+      }
+
+      fclose(file);
+      file = NULL;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(directory);
+
+   return match ? 0 : 1;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(directory);
+
+   return 1;
+}
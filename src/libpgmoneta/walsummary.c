@@ -0,0 +1,1301 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <aes.h>
+#include <compression.h>
+#include <logging.h>
+#include <utils.h>
+#include <walfile.h>
+#include <walsummary.h>
+#include <walfile/rm_database.h>
+#include <walfile/rm.h>
+#include <walfile/rm_storage.h>
+#include <walfile/wal_reader.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define SUMMARY_RM_SMGR_ID  2
+#define SUMMARY_RM_DBASE_ID 4
+
+#define SUMMARY_TRUNCATE_HEAP 0x0001
+#define SUMMARY_TRUNCATE_VM   0x0002
+#define SUMMARY_TRUNCATE_FSM  0x0004
+
+#define SUMMARY_COMPLETE   0
+#define SUMMARY_ERROR      1
+#define SUMMARY_INCOMPLETE 2
+
+#define SUMMARY_MAX_RECORD (1024 * 1024 * 1024)
+
+/** @struct summary_segment
+ * Defines a WAL segment in the WAL directory
+ */
+struct summary_segment
+{
+   uint32_t timeline;         /**< The timeline */
+   uint64_t segno;            /**< The segment number */
+   char name[MISC_LENGTH];    /**< The file name, including any suffix */
+};
+
+/** @struct summary_reader
+ * Defines a reader of the record data of consecutive WAL segments,
+ * which skips the page headers
+ */
+struct summary_reader
+{
+   int server;                          /**< The server */
+   char* wal;                           /**< The WAL directory */
+   char* directory;                     /**< The summary directory */
+   struct summary_segment* segments;    /**< The segments, sorted */
+   int number_of_segments;              /**< The number of segments */
+   size_t segsize;                      /**< The size of a segment */
+   size_t blcksz;                       /**< The size of a WAL page */
+   int index;                           /**< The segment being read */
+   char* data;                          /**< The segment being summarized */
+   char* next;                          /**< A following segment, when a record crosses into it */
+   bool crossed;                        /**< Has the reader moved into a following segment */
+   size_t offset;                       /**< The offset in the segment being read */
+   int number_of_refs;                  /**< The number of references */
+   int capacity;                        /**< The capacity of the references */
+   struct wal_block_ref* refs;          /**< The references */
+};
+
+static int summary_segments(char* wal, struct summary_segment** segments, int* number_of_segments);
+static int summary_segment(struct summary_reader* reader, int index);
+static int summary_load(struct summary_reader* reader, int index, char** data);
+static int summary_read(struct summary_reader* reader, void* dst, size_t n);
+static int summary_decode(struct summary_reader* reader, struct xlog_record* header, char* data, size_t length);
+static int summary_add(struct summary_reader* reader, uint32_t spcoid, uint32_t dboid, uint32_t relnumber, int forknum, uint32_t blkno, char type);
+static int summary_write(struct summary_reader* reader, char* path);
+static int summary_load_file(char* path, struct wal_block_ref** refs, int* number_of_refs, int* capacity);
+static void summary_prune(char* directory, struct summary_segment* segments, int number_of_segments);
+static int summary_compare(const void* a, const void* b);
+static int summary_unique(struct wal_block_ref* refs, int number_of_refs);
+static char* summary_directory(int server);
+
+int
+pgmoneta_summarize_wal(int server)
+{
+   char path[MAX_PATH];
+   int ret;
+   struct summary_reader reader;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&reader, 0, sizeof(struct summary_reader));
+   reader.server = server;
+   reader.segsize = config->servers[server].wal_size > 0 ? (size_t)config->servers[server].wal_size : (size_t)DEFAULT_WAL_SEGZ_BYTES;
+   reader.wal = pgmoneta_get_server_wal(server);
+   reader.directory = summary_directory(server);
+
+   if (pgmoneta_mkdir(reader.directory))
+   {
+      pgmoneta_log_error("WAL summary: Could not create %s", reader.directory);
+      goto error;
+   }
+
+   if (summary_segments(reader.wal, &reader.segments, &reader.number_of_segments))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < reader.number_of_segments; i++)
+   {
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%.24s%s", reader.directory, reader.segments[i].name, WAL_SUMMARY_SUFFIX);
+
+      if (pgmoneta_exists(path))
+      {
+         continue;
+      }
+
+      ret = summary_segment(&reader, i);
+
+      if (ret == SUMMARY_INCOMPLETE)
+      {
+         // the rest of the last record hasn't been received yet
+         break;
+      }
+      else if (ret == SUMMARY_ERROR)
+      {
+         pgmoneta_log_warn("WAL summary: Could not summarize %s", reader.segments[i].name);
+         goto error;
+      }
+
+      if (summary_write(&reader, path))
+      {
+         pgmoneta_log_error("WAL summary: Could not write %s", path);
+         goto error;
+      }
+
+      pgmoneta_log_debug("WAL summary: %s has %d block references", reader.segments[i].name, reader.number_of_refs);
+   }
+
+   summary_prune(reader.directory, reader.segments, reader.number_of_segments);
+
+   free(reader.data);
+   free(reader.next);
+   free(reader.refs);
+   free(reader.segments);
+   free(reader.directory);
+   free(reader.wal);
+
+   return 0;
+
+error:
+
+   free(reader.data);
+   free(reader.next);
+   free(reader.refs);
+   free(reader.segments);
+   free(reader.directory);
+   free(reader.wal);
+
+   return 1;
+}
+
+int
+pgmoneta_wal_summary_read(int server, uint32_t timeline, uint64_t start_lsn, uint64_t end_lsn, struct wal_summary** summary)
+{
+   char* directory = NULL;
+   char path[MAX_PATH];
+   char name[MISC_LENGTH];
+   size_t segsize;
+   uint64_t first;
+   uint64_t last;
+   int capacity = 0;
+   bool found;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct wal_summary* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *summary = NULL;
+
+   segsize = config->servers[server].wal_size > 0 ? (size_t)config->servers[server].wal_size : (size_t)DEFAULT_WAL_SEGZ_BYTES;
+   first = start_lsn / segsize;
+   last = end_lsn / segsize;
+
+   s = (struct wal_summary*)calloc(1, sizeof(struct wal_summary));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   s->start_lsn = start_lsn;
+   s->end_lsn = end_lsn;
+
+   directory = summary_directory(server);
+
+   for (uint64_t segno = first; segno <= last; segno++)
+   {
+      uint32_t best = 0;
+
+      found = false;
+
+      // the segment may come from an earlier timeline than the range itself
+      dir = opendir(directory);
+      if (dir == NULL)
+      {
+         goto error;
+      }
+
+      while ((entry = readdir(dir)) != NULL)
+      {
+         uint32_t tli;
+         uint32_t log;
+         uint32_t seg;
+
+         if (!pgmoneta_ends_with(entry->d_name, WAL_SUMMARY_SUFFIX) ||
+             sscanf(entry->d_name, "%08X%08X%08X", &tli, &log, &seg) != 3)
+         {
+            continue;
+         }
+
+         if ((uint64_t)log * (0x100000000UL / segsize) + seg == segno && tli <= timeline && tli >= best)
+         {
+            best = tli;
+            found = true;
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "%s", entry->d_name);
+         }
+      }
+
+      closedir(dir);
+      dir = NULL;
+
+      if (!found)
+      {
+         pgmoneta_log_debug("WAL summary: Segment %lu of %s hasn't been summarized", segno, config->servers[server].name);
+         goto error;
+      }
+
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%s", directory, name);
+
+      if (summary_load_file(path, &s->refs, &s->number_of_refs, &capacity))
+      {
+         goto error;
+      }
+   }
+
+   qsort(s->refs, s->number_of_refs, sizeof(struct wal_block_ref), summary_compare);
+   s->number_of_refs = summary_unique(s->refs, s->number_of_refs);
+
+   *summary = s;
+
+   free(directory);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   pgmoneta_wal_summary_destroy(s);
+   free(directory);
+
+   return 1;
+}
+
+int
+pgmoneta_wal_summary_blocks(struct wal_summary* summary, uint32_t spcoid, uint32_t dboid, uint32_t relnumber, int forknum,
+                            uint32_t start, uint32_t end, uint32_t* limit, uint32_t** blocks, int* number_of_blocks)
+{
+   struct wal_block_ref key;
+   uint32_t* b = NULL;
+   int count = 0;
+   int capacity = 0;
+   int low;
+   int high;
+
+   *limit = WAL_SUMMARY_NO_LIMIT;
+   *blocks = NULL;
+   *number_of_blocks = 0;
+
+   // a database copied from its template counts as created
+   memset(&key, 0, sizeof(struct wal_block_ref));
+   key.spcoid = spcoid;
+   key.dboid = dboid;
+
+   low = 0;
+   high = summary->number_of_refs;
+   while (low < high)
+   {
+      int mid = low + (high - low) / 2;
+
+      if (summary_compare(&summary->refs[mid], &key) < 0)
+      {
+         low = mid + 1;
+      }
+      else
+      {
+         high = mid;
+      }
+   }
+
+   if (low < summary->number_of_refs && summary->refs[low].type == WAL_SUMMARY_DATABASE &&
+       summary->refs[low].spcoid == spcoid && summary->refs[low].dboid == dboid)
+   {
+      *limit = 0;
+   }
+
+   key.relnumber = relnumber;
+   key.forknum = forknum;
+
+   low = 0;
+   high = summary->number_of_refs;
+   while (low < high)
+   {
+      int mid = low + (high - low) / 2;
+
+      if (summary_compare(&summary->refs[mid], &key) < 0)
+      {
+         low = mid + 1;
+      }
+      else
+      {
+         high = mid;
+      }
+   }
+
+   for (int i = low; i < summary->number_of_refs; i++)
+   {
+      struct wal_block_ref* ref = &summary->refs[i];
+
+      if (ref->spcoid != spcoid || ref->dboid != dboid || ref->relnumber != relnumber || ref->forknum != forknum)
+      {
+         break;
+      }
+
+      if (ref->type == WAL_SUMMARY_LIMIT)
+      {
+         *limit = MIN(*limit, ref->blkno);
+      }
+      else if (ref->type == WAL_SUMMARY_BLOCK && ref->blkno >= start && ref->blkno < end)
+      {
+         if (count == capacity)
+         {
+            uint32_t* n = NULL;
+
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            n = (uint32_t*)realloc(b, capacity * sizeof(uint32_t));
+            if (n == NULL)
+            {
+               goto error;
+            }
+            b = n;
+         }
+
+         b[count++] = ref->blkno - start;
+      }
+   }
+
+   *blocks = b;
+   *number_of_blocks = count;
+
+   return 0;
+
+error:
+
+   free(b);
+
+   return 1;
+}
+
+bool
+pgmoneta_wal_summary_relation(char* path, uint32_t* spcoid, uint32_t* dboid, uint32_t* relnumber, int* forknum, uint32_t* segno)
+{
+   char* name = NULL;
+   char* end = NULL;
+   char copy[MAX_PATH];
+   char* parts[6];
+   int number_of_parts = 0;
+   char* saveptr = NULL;
+   char* token = NULL;
+
+   memset(copy, 0, sizeof(copy));
+   snprintf(copy, sizeof(copy), "%s", path);
+
+   token = strtok_r(copy, "/", &saveptr);
+   while (token != NULL && number_of_parts < 6)
+   {
+      parts[number_of_parts++] = token;
+      token = strtok_r(NULL, "/", &saveptr);
+   }
+
+   if (token != NULL || number_of_parts < 2)
+   {
+      return false;
+   }
+
+   if (number_of_parts == 2 && !strcmp(parts[0], "global"))
+   {
+      *spcoid = 1664;
+      *dboid = 0;
+   }
+   else if (number_of_parts == 3 && !strcmp(parts[0], "base"))
+   {
+      *spcoid = 1663;
+      *dboid = (uint32_t)strtoul(parts[1], &end, 10);
+      if (*end != '\0')
+      {
+         return false;
+      }
+   }
+   else if (number_of_parts == 5 && !strcmp(parts[0], "pg_tblspc"))
+   {
+      *spcoid = (uint32_t)strtoul(parts[1], &end, 10);
+      if (*end != '\0')
+      {
+         return false;
+      }
+      *dboid = (uint32_t)strtoul(parts[3], &end, 10);
+      if (*end != '\0')
+      {
+         return false;
+      }
+   }
+   else
+   {
+      return false;
+   }
+
+   // <relnumber>[_fsm|_vm|_init][.<segno>]
+   name = parts[number_of_parts - 1];
+
+   if (*name < '1' || *name > '9')
+   {
+      return false;
+   }
+
+   *relnumber = (uint32_t)strtoul(name, &end, 10);
+   *forknum = MAIN_FORKNUM;
+   *segno = 0;
+
+   if (!strncmp(end, "_fsm", 4))
+   {
+      *forknum = FSM_FORKNUM;
+      end += 4;
+   }
+   else if (!strncmp(end, "_vm", 3))
+   {
+      *forknum = VISIBILITYMAP_FORKNUM;
+      end += 3;
+   }
+   else if (!strncmp(end, "_init", 5))
+   {
+      *forknum = INIT_FORKNUM;
+      end += 5;
+   }
+
+   if (*end == '.')
+   {
+      name = end + 1;
+      if (*name < '1' || *name > '9')
+      {
+         return false;
+      }
+      *segno = (uint32_t)strtoul(name, &end, 10);
+   }
+
+   return *end == '\0';
+}
+
+void
+pgmoneta_wal_summary_destroy(struct wal_summary* summary)
+{
+   if (summary == NULL)
+   {
+      return;
+   }
+
+   free(summary->refs);
+   free(summary);
+}
+
+static int
+summary_segments(char* wal, struct summary_segment** segments, int* number_of_segments)
+{
+   int number_of_files = 0;
+   char** files = NULL;
+   int count = 0;
+   struct summary_segment* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *segments = NULL;
+   *number_of_segments = 0;
+
+   if (pgmoneta_get_wal_files(wal, &number_of_files, &files))
+   {
+      goto error;
+   }
+
+   if (number_of_files == 0)
+   {
+      free(files);
+      return 0;
+   }
+
+   s = (struct summary_segment*)calloc(number_of_files, sizeof(struct summary_segment));
+   if (s == NULL)
+   {
+      goto error;
+   }
+
+   // the names sort by timeline first, then by position
+   for (int i = 0; i < number_of_files; i++)
+   {
+      uint32_t tli;
+      uint32_t log;
+      uint32_t seg;
+      size_t segsize = DEFAULT_WAL_SEGZ_BYTES;
+
+      if (strlen(files[i]) < 24 || sscanf(files[i], "%08X%08X%08X", &tli, &log, &seg) != 3)
+      {
+         continue;
+      }
+
+      for (int j = 0; j < config->number_of_servers; j++)
+      {
+         if (strstr(wal, config->servers[j].name) != NULL && config->servers[j].wal_size > 0)
+         {
+            segsize = config->servers[j].wal_size;
+         }
+      }
+
+      // a segment both compressed and not is being compressed right now
+      if (count > 0 && !strncmp(s[count - 1].name, files[i], 24))
+      {
+         continue;
+      }
+
+      s[count].timeline = tli;
+      s[count].segno = (uint64_t)log * (0x100000000UL / segsize) + seg;
+      snprintf(s[count].name, sizeof(s[count].name), "%s", files[i]);
+      count++;
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   *segments = s;
+   *number_of_segments = count;
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+   free(s);
+
+   return 1;
+}
+
+static int
+summary_segment(struct summary_reader* reader, int index)
+{
+   struct xlog_long_page_header_data* long_header = NULL;
+   struct xlog_record header;
+   char* data = NULL;
+   size_t capacity = 0;
+   size_t length;
+   int ret;
+
+   free(reader->data);
+   free(reader->next);
+   reader->data = NULL;
+   reader->next = NULL;
+   reader->crossed = false;
+   reader->number_of_refs = 0;
+
+   if (summary_load(reader, index, &reader->data))
+   {
+      goto error;
+   }
+
+   long_header = (struct xlog_long_page_header_data*)reader->data;
+   reader->blcksz = long_header->xlp_xlog_blcksz;
+   reader->index = index;
+   reader->offset = 0;
+
+   if (reader->blcksz == 0 || reader->segsize % reader->blcksz != 0 || long_header->xlp_seg_size != reader->segsize)
+   {
+      pgmoneta_log_error("WAL summary: Invalid header in %s", reader->segments[index].name);
+      goto error;
+   }
+
+   // the tail of a record which started in the previous segment
+   if ((ret = summary_read(reader, NULL, long_header->std.xlp_rem_len)) != SUMMARY_COMPLETE)
+   {
+      goto done;
+   }
+   reader->offset = MAXALIGN(reader->offset);
+
+   while (!reader->crossed && reader->offset < reader->segsize)
+   {
+      ret = summary_read(reader, &header, SIZE_OF_XLOG_RECORD);
+      if (ret != SUMMARY_COMPLETE)
+      {
+         goto done;
+      }
+
+      // the rest of the segment is empty after a WAL switch
+      if (header.xl_tot_len < SIZE_OF_XLOG_RECORD || header.xl_tot_len > SUMMARY_MAX_RECORD)
+      {
+         break;
+      }
+
+      length = header.xl_tot_len - SIZE_OF_XLOG_RECORD;
+
+      if (length > capacity)
+      {
+         char* n = (char*)realloc(data, length);
+         if (n == NULL)
+         {
+            goto error;
+         }
+         data = n;
+         capacity = length;
+      }
+
+      if ((ret = summary_read(reader, data, length)) != SUMMARY_COMPLETE)
+      {
+         goto done;
+      }
+
+      if (summary_decode(reader, &header, data, length))
+      {
+         pgmoneta_log_error("WAL summary: Invalid record in %s", reader->segments[index].name);
+         goto error;
+      }
+
+      reader->offset = MAXALIGN(reader->offset);
+   }
+
+   ret = SUMMARY_COMPLETE;
+
+done:
+
+   free(data);
+
+   return ret;
+
+error:
+
+   free(data);
+
+   return SUMMARY_ERROR;
+}
+
+static int
+summary_load(struct summary_reader* reader, int index, char** data)
+{
+   char from[MAX_PATH];
+   char tmp[MAX_PATH];
+   char plain[MAX_PATH];
+   char* name = reader->segments[index].name;
+   char* path = from;
+   char* d = NULL;
+   bool copied = false;
+   FILE* file = NULL;
+
+   *data = NULL;
+
+   memset(from, 0, sizeof(from));
+   snprintf(from, sizeof(from), "%s%s", reader->wal, name);
+
+   // decrypt and decompress a copy, since that removes the source file
+   if (pgmoneta_is_encrypted_archive(name) || pgmoneta_is_compressed_archive(name))
+   {
+      memset(plain, 0, sizeof(plain));
+      snprintf(plain, sizeof(plain), "%s%.24s.%d", reader->directory, name, getpid());
+      memset(tmp, 0, sizeof(tmp));
+      snprintf(tmp, sizeof(tmp), "%s%s", plain, name + 24);
+
+      if (pgmoneta_copy_file(from, tmp, NULL))
+      {
+         goto error;
+      }
+      copied = true;
+
+      if (pgmoneta_is_encrypted_archive(tmp))
+      {
+         char decrypted[MAX_PATH];
+
+         memset(decrypted, 0, sizeof(decrypted));
+         snprintf(decrypted, sizeof(decrypted), "%.*s", (int)(strlen(tmp) - strlen(".aes")), tmp);
+
+         if (pgmoneta_decrypt_file(tmp, decrypted))
+         {
+            goto error;
+         }
+
+         memcpy(tmp, decrypted, sizeof(tmp));
+      }
+
+      if (pgmoneta_is_compressed_archive(tmp))
+      {
+         if (pgmoneta_decompress(tmp, plain))
+         {
+            goto error;
+         }
+      }
+
+      path = plain;
+   }
+
+   // a compacted segment is expanded into the copy
+   if (pgmoneta_is_compacted_walfile(path))
+   {
+      if (!copied)
+      {
+         memset(plain, 0, sizeof(plain));
+         snprintf(plain, sizeof(plain), "%s%.24s.%d", reader->directory, name, getpid());
+         memset(tmp, 0, sizeof(tmp));
+         copied = true;
+      }
+
+      if (pgmoneta_expand_walfile(path, plain))
+      {
+         goto error;
+      }
+
+      path = plain;
+   }
+
+   if (pgmoneta_get_file_size(path) != reader->segsize)
+   {
+      goto error;
+   }
+
+   d = (char*)malloc(reader->segsize);
+   if (d == NULL)
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL || fread(d, 1, reader->segsize, file) != reader->segsize)
+   {
+      goto error;
+   }
+
+   fclose(file);
+
+   if (copied)
+   {
+      unlink(plain);
+   }
+
+   *data = d;
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   if (copied)
+   {
+      unlink(tmp);
+      unlink(plain);
+   }
+
+   free(d);
+
+   return 1;
+}
+
+static int
+summary_read(struct summary_reader* reader, void* dst, size_t n)
+{
+   char* data = reader->crossed ? reader->next : reader->data;
+   char* out = (char*)dst;
+
+   while (n > 0)
+   {
+      size_t page_offset;
+      size_t chunk;
+
+      if (reader->offset >= reader->segsize)
+      {
+         int next = reader->index + 1;
+
+         // the record continues in the following segment
+         if (next >= reader->number_of_segments || reader->segments[next].segno != reader->segments[reader->index].segno + 1)
+         {
+            return SUMMARY_INCOMPLETE;
+         }
+
+         free(reader->next);
+         reader->next = NULL;
+
+         if (summary_load(reader, next, &reader->next))
+         {
+            return SUMMARY_INCOMPLETE;
+         }
+
+         reader->index = next;
+         reader->crossed = true;
+         reader->offset = 0;
+         data = reader->next;
+      }
+
+      page_offset = reader->offset % reader->blcksz;
+
+      if (page_offset == 0)
+      {
+         reader->offset += reader->offset == 0 ? SIZE_OF_XLOG_LONG_PHD : SIZE_OF_XLOG_SHORT_PHD;
+         continue;
+      }
+
+      chunk = MIN(n, reader->blcksz - page_offset);
+
+      if (out != NULL)
+      {
+         memcpy(out, data + reader->offset, chunk);
+         out += chunk;
+      }
+
+      reader->offset += chunk;
+      n -= chunk;
+   }
+
+   return SUMMARY_COMPLETE;
+}
+
+static int
+summary_decode(struct summary_reader* reader, struct xlog_record* header, char* data, size_t length)
+{
+   size_t position = 0;
+   size_t data_total = 0;
+   uint32_t main_data_length = 0;
+   uint8_t info;
+   struct rel_file_locator locator;
+   bool have_locator = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+#define SUMMARY_FIELD(dst, size)        \
+        if (position + (size) > length) \
+        {                               \
+           return 1;                    \
+        }                               \
+        memcpy((dst), data + position, (size)); \
+        position += (size);
+
+   memset(&locator, 0, sizeof(struct rel_file_locator));
+
+   // the block headers, like DecodeXLogRecord()
+   while (length - position > data_total)
+   {
+      uint8_t block_id;
+
+      SUMMARY_FIELD(&block_id, sizeof(uint8_t));
+
+      if (block_id == XLR_BLOCK_ID_DATA_SHORT)
+      {
+         uint8_t short_length;
+
+         SUMMARY_FIELD(&short_length, sizeof(uint8_t));
+         main_data_length = short_length;
+         data_total += main_data_length;
+         break;
+      }
+      else if (block_id == XLR_BLOCK_ID_DATA_LONG)
+      {
+         SUMMARY_FIELD(&main_data_length, sizeof(uint32_t));
+         data_total += main_data_length;
+         break;
+      }
+      else if (block_id == XLR_BLOCK_ID_ORIGIN)
+      {
+         position += sizeof(uint16_t);
+      }
+      else if (block_id == XLR_BLOCK_ID_TOPLEVEL_XID)
+      {
+         position += sizeof(uint32_t);
+      }
+      else if (block_id <= XLR_MAX_BLOCK_ID)
+      {
+         uint8_t fork_flags;
+         uint16_t data_length;
+         uint32_t blkno;
+
+         SUMMARY_FIELD(&fork_flags, sizeof(uint8_t));
+         SUMMARY_FIELD(&data_length, sizeof(uint16_t));
+         data_total += data_length;
+
+         if (fork_flags & BKPBLOCK_HAS_IMAGE)
+         {
+            uint16_t bimg_len;
+            uint16_t hole_offset;
+            uint8_t bimg_info;
+
+            SUMMARY_FIELD(&bimg_len, sizeof(uint16_t));
+            SUMMARY_FIELD(&hole_offset, sizeof(uint16_t));
+            SUMMARY_FIELD(&bimg_info, sizeof(uint8_t));
+
+            if (pgmoneta_wal_is_bkp_image_compressed(((struct xlog_page_header_data*)reader->data)->xlp_magic, bimg_info) &&
+                (bimg_info & BKPIMAGE_HAS_HOLE))
+            {
+               position += sizeof(uint16_t);
+            }
+
+            data_total += bimg_len;
+         }
+
+         if (!(fork_flags & BKPBLOCK_SAME_REL))
+         {
+            SUMMARY_FIELD(&locator, sizeof(struct rel_file_locator));
+            have_locator = true;
+         }
+         else if (!have_locator)
+         {
+            return 1;
+         }
+
+         SUMMARY_FIELD(&blkno, sizeof(uint32_t));
+
+         if (summary_add(reader, locator.spcOid, locator.dbOid, locator.relNumber, fork_flags & BKPBLOCK_FORK_MASK, blkno, WAL_SUMMARY_BLOCK))
+         {
+            return 1;
+         }
+      }
+      else
+      {
+         return 1;
+      }
+   }
+
+#undef SUMMARY_FIELD
+
+   if (main_data_length > length || position > length)
+   {
+      return 1;
+   }
+
+   // the main data is at the end of the record
+   data = data + length - main_data_length;
+   info = header->xl_info & ~XLR_INFO_MASK;
+
+   if (header->xl_rmid == SUMMARY_RM_SMGR_ID)
+   {
+      if (info == XLOG_SMGR_CREATE && main_data_length >= sizeof(struct xl_smgr_create))
+      {
+         struct xl_smgr_create create;
+
+         memcpy(&create, data, sizeof(struct xl_smgr_create));
+
+         if (summary_add(reader, create.rnode.spcNode, create.rnode.dbNode, create.rnode.relNode, create.forkNum, 0, WAL_SUMMARY_LIMIT))
+         {
+            return 1;
+         }
+      }
+      else if (info == XLOG_SMGR_TRUNCATE && main_data_length >= sizeof(struct xl_smgr_truncate))
+      {
+         struct xl_smgr_truncate truncate;
+
+         memcpy(&truncate, data, sizeof(struct xl_smgr_truncate));
+
+         if ((truncate.flags & SUMMARY_TRUNCATE_HEAP) &&
+             summary_add(reader, truncate.rnode.spcNode, truncate.rnode.dbNode, truncate.rnode.relNode, MAIN_FORKNUM, truncate.blkno, WAL_SUMMARY_LIMIT))
+         {
+            return 1;
+         }
+
+         // the maps are truncated to a length computed by the server, so take all of them
+         if ((truncate.flags & SUMMARY_TRUNCATE_FSM) &&
+             summary_add(reader, truncate.rnode.spcNode, truncate.rnode.dbNode, truncate.rnode.relNode, FSM_FORKNUM, 0, WAL_SUMMARY_LIMIT))
+         {
+            return 1;
+         }
+
+         if ((truncate.flags & SUMMARY_TRUNCATE_VM) &&
+             summary_add(reader, truncate.rnode.spcNode, truncate.rnode.dbNode, truncate.rnode.relNode, VISIBILITYMAP_FORKNUM, 0, WAL_SUMMARY_LIMIT))
+         {
+            return 1;
+         }
+      }
+   }
+   else if (header->xl_rmid == SUMMARY_RM_DBASE_ID && main_data_length >= 2 * sizeof(uint32_t))
+   {
+      // the files of a database created by copying its template aren't WAL logged
+      if (info == XLOG_DBASE_CREATE ||
+          (config->servers[reader->server].version >= 15 && info == XLOG_DBASE_CREATE_WAL_LOG))
+      {
+         uint32_t dboid;
+         uint32_t spcoid;
+
+         memcpy(&dboid, data, sizeof(uint32_t));
+         memcpy(&spcoid, data + sizeof(uint32_t), sizeof(uint32_t));
+
+         if (summary_add(reader, spcoid, dboid, 0, 0, 0, WAL_SUMMARY_DATABASE))
+         {
+            return 1;
+         }
+      }
+   }
+
+   return 0;
+}
+
+static int
+summary_add(struct summary_reader* reader, uint32_t spcoid, uint32_t dboid, uint32_t relnumber, int forknum, uint32_t blkno, char type)
+{
+   struct wal_block_ref* ref = NULL;
+
+   if (reader->number_of_refs == reader->capacity)
+   {
+      struct wal_block_ref* n = NULL;
+      int capacity = reader->capacity == 0 ? 4096 : reader->capacity * 2;
+
+      n = (struct wal_block_ref*)realloc(reader->refs, capacity * sizeof(struct wal_block_ref));
+      if (n == NULL)
+      {
+         return 1;
+      }
+
+      reader->refs = n;
+      reader->capacity = capacity;
+   }
+
+   ref = &reader->refs[reader->number_of_refs++];
+   memset(ref, 0, sizeof(struct wal_block_ref));
+   ref->spcoid = spcoid;
+   ref->dboid = dboid;
+   ref->relnumber = relnumber;
+   ref->forknum = forknum;
+   ref->blkno = blkno;
+   ref->type = type;
+
+   return 0;
+}
+
+static int
+summary_write(struct summary_reader* reader, char* path)
+{
+   char tmp[MAX_PATH];
+   FILE* file = NULL;
+
+   qsort(reader->refs, reader->number_of_refs, sizeof(struct wal_block_ref), summary_compare);
+   reader->number_of_refs = summary_unique(reader->refs, reader->number_of_refs);
+
+   memset(tmp, 0, sizeof(tmp));
+   snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+
+   file = fopen(tmp, "w");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < reader->number_of_refs; i++)
+   {
+      struct wal_block_ref* ref = &reader->refs[i];
+
+      if (fprintf(file, "%c %u %u %u %d %u\n", ref->type, ref->spcoid, ref->dboid, ref->relnumber, ref->forknum, ref->blkno) < 0)
+      {
+         goto error;
+      }
+   }
+
+   if (fflush(file) || fsync(fileno(file)))
+   {
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (rename(tmp, path))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   unlink(tmp);
+
+   return 1;
+}
+
+static int
+summary_load_file(char* path, struct wal_block_ref** refs, int* number_of_refs, int* capacity)
+{
+   char line[MISC_LENGTH];
+   FILE* file = NULL;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   memset(line, 0, sizeof(line));
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      struct wal_block_ref ref;
+
+      memset(&ref, 0, sizeof(struct wal_block_ref));
+
+      if (sscanf(line, "%c %u %u %u %d %u", &ref.type, &ref.spcoid, &ref.dboid, &ref.relnumber, &ref.forknum, &ref.blkno) != 6)
+      {
+         pgmoneta_log_error("WAL summary: Invalid line in %s", path);
+         goto error;
+      }
+
+      if (*number_of_refs == *capacity)
+      {
+         struct wal_block_ref* n = NULL;
+         int c = *capacity == 0 ? 4096 : *capacity * 2;
+
+         n = (struct wal_block_ref*)realloc(*refs, c * sizeof(struct wal_block_ref));
+         if (n == NULL)
+         {
+            goto error;
+         }
+
+         *refs = n;
+         *capacity = c;
+      }
+
+      (*refs)[(*number_of_refs)++] = ref;
+
+      memset(line, 0, sizeof(line));
+   }
+
+   fclose(file);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   return 1;
+}
+
+static void
+summary_prune(char* directory, struct summary_segment* segments, int number_of_segments)
+{
+   char path[MAX_PATH];
+   bool found;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   if (!(dir = opendir(directory)))
+   {
+      return;
+   }
+
+   // a summary goes together with its segment
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!pgmoneta_ends_with(entry->d_name, WAL_SUMMARY_SUFFIX))
+      {
+         continue;
+      }
+
+      found = false;
+      for (int i = 0; !found && i < number_of_segments; i++)
+      {
+         found = !strncmp(entry->d_name, segments[i].name, 24);
+      }
+
+      if (!found)
+      {
+         memset(path, 0, sizeof(path));
+         snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
+         unlink(path);
+      }
+   }
+
+   closedir(dir);
+}
+
+static int
+summary_compare(const void* a, const void* b)
+{
+   const struct wal_block_ref* ra = (const struct wal_block_ref*)a;
+   const struct wal_block_ref* rb = (const struct wal_block_ref*)b;
+
+   if (ra->spcoid != rb->spcoid)
+   {
+      return ra->spcoid < rb->spcoid ? -1 : 1;
+   }
+
+   if (ra->dboid != rb->dboid)
+   {
+      return ra->dboid < rb->dboid ? -1 : 1;
+   }
+
+   if (ra->relnumber != rb->relnumber)
+   {
+      return ra->relnumber < rb->relnumber ? -1 : 1;
+   }
+
+   if (ra->forknum != rb->forknum)
+   {
+      return ra->forknum < rb->forknum ? -1 : 1;
+   }
+
+   if (ra->blkno != rb->blkno)
+   {
+      return ra->blkno < rb->blkno ? -1 : 1;
+   }
+
+   return (int)ra->type - (int)rb->type;
+}
+
+static int
+summary_unique(struct wal_block_ref* refs, int number_of_refs)
+{
+   int n = 0;
+
+   for (int i = 0; i < number_of_refs; i++)
+   {
+      if (n == 0 || summary_compare(&refs[n - 1], &refs[i]) != 0)
+      {
+         refs[n++] = refs[i];
+      }
+   }
+
+   return n;
+}
+
+static char*
+summary_directory(int server)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "walsummary/");
+
+   return d;
+}
@@ -29,12 +29,14 @@
 /* pgmoneta */
 #include <pgmoneta.h>
 #include <backup.h>
+#include <compression.h>
 #include <info.h>
 #include <logging.h>
 #include <management.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
+#include <parallel.h>
 #include <security.h>
 #include <server.h>
 #include <stdint.h>
@@ -121,7 +123,7 @@ basebackup_execute(int server, char* identifier, struct deque* nodes)
    int backup_max_rate;
    int network_max_rate;
    int hash;
-   uint64_t biggest_file_size;
+   unsigned long biggest_file_size = 0;
    struct configuration* config;
    struct message* basebackup_msg = NULL;
    struct message* tablespace_msg = NULL;
@@ -237,38 +239,8 @@ basebackup_execute(int server, char* identifier, struct deque* nodes)
    response = NULL;
    pgmoneta_close_ssl(ssl);
    pgmoneta_disconnect(socket);
-
-   if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket) != AUTH_SUCCESS)
-   {
-      pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
-      goto error;
-   }
-
-   pgmoneta_memory_stream_buffer_init(&buffer);
-
-   if (incremental != NULL)
-   {
-      // send UPLOAD_MANIFEST
-      if (send_upload_manifest(ssl, socket))
-      {
-         pgmoneta_log_error("Fail to send UPLOAD_MANIFEST to server %s", config->servers[server].name);
-         goto error;
-      }
-      manifest_path = pgmoneta_append(NULL, incremental);
-      manifest_path = pgmoneta_append(manifest_path, "data/backup_manifest");
-      if (upload_manifest(ssl, socket, manifest_path))
-      {
-         pgmoneta_log_error("Fail to upload manifest to server %s", config->servers[server].name);
-         goto error;
-      }
-      // receive and ignore the result set for UPLOAD_MANIFEST
-      if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
-      {
-         goto error;
-      }
-      pgmoneta_free_query_response(response);
-      response = NULL;
-   }
+   ssl = NULL;
+   socket = -1;
 
    label = pgmoneta_append(label, "pgmoneta_");
    label = pgmoneta_append(label, identifier);
@@ -279,34 +251,16 @@ basebackup_execute(int server, char* identifier, struct deque* nodes)
       hash = config->manifest;
    }
 
-   pgmoneta_create_base_backup_message(config->servers[server].version, incremental != NULL, label, true, hash,
-                                       config->compression_type, config->compression_level,
-                                       &basebackup_msg);
-
-   status = pgmoneta_write_message(ssl, socket, basebackup_msg);
-   if (status != MESSAGE_STATUS_OK)
-   {
-      goto error;
-   }
-
-   // Receive the first result set, which contains the WAL starting point
-   if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
+   if (pgmoneta_parallel_backup_enabled(server, incremental != NULL))
    {
-      goto error;
-   }
-   memset(startpos, 0, sizeof(startpos));
-   memcpy(startpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
-   start_timeline = atoi(response->tuples[0].data[1]);
-   pgmoneta_free_query_response(response);
-   response = NULL;
+      // create the root dir
+      backup_base = pgmoneta_get_server_backup_identifier(server, identifier);
 
-   // create the root dir
-   backup_base = pgmoneta_get_server_backup_identifier(server, identifier);
+      pgmoneta_mkdir(backup_base);
 
-   pgmoneta_mkdir(backup_base);
-   if (config->servers[server].version < 15)
-   {
-      if (pgmoneta_receive_archive_files(ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket))
+      if (pgmoneta_parallel_backup(server, usr, label, backup_base, tablespaces, hash,
+                                   incremental, startpos, &start_timeline, endpos, &end_timeline,
+                                   &size, &biggest_file_size))
       {
          pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
 
@@ -317,52 +271,123 @@ basebackup_execute(int server, char* identifier, struct deque* nodes)
    }
    else
    {
-      if (pgmoneta_receive_archive_stream(ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket))
+      if (pgmoneta_server_authenticate(server, "postgres", config->users[usr].username, config->users[usr].password, true, &ssl, &socket) != AUTH_SUCCESS)
       {
-         pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
+         pgmoneta_log_info("Invalid credentials for %s", config->users[usr].username);
+         goto error;
+      }
 
-         pgmoneta_create_info(backup_base, identifier, 0);
+      pgmoneta_memory_stream_buffer_init(&buffer);
+
+      if (incremental != NULL)
+      {
+         // send UPLOAD_MANIFEST
+         if (send_upload_manifest(ssl, socket))
+         {
+            pgmoneta_log_error("Fail to send UPLOAD_MANIFEST to server %s", config->servers[server].name);
+            goto error;
+         }
+         manifest_path = pgmoneta_append(NULL, incremental);
+         manifest_path = pgmoneta_append(manifest_path, "data/backup_manifest");
+         if (upload_manifest(ssl, socket, manifest_path))
+         {
+            pgmoneta_log_error("Fail to upload manifest to server %s", config->servers[server].name);
+            goto error;
+         }
+         // receive and ignore the result set for UPLOAD_MANIFEST
+         if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
+         {
+            goto error;
+         }
+         pgmoneta_free_query_response(response);
+         response = NULL;
+      }
+
+      pgmoneta_create_base_backup_message(config->servers[server].version, incremental != NULL, label, true, hash,
+                                          config->compression_type, config->compression_level,
+                                          &basebackup_msg);
 
+      status = pgmoneta_write_message(ssl, socket, basebackup_msg);
+      if (status != MESSAGE_STATUS_OK)
+      {
          goto error;
       }
-   }
 
-   // Receive the final result set, which contains the WAL ending point
-   if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
-   {
-      goto error;
-   }
-   memset(endpos, 0, sizeof(endpos));
-   memcpy(endpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
-   end_timeline = atoi(response->tuples[0].data[1]);
-   pgmoneta_free_query_response(response);
-   response = NULL;
+      // Receive the first result set, which contains the WAL starting point
+      if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
+      {
+         goto error;
+      }
+      memset(startpos, 0, sizeof(startpos));
+      memcpy(startpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
+      start_timeline = atoi(response->tuples[0].data[1]);
+      pgmoneta_free_query_response(response);
+      response = NULL;
 
-   // remove backup_label.old if it exists
-   memset(old_label_path, 0, MAX_PATH);
-   if (pgmoneta_ends_with(backup_base, "/"))
-   {
-      snprintf(old_label_path, MAX_PATH, "%sdata/%s", backup_base, "backup_label.old");
-   }
-   else
-   {
-      snprintf(old_label_path, MAX_PATH, "%s/data/%s", backup_base, "backup_label.old");
-   }
+      // create the root dir
+      backup_base = pgmoneta_get_server_backup_identifier(server, identifier);
 
-   if (pgmoneta_exists(old_label_path))
-   {
-      if (pgmoneta_exists(old_label_path))
+      pgmoneta_mkdir(backup_base);
+      if (config->servers[server].version < 15)
       {
-         pgmoneta_delete_file(old_label_path, NULL);
+         if (pgmoneta_receive_archive_files(server, ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket, &size, &biggest_file_size))
+         {
+            pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
+
+            pgmoneta_create_info(backup_base, identifier, 0);
+
+            goto error;
+         }
       }
       else
       {
-         pgmoneta_log_debug("%s doesn't exists", old_label_path);
+         if (pgmoneta_receive_archive_stream(server, ssl, socket, buffer, backup_base, tablespaces, bucket, network_bucket, &size, &biggest_file_size))
+         {
+            pgmoneta_log_error("Backup: Could not backup %s", config->servers[server].name);
+
+            pgmoneta_create_info(backup_base, identifier, 0);
+
+            goto error;
+         }
       }
-   }
 
-   // receive and ignore the last result set, it's just a summary
-   pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response);
+      // Receive the final result set, which contains the WAL ending point
+      if (pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response))
+      {
+         goto error;
+      }
+      memset(endpos, 0, sizeof(endpos));
+      memcpy(endpos, response->tuples[0].data[0], strlen(response->tuples[0].data[0]));
+      end_timeline = atoi(response->tuples[0].data[1]);
+      pgmoneta_free_query_response(response);
+      response = NULL;
+
+      // remove backup_label.old if it exists
+      memset(old_label_path, 0, MAX_PATH);
+      if (pgmoneta_ends_with(backup_base, "/"))
+      {
+         snprintf(old_label_path, MAX_PATH, "%sdata/%s", backup_base, "backup_label.old");
+      }
+      else
+      {
+         snprintf(old_label_path, MAX_PATH, "%s/data/%s", backup_base, "backup_label.old");
+      }
+
+      if (pgmoneta_exists(old_label_path))
+      {
+         if (pgmoneta_exists(old_label_path))
+         {
+            pgmoneta_delete_file(old_label_path, NULL);
+         }
+         else
+         {
+            pgmoneta_log_debug("%s doesn't exists", old_label_path);
+         }
+      }
+
+      // receive and ignore the last result set, it's just a summary
+      pgmoneta_consume_data_row_messages(ssl, socket, buffer, &response);
+   }
 
    clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
 
@@ -378,10 +403,14 @@ basebackup_execute(int server, char* identifier, struct deque* nodes)
 
    backup_data = pgmoneta_get_server_backup_identifier_data(server, identifier);
 
-   size = pgmoneta_directory_size(backup_data);
+   // with inline compression the files on disk are compressed, so use the sizes from the archive
+   if (!pgmoneta_compression_inline(server))
+   {
+      size = pgmoneta_directory_size(backup_data);
+      biggest_file_size = pgmoneta_biggest_file(backup_data);
+   }
    pgmoneta_read_wal(backup_data, &wal);
    pgmoneta_read_checkpoint_info(backup_data, &chkptpos);
-   biggest_file_size = pgmoneta_biggest_file(backup_data);
 
    if (pgmoneta_deque_add(nodes, NODE_BACKUP_BASE, (uintptr_t)backup_base, ValueString))
    {
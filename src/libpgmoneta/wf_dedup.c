@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <dedup.h>
+#include <logging.h>
+#include <utils.h>
+#include <workers.h>
+#include <workflow.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdlib.h>
+
+static int dedup_setup(int, char*, struct deque*);
+static int dedup_execute_store(int, char*, struct deque*);
+static int dedup_execute_rehydrate(int, char*, struct deque*);
+static int dedup_teardown(int, char*, struct deque*);
+
+struct workflow*
+pgmoneta_create_dedup(bool store)
+{
+   struct workflow* wf = NULL;
+
+   wf = (struct workflow*)malloc(sizeof(struct workflow));
+
+   if (wf == NULL)
+   {
+      return NULL;
+   }
+
+   wf->setup = &dedup_setup;
+
+   if (store == true)
+   {
+      wf->execute = &dedup_execute_store;
+   }
+   else
+   {
+      wf->execute = &dedup_execute_rehydrate;
+   }
+
+   wf->teardown = &dedup_teardown;
+   wf->next = NULL;
+
+   return wf;
+}
+
+static int
+dedup_setup(int server, char* identifier, struct deque* nodes)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Dedup (setup): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   return 0;
+}
+
+static int
+dedup_execute_store(int server, char* identifier, struct deque* nodes)
+{
+   struct timespec start_t;
+   struct timespec end_t;
+   double dedup_elapsed_time;
+   char* label = NULL;
+   char* backup_base = NULL;
+   char* backup_data = NULL;
+   int hours;
+   int minutes;
+   double seconds;
+   char elapsed[128];
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Dedup (store): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   label = (char*)pgmoneta_deque_get(nodes, NODE_LABEL);
+   backup_base = (char*)pgmoneta_deque_get(nodes, NODE_BACKUP_BASE);
+   backup_data = (char*)pgmoneta_deque_get(nodes, NODE_BACKUP_DATA);
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (pgmoneta_dedup_data(server, label, backup_data, workers))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_dedup_tablespaces(server, label, backup_base, workers))
+   {
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+   dedup_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
+
+   hours = dedup_elapsed_time / 3600;
+   minutes = ((int)dedup_elapsed_time % 3600) / 60;
+   seconds = (int)dedup_elapsed_time % 60 + (dedup_elapsed_time - ((long)dedup_elapsed_time));
+
+   memset(&elapsed[0], 0, sizeof(elapsed));
+   sprintf(&elapsed[0], "%02i:%02i:%.4f", hours, minutes, seconds);
+
+   pgmoneta_log_debug("Dedup: %s/%s (Elapsed: %s)", config->servers[server].name, identifier, &elapsed[0]);
+
+   return 0;
+
+error:
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   return 1;
+}
+
+static int
+dedup_execute_rehydrate(int server, char* identifier, struct deque* nodes)
+{
+   char* base = NULL;
+   char* store = NULL;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Dedup (rehydrate): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   /* Nothing to do when the server has never used the chunk store */
+   store = pgmoneta_get_server(server);
+   store = pgmoneta_append(store, "dedup/");
+
+   if (!pgmoneta_exists(store))
+   {
+      free(store);
+      return 0;
+   }
+
+   base = (char*)pgmoneta_deque_get(nodes, NODE_DESTINATION);
+   if (base == NULL)
+   {
+      base = (char*)pgmoneta_deque_get(nodes, NODE_BACKUP_BASE);
+   }
+   if (base == NULL)
+   {
+      base = (char*)pgmoneta_deque_get(nodes, NODE_BACKUP_DATA);
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (pgmoneta_dedup_rehydrate(server, base, workers))
+   {
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+   }
+
+   free(store);
+
+   return 0;
+
+error:
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   free(store);
+
+   return 1;
+}
+
+static int
+dedup_teardown(int server, char* identifier, struct deque* nodes)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Dedup (teardown): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   return 0;
+}
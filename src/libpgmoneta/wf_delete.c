@@ -28,6 +28,7 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <dedup.h>
 #include <deque.h>
 #include <info.h>
 #include <link.h>
@@ -192,6 +193,11 @@ delete_backup_execute(int server, char* identifier, struct deque* nodes)
       }
    }
 
+   if (pgmoneta_dedup_release(server, label))
+   {
+      pgmoneta_log_warn("Delete: Could not release the chunks of %s/%s", config->servers[server].name, label);
+   }
+
    pgmoneta_log_debug("Delete: %s/%s", config->servers[server].name, backups[backup_index]->label);
 
    for (int i = 0; i < number_of_backups; i++)
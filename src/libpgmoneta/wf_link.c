@@ -30,6 +30,7 @@
 #include <pgmoneta.h>
 #include <art.h>
 #include <backup.h>
+#include <dedup.h>
 #include <info.h>
 #include <link.h>
 #include <logging.h>
@@ -43,11 +44,13 @@
 #include <string.h>
 
 static int link_setup(int, char*, struct deque*);
-static int link_execute(int, char*, struct deque*);
+static int link_execute_symbolic(int, char*, struct deque*);
+static int link_execute_hard(int, char*, struct deque*);
+static int link_execute(int, char*, struct deque*, bool);
 static int link_teardown(int, char*, struct deque*);
 
 struct workflow*
-pgmoneta_create_link(void)
+pgmoneta_create_link(bool hard)
 {
    struct workflow* wf = NULL;
 
@@ -59,7 +62,7 @@ pgmoneta_create_link(void)
    }
 
    wf->setup = &link_setup;
-   wf->execute = &link_execute;
+   wf->execute = hard ? &link_execute_hard : &link_execute_symbolic;
    wf->teardown = &link_teardown;
    wf->next = NULL;
 
@@ -80,7 +83,19 @@ link_setup(int server, char* identifier, struct deque* nodes)
 }
 
 static int
-link_execute(int server, char* identifier, struct deque* nodes)
+link_execute_symbolic(int server, char* identifier, struct deque* nodes)
+{
+   return link_execute(server, identifier, nodes, false);
+}
+
+static int
+link_execute_hard(int server, char* identifier, struct deque* nodes)
+{
+   return link_execute(server, identifier, nodes, true);
+}
+
+static int
+link_execute(int server, char* identifier, struct deque* nodes, bool hard)
 {
    struct timespec start_t;
    struct timespec end_t;
@@ -122,7 +137,9 @@ link_execute(int server, char* identifier, struct deque* nodes)
    {
       for (int j = number_of_backups - 2; j >= 0 && next_newest == -1; j--)
       {
-         if (backups[j]->valid == VALID_TRUE && backups[j]->major_version == backups[number_of_backups - 1]->major_version)
+         // hard links go to the full backup, since the files of an incremental backup differ
+         if (backups[j]->valid == VALID_TRUE && backups[j]->major_version == backups[number_of_backups - 1]->major_version &&
+             (!hard || backups[j]->type == TYPE_FULL))
          {
             if (next_newest == -1)
             {
@@ -131,6 +148,12 @@ link_execute(int server, char* identifier, struct deque* nodes)
          }
       }
 
+      /* The files of a deduplicated backup are recipes owned by its chunk references */
+      if (next_newest != -1 && pgmoneta_dedup_exists(server, backups[next_newest]->label))
+      {
+         next_newest = -1;
+      }
+
       if (next_newest != -1)
       {
          number_of_workers = pgmoneta_get_number_of_workers(server);
@@ -154,7 +177,7 @@ link_execute(int server, char* identifier, struct deque* nodes)
          to = pgmoneta_append(to, "data/");
 
          pgmoneta_compare_manifests(to_manifest, from_manifest, &deleted_files, &changed_files, &added_files);
-         pgmoneta_link_manifest(from, to, from, changed_files, added_files, workers);
+         pgmoneta_link_manifest(from, to, from, changed_files, added_files, hard, workers);
 
          if (number_of_workers > 0)
          {
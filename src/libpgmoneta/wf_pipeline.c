@@ -0,0 +1,692 @@
+/*
+ * Copyright (C) 2025 The pgmoneta community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgmoneta */
+#include <pgmoneta.h>
+#include <aes.h>
+#include <art.h>
+#include <compression.h>
+#include <deque.h>
+#include <info.h>
+#include <logging.h>
+#include <security.h>
+#include <utils.h>
+#include <workers.h>
+#include <workflow.h>
+
+/* system */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_BUFFER_SIZE 65536
+
+/** @struct pipeline
+ * Defines the state of a single file going through the pipeline
+ */
+struct pipeline
+{
+   FILE* file;                     /**< The output file */
+   struct compressor* compressor;  /**< The compressor, or NULL */
+   struct encryptor* encryptor;    /**< The encryptor, or NULL */
+   struct hash* hash;              /**< The SHA-256 of the output, or NULL */
+};
+
+static int pipeline_setup(int, char*, struct deque*);
+static int pipeline_execute(int, char*, struct deque*);
+static int pipeline_teardown(int, char*, struct deque*);
+
+static bool pipeline_compress(char* name);
+static bool pipeline_encrypt(char* name);
+static int pipeline_directory(char* directory, char* relative_path, bool data, struct deque* checksums, struct workers* workers);
+static int pipeline_tablespaces(char* root, struct workers* workers);
+static void do_pipeline_file(struct worker_input* wi);
+static int pipeline_input(struct worker_input* wi);
+static int pipeline_file(char* from, char* to, bool compress, bool encrypt, char** sha256);
+static int pipeline_compressed(void* data, size_t size, void* arg);
+static int pipeline_sink(void* data, size_t size, void* arg);
+
+struct workflow*
+pgmoneta_create_pipeline(void)
+{
+   struct workflow* wf = NULL;
+
+   wf = (struct workflow*)malloc(sizeof(struct workflow));
+
+   if (wf == NULL)
+   {
+      return NULL;
+   }
+
+   wf->setup = &pipeline_setup;
+   wf->execute = &pipeline_execute;
+   wf->teardown = &pipeline_teardown;
+   wf->next = NULL;
+
+   return wf;
+}
+
+static int
+pipeline_setup(int server, char* identifier, struct deque* nodes)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Pipeline (setup): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   return 0;
+}
+
+static int
+pipeline_execute(int server, char* identifier, struct deque* nodes)
+{
+   struct timespec start_t;
+   struct timespec end_t;
+   double pipeline_elapsed_time;
+   char* backup_base = NULL;
+   char* backup_data = NULL;
+   int hours;
+   int minutes;
+   double seconds;
+   char elapsed[128];
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
+   struct deque* checksums = NULL;
+   struct deque_iterator* iter = NULL;
+   struct art* sha256 = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Pipeline (execute): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &start_t);
+
+   backup_base = (char*)pgmoneta_deque_get(nodes, NODE_BACKUP_BASE);
+   backup_data = (char*)pgmoneta_deque_get(nodes, NODE_BACKUP_DATA);
+
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   {
+      if (pgmoneta_deque_create(true, &checksums))
+      {
+         goto error;
+      }
+   }
+
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (pipeline_directory(backup_data, "", true, checksums, workers))
+   {
+      goto error;
+   }
+
+   if (pipeline_tablespaces(backup_base, workers))
+   {
+      goto error;
+   }
+
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_wait(workers);
+      if (!workers->outcome)
+      {
+         goto error;
+      }
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
+   if (checksums != NULL)
+   {
+      if (pgmoneta_art_create(&sha256))
+      {
+         goto error;
+      }
+
+      pgmoneta_deque_iterator_create(checksums, &iter);
+      while (pgmoneta_deque_iterator_next(iter))
+      {
+         pgmoneta_art_insert(sha256, (unsigned char*)iter->tag, strlen(iter->tag) + 1,
+                             pgmoneta_value_data(iter->value), ValueString);
+      }
+      pgmoneta_deque_iterator_destroy(iter);
+      iter = NULL;
+
+      if (pgmoneta_deque_add(nodes, NODE_SHA256, (uintptr_t)sha256, ValueART))
+      {
+         goto error;
+      }
+      sha256 = NULL;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC_RAW, &end_t);
+   pipeline_elapsed_time = pgmoneta_compute_duration(start_t, end_t);
+
+   hours = pipeline_elapsed_time / 3600;
+   minutes = ((int)pipeline_elapsed_time % 3600) / 60;
+   seconds = (int)pipeline_elapsed_time % 60 + (pipeline_elapsed_time - ((long)pipeline_elapsed_time));
+
+   memset(&elapsed[0], 0, sizeof(elapsed));
+   sprintf(&elapsed[0], "%02i:%02i:%.4f", hours, minutes, seconds);
+
+   pgmoneta_log_debug("Pipeline: %s/%s (Elapsed: %s)", config->servers[server].name, identifier, &elapsed[0]);
+
+   /* The work is shared, so account the whole pass to the first transformation */
+   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+   {
+      pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_GZIP_ELAPSED, pipeline_elapsed_time);
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+   {
+      pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_ZSTD_ELAPSED, pipeline_elapsed_time);
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+   {
+      pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_LZ4_ELAPSED, pipeline_elapsed_time);
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+   {
+      pgmoneta_update_info_double(backup_base, INFO_COMPRESSION_BZIP2_ELAPSED, pipeline_elapsed_time);
+   }
+   else if (config->encryption != ENCRYPTION_NONE)
+   {
+      pgmoneta_update_info_double(backup_base, INFO_ENCRYPTION_ELAPSED, pipeline_elapsed_time);
+   }
+
+   pgmoneta_deque_destroy(checksums);
+
+   return 0;
+
+error:
+
+   if (workers != NULL)
+   {
+      pgmoneta_workers_wait(workers);
+      pgmoneta_workers_destroy(workers);
+   }
+
+   pgmoneta_deque_iterator_destroy(iter);
+   pgmoneta_deque_destroy(checksums);
+   pgmoneta_art_destroy(sha256);
+
+   return 1;
+}
+
+static int
+pipeline_teardown(int server, char* identifier, struct deque* nodes)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgmoneta_log_debug("Pipeline (teardown): %s/%s", config->servers[server].name, identifier);
+   pgmoneta_deque_list(nodes);
+
+   return 0;
+}
+
+static bool
+pipeline_compress(char* name)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->compression_type == COMPRESSION_NONE)
+   {
+      return false;
+   }
+
+   if (pgmoneta_ends_with(name, "backup_manifest") ||
+       pgmoneta_ends_with(name, "backup_label") ||
+       pgmoneta_is_compressed_archive(name) ||
+       pgmoneta_is_encrypted_archive(name))
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+pipeline_encrypt(char* name)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->encryption == ENCRYPTION_NONE)
+   {
+      return false;
+   }
+
+   if (pgmoneta_ends_with(name, ".aes") ||
+       pgmoneta_ends_with(name, ".partial") ||
+       pgmoneta_ends_with(name, ".history") ||
+       pgmoneta_ends_with(name, "backup_label") ||
+       pgmoneta_ends_with(name, "backup_manifest"))
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static int
+pipeline_directory(char* directory, char* relative_path, bool data, struct deque* checksums, struct workers* workers)
+{
+   char* path = NULL;
+   char* from = NULL;
+   char* to = NULL;
+   char* relative_file_path = NULL;
+   bool compress;
+   bool encrypt;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   path = pgmoneta_append(path, directory);
+   path = pgmoneta_append(path, relative_path);
+
+   if (!(dir = opendir(path)))
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         char relative_dir[MAX_PATH];
+
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         {
+            continue;
+         }
+
+         if (data && strlen(relative_path) == 0 && strcmp(entry->d_name, "pg_tblspc") == 0)
+         {
+            continue;
+         }
+
+         snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
+
+         if (pipeline_directory(directory, relative_dir, data, checksums, workers))
+         {
+            goto error;
+         }
+      }
+      else if (entry->d_type == DT_REG)
+      {
+         compress = pipeline_compress(entry->d_name);
+         encrypt = pipeline_encrypt(entry->d_name);
+
+         if (!compress && !encrypt)
+         {
+            continue;
+         }
+
+         from = pgmoneta_append(from, path);
+         from = pgmoneta_append(from, "/");
+         from = pgmoneta_append(from, entry->d_name);
+
+         to = pgmoneta_append(to, from);
+         if (compress)
+         {
+            to = pgmoneta_append(to, pgmoneta_compression_suffix(config->compression_type));
+         }
+         if (encrypt)
+         {
+            to = pgmoneta_append(to, ".aes");
+         }
+
+         if (data && checksums != NULL)
+         {
+            relative_file_path = pgmoneta_append(relative_file_path, to + strlen(directory));
+         }
+
+         if (pgmoneta_exists(from))
+         {
+            struct worker_input* wi = NULL;
+
+            if (!pgmoneta_create_worker_input(relative_file_path, from, to, config->compression_level, workers, &wi))
+            {
+               wi->all = relative_file_path != NULL ? checksums : NULL;
+
+               if (workers != NULL)
+               {
+                  if (workers->outcome)
+                  {
+                     pgmoneta_workers_add(workers, do_pipeline_file, wi);
+                  }
+               }
+               else
+               {
+                  int ret = pipeline_input(wi);
+
+                  free(wi);
+
+                  if (ret)
+                  {
+                     goto error;
+                  }
+               }
+            }
+         }
+
+         free(from);
+         free(to);
+         free(relative_file_path);
+
+         from = NULL;
+         to = NULL;
+         relative_file_path = NULL;
+      }
+   }
+
+   closedir(dir);
+
+   free(path);
+
+   return 0;
+
+error:
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   free(path);
+   free(from);
+   free(to);
+   free(relative_file_path);
+
+   return 1;
+}
+
+static int
+pipeline_tablespaces(char* root, struct workers* workers)
+{
+   char* path = NULL;
+   DIR* dir;
+   struct dirent* entry;
+
+   if (!(dir = opendir(root)))
+   {
+      return 1;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "data") == 0)
+         {
+            continue;
+         }
+
+         path = pgmoneta_append(path, root);
+         if (!pgmoneta_ends_with(root, "/"))
+         {
+            path = pgmoneta_append(path, "/");
+         }
+         path = pgmoneta_append(path, entry->d_name);
+
+         if (pipeline_directory(path, "", false, NULL, workers))
+         {
+            free(path);
+            closedir(dir);
+            return 1;
+         }
+
+         free(path);
+         path = NULL;
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+}
+
+static void
+do_pipeline_file(struct worker_input* wi)
+{
+   if (pipeline_input(wi))
+   {
+      wi->workers->outcome = false;
+   }
+
+   free(wi);
+}
+
+static int
+pipeline_input(struct worker_input* wi)
+{
+   char* sha256 = NULL;
+   char* name = NULL;
+
+   name = strrchr(wi->from, '/');
+   name = name != NULL ? name + 1 : wi->from;
+
+   if (pipeline_file(wi->from, wi->to, pipeline_compress(name), pipeline_encrypt(name), wi->all != NULL ? &sha256 : NULL))
+   {
+      pgmoneta_log_error("Pipeline: %s -> %s", wi->from, wi->to);
+      return 1;
+   }
+
+   if (wi->all != NULL)
+   {
+      pgmoneta_deque_add(wi->all, wi->directory, (uintptr_t)sha256, ValueString);
+   }
+
+   pgmoneta_delete_file(wi->from, NULL);
+
+   free(sha256);
+
+   return 0;
+}
+
+static int
+pipeline_file(char* from, char* to, bool compress, bool encrypt, char** sha256)
+{
+   FILE* in = NULL;
+   char* buffer = NULL;
+   size_t n;
+   struct pipeline p;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   memset(&p, 0, sizeof(struct pipeline));
+
+   if (sha256 != NULL)
+   {
+      *sha256 = NULL;
+   }
+
+   in = fopen(from, "rb");
+   if (in == NULL)
+   {
+      goto error;
+   }
+
+   p.file = fopen(to, "wb");
+   if (p.file == NULL)
+   {
+      goto error;
+   }
+
+   if (sha256 != NULL)
+   {
+      if (pgmoneta_hash_create(HASH_ALGORITHM_SHA256, &p.hash))
+      {
+         goto error;
+      }
+   }
+
+   if (encrypt)
+   {
+      if (pgmoneta_encryptor_create(config->encryption, true, &pipeline_sink, &p, &p.encryptor))
+      {
+         goto error;
+      }
+   }
+
+   if (compress)
+   {
+      if (pgmoneta_compressor_create_output(config->compression_type, config->compression_level,
+                                            &pipeline_compressed, &p, &p.compressor))
+      {
+         goto error;
+      }
+   }
+
+   buffer = (char*)malloc(PIPELINE_BUFFER_SIZE);
+   if (buffer == NULL)
+   {
+      goto error;
+   }
+
+   while ((n = fread(buffer, 1, PIPELINE_BUFFER_SIZE, in)) > 0)
+   {
+      if (p.compressor != NULL)
+      {
+         if (pgmoneta_compressor_write(p.compressor, buffer, n))
+         {
+            goto error;
+         }
+      }
+      else if (pipeline_compressed(buffer, n, &p))
+      {
+         goto error;
+      }
+   }
+
+   if (ferror(in))
+   {
+      goto error;
+   }
+
+   if (p.compressor != NULL && pgmoneta_compressor_finish(p.compressor))
+   {
+      goto error;
+   }
+
+   if (p.encryptor != NULL && pgmoneta_encryptor_finish(p.encryptor))
+   {
+      goto error;
+   }
+
+   if (fflush(p.file) != 0)
+   {
+      goto error;
+   }
+
+   if (p.hash != NULL && pgmoneta_hash_final(p.hash, sha256))
+   {
+      goto error;
+   }
+
+   fclose(in);
+   fclose(p.file);
+
+   pgmoneta_compressor_destroy(p.compressor);
+   pgmoneta_encryptor_destroy(p.encryptor);
+   pgmoneta_hash_destroy(p.hash);
+   free(buffer);
+
+   return 0;
+
+error:
+
+   if (in != NULL)
+   {
+      fclose(in);
+   }
+
+   if (p.file != NULL)
+   {
+      fclose(p.file);
+      remove(to);
+   }
+
+   pgmoneta_compressor_destroy(p.compressor);
+   pgmoneta_encryptor_destroy(p.encryptor);
+   pgmoneta_hash_destroy(p.hash);
+   free(buffer);
+
+   return 1;
+}
+
+static int
+pipeline_compressed(void* data, size_t size, void* arg)
+{
+   struct pipeline* p = (struct pipeline*)arg;
+
+   if (p->encryptor != NULL)
+   {
+      return pgmoneta_encryptor_write(p->encryptor, data, size);
+   }
+
+   return pipeline_sink(data, size, arg);
+}
+
+static int
+pipeline_sink(void* data, size_t size, void* arg)
+{
+   struct pipeline* p = (struct pipeline*)arg;
+
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (fwrite(data, 1, size, p->file) != size)
+   {
+      return 1;
+   }
+
+   if (p->hash != NULL)
+   {
+      return pgmoneta_hash_update(p->hash, data, size);
+   }
+
+   return 0;
+}
@@ -34,6 +34,8 @@
 #include <restore.h>
 #include <string.h>
 #include <utils.h>
+#include <walfile.h>
+#include <walindex.h>
 #include <workers.h>
 #include <workflow.h>
 
@@ -64,6 +66,7 @@ static int restore_excluded_files_teardown(int, char*, struct deque*);
 
 static char* get_user_password(char* username);
 static void create_standby_signal(char* basedir);
+static bool restore_delta(char* position);
 
 struct workflow*
 pgmoneta_create_restore(void)
@@ -191,6 +194,8 @@ restore_execute(int server, char* identifier, struct deque* nodes)
    char* origwal = NULL;
    char* waldir = NULL;
    char* waltarget = NULL;
+   char* walend = NULL;
+   int delta = 0;
    int number_of_workers = 0;
    struct workers* workers = NULL;
    struct configuration* config;
@@ -225,15 +230,34 @@ restore_execute(int server, char* identifier, struct deque* nodes)
 
    pgmoneta_deque_list(nodes);
 
-   pgmoneta_delete_directory(to);
-
    number_of_workers = pgmoneta_get_number_of_workers(server);
    if (number_of_workers > 0)
    {
       pgmoneta_workers_initialize(number_of_workers, &workers);
    }
 
-   if (pgmoneta_copy_postgresql_restore(from, to, directory, config->servers[server].name, label, backup, workers))
+   if (backup->type == TYPE_FULL && restore_delta(position))
+   {
+      delta = pgmoneta_restore_delta(from, to, workers);
+
+      if (delta == 2)
+      {
+         pgmoneta_log_info("Restore: %s can't be restored in delta mode", to);
+      }
+   }
+   else
+   {
+      delta = 2;
+   }
+
+   if (delta == 2)
+   {
+      pgmoneta_delete_directory(to);
+
+      delta = pgmoneta_copy_postgresql_restore(from, to, directory, config->servers[server].name, label, backup, workers);
+   }
+
+   if (delta)
    {
       pgmoneta_log_error("Restore: Could not restore %s/%s", config->servers[server].name, label);
       goto error;
@@ -290,7 +314,8 @@ restore_execute(int server, char* identifier, struct deque* nodes)
             {
                primary = false;
             }
-            else if (!strcmp(&key[0], "inclusive") || !strcmp(&key[0], "timeline") || !strcmp(&key[0], "action"))
+            else if (!strcmp(&key[0], "inclusive") || !strcmp(&key[0], "timeline") || !strcmp(&key[0], "action") ||
+                     !strcmp(&key[0], "delta"))
             {
                /* Ok */
             }
@@ -320,7 +345,17 @@ restore_execute(int server, char* identifier, struct deque* nodes)
             waltarget = pgmoneta_append(waltarget, label);
             waltarget = pgmoneta_append(waltarget, "/pg_wal/");
 
-            pgmoneta_copy_wal_files(waldir, waltarget, &backup->wal[0], workers);
+            if (config->wal_index)
+            {
+               pgmoneta_wal_index_target(server, backup, position, &walend);
+
+               if (walend != NULL)
+               {
+                  pgmoneta_log_debug("Restore: WAL up to %s for %s", walend, position);
+               }
+            }
+
+            pgmoneta_copy_wal_files(waldir, waltarget, &backup->wal[0], walend, workers);
          }
       }
       else
@@ -356,6 +391,7 @@ restore_execute(int server, char* identifier, struct deque* nodes)
    free(origwal);
    free(waldir);
    free(waltarget);
+   free(walend);
 
    return 0;
 
@@ -372,6 +408,7 @@ error:
    free(origwal);
    free(waldir);
    free(waltarget);
+   free(walend);
 
    return 1;
 }
@@ -411,6 +448,8 @@ combine_incremental_execute(int server, char* identifier, struct deque* nodes)
    char* base = NULL;
    struct backup* bck = NULL;
    struct json* manifest = NULL;
+   int number_of_workers = 0;
+   struct workers* workers = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -452,11 +491,23 @@ combine_incremental_execute(int server, char* identifier, struct deque* nodes)
       }
    }
 
-   if (pgmoneta_combine_backups(server, base, input_dir, output_dir, prior_backups, bck, manifest))
+   number_of_workers = pgmoneta_get_number_of_workers(server);
+   if (number_of_workers > 0)
+   {
+      pgmoneta_workers_initialize(number_of_workers, &workers);
+   }
+
+   if (pgmoneta_combine_backups(server, base, input_dir, output_dir, prior_backups, bck, manifest, workers))
    {
       goto error;
    }
 
+   if (workers != NULL)
+   {
+      pgmoneta_workers_destroy(workers);
+      workers = NULL;
+   }
+
    if (pgmoneta_deque_add(nodes, NODE_OUTPUT, (uintptr_t)output_dir, ValueString))
    {
       goto error;
@@ -466,6 +517,10 @@ combine_incremental_execute(int server, char* identifier, struct deque* nodes)
    return 0;
 
 error:
+   if (workers != NULL)
+   {
+      pgmoneta_workers_destroy(workers);
+   }
    free(input_dir);
    return 1;
 }
@@ -632,6 +687,23 @@ recovery_info_execute(int server, char* identifier, struct deque* nodes)
       goto error;
    }
 
+   // the WAL is decrypted and decompressed by now, so compacted segments can be expanded
+   path = pgmoneta_append(path, base);
+   if (!pgmoneta_ends_with(path, "/"))
+   {
+      path = pgmoneta_append(path, "/");
+   }
+   path = pgmoneta_append(path, "pg_wal/");
+
+   if (pgmoneta_exists(path) && pgmoneta_expand_wal(path))
+   {
+      pgmoneta_log_error("Recovery: Could not expand the WAL in %s", path);
+      goto error;
+   }
+
+   free(path);
+   path = NULL;
+
    position = (char*)pgmoneta_deque_get(nodes, NODE_POSITION);
    primary = (bool)pgmoneta_deque_get(nodes, NODE_PRIMARY);
 
@@ -790,7 +862,7 @@ recovery_info_execute(int server, char* identifier, struct deque* nodes)
                   mode = true;
                }
             }
-            else if (!strcmp(&key[0], "primary") || !strcmp(&key[0], "replica"))
+            else if (!strcmp(&key[0], "primary") || !strcmp(&key[0], "replica") || !strcmp(&key[0], "delta"))
             {
                /* Ok */
             }
@@ -1062,7 +1134,7 @@ restore_excluded_files_execute(int server, char* identifier, struct deque* nodes
 
       pgmoneta_log_trace("Excluded: %s -> %s", from_file, to_file);
 
-      if (pgmoneta_copy_file(from_file, to_file, workers))
+      if (pgmoneta_extract_file(from_file, to_file, workers))
       {
          pgmoneta_log_error("Restore: Could not copy file %s to %s", from_file, to_file);
          goto error;
@@ -1276,4 +1348,33 @@ create_standby_signal(char* basedir)
    }
 
    free(f);
-}
\ No newline at end of file
+}
+
+static bool
+restore_delta(char* position)
+{
+   char tokens[512];
+   char* ptr = NULL;
+
+   if (position == NULL || strlen(position) == 0)
+   {
+      return false;
+   }
+
+   memset(&tokens[0], 0, sizeof(tokens));
+   snprintf(&tokens[0], sizeof(tokens), "%s", position);
+
+   ptr = strtok(&tokens[0], ",");
+
+   while (ptr != NULL)
+   {
+      if (!strcmp(ptr, "delta"))
+      {
+         return true;
+      }
+
+      ptr = strtok(NULL, ",");
+   }
+
+   return false;
+}
@@ -28,6 +28,7 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <art.h>
 #include <deque.h>
 #include <logging.h>
 #include <security.h>
@@ -41,7 +42,7 @@ static int sha256_setup(int, char*, struct deque*);
 static int sha256_execute(int, char*, struct deque*);
 static int sha256_teardown(int, char*, struct deque*);
 
-static int write_backup_sha256(char* root, char* relative_path);
+static int write_backup_sha256(char* root, char* relative_path, struct art* precomputed);
 
 static FILE* sha256_file = NULL;
 
@@ -79,6 +80,7 @@ sha256_execute(int server, char* identifier, struct deque* nodes)
    char* root = NULL;
    char* d = NULL;
    char* sha256_path = NULL;
+   struct art* precomputed = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -99,7 +101,9 @@ sha256_execute(int server, char* identifier, struct deque* nodes)
 
    d = pgmoneta_get_server_backup_identifier_data(server, identifier);
 
-   if (write_backup_sha256(d, ""))
+   precomputed = (struct art*)pgmoneta_deque_get(nodes, NODE_SHA256);
+
+   if (write_backup_sha256(d, "", precomputed))
    {
       goto error;
    }
@@ -142,7 +146,7 @@ sha256_teardown(int server, char* identifier, struct deque* nodes)
 }
 
 static int
-write_backup_sha256(char* root, char* relative_path)
+write_backup_sha256(char* root, char* relative_path, struct art* precomputed)
 {
    char* dir_path = NULL;
    char* relative_file_path;
@@ -173,7 +177,7 @@ write_backup_sha256(char* root, char* relative_path)
 
          snprintf(relative_dir, sizeof(relative_dir), "%s/%s", relative_path, entry->d_name);
 
-         write_backup_sha256(root, relative_dir);
+         write_backup_sha256(root, relative_dir, precomputed);
       }
       else
       {
@@ -190,7 +194,14 @@ write_backup_sha256(char* root, char* relative_path)
          absolute_file_path = pgmoneta_append(absolute_file_path, "/");
          absolute_file_path = pgmoneta_append(absolute_file_path, relative_file_path);
 
-         pgmoneta_create_sha256_file(absolute_file_path, &sha256);
+         if (precomputed != NULL && pgmoneta_art_contains_key(precomputed, (unsigned char*)relative_file_path, strlen(relative_file_path) + 1))
+         {
+            sha256 = pgmoneta_append(sha256, (char*)pgmoneta_art_search(precomputed, (unsigned char*)relative_file_path, strlen(relative_file_path) + 1));
+         }
+         else
+         {
+            pgmoneta_create_sha256_file(absolute_file_path, &sha256);
+         }
 
          buffer = pgmoneta_append(buffer, relative_file_path);
          buffer = pgmoneta_append(buffer, ":");
@@ -49,6 +49,9 @@ static struct workflow* wf_verify(struct backup* backup);
 static struct workflow* wf_archive(struct backup* backup);
 static struct workflow* wf_delete_backup(struct backup* backup);
 static struct workflow* wf_retention(struct backup* backup);
+static struct workflow* wf_consolidate(void);
+
+static bool use_pipeline(void);
 
 struct workflow*
 pgmoneta_workflow_create(int workflow_type, int server, struct backup* backup)
@@ -79,6 +82,9 @@ pgmoneta_workflow_create(int workflow_type, int server, struct backup* backup)
       case WORKFLOW_TYPE_INCREMENTAL_BACKUP:
          return wf_incremental_backup();
          break;
+      case WORKFLOW_TYPE_CONSOLIDATE:
+         return wf_consolidate();
+         break;
       default:
          break;
    }
@@ -255,43 +261,57 @@ wf_backup(struct backup* backup)
    current->next = pgmoneta_create_hot_standby();
    current = current->next;
 
-   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+   if (config->dedup)
    {
-      current->next = pgmoneta_create_gzip(true);
-      current = current->next;
-   }
-   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
-   {
-      current->next = pgmoneta_create_zstd(true);
+      current->next = pgmoneta_create_dedup(true);
       current = current->next;
    }
-   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+
+   if (use_pipeline())
    {
-      current->next = pgmoneta_create_lz4(true);
+      current->next = pgmoneta_create_pipeline();
       current = current->next;
    }
-   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+   else
    {
-      current->next = pgmoneta_create_bzip2(true);
-      current = current->next;
-   }
+      if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+      {
+         current->next = pgmoneta_create_gzip(true);
+         current = current->next;
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+      {
+         current->next = pgmoneta_create_zstd(true);
+         current = current->next;
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+      {
+         current->next = pgmoneta_create_lz4(true);
+         current = current->next;
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+      {
+         current->next = pgmoneta_create_bzip2(true);
+         current = current->next;
+      }
 
-   if (config->encryption != ENCRYPTION_NONE)
-   {
-      current->next = pgmoneta_encryption(true);
-      current = current->next;
+      if (config->encryption != ENCRYPTION_NONE)
+      {
+         current->next = pgmoneta_encryption(true);
+         current = current->next;
+      }
    }
 
+   /* The chunk store already shares the unchanged data */
 #ifdef DEBUG
-   if (config->link)
+   if (config->link && !config->dedup)
+#else
+   if (!config->dedup)
+#endif
    {
-      current->next = pgmoneta_create_link();
+      current->next = pgmoneta_create_link(false);
       current = current->next;
    }
-#else
-   current->next = pgmoneta_create_link();
-   current = current->next;
-#endif
 
    current->next = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
    current = current->next;
@@ -356,6 +376,9 @@ wf_restore(struct backup* backup)
       current = current->next;
    }
 
+   current->next = pgmoneta_create_dedup(false);
+   current = current->next;
+
    current->next = pgmoneta_create_recovery_info();
    current = current->next;
 
@@ -453,34 +476,42 @@ wf_incremental_backup(void)
    // current->next = pgmoneta_create_hot_standby();
    // current = current->next;
 
-   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
-   {
-      current->next = pgmoneta_create_gzip(true);
-      current = current->next;
-   }
-   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
-   {
-      current->next = pgmoneta_create_zstd(true);
-      current = current->next;
-   }
-   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+   if (use_pipeline())
    {
-      current->next = pgmoneta_create_lz4(true);
+      current->next = pgmoneta_create_pipeline();
       current = current->next;
    }
-   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+   else
    {
-      current->next = pgmoneta_create_bzip2(true);
-      current = current->next;
-   }
+      if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+      {
+         current->next = pgmoneta_create_gzip(true);
+         current = current->next;
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+      {
+         current->next = pgmoneta_create_zstd(true);
+         current = current->next;
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+      {
+         current->next = pgmoneta_create_lz4(true);
+         current = current->next;
+      }
+      else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+      {
+         current->next = pgmoneta_create_bzip2(true);
+         current = current->next;
+      }
 
-   if (config->encryption != ENCRYPTION_NONE)
-   {
-      current->next = pgmoneta_encryption(true);
-      current = current->next;
+      if (config->encryption != ENCRYPTION_NONE)
+      {
+         current->next = pgmoneta_encryption(true);
+         current = current->next;
+      }
    }
 
-   current->next = pgmoneta_create_link();
+   current->next = pgmoneta_create_link(false);
    current = current->next;
 
    current->next = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
@@ -546,6 +577,9 @@ wf_verify(struct backup* backup)
       current = current->next;
    }
 
+   current->next = pgmoneta_create_dedup(false);
+   current = current->next;
+
    current->next = pgmoneta_restore_excluded_files();
    current = current->next;
 
@@ -621,3 +655,77 @@ wf_delete_backup(struct backup* backup)
 
    return head;
 }
+
+static struct workflow*
+wf_consolidate(void)
+{
+   struct workflow* head = NULL;
+   struct workflow* current = NULL;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   head = pgmoneta_create_manifest();
+   current = head;
+
+   if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
+   {
+      current->next = pgmoneta_create_gzip(true);
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
+   {
+      current->next = pgmoneta_create_zstd(true);
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
+   {
+      current->next = pgmoneta_create_lz4(true);
+      current = current->next;
+   }
+   else if (config->compression_type == COMPRESSION_CLIENT_BZIP2)
+   {
+      current->next = pgmoneta_create_bzip2(true);
+      current = current->next;
+   }
+
+   if (config->encryption != ENCRYPTION_NONE)
+   {
+      current->next = pgmoneta_encryption(true);
+      current = current->next;
+   }
+
+   current->next = pgmoneta_create_link(true);
+   current = current->next;
+
+   current->next = pgmoneta_create_permissions(PERMISSION_TYPE_BACKUP);
+   current = current->next;
+
+   return head;
+}
+
+static bool
+use_pipeline(void)
+{
+   int steps = 0;
+   struct configuration* config = NULL;
+
+   config = (struct configuration*)shmem;
+
+   if (config->compression_type != COMPRESSION_NONE)
+   {
+      steps++;
+   }
+
+   if (config->encryption != ENCRYPTION_NONE)
+   {
+      steps++;
+   }
+
+   if (config->storage_engine & STORAGE_ENGINE_SSH)
+   {
+      steps++;
+   }
+
+   return steps > 1;
+}
@@ -28,17 +28,23 @@
 
 /* pgmoneta */
 #include <pgmoneta.h>
+#include <aes.h>
+#include <info.h>
 #include <logging.h>
 #include <management.h>
+#include <uring.h>
 #include <utils.h>
 #include <workers.h>
 #include <zstandard_compression.h>
 
 /* system */
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <zdict.h>
 #include <zstd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -48,6 +54,16 @@
 
 static int zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin, size_t zout_size, void* zout);
 static int zstd_decompress(char* from, char* to, ZSTD_DCtx* dctx, size_t zin_size, void* zin, size_t zout_size, void* zout);
+static int zstd_wal_dictionary(int server, ZSTD_CCtx* cctx);
+static int zstd_dictionary_load(char* directory, unsigned int id, void** dictionary, size_t* size);
+static int zstd_dictionary_find(char* path, unsigned int id, void** dictionary, size_t* size);
+static char* zstd_dictionary_directory(int server);
+static bool zstd_dictionary_usable(int server);
+static void zstd_dictionary_prune(int server, char* directory, bool keep_newest);
+static int zstd_dictionary_referenced(char* directory, unsigned int* ids, bool* referenced, int number_of_ids);
+static int zstd_frame_dictionary(char* path, unsigned int* id);
+static int zstd_frame_output(void* data, size_t size, void* arg);
+static size_t zstd_read_segment(char* path, void* buffer, size_t size);
 
 void
 pgmoneta_zstandardc_data(char* directory, struct workers* workers)
@@ -185,6 +201,8 @@ pgmoneta_zstandardc_data(char* directory, struct workers* workers)
 
 error:
 
+   closedir(dir);
+
    if (cctx != NULL)
    {
       ZSTD_freeCCtx(cctx);
@@ -229,7 +247,7 @@ pgmoneta_zstandardc_tablespaces(char* root, struct workers* workers)
 }
 
 void
-pgmoneta_zstandardc_wal(char* directory)
+pgmoneta_zstandardc_wal(int server, char* directory)
 {
    size_t zin_size = -1;
    void* zin = NULL;
@@ -278,6 +296,11 @@ pgmoneta_zstandardc_wal(char* directory)
    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers);
 
+   if (zstd_wal_dictionary(server, cctx))
+   {
+      goto error;
+   }
+
    while ((entry = readdir(dir)) != NULL)
    {
       if (entry->d_type == DT_REG)
@@ -347,6 +370,8 @@ pgmoneta_zstandardc_wal(char* directory)
 
 error:
 
+   closedir(dir);
+
    if (cctx != NULL)
    {
       ZSTD_freeCCtx(cctx);
@@ -814,6 +839,310 @@ error:
    return 1;
 }
 
+int
+pgmoneta_zstandardc_wal_file(int server, char* from, char* to)
+{
+   size_t zin_size = -1;
+   void* zin = NULL;
+   size_t zout_size = -1;
+   void* zout = NULL;
+   ZSTD_CCtx* cctx = NULL;
+   int level;
+   int workers;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   level = config->compression_level;
+   if (level < 1)
+   {
+      level = 1;
+   }
+   else if (level > 19)
+   {
+      level = 19;
+   }
+
+   workers = config->workers != 0 ? config->workers : ZSTD_DEFAULT_NUMBER_OF_WORKERS;
+
+   zin_size = ZSTD_CStreamInSize();
+   zin = malloc(zin_size);
+   zout_size = ZSTD_CStreamOutSize();
+   zout = malloc(zout_size);
+
+   cctx = ZSTD_createCCtx();
+   if (cctx == NULL)
+   {
+      goto error;
+   }
+
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers);
+
+   if (zstd_wal_dictionary(server, cctx))
+   {
+      goto error;
+   }
+
+   if (zstd_compress(from, to, cctx, zin_size, zin, zout_size, zout))
+   {
+      goto error;
+   }
+
+   if (pgmoneta_exists(from))
+   {
+      pgmoneta_delete_file(from, NULL);
+   }
+   else
+   {
+      pgmoneta_log_debug("%s doesn't exists", from);
+   }
+
+   ZSTD_freeCCtx(cctx);
+
+   free(zin);
+   free(zout);
+
+   return 0;
+
+error:
+
+   if (cctx != NULL)
+   {
+      ZSTD_freeCCtx(cctx);
+   }
+
+   free(zin);
+   free(zout);
+
+   return 1;
+}
+
+int
+pgmoneta_zstandard_wal_train(int server)
+{
+   char* directory = NULL;
+   char* wal = NULL;
+   char path[MAX_PATH];
+   char tmp[MAX_PATH];
+   int number_of_files = 0;
+   char** files = NULL;
+   int segments = 0;
+   size_t segment_size;
+   size_t length;
+   size_t pages;
+   size_t step;
+   void* segment = NULL;
+   char* samples = NULL;
+   size_t* sample_sizes = NULL;
+   unsigned int number_of_samples = 0;
+   void* dictionary = NULL;
+   size_t dictionary_size;
+   unsigned int id;
+   time_t newest = 0;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+   FILE* file = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   segment_size = config->servers[server].wal_size > 0 ? (size_t)config->servers[server].wal_size : (size_t)16 * 1024 * 1024;
+
+   directory = zstd_dictionary_directory(server);
+
+   if (!zstd_dictionary_usable(server))
+   {
+      // the dictionaries of the segments compressed before are pruned once a day
+      if (!stat(directory, &st) && S_ISDIR(st.st_mode) && time(NULL) - st.st_mtime >= WAL_DICTIONARY_INTERVAL)
+      {
+         zstd_dictionary_prune(server, directory, false);
+         utimensat(AT_FDCWD, directory, NULL, 0);
+      }
+      goto done;
+   }
+
+   if (pgmoneta_mkdir(directory))
+   {
+      goto error;
+   }
+
+   // only retrain once the current dictionary is old enough
+   if ((dir = opendir(directory)) != NULL)
+   {
+      while ((entry = readdir(dir)) != NULL)
+      {
+         if (!pgmoneta_ends_with(entry->d_name, ".dict"))
+         {
+            continue;
+         }
+
+         memset(path, 0, sizeof(path));
+         snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
+
+         if (!stat(path, &st) && st.st_mtime > newest)
+         {
+            newest = st.st_mtime;
+         }
+      }
+      closedir(dir);
+      dir = NULL;
+   }
+
+   if (newest != 0 && time(NULL) - newest < WAL_DICTIONARY_INTERVAL)
+   {
+      goto done;
+   }
+
+   zstd_dictionary_prune(server, directory, true);
+
+   wal = pgmoneta_get_server_wal(server);
+
+   if (pgmoneta_get_wal_files(wal, &number_of_files, &files) || number_of_files == 0)
+   {
+      goto done;
+   }
+
+   segment = malloc(segment_size);
+   samples = malloc((size_t)WAL_DICTIONARY_SEGMENTS * WAL_DICTIONARY_PAGES * WAL_DICTIONARY_PAGE_SIZE);
+   sample_sizes = (size_t*)malloc(sizeof(size_t) * WAL_DICTIONARY_SEGMENTS * WAL_DICTIONARY_PAGES);
+
+   if (segment == NULL || samples == NULL || sample_sizes == NULL)
+   {
+      goto error;
+   }
+
+   // sample pages spread over the most recent segments
+   for (int i = number_of_files - 1; i >= 0 && segments < WAL_DICTIONARY_SEGMENTS; i--)
+   {
+      if (pgmoneta_is_encrypted_archive(files[i]) ||
+          (pgmoneta_is_compressed_archive(files[i]) && !pgmoneta_ends_with(files[i], ".zstd")))
+      {
+         continue;
+      }
+
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%s", wal, files[i]);
+
+      length = zstd_read_segment(path, segment, segment_size);
+      pages = length / WAL_DICTIONARY_PAGE_SIZE;
+
+      if (pages == 0)
+      {
+         continue;
+      }
+
+      step = pages > WAL_DICTIONARY_PAGES ? pages / WAL_DICTIONARY_PAGES : 1;
+
+      for (size_t p = 0; p < pages && p / step < WAL_DICTIONARY_PAGES; p += step)
+      {
+         memcpy(samples + (size_t)number_of_samples * WAL_DICTIONARY_PAGE_SIZE,
+                (char*)segment + p * WAL_DICTIONARY_PAGE_SIZE, WAL_DICTIONARY_PAGE_SIZE);
+         sample_sizes[number_of_samples] = WAL_DICTIONARY_PAGE_SIZE;
+         number_of_samples++;
+      }
+
+      segments++;
+   }
+
+   if (number_of_samples < WAL_DICTIONARY_PAGES)
+   {
+      pgmoneta_log_debug("ZSTD: Not enough WAL to train a dictionary for %s", config->servers[server].name);
+      goto done;
+   }
+
+   dictionary = malloc(WAL_DICTIONARY_SIZE);
+   if (dictionary == NULL)
+   {
+      goto error;
+   }
+
+   dictionary_size = ZDICT_trainFromBuffer(dictionary, WAL_DICTIONARY_SIZE, samples, sample_sizes, number_of_samples);
+   if (ZDICT_isError(dictionary_size))
+   {
+      pgmoneta_log_warn("ZSTD: Could not train a WAL dictionary for %s: %s", config->servers[server].name, ZDICT_getErrorName(dictionary_size));
+      goto done;
+   }
+
+   id = ZDICT_getDictID(dictionary, dictionary_size);
+   if (id == 0)
+   {
+      goto done;
+   }
+
+   // the frames name their dictionary, so every version is kept for decompression
+   memset(path, 0, sizeof(path));
+   snprintf(path, sizeof(path), "%s%08x.dict", directory, id);
+   memset(tmp, 0, sizeof(tmp));
+   snprintf(tmp, sizeof(tmp), "%s.partial", path);
+
+   file = fopen(tmp, "wb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (fwrite(dictionary, 1, dictionary_size, file) != dictionary_size || fflush(file) || fsync(fileno(file)))
+   {
+      goto error;
+   }
+
+   fclose(file);
+   file = NULL;
+
+   if (rename(tmp, path))
+   {
+      goto error;
+   }
+
+   pgmoneta_log_info("ZSTD: Trained WAL dictionary %08x for %s from %u pages", id, config->servers[server].name, number_of_samples);
+
+done:
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   free(segment);
+   free(samples);
+   free(sample_sizes);
+   free(dictionary);
+   free(directory);
+   free(wal);
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+      unlink(tmp);
+   }
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   for (int i = 0; i < number_of_files; i++)
+   {
+      free(files[i]);
+   }
+   free(files);
+
+   free(segment);
+   free(samples);
+   free(sample_sizes);
+   free(dictionary);
+   free(directory);
+   free(wal);
+
+   return 1;
+}
+
 int
 pgmoneta_zstdc_string(char* s, unsigned char** buffer, size_t* buffer_size)
 {
@@ -886,20 +1215,16 @@ pgmoneta_zstdd_string(unsigned char* compressed_buffer, size_t compressed_size,
 static int
 zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin, size_t zout_size, void* zout)
 {
-   FILE* fin = NULL;
-   FILE* fout = NULL;
+   struct uring_file* fin = NULL;
+   struct uring_file* fout = NULL;
    size_t toRead;
 
-   fin = fopen(from, "rb");
-
-   if (fin == NULL)
+   if (pgmoneta_uring_open_read(from, &fin))
    {
       goto error;
    }
 
-   fout = fopen(to, "wb");
-
-   if (fout == NULL)
+   if (pgmoneta_uring_open_write(to, 0666, &fout))
    {
       goto error;
    }
@@ -907,8 +1232,12 @@ zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin,
    toRead = zin_size;
    for (;;)
    {
-      size_t read = fread(zin, sizeof(char), toRead, fin);
-      int lastChunk = (read < toRead);
+      ssize_t read = pgmoneta_uring_read(fin, zin, toRead);
+      if (read < 0)
+      {
+         goto error;
+      }
+      int lastChunk = ((size_t)read < toRead);
       ZSTD_EndDirective mode = lastChunk ? ZSTD_e_end : ZSTD_e_continue;
       ZSTD_inBuffer input = {zin, read, 0};
       int finished;
@@ -916,7 +1245,7 @@ zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin,
       {
          ZSTD_outBuffer output = {zout, zout_size, 0};
          size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
-         fwrite(zout, sizeof(char), output.pos, fout);
+         pgmoneta_uring_write(fout, zout, output.pos);
          finished = lastChunk ? (remaining == 0) : (input.pos == input.size);
       }
       while (!finished);
@@ -927,8 +1256,14 @@ zstd_compress(char* from, char* to, ZSTD_CCtx* cctx, size_t zin_size, void* zin,
       }
    }
 
-   fclose(fout);
-   fclose(fin);
+   pgmoneta_uring_close(fin, false);
+   fin = NULL;
+
+   if (pgmoneta_uring_close(fout, false))
+   {
+      fout = NULL;
+      goto error;
+   }
 
    return 0;
 
@@ -936,12 +1271,12 @@ error:
 
    if (fout != NULL)
    {
-      fclose(fout);
+      pgmoneta_uring_close(fout, false);
    }
 
    if (fin != NULL)
    {
-      fclose(fin);
+      pgmoneta_uring_close(fin, false);
    }
 
    return 1;
@@ -950,60 +1285,615 @@ error:
 static int
 zstd_decompress(char* from, char* to, ZSTD_DCtx* dctx, size_t zin_size, void* zin, size_t zout_size, void* zout)
 {
-   FILE* fin = NULL;
-   FILE* fout = NULL;
+   struct uring_file* fin = NULL;
+   struct uring_file* fout = NULL;
    size_t toRead;
-   size_t read;
+   ssize_t read;
    size_t lastRet = 0;
+   void* dictionary = NULL;
+   size_t dictionary_size = 0;
+   unsigned int id;
+   bool first = true;
 
-   fin = fopen(from, "rb");
-
-   if (fin == NULL)
+   if (pgmoneta_uring_open_read(from, &fin))
    {
       goto error;
    }
 
-   fout = fopen(to, "wb");;
-
-   if (fout == NULL)
+   if (pgmoneta_uring_open_write(to, 0666, &fout))
    {
       goto error;
    }
 
+   ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+
    toRead = zin_size;
-   while ((read = fread(zin, sizeof(char), toRead, fin)))
+   while ((read = pgmoneta_uring_read(fin, zin, toRead)) > 0)
    {
       ZSTD_inBuffer input = {zin, read, 0};
+
+      // WAL segments may be compressed with a trained dictionary
+      if (first)
+      {
+         first = false;
+         id = ZSTD_getDictID_fromFrame(zin, read);
+
+         if (id != 0)
+         {
+            if (zstd_dictionary_find(from, id, &dictionary, &dictionary_size))
+            {
+               goto error;
+            }
+
+            if (ZSTD_isError(ZSTD_DCtx_loadDictionary(dctx, dictionary, dictionary_size)))
+            {
+               goto error;
+            }
+         }
+      }
+
       while (input.pos < input.size)
       {
          ZSTD_outBuffer output = {zout, zout_size, 0};
          size_t ret = ZSTD_decompressStream(dctx, &output, &input);
-         fwrite(zout, sizeof(char), output.pos, fout);
+         pgmoneta_uring_write(fout, zout, output.pos);
          lastRet = ret;
       }
    }
 
-   if (lastRet != 0)
+   if (read < 0 || lastRet != 0)
+   {
+      goto error;
+   }
+
+   pgmoneta_uring_close(fin, false);
+   fin = NULL;
+
+   if (pgmoneta_uring_close(fout, false))
    {
+      fout = NULL;
       goto error;
    }
 
-   fclose(fin);
-   fclose(fout);
+   free(dictionary);
 
    return 0;
 
 error:
 
+   free(dictionary);
+
    if (fin != NULL)
    {
-      fclose(fin);
+      pgmoneta_uring_close(fin, false);
    }
 
    if (fout != NULL)
    {
-      fclose(fout);
+      pgmoneta_uring_close(fout, false);
    }
 
    return 1;
 }
+
+static int
+zstd_wal_dictionary(int server, ZSTD_CCtx* cctx)
+{
+   char* directory = NULL;
+   char path[MAX_PATH];
+   void* dictionary = NULL;
+   size_t size = 0;
+   unsigned int id = 0;
+   time_t newest = 0;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+
+   if (!zstd_dictionary_usable(server))
+   {
+      return 0;
+   }
+
+   directory = zstd_dictionary_directory(server);
+
+   // the most recently trained dictionary is the current one
+   if ((dir = opendir(directory)) != NULL)
+   {
+      while ((entry = readdir(dir)) != NULL)
+      {
+         unsigned int candidate;
+
+         if (!pgmoneta_ends_with(entry->d_name, ".dict") || sscanf(entry->d_name, "%08x.dict", &candidate) != 1)
+         {
+            continue;
+         }
+
+         memset(path, 0, sizeof(path));
+         snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
+
+         if (!stat(path, &st) && st.st_mtime >= newest)
+         {
+            newest = st.st_mtime;
+            id = candidate;
+         }
+      }
+      closedir(dir);
+   }
+
+   if (id != 0)
+   {
+      if (zstd_dictionary_load(directory, id, &dictionary, &size))
+      {
+         goto error;
+      }
+
+      if (ZSTD_isError(ZSTD_CCtx_loadDictionary(cctx, dictionary, size)))
+      {
+         pgmoneta_log_error("ZSTD: Could not use WAL dictionary %08x", id);
+         goto error;
+      }
+   }
+
+   free(dictionary);
+   free(directory);
+
+   return 0;
+
+error:
+
+   free(dictionary);
+   free(directory);
+
+   return 1;
+}
+
+static int
+zstd_dictionary_load(char* directory, unsigned int id, void** dictionary, size_t* size)
+{
+   char path[MAX_PATH];
+   FILE* file = NULL;
+   void* d = NULL;
+   size_t s;
+
+   *dictionary = NULL;
+   *size = 0;
+
+   memset(path, 0, sizeof(path));
+   snprintf(path, sizeof(path), "%s%s%08x.dict", directory, pgmoneta_ends_with(directory, "/") ? "" : "/", id);
+
+   s = pgmoneta_get_file_size(path);
+   if (s == 0)
+   {
+      goto error;
+   }
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   d = malloc(s);
+   if (d == NULL || fread(d, 1, s, file) != s)
+   {
+      goto error;
+   }
+
+   fclose(file);
+
+   *dictionary = d;
+   *size = s;
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   free(d);
+
+   return 1;
+}
+
+static int
+zstd_dictionary_find(char* path, unsigned int id, void** dictionary, size_t* size)
+{
+   char directory[MAX_PATH];
+   char* slash = NULL;
+   char* d = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   // a segment in <server>/wal/ has its dictionaries in <server>/waldict/
+   memset(directory, 0, sizeof(directory));
+   snprintf(directory, sizeof(directory), "%s", path);
+   slash = strrchr(directory, '/');
+   if (slash != NULL)
+   {
+      snprintf(slash, sizeof(directory) - (slash - directory), "/../waldict/");
+
+      if (!zstd_dictionary_load(directory, id, dictionary, size))
+      {
+         return 0;
+      }
+   }
+
+   // segments copied into a backup, or restored elsewhere
+   if (config != NULL)
+   {
+      for (int i = 0; i < config->number_of_servers; i++)
+      {
+         d = zstd_dictionary_directory(i);
+
+         if (!zstd_dictionary_load(d, id, dictionary, size))
+         {
+            free(d);
+            return 0;
+         }
+
+         free(d);
+      }
+   }
+
+   pgmoneta_log_error("ZSTD: Could not find dictionary %08x for %s", id, path);
+
+   return 1;
+}
+
+static char*
+zstd_dictionary_directory(int server)
+{
+   char* d = NULL;
+
+   d = pgmoneta_get_server(server);
+   d = pgmoneta_append(d, "waldict/");
+
+   return d;
+}
+
+static bool
+zstd_dictionary_usable(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!config->wal_dictionary)
+   {
+      return false;
+   }
+
+   // the dictionaries stay on this host, so segments which are copied elsewhere can't use them
+   if ((config->storage_engine & STORAGE_ENGINE_SSH) ||
+       (config->storage_engine & STORAGE_ENGINE_S3) ||
+       (config->storage_engine & STORAGE_ENGINE_AZURE) ||
+       strlen(config->servers[server].wal_shipping) > 0)
+   {
+      return false;
+   }
+
+   return true;
+}
+
+static void
+zstd_dictionary_prune(int server, char* directory, bool keep_newest)
+{
+   char path[MAX_PATH];
+   char* wal = NULL;
+   char* server_backup = NULL;
+   int number_of_backups = 0;
+   struct backup** backups = NULL;
+   unsigned int ids[WAL_DICTIONARY_MAX];
+   bool referenced[WAL_DICTIONARY_MAX];
+   time_t times[WAL_DICTIONARY_MAX];
+   int number_of_ids = 0;
+   int newest = -1;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if ((dir = opendir(directory)) == NULL)
+   {
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL && number_of_ids < WAL_DICTIONARY_MAX)
+   {
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%s", directory, entry->d_name);
+
+      if (pgmoneta_ends_with(entry->d_name, ".dict") &&
+          sscanf(entry->d_name, "%08x.dict", &ids[number_of_ids]) == 1 &&
+          !stat(path, &st))
+      {
+         referenced[number_of_ids] = false;
+         times[number_of_ids] = st.st_mtime;
+         if (newest == -1 || st.st_mtime >= times[newest])
+         {
+            newest = number_of_ids;
+         }
+         number_of_ids++;
+      }
+   }
+   closedir(dir);
+
+   if (number_of_ids == 0)
+   {
+      return;
+   }
+
+   // the current dictionary is used by the next segments
+   if (keep_newest)
+   {
+      referenced[newest] = true;
+   }
+
+   // a segment which can't be read keeps every dictionary
+   wal = pgmoneta_get_server_wal(server);
+   if (zstd_dictionary_referenced(wal, ids, referenced, number_of_ids))
+   {
+      goto done;
+   }
+
+   server_backup = pgmoneta_get_server_backup(server);
+   if (pgmoneta_get_backups(server_backup, &number_of_backups, &backups))
+   {
+      goto done;
+   }
+
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      char* d = pgmoneta_get_server_backup_identifier_data_wal(server, backups[i]->label);
+      int ret = zstd_dictionary_referenced(d, ids, referenced, number_of_ids);
+
+      free(d);
+
+      if (ret)
+      {
+         goto done;
+      }
+   }
+
+   for (int i = 0; i < number_of_ids; i++)
+   {
+      if (!referenced[i])
+      {
+         memset(path, 0, sizeof(path));
+         snprintf(path, sizeof(path), "%s%08x.dict", directory, ids[i]);
+
+         if (!unlink(path))
+         {
+            pgmoneta_log_info("ZSTD: Removed WAL dictionary %08x for %s", ids[i], config->servers[server].name);
+         }
+      }
+   }
+
+done:
+   for (int i = 0; i < number_of_backups; i++)
+   {
+      free(backups[i]);
+   }
+   free(backups);
+
+   free(server_backup);
+   free(wal);
+}
+
+static int
+zstd_dictionary_referenced(char* directory, unsigned int* ids, bool* referenced, int number_of_ids)
+{
+   char path[MAX_PATH];
+   unsigned int id;
+   DIR* dir = NULL;
+   struct dirent* entry;
+
+   if ((dir = opendir(directory)) == NULL)
+   {
+      return 0;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!pgmoneta_ends_with(entry->d_name, ".zstd") && !pgmoneta_ends_with(entry->d_name, ".zstd.aes"))
+      {
+         continue;
+      }
+
+      memset(path, 0, sizeof(path));
+      snprintf(path, sizeof(path), "%s%s%s", directory, pgmoneta_ends_with(directory, "/") ? "" : "/", entry->d_name);
+
+      if (zstd_frame_dictionary(path, &id))
+      {
+         pgmoneta_log_debug("ZSTD: Could not read the dictionary of %s", path);
+         closedir(dir);
+         return 1;
+      }
+
+      for (int i = 0; id != 0 && i < number_of_ids; i++)
+      {
+         if (ids[i] == id)
+         {
+            referenced[i] = true;
+         }
+      }
+   }
+
+   closedir(dir);
+
+   return 0;
+}
+
+struct zstd_frame
+{
+   unsigned char header[18];
+   size_t size;
+};
+
+static int
+zstd_frame_dictionary(char* path, unsigned int* id)
+{
+   char buffer[64];
+   size_t n;
+   FILE* file = NULL;
+   struct encryptor* encryptor = NULL;
+   struct zstd_frame frame;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *id = 0;
+
+   memset(&frame, 0, sizeof(struct zstd_frame));
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   n = fread(buffer, 1, sizeof(buffer), file);
+   fclose(file);
+   file = NULL;
+
+   if (pgmoneta_ends_with(path, ".aes"))
+   {
+      // the key is derived from the master key alone, so the first blocks decrypt on their own
+      if (config->encryption == ENCRYPTION_NONE ||
+          pgmoneta_encryptor_create(config->encryption, false, &zstd_frame_output, &frame, &encryptor) ||
+          pgmoneta_encryptor_write(encryptor, buffer, n))
+      {
+         goto error;
+      }
+
+      pgmoneta_encryptor_destroy(encryptor);
+      encryptor = NULL;
+   }
+   else
+   {
+      zstd_frame_output(buffer, n, &frame);
+   }
+
+   // a segment encrypted with another mode doesn't decrypt into a frame
+   if (frame.size < 4 ||
+       (frame.header[0] | frame.header[1] << 8 | frame.header[2] << 16 | (unsigned int)frame.header[3] << 24) != ZSTD_MAGICNUMBER)
+   {
+      goto error;
+   }
+
+   *id = ZSTD_getDictID_fromFrame(frame.header, frame.size);
+
+   return 0;
+
+error:
+
+   pgmoneta_encryptor_destroy(encryptor);
+
+   return 1;
+}
+
+static int
+zstd_frame_output(void* data, size_t size, void* arg)
+{
+   struct zstd_frame* frame = (struct zstd_frame*)arg;
+   size_t n = MIN(size, sizeof(frame->header) - frame->size);
+
+   memcpy(frame->header + frame->size, data, n);
+   frame->size += n;
+
+   return 0;
+}
+
+static size_t
+zstd_read_segment(char* path, void* buffer, size_t size)
+{
+   ZSTD_DCtx* dctx = NULL;
+   FILE* file = NULL;
+   char in[DEFAULT_BUFFER_SIZE];
+   size_t n;
+   size_t length = 0;
+   void* dictionary = NULL;
+   size_t dictionary_size = 0;
+   unsigned int id;
+   bool first = true;
+
+   file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   if (!pgmoneta_ends_with(path, ".zstd"))
+   {
+      length = fread(buffer, 1, size, file);
+      fclose(file);
+
+      return length;
+   }
+
+   dctx = ZSTD_createDCtx();
+   if (dctx == NULL)
+   {
+      goto error;
+   }
+
+   while (length < size && (n = fread(in, 1, sizeof(in), file)) > 0)
+   {
+      ZSTD_inBuffer input = {in, n, 0};
+
+      if (first)
+      {
+         first = false;
+         id = ZSTD_getDictID_fromFrame(in, n);
+
+         if (id != 0)
+         {
+            if (zstd_dictionary_find(path, id, &dictionary, &dictionary_size))
+            {
+               goto error;
+            }
+            ZSTD_DCtx_loadDictionary(dctx, dictionary, dictionary_size);
+         }
+      }
+
+      while (input.pos < input.size && length < size)
+      {
+         ZSTD_outBuffer output = {(char*)buffer + length, size - length, 0};
+
+         if (ZSTD_isError(ZSTD_decompressStream(dctx, &output, &input)))
+         {
+            goto error;
+         }
+
+         length += output.pos;
+      }
+   }
+
+   fclose(file);
+   ZSTD_freeDCtx(dctx);
+   free(dictionary);
+
+   return length;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   if (dctx != NULL)
+   {
+      ZSTD_freeDCtx(dctx);
+   }
+
+   free(dictionary);
+
+   return 0;
+}
@@ -54,6 +54,9 @@
 #include <utils.h>
 #include <verify.h>
 #include <wal.h>
+#include <walfile.h>
+#include <walindex.h>
+#include <walsummary.h>
 #include <zstandard_compression.h>
 
 /* system */
@@ -645,11 +648,11 @@ main(int argc, char** argv)
 
    if (!offline)
    {
-      /* Start WAL compression */
+      /* Start WAL compression of the segments the WAL receivers left behind */
       if (config->compression_type != COMPRESSION_NONE ||
           config->encryption != ENCRYPTION_NONE)
       {
-         ev_periodic_init(&wal, wal_cb, 0., 60, 0);
+         ev_periodic_init(&wal, wal_cb, 0., 600, 0);
          ev_periodic_start(main_loop, &wal);
       }
    }
@@ -1763,6 +1766,7 @@ wal_cb(struct ev_loop* loop, ev_periodic* w, int revents)
       if (!fork())
       {
          bool active = false;
+         bool compressing = false;
          char* d = NULL;
 
          pgmoneta_set_proc_title(1, argv_ptr, "wal", config->servers[i].name);
@@ -1773,13 +1777,32 @@ wal_cb(struct ev_loop* loop, ev_periodic* w, int revents)
          {
             d = pgmoneta_get_server_wal(i);
 
+            // the WAL receiver never waits for the sweep, it leaves its segments to the compression below
+            while (!atomic_compare_exchange_strong(&config->servers[i].wal_compress, &compressing, true))
+            {
+               compressing = false;
+               SLEEP(10000000L);
+            }
+
+            // summarize the segments before they are compressed
+            if (config->wal_summary && config->servers[i].version < 17)
+            {
+               pgmoneta_summarize_wal(i);
+            }
+
+            if (config->wal_index)
+            {
+               pgmoneta_wal_index(i);
+            }
+
             if (config->compression_type == COMPRESSION_CLIENT_GZIP || config->compression_type == COMPRESSION_SERVER_GZIP)
             {
                pgmoneta_gzip_wal(d);
             }
             else if (config->compression_type == COMPRESSION_CLIENT_ZSTD || config->compression_type == COMPRESSION_SERVER_ZSTD)
             {
-               pgmoneta_zstandardc_wal(d);
+               pgmoneta_zstandard_wal_train(i);
+               pgmoneta_zstandardc_wal(i, d);
             }
             else if (config->compression_type == COMPRESSION_CLIENT_LZ4 || config->compression_type == COMPRESSION_SERVER_LZ4)
             {
@@ -1795,6 +1818,14 @@ wal_cb(struct ev_loop* loop, ev_periodic* w, int revents)
                pgmoneta_encrypt_wal(d);
             }
 
+            atomic_store(&config->servers[i].wal_compress, false);
+
+            // compact the segments from before the newest full backup
+            if (config->wal_compaction)
+            {
+               pgmoneta_compact_wal(i);
+            }
+
             free(d);
 
             atomic_store(&config->servers[i].wal, false);
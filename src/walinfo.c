@@ -59,7 +59,7 @@ usage(void)
    printf("\n");
 
    printf("Usage:\n");
-   printf("  pgmoneta-walinfo <file>\n");
+   printf("  pgmoneta-walinfo <file|directory> [<file|directory> ...]\n");
    printf("\n");
    printf("Options:\n");
    printf("  -c, --config CONFIG_FILE Set the path to the pgmoneta.conf file\n");
@@ -73,6 +73,7 @@ usage(void)
    printf("  -e, --end                Filter on an end LSN\n");
    printf("  -x, --xid                Filter on an XID\n");
    printf("  -l, --limit              Limit number of outputs\n");
+   printf("  -w, --workers            Number of workers decoding WAL files\n");
    printf("  -v, --verbose            Output result\n");
    printf("  -V, --version            Display version information\n");
    printf("  -?, --help               Display help\n");
@@ -102,6 +103,7 @@ main(int argc, char** argv)
    uint64_t end_lsn_low = 0;
    struct deque* xids = NULL;
    uint32_t limit = 0;
+   int workers = 0;
    bool verbose = false;
    enum value_type type = ValueString;
    size_t size;
@@ -128,13 +130,14 @@ main(int argc, char** argv)
          {"end", required_argument, 0, 'e'},
          {"xid", required_argument, 0, 'x'},
          {"limit", required_argument, 0, 'l'},
+         {"workers", required_argument, 0, 'w'},
          {"verbose", no_argument, 0, 'v'},
          {"version", no_argument, 0, 'V'},
          {"help", no_argument, 0, '?'},
          {0, 0, 0, 0}
       };
 
-      c = getopt_long(argc, argv, "c:qvV?:o:F:L:r:s:e:x:l:",
+      c = getopt_long(argc, argv, "c:qvV?:o:F:L:r:s:e:x:l:w:",
                       long_options, &option_index);
 
       if (c == -1)
@@ -244,6 +247,9 @@ main(int argc, char** argv)
          case 'l':
             limit = pgmoneta_atoi(optarg);
             break;
+         case 'w':
+            workers = pgmoneta_atoi(optarg);
+            break;
          case 'v':
             verbose = true;
             break;
@@ -305,12 +311,15 @@ main(int argc, char** argv)
       exit(1);
    }
 
-   if (optind < argc)
+   if (workers <= 0)
    {
-      char* file_path = argv[optind];
+      workers = config->workers > 0 ? config->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+   }
 
-      if (pgmoneta_describe_walfile(file_path, type, output, quiet, color,
-                                    rms, start_lsn, end_lsn, xids, limit))
+   if (optind < argc)
+   {
+      if (pgmoneta_describe_walfiles(&argv[optind], argc - optind, workers, type, output, quiet, color,
+                                     rms, start_lsn, end_lsn, xids, limit))
       {
          fprintf(stderr, "Error while reading/describing WAL file\n");
          goto error;
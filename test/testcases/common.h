@@ -47,6 +47,16 @@
 
 #define SUCCESS_STATUS  "Status: true"
 
+#define CONSOLIDATE_INCREMENTAL "Incremental: "
+#define CONSOLIDATE_CHECKS      12
+#define CONSOLIDATE_WAIT        10
+
+#define DELTA_PREFIX    "primary-"
+#define DELTA_UNCHANGED "PG_VERSION"
+#define DELTA_MODIFIED  "pg_ident.conf"
+#define DELTA_EXTRA     "pgmoneta_delta_extra"
+#define DELTA_MARKER    "# pgmoneta delta restore\n"
+
 extern char project_directory[BUFFER_SIZE];
 
 /**
@@ -30,6 +30,9 @@
 #include "pgmoneta_test_2.h"
 #include "common.h"
 
+static int restore_delta(char* executable_path, char* configuration_path, char* restore_path);
+static int restore_delta_target(char* restore_path, char* target, size_t size);
+
 // test backup
 START_TEST(test_pgmoneta_backup)
 {
@@ -98,6 +101,200 @@ START_TEST(test_pgmoneta_restore)
 
    pclose(fp);
 
+done:
+   free(executable_path);
+   free(configuration_path);
+   free(restore_path);
+   free(log_path);
+}
+END_TEST
+// test delta restore over an earlier restore
+START_TEST(test_pgmoneta_restore_delta)
+{
+   char target[BUFFER_SIZE];
+   char unchanged[BUFFER_SIZE];
+   char modified[BUFFER_SIZE];
+   char extra[BUFFER_SIZE];
+   char content[BUFFER_SIZE];
+   char* executable_path = NULL;
+   char* configuration_path = NULL;
+   char* restore_path = NULL;
+   char* log_path = NULL;
+   struct stat before;
+   struct stat after;
+   FILE* fp;
+
+   executable_path = get_executable_path();
+   configuration_path = get_configuration_path();
+   restore_path = get_restore_path();
+   log_path = get_log_path();
+
+   // the first delta restore sets the times of the manifest
+   ck_assert_msg(restore_delta(executable_path, configuration_path, restore_path), "success status not found");
+
+   ck_assert_msg(!restore_delta_target(restore_path, target, sizeof(target)), "restored directory not found");
+
+   snprintf(unchanged, sizeof(unchanged), "%s/%s", target, DELTA_UNCHANGED);
+   snprintf(modified, sizeof(modified), "%s/%s", target, DELTA_MODIFIED);
+   snprintf(extra, sizeof(extra), "%s/%s", target, DELTA_EXTRA);
+
+   ck_assert_msg(!stat(unchanged, &before), "%s not found", unchanged);
+
+   fp = fopen(modified, "a");
+   ck_assert_msg(fp != NULL, "couldn't modify %s", modified);
+   fputs(DELTA_MARKER, fp);
+   fclose(fp);
+
+   fp = fopen(extra, "w");
+   ck_assert_msg(fp != NULL, "couldn't create %s", extra);
+   fputs(DELTA_MARKER, fp);
+   fclose(fp);
+
+   ck_assert_msg(restore_delta(executable_path, configuration_path, restore_path), "success status not found");
+
+   // a full restore would rewrite the unchanged file, and leave the extra file
+   ck_assert_msg(!stat(unchanged, &after), "%s not found", unchanged);
+   ck_assert_msg(before.st_ino == after.st_ino, "%s was rewritten", unchanged);
+   ck_assert_msg(before.st_mtime == after.st_mtime, "%s was touched", unchanged);
+
+   memset(content, 0, sizeof(content));
+   fp = fopen(modified, "r");
+   ck_assert_msg(fp != NULL, "%s not found", modified);
+   fread(content, sizeof(char), sizeof(content) - 1, fp);
+   fclose(fp);
+   ck_assert_msg(strstr(content, DELTA_MARKER) == NULL, "%s wasn't restored", modified);
+
+   ck_assert_msg(access(extra, F_OK) != 0, "%s wasn't removed", extra);
+
+done:
+   free(executable_path);
+   free(configuration_path);
+   free(restore_path);
+   free(log_path);
+}
+END_TEST
+// test incremental backup
+START_TEST(test_pgmoneta_backup_incremental)
+{
+   int found = 0;
+   char command[BUFFER_SIZE];
+   char* executable_path = NULL;
+   char* configuration_path = NULL;
+   char* log_path = NULL;
+   char command_output[BUFFER_SIZE];
+   FILE* fp;
+
+   executable_path = get_executable_path();
+   configuration_path = get_configuration_path();
+   log_path = get_log_path();
+
+   memset(command_output, 0, sizeof(command_output));
+   snprintf(command, sizeof(command), "%s -c %s backup primary newest", executable_path, configuration_path);
+
+   fp = popen(command, "r");
+   if (fp == NULL)
+   {
+      ck_assert_msg(0, "couldn't execute the command");
+   }
+
+   fread(command_output, sizeof(char), BUFFER_SIZE - 1, fp);
+
+   pclose(fp);
+
+   if (strstr(command_output, SUCCESS_STATUS) != NULL)
+   {
+      found = 1;
+   }
+   ck_assert_msg(found, "success status not found");
+
+done:
+   free(executable_path);
+   free(configuration_path);
+   free(log_path);
+}
+END_TEST
+// test consolidation of the incremental chain by the retention check
+START_TEST(test_pgmoneta_consolidate)
+{
+   int found = 0;
+   char command[BUFFER_SIZE];
+   char* executable_path = NULL;
+   char* configuration_path = NULL;
+   char* restore_path = NULL;
+   char* log_path = NULL;
+   char* output = NULL;
+   char* incremental = NULL;
+   char buffer[BUFFER_SIZE];
+   size_t size;
+   size_t n;
+   FILE* fp;
+
+   executable_path = get_executable_path();
+   configuration_path = get_configuration_path();
+   restore_path = get_restore_path();
+   log_path = get_log_path();
+
+   snprintf(command, sizeof(command), "%s -c %s list-backup primary", executable_path, configuration_path);
+
+   // the newest backup becomes a full backup on one of the next retention checks
+   for (int i = 0; !found && i < CONSOLIDATE_CHECKS; i++)
+   {
+      sleep(CONSOLIDATE_WAIT);
+
+      fp = popen(command, "r");
+      if (fp == NULL)
+      {
+         ck_assert_msg(0, "couldn't execute the command");
+      }
+
+      size = 0;
+      output = NULL;
+      while ((n = fread(buffer, sizeof(char), sizeof(buffer), fp)) > 0)
+      {
+         output = realloc(output, size + n + 1);
+         memcpy(output + size, buffer, n);
+         size += n;
+         output[size] = '\0';
+      }
+
+      pclose(fp);
+
+      incremental = NULL;
+      for (char* p = output; p != NULL && (p = strstr(p, CONSOLIDATE_INCREMENTAL)) != NULL; p++)
+      {
+         incremental = p;
+      }
+
+      if (incremental != NULL && !strncmp(incremental + strlen(CONSOLIDATE_INCREMENTAL), "false", strlen("false")))
+      {
+         found = 1;
+      }
+
+      free(output);
+      output = NULL;
+   }
+   ck_assert_msg(found, "newest backup not consolidated");
+
+   found = 0;
+   memset(buffer, 0, sizeof(buffer));
+   snprintf(command, sizeof(command), "%s -c %s restore primary newest current %s", executable_path, configuration_path, restore_path);
+
+   fp = popen(command, "r");
+   if (fp == NULL)
+   {
+      ck_assert_msg(0, "couldn't execute the command");
+   }
+
+   fread(buffer, sizeof(char), BUFFER_SIZE - 1, fp);
+
+   pclose(fp);
+
+   if (strstr(buffer, SUCCESS_STATUS) != NULL)
+   {
+      found = 1;
+   }
+   ck_assert_msg(found, "success status not found");
+
 done:
    free(executable_path);
    free(configuration_path);
@@ -139,11 +336,74 @@ done:
 }
 END_TEST
 
+static int
+restore_delta(char* executable_path, char* configuration_path, char* restore_path)
+{
+   char command[BUFFER_SIZE];
+   char command_output[BUFFER_SIZE];
+   FILE* fp;
+
+   memset(command_output, 0, sizeof(command_output));
+   snprintf(command, sizeof(command), "%s -c %s restore primary newest current,delta %s", executable_path, configuration_path, restore_path);
+
+   fp = popen(command, "r");
+   if (fp == NULL)
+   {
+      return 0;
+   }
+
+   fread(command_output, sizeof(char), BUFFER_SIZE - 1, fp);
+
+   pclose(fp);
+
+   return strstr(command_output, SUCCESS_STATUS) != NULL;
+}
+
+static int
+restore_delta_target(char* restore_path, char* target, size_t size)
+{
+   char path[BUFFER_SIZE];
+   time_t newest = 0;
+   DIR* dir = NULL;
+   struct dirent* entry;
+   struct stat st;
+
+   memset(target, 0, size);
+
+   dir = opendir(restore_path);
+   if (dir == NULL)
+   {
+      return 1;
+   }
+
+   // the newest restore of the primary is the target of the delta restore
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (strncmp(entry->d_name, DELTA_PREFIX, strlen(DELTA_PREFIX)))
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s%s", restore_path, entry->d_name);
+
+      if (!stat(path, &st) && S_ISDIR(st.st_mode) && st.st_mtime >= newest)
+      {
+         newest = st.st_mtime;
+         snprintf(target, size, "%s", path);
+      }
+   }
+
+   closedir(dir);
+
+   return strlen(target) == 0;
+}
+
 Suite*
 pgmoneta_test2_suite(char* dir)
 {
    Suite* s;
    TCase* tc_core;
+   TCase* tc_consolidate;
 
    memset(project_directory, 0, sizeof(project_directory));
    memcpy(project_directory, dir, strlen(dir));
@@ -157,7 +417,18 @@ pgmoneta_test2_suite(char* dir)
    tcase_add_test(tc_core, test_pgmoneta_backup);
    tcase_add_test(tc_core, test_pgmoneta_delete);
    tcase_add_test(tc_core, test_pgmoneta_restore);
+   tcase_add_test(tc_core, test_pgmoneta_restore_delta);
    suite_add_tcase(s, tc_core);
 
+   tc_consolidate = tcase_create("Consolidate");
+
+   tcase_set_timeout(tc_consolidate, 180);
+   tcase_add_test(tc_consolidate, test_pgmoneta_backup);
+   tcase_add_test(tc_consolidate, test_pgmoneta_backup_incremental);
+   tcase_add_test(tc_consolidate, test_pgmoneta_backup_incremental);
+   tcase_add_test(tc_consolidate, test_pgmoneta_consolidate);
+   tcase_add_test(tc_consolidate, test_pgmoneta_restore_delta);
+   suite_add_tcase(s, tc_consolidate);
+
    return s;
 }
\ No newline at end of file
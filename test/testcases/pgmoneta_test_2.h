@@ -31,9 +31,13 @@
 #define PGMONETA_TEST2_H
 
 #include <check.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 /**
  * Set up a suite of test cases for pgmoneta
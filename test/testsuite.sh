@@ -404,6 +404,12 @@ EOF
     echo ""
 }
 
+pgmoneta_consolidate_configuration() {
+    echo -e "\e[34mConsolidate pgmoneta configuration \e[0m"
+    sed -i "s/^retention = 7$/retention = 7\nretention_interval = 10\nconsolidate = 2/" $CONFIGURATION_DIRECTORY/pgmoneta.conf
+    echo "add consolidation to pgmoneta.conf ... ok"
+}
+
 execute_testcases() {
     echo -e "\e[34mExecute Testcases \e[0m"
     set +e
@@ -434,7 +440,31 @@ execute_testcases() {
     fi
 
     ### RUN TESTCASES ###
-    $TEST_DIRECTORY/pgmoneta_test $PROJECT_DIRECTORY
+    CK_EXCLUDE_CASE=Consolidate $TEST_DIRECTORY/pgmoneta_test $PROJECT_DIRECTORY
+
+    echo "running shutdown cli command"
+    $EXECUTABLE_DIRECTORY/pgmoneta-cli -c $CONFIGURATION_DIRECTORY/pgmoneta.conf shutdown
+    echo "shutdown pgmoneta server ... ok"
+
+    ### RUN CONSOLIDATE TESTCASES ###
+    # the retention check rewrites backups, so it only runs for its own testcases
+    pgmoneta_consolidate_configuration
+
+    echo "starting pgmoneta server in daemon mode (wait time = 5 seconds)"
+    $EXECUTABLE_DIRECTORY/pgmoneta -c $CONFIGURATION_DIRECTORY/pgmoneta.conf -u $CONFIGURATION_DIRECTORY/pgmoneta_users.conf -d
+    sleep 5
+
+    $EXECUTABLE_DIRECTORY/pgmoneta-cli -c $CONFIGURATION_DIRECTORY/pgmoneta.conf ping
+    if [ $? -eq 0 ]; then
+        echo "pgmoneta server started ... ok"
+    else
+        echo "pgmoneta server not started ... not ok"
+        pg_ctl -D $DATA_DIRECTORY -l $PGCTL_LOG_FILE stop
+        clean
+        exit 1
+    fi
+
+    CK_RUN_CASE=Consolidate $TEST_DIRECTORY/pgmoneta_test $PROJECT_DIRECTORY
 
     echo "running shutdown cli command"
     $EXECUTABLE_DIRECTORY/pgmoneta-cli -c $CONFIGURATION_DIRECTORY/pgmoneta.conf shutdown